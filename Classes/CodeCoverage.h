@@ -17,12 +17,26 @@
 //  the License.
 //
 
+#if COVERSTORY_HEADLESS
+#import <Foundation/Foundation.h>
+#else
 #import <Cocoa/Cocoa.h>
+#endif
 #import "CoverStoryProtocols.h"
 #import "CoverStoryCoverageFileData.h"
 
 @class CoverStoryDocument;
 extern float codeCoverage(NSInteger codeLines, NSInteger hitCodeLines, NSString * *outCoverageString);
+// Turns the raw bytes of a line of source (as copied through by gcov) into a
+// string.
+extern NSString *coverageLineString(const char *bytes, NSUInteger length);
+// "Executed 50.0% of 10 lines (...)" for one file (or anything else w/ line
+// coverage).
+extern NSString *coverageSummaryString(id<CoverStoryLineCoverageProtocol> data);
+// "50.0% of 10 lines" for a collection of file datas.
+extern NSString *coverageShortSummaryString(id<NSFastEnumeration> fileDatas);
+// Same, for counts that were already added up.
+extern NSString *coverageShortSummaryStringForLineCounts(CoverStoryLineCounts counts);
 
 enum {
     // Value for hitCount for lines that aren't executed
@@ -31,7 +45,22 @@ enum {
     kCoverStoryNonFeasibleMarker = -2
 };
 
-#pragma mark -
+// Combines the hit count for a line from two runs.  We could be processing big
+// and little endian runs, and w/ ifdefs one set of lines would be ignored in
+// one run, but not in the other. so...  if it was a not hit line, we just take
+// the new hits, otherwise we add any real hits to the count.
+static inline int64_t coverageMergeHitCounts(int64_t hitCount, int64_t newHits)
+{
+    if (hitCount == kCoverStoryNotExecutedMarker)
+    {
+        return newHits;
+    }
+    if (newHits > 0)
+    {
+        return hitCount + newHits;
+    }
+    return hitCount;
+}
 
 #pragma mark -
 
@@ -19,6 +19,10 @@
 
 #import "CoverStoryProtocols.h"
 
+NSString *const kCoverStoryErrorDomain      = @"CoverStoryErrorDomain";
+const NSInteger kCoverStoryExportError      = 1;
+const NSInteger kCoverStoryShardError       = 2;
+const NSInteger kCoverStoryQueryServerError = 3;
 
 // helper for building the string to make sure rounding doesn't get us
 float codeCoverage (NSInteger codeLines, NSInteger hitCodeLines, NSString * *outCoverageString)
@@ -47,6 +51,87 @@ float codeCoverage (NSInteger codeLines, NSInteger hitCodeLines, NSString * *out
     return coverage;
 }
 
+NSString *coverageLineString(const char *bytes, NSUInteger length)
+{
+    if (length == 0)
+    {
+        return @"";
+    }
+    NSString *line = [[NSString alloc] initWithBytes:bytes
+                                              length:length
+                                            encoding:NSUTF8StringEncoding];
+    if (!line)
+    {
+        // Sadly, not everything is UTF-8.  math.h in the system headers is in
+        // MacRoman, and since every byte is valid MacRoman this can't fail.
+        line = [[NSString alloc] initWithBytes:bytes
+                                        length:length
+                                      encoding:NSMacOSRomanStringEncoding];
+    }
+    return line;
+}
+
+NSString *coverageSummaryString(id<CoverStoryLineCoverageProtocol> data)
+{
+    NSInteger totalLines  = 0;
+    NSInteger codeLines   = 0;
+    NSInteger hitLines    = 0;
+    NSInteger nonfeasible = 0;
+    NSString *coverage    = nil;
+    [data coverageTotalLines:&totalLines
+                   codeLines:&codeLines
+                hitCodeLines:&hitLines
+            nonFeasibleLines:&nonfeasible
+              coverageString:&coverage
+                    coverage:NULL];
+    
+    NSString *statString = nil;
+    if (nonfeasible)
+    {
+        statString = [NSString stringWithFormat:
+                      @"Executed %@%% of %ld lines (%ld executed, %ld executable, "
+                      "%ld non-feasible, %ld total lines)", coverage,
+                      (long)codeLines, (long)hitLines, (long)codeLines,
+                      (long)nonfeasible, (long)totalLines];
+    }
+    else
+    {
+        statString = [NSString stringWithFormat:
+                      @"Executed %@%% of %ld lines (%ld executed, %ld executable, "
+                      "%ld total lines)", coverage, (long)codeLines, (long)hitLines,
+                      (long)codeLines, (long)totalLines];
+    }
+    return statString;
+}
+
+NSString *coverageShortSummaryString(id<NSFastEnumeration> fileDatas)
+{
+    NSInteger codeLines    = 0;
+    NSInteger hitCodeLines = 0;
+    for (id<CoverStoryLineCoverageProtocol> data in fileDatas)
+    {
+        NSInteger localCode    = 0;
+        NSInteger localHitCode = 0;
+        [data coverageTotalLines:NULL
+                       codeLines:&localCode
+                    hitCodeLines:&localHitCode
+                nonFeasibleLines:NULL
+                  coverageString:NULL
+                        coverage:NULL];
+        codeLines    += localCode;
+        hitCodeLines += localHitCode;
+    }
+    CoverStoryLineCounts counts = { 0, codeLines, hitCodeLines, 0 };
+    return coverageShortSummaryStringForLineCounts(counts);
+}
+
+NSString *coverageShortSummaryStringForLineCounts(CoverStoryLineCounts counts)
+{
+    NSString *coverage = nil;
+    codeCoverage(counts.codeLines, counts.hitCodeLines, &coverage);
+    return [NSString stringWithFormat:@"%@%% of %ld lines", coverage, (long)counts.codeLines];
+}
+
 @implementation NSEnumerator (CodeCoverage)
 
 - (void)coverageTotalLines:(NSInteger *)outTotal
@@ -23,6 +23,7 @@
 #import "CoverStoryDocument.h"
 #import "CoverStoryPreferenceKeys.h"
 #import "CoverStoryValueTransformers.h"
+#import "GCovVersionManager.h"
 
 @implementation CoverStoryApplicationDelegate
 - (void)applicationWillFinishLaunching:(NSNotification *)notification
@@ -33,6 +34,16 @@
     [CoverStoryDocument registerDefaults];
     [CoverageLineDataToSourceLineTransformer registerDefaults];
 
+    // Get the looking for gcovs out of the way of the first load.
+    GCovVersionManager *gcovVerMgr = [GCovVersionManager defaultManager];
+    NSArray *gcovSearchPaths       = [[NSUserDefaults standardUserDefaults]
+                                      arrayForKey:kCoverStoryGCovSearchPathsKey];
+    if ([gcovSearchPaths count])
+    {
+        [gcovVerMgr setAdditionalSearchPaths:gcovSearchPaths];
+    }
+    [gcovVerMgr discoverInBackground];
+
     // Set our document controller up as the shared document controller
     // so we don't get NSDocumentController instead.
     __unused id docController = [[CoverStoryDocumentController alloc] init];
@@ -17,13 +17,25 @@
 //
 
 #import <Cocoa/Cocoa.h>
+#import "CoverStoryProtocols.h"
 
 
 @class CoverStoryDocument;
+@class CoverStoryCoverageFileData;
+@class CoverStoryCoverageTotals;
 
 @interface CoverStoryArrayController : NSArrayController
 
 @property (nonatomic, weak) IBOutlet CoverStoryDocument *owningDocument;
+// The counts for what's arranged (for the summary above the file list), made
+// as the objects are filtered and kept up as they're merged into.
+@property (readonly, nonatomic, strong) CoverStoryCoverageTotals *arrangedTotals;
+// When set, only the sources w/ these paths are arranged (on top of the
+// filter), nil for all of them.
+@property (nonatomic, copy) NSSet *onlySourcePaths;
+
+// |fileData| (in the content) was merged into, it had |before| until then.
+- (void)fileData:(CoverStoryCoverageFileData *)fileData changedFromLineCounts:(CoverStoryLineCounts)before;
 
 @end
 
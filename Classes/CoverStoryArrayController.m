@@ -19,6 +19,10 @@
 
 #import "CoverStoryArrayController.h"
 #import "CoverStoryDocument.h"
+#import "CoverStoryFilePredicate.h"
+#import "CoverStoryCoverageFileData.h"
+#import "CoverStoryCoverageSet.h"
+#import "CoverStoryCoverageTotals.h"
 #import "CoverStoryPreferenceKeys.h"
 #import "NSUserDefaultsController+KeyValues.h"
 
@@ -30,8 +34,62 @@
 @interface CoverStoryArrayController ()
 @property (nonatomic, retain) NSArray *prefsToWatch;
 @property (nonatomic, retain) NSArray *docKeyPathsToWatch;
+// The common prefix is kept as a running count of the leading bytes every
+// arranged path shares w/ |prefixPath|, so adding a file costs its length.
+@property (nonatomic, strong) NSData *prefixPath;
+@property (nonatomic, assign) NSUInteger prefixLength;
+// the content (and how much of it) that's been folded in
+@property (nonatomic, strong) NSArray *foldedContent;
+@property (nonatomic, assign) NSUInteger foldedCount;
+@property (readwrite, nonatomic, strong) CoverStoryCoverageTotals *arrangedTotals;
 @end
 
+// Sorts |fileDatas| w/ |sortDescriptors|, but by coverage it compares the keys
+// the file datas keep instead of boxing a number for every comparison.
+static NSArray *CSSortedFileDatas(NSArray *fileDatas, NSArray *sortDescriptors)
+{
+    if ([sortDescriptors count] == 0)
+    {
+        return fileDatas;
+    }
+    NSMutableArray *comparators = [NSMutableArray arrayWithCapacity:[sortDescriptors count]];
+    for (NSSortDescriptor *descriptor in sortDescriptors)
+    {
+        NSComparator comparator = nil;
+        if ([[descriptor key] isEqualToString:@"coverage"])
+        {
+            BOOL ascending = [descriptor ascending];
+            comparator = ^NSComparisonResult(CoverStoryCoverageFileData *a, CoverStoryCoverageFileData *b) {
+                float keyA = [a coverageSortKey];
+                float keyB = [b coverageSortKey];
+                if (keyA == keyB)
+                {
+                    return NSOrderedSame;
+                }
+                return ((keyA < keyB) == ascending) ? NSOrderedAscending : NSOrderedDescending;
+            };
+        }
+        else
+        {
+            comparator = ^NSComparisonResult(id a, id b) {
+                return [descriptor compareObject:a toObject:b];
+            };
+        }
+        [comparators addObject:[comparator copy]];
+    }
+    return [fileDatas sortedArrayWithOptions:NSSortStable usingComparator:^NSComparisonResult(id a, id b) {
+        for (NSComparator comparator in comparators)
+        {
+            NSComparisonResult result = comparator(a, b);
+            if (result != NSOrderedSame)
+            {
+                return result;
+            }
+        }
+        return NSOrderedSame;
+    }];
+}
+
 @implementation CoverStoryArrayController
 
 - (void)dealloc
@@ -108,59 +166,187 @@
     }
 }
 
+// The path bytes |object| shares w/ everything folded in so far.
+- (void)foldPathOfObject:(id)object
+{
+    const char *path = NULL;
+    NSString *sourcePath = nil;
+    if ([object respondsToSelector:@selector(sourcePathUTF8String)])
+    {
+        path = [object sourcePathUTF8String];
+    }
+    else
+    {
+        sourcePath = [object valueForKey:@"sourcePath"];
+        path       = [sourcePath UTF8String];
+    }
+    if (!path)
+    {
+        return;
+    }
+    if (!self.prefixPath)
+    {
+        self.prefixPath   = [NSData dataWithBytes:path length:strlen(path)];
+        self.prefixLength = [self.prefixPath length];
+        return;
+    }
+    const char *prefix = [self.prefixPath bytes];
+    NSUInteger length  = 0;
+    while ((length < self.prefixLength) && (prefix[length] == path[length]))
+    {
+        ++length;
+    }
+    self.prefixLength = length;
+}
+
+- (void)resetCommonPathPrefix
+{
+    self.prefixPath    = nil;
+    self.prefixLength  = 0;
+    self.foldedContent = nil;
+    self.foldedCount   = 0;
+}
+
+- (void)publishCommonPathPrefix
+{
+    // if you have two files of:
+    //   /Foo/bar/spam.m
+    //   /Foo/baz/wee.m
+    // the common bytes are "/Foo/ba", but we don't want to do that, so we cut
+    // back to (and include) the last slash.  the slash is ASCII, so that's
+    // always a character boundary.
+    NSString *newPrefix = @"";
+    const char *prefix  = [self.prefixPath bytes];
+    NSUInteger length   = self.prefixLength;
+    while ((length > 0) && (prefix[length - 1] != '/'))
+    {
+        --length;
+    }
+    // if we just have the leading "/", use no prefix
+    if (length > 1)
+    {
+        newPrefix = [[NSString alloc] initWithBytes:prefix length:length encoding:NSUTF8StringEncoding] ?: @"";
+    }
+    // send it back to the document
+    [_owningDocument setCommonPathPrefix:newPrefix];
+}
+
 - (void)updateCommonPathPrefix
 {
     if (!_owningDocument)
         return;
-    
-    NSString *newPrefix = nil;
-    
-    // now figure out a new prefix
-    NSArray *arranged = [self arrangedObjects];
-    if ([arranged count] == 0)
+
+    // fold in all of the arranged paths, giving up the moment the only common
+    // prefix is "/"
+    [self resetCommonPathPrefix];
+    for (id object in [self arrangedObjects])
+    {
+        [self foldPathOfObject:object];
+        if (self.prefixLength <= 1)
+        {
+            break;
+        }
+    }
+    id content = [self content];
+    if ([content isKindOfClass:[NSArray class]])
     {
-        // empty string
-        newPrefix = @"";
+        self.foldedContent = content;
+        self.foldedCount   = [content count];
     }
-    else
+    [self publishCommonPathPrefix];
+}
+
+// Called as results arrive during a load.  The data set only appends (or, when
+// a watched folder reloads, swaps a file for one w/ the same path), so as long
+// as the content we saw last time is still at the front, just the new files
+// that pass the filter get folded in.
+- (void)updateCommonPathPrefixForContent:(id)content
+{
+    if (!_owningDocument)
+        return;
+
+    NSArray *folded     = self.foldedContent;
+    NSUInteger oldCount = self.foldedCount;
+    if (![content isKindOfClass:[NSArray class]] || !folded ||
+        ([content count] < oldCount) ||
+        ((oldCount > 0) && ((content[0] != folded[0]) || (content[oldCount - 1] != folded[oldCount - 1]))))
+    {
+        [self updateCommonPathPrefix];
+        return;
+    }
+    NSPredicate *predicate = [self filterPredicate];
+    NSUInteger count       = [content count];
+    for (NSUInteger x = oldCount; x < count; ++x)
     {
-        // process the list to find the common prefix
-        
-        // start w/ the first path, and now loop throught them all, but give up
-        // the moment he only common prefix is "/"
-        NSArray *sourcePaths     = [arranged valueForKey:@"sourcePath"];
-        NSEnumerator *enumerator = [sourcePaths objectEnumerator];
-        newPrefix = [enumerator nextObject];
-        NSString *basePath;
-        while (([newPrefix length] > 1) && (basePath = [enumerator nextObject]))
+        id object = content[x];
+        if ((!predicate || [predicate evaluateWithObject:object]) &&
+            (!_onlySourcePaths || [_onlySourcePaths containsObject:[object valueForKey:@"sourcePath"]]))
         {
-            newPrefix = [newPrefix commonPrefixWithString:basePath options:NSLiteralSearch];
+            [self foldPathOfObject:object];
         }
-        // if you have two files of:
-        //   /Foo/bar/spam.m
-        //   /Foo/baz/wee.m
-        // we end up here w/ "/Foo/ba" as the common prefix, but we don't want
-        // to do that, so we make sure we end in a slash
-        if (![newPrefix hasSuffix:@"/"])
+    }
+    self.foldedContent = content;
+    self.foldedCount   = count;
+    [self publishCommonPathPrefix];
+}
+
+- (NSArray *)arrangeObjects:(NSArray *)objects
+{
+    // our predicate can reuse its last pass and split big lists up, which
+    // filteredArrayUsingPredicate: can't
+    NSPredicate *predicate = [self filterPredicate];
+    NSArray *filtered      = objects;
+    if ([predicate isKindOfClass:[CoverStoryFilePredicate class]])
+    {
+        // the content is the data set's, its generation says when it changed
+        CoverStoryFilePredicate *filePredicate = (CoverStoryFilePredicate *)predicate;
+        CoverStoryCoverageSet *dataSet         = [_owningDocument dataSet];
+        if (dataSet)
         {
-            NSRange lastSlash = [newPrefix rangeOfString:@"/" options:NSBackwardsSearch];
-            if (lastSlash.location == NSNotFound)
-            {
-                newPrefix = @"";
-            }
-            else
-            {
-                newPrefix = [newPrefix substringToIndex:NSMaxRange(lastSlash)];
-            }
+            filtered = [filePredicate filteredArrayFromArray:objects contentGeneration:[dataSet contentGeneration]];
         }
-        // if we just have the leading "/", use no prefix
-        if ([newPrefix length] <= 1)
+        else
         {
-            newPrefix = @"";
+            filtered = [filePredicate filteredArrayFromArray:objects];
         }
     }
-    // send it back to the document
-    [_owningDocument setCommonPathPrefix:newPrefix];
+    else if (predicate)
+    {
+        filtered = [objects filteredArrayUsingPredicate:predicate];
+    }
+    if (_onlySourcePaths)
+    {
+        NSMutableArray *only = [NSMutableArray arrayWithCapacity:[_onlySourcePaths count]];
+        for (CoverStoryCoverageFileData *fileData in filtered)
+        {
+            if ([_onlySourcePaths containsObject:[fileData sourcePath]])
+            {
+                [only addObject:fileData];
+            }
+        }
+        filtered = only;
+    }
+    // what passed gets counted once here, the summary just reads the totals
+    CoverStoryCoverageTotals *totals = [[CoverStoryCoverageTotals alloc] init];
+    for (CoverStoryCoverageFileData *fileData in filtered)
+    {
+        [totals addFileData:fileData];
+    }
+    self.arrangedTotals = totals;
+    return CSSortedFileDatas(filtered, [self sortDescriptors]);
+}
+
+- (void)fileData:(CoverStoryCoverageFileData *)fileData changedFromLineCounts:(CoverStoryLineCounts)before
+{
+    NSPredicate *predicate = [self filterPredicate];
+    if (!_arrangedTotals || (predicate && ![predicate evaluateWithObject:fileData]) ||
+        (_onlySourcePaths && ![_onlySourcePaths containsObject:[fileData sourcePath]]))
+    {
+        return;
+    }
+    [self willChangeValueForKey:@"arrangedTotals"];
+    [_arrangedTotals fileData:fileData changedFromLineCounts:before];
+    [self didChangeValueForKey:@"arrangedTotals"];
 }
 
 - (void)rearrangeObjects
@@ -174,6 +360,21 @@
 {
     // this fires as results are added during a load
     [super setContent:content];
+    [self updateCommonPathPrefixForContent:content];
+}
+
+- (void)setOnlySourcePaths:(NSSet *)onlySourcePaths
+{
+    if ((_onlySourcePaths != onlySourcePaths) && ![_onlySourcePaths isEqualToSet:onlySourcePaths])
+    {
+        _onlySourcePaths = [onlySourcePaths copy];
+        [self rearrangeObjects];
+    }
+}
+
+- (void)setFilterPredicate:(NSPredicate *)filterPredicate
+{
+    [super setFilterPredicate:filterPredicate];
     [self updateCommonPathPrefix];
 }
 
@@ -0,0 +1,40 @@
+//
+//  CoverStoryCodeRenderingCache.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// What the code table draws, kept between cell requests.  The attributes (and
+// the line colors they come from) are made once per preference change, the
+// hit count strings are interned, and the source lines of the few most
+// recently shown files are kept up to a limit, dropping the least recently
+// drawn first.  CoverStoryCodeViewTableView calls -invalidate when the colors
+// change and prefetches the rows around what's visible.  Main thread only.
+
+#import <Cocoa/Cocoa.h>
+
+@class CoverStoryCoverageFileData;
+@class CoverStoryCoverageLineData;
+
+@interface CoverStoryCodeRenderingCache : NSObject {
+@private
+    NSDictionary *_hitCountAttributes;
+    NSDictionary *_missedHitCountAttributes;
+    NSArray *_lineAttributes;          // by CSLineKind
+    NSMutableArray *_hitCountStrings;  // of NSAttributedString or NSNull
+    NSMutableArray *_fileCaches;       // most recently used first
+}
+
++ (CoverStoryCodeRenderingCache *)sharedCache;
+
+- (NSAttributedString *)hitCountStringForHitCount:(NSInteger)hitCount;
+- (NSAttributedString *)sourceLineStringForLineData:(CoverStoryCoverageLineData *)lineData;
+
+// Builds any of |rows| of |fileData| that aren't already cached, and keeps
+// at least that many rows for it.
+- (void)prefetchRows:(NSRange)rows ofFileData:(CoverStoryCoverageFileData *)fileData;
+
+// Drops everything, the colors are read again the next time they're needed.
+- (void)invalidate;
+
+@end
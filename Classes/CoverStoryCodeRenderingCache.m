@@ -0,0 +1,297 @@
+//
+//  CoverStoryCodeRenderingCache.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "CoverStoryCodeRenderingCache.h"
+#import "CoverStoryCoverageFileData.h"
+#import "CoverStoryCoverageLineData.h"
+#import "CoverStoryPreferenceKeys.h"
+
+typedef NS_ENUM(NSUInteger, CSLineKind)
+{
+    kCSLineKindMissed = 0,
+    kCSLineKindUnexecutable,
+    kCSLineKindNonFeasible,
+    kCSLineKindExecuted,
+};
+
+// Counts below this get an interned string ("99+" above it).
+static const NSInteger kCSMaxShownHitCount = 999;
+// How many rows a file keeps at least, and how many files keep rows.
+static const NSUInteger kCSMinimumCachedRows = 512;
+static const NSUInteger kCSCachedFiles       = 4;
+
+static CSLineKind CSLineKindForHitCount(NSInteger hitCount)
+{
+    switch (hitCount) {
+        case 0:
+            return kCSLineKindMissed;
+        case kCoverStoryNotExecutedMarker:
+            return kCSLineKindUnexecutable;
+        case kCoverStoryNonFeasibleMarker:
+            return kCSLineKindNonFeasible;
+        default:
+            return kCSLineKindExecuted;
+    }
+}
+
+@interface CSCachedRow : NSObject {
+@public
+    NSAttributedString *_string;
+    NSInteger _hitCount;  // what |_string| was colored for
+    NSUInteger _lastUse;
+}
+@end
+
+@implementation CSCachedRow
+@end
+
+// The rows of one file, evicted least recently used first.
+@interface CSFileRowCache : NSObject {
+@public
+    __weak CoverStoryCoverageFileData *_fileData;
+    NSMutableDictionary *_rows;  // NSNumber row -> CSCachedRow
+    NSUInteger _capacity;
+    NSUInteger _clock;
+}
+- (void)evictIfNeeded;
+@end
+
+@implementation CSFileRowCache
+
+- (void)evictIfNeeded
+{
+    if ([_rows count] <= _capacity)
+    {
+        return;
+    }
+    // Drop down to 3/4 full at once so the sort is paid for every few hundred
+    // rows rather than every row.
+    NSArray *byAge = [[_rows allKeys] sortedArrayUsingComparator:^NSComparisonResult(id a, id b) {
+        NSUInteger aUse = ((CSCachedRow *)_rows[a])->_lastUse;
+        NSUInteger bUse = ((CSCachedRow *)_rows[b])->_lastUse;
+        return (aUse < bUse) ? NSOrderedAscending : ((aUse > bUse) ? NSOrderedDescending : NSOrderedSame);
+    }];
+    NSUInteger dropCount = [_rows count] - (_capacity * 3 / 4);
+    [_rows removeObjectsForKeys:[byAge subarrayWithRange:NSMakeRange(0, dropCount)]];
+}
+
+@end
+
+@interface CoverStoryCodeRenderingCache ()
+- (void)loadAttributes;
+- (CSFileRowCache *)rowCacheForFileData:(CoverStoryCoverageFileData *)fileData;
+- (NSAttributedString *)rowInCache:(CSFileRowCache *)cache atIndex:(NSUInteger)index;
+@end
+
+@implementation CoverStoryCodeRenderingCache
+
++ (CoverStoryCodeRenderingCache *)sharedCache
+{
+    static CoverStoryCodeRenderingCache *sharedCache = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedCache = [[self alloc] init];
+    });
+    return sharedCache;
+}
+
+- (id)init
+{
+    if ((self = [super init]))
+    {
+        _fileCaches = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (void)invalidate
+{
+    _hitCountAttributes       = nil;
+    _missedHitCountAttributes = nil;
+    _lineAttributes           = nil;
+    _hitCountStrings          = nil;
+    [_fileCaches removeAllObjects];
+}
+
+- (NSColor *)defaultColorNamed:(NSString *)name
+{
+    NSColor *color = nil;
+    NSUserDefaultsController *defaults = [NSUserDefaultsController sharedUserDefaultsController];
+    NSData *colorData = [[defaults values] valueForKey:name];
+    if (colorData)
+    {
+        color = (NSColor *)[NSUnarchiver unarchiveObjectWithData:colorData];
+    }
+    return color;
+}
+
+- (void)loadAttributes
+{
+    NSMutableParagraphStyle *pStyle = [[NSParagraphStyle defaultParagraphStyle] mutableCopy];
+    [pStyle setAlignment:NSRightTextAlignment];
+    [pStyle setMinimumLineHeight:13];
+    _hitCountAttributes       = @{NSParagraphStyleAttributeName : pStyle,
+                                  NSForegroundColorAttributeName : [NSColor colorWithDeviceWhite:0.4 alpha:1.0]};
+    _missedHitCountAttributes = @{NSParagraphStyleAttributeName : pStyle,
+                                  NSForegroundColorAttributeName : [NSColor redColor]};
+
+    NSArray *colorNames = @[kCoverStoryMissedLineColorKey, kCoverStoryUnexecutableLineColorKey,
+                            kCoverStoryNonFeasibleLineColorKey, kCoverStoryExecutedLineColorKey];
+    NSMutableArray *lineAttributes = [NSMutableArray arrayWithCapacity:[colorNames count]];
+    for (NSString *colorName in colorNames)
+    {
+        NSColor *color = [self defaultColorNamed:colorName];
+        [lineAttributes addObject:color ? @{NSForegroundColorAttributeName : color} : @{}];
+    }
+    _lineAttributes  = lineAttributes;
+    _hitCountStrings = [NSMutableArray arrayWithCapacity:kCSMaxShownHitCount + 3];
+    for (NSInteger x = 0; x < kCSMaxShownHitCount + 3; ++x)
+    {
+        [_hitCountStrings addObject:[NSNull null]];
+    }
+}
+
+- (NSAttributedString *)hitCountStringForHitCount:(NSInteger)hitCount
+{
+    if (!_hitCountStrings)
+    {
+        [self loadAttributes];
+    }
+    // after the counts, the table has "--", "99+" and "" for not executed
+    NSUInteger slot;
+    NSString *displayString  = nil;
+    NSDictionary *attributes = _hitCountAttributes;
+    if (hitCount == kCoverStoryNotExecutedMarker)
+    {
+        slot          = kCSMaxShownHitCount + 2;
+        displayString = @"";
+        attributes    = nil;
+    }
+    else if (hitCount == kCoverStoryNonFeasibleMarker)
+    {
+        slot          = kCSMaxShownHitCount;
+        displayString = @"--"; // for non-feasible lines
+    }
+    else if (hitCount >= kCSMaxShownHitCount)
+    {
+        slot          = kCSMaxShownHitCount + 1;
+        displayString = @"99+";
+    }
+    else if (hitCount >= 0)
+    {
+        slot       = (NSUInteger)hitCount;
+        attributes = (hitCount == 0) ? _missedHitCountAttributes : _hitCountAttributes;
+    }
+    else
+    {
+        // shouldn't happen, but don't intern it
+        return [[NSAttributedString alloc] initWithString:[NSString stringWithFormat:@"%ld", (long)hitCount]
+                                               attributes:_hitCountAttributes];
+    }
+    id string = _hitCountStrings[slot];
+    if (string == [NSNull null])
+    {
+        if (!displayString)
+        {
+            displayString = [NSString stringWithFormat:@"%ld", (long)hitCount];
+        }
+        string = [[NSAttributedString alloc] initWithString:displayString attributes:attributes];
+        _hitCountStrings[slot] = string;
+    }
+    return string;
+}
+
+- (CSFileRowCache *)rowCacheForFileData:(CoverStoryCoverageFileData *)fileData
+{
+    NSUInteger count = [_fileCaches count];
+    for (NSUInteger x = 0; x < count; ++x)
+    {
+        CSFileRowCache *cache = _fileCaches[x];
+        if (cache->_fileData == fileData)
+        {
+            if (x > 0)
+            {
+                [_fileCaches removeObjectAtIndex:x];
+                [_fileCaches insertObject:cache atIndex:0];
+            }
+            return cache;
+        }
+    }
+    CSFileRowCache *cache = [[CSFileRowCache alloc] init];
+    cache->_fileData      = fileData;
+    cache->_rows          = [[NSMutableDictionary alloc] init];
+    cache->_capacity      = kCSMinimumCachedRows;
+    [_fileCaches insertObject:cache atIndex:0];
+    if ([_fileCaches count] > kCSCachedFiles)
+    {
+        [_fileCaches removeLastObject];
+    }
+    return cache;
+}
+
+- (NSAttributedString *)rowInCache:(CSFileRowCache *)cache atIndex:(NSUInteger)index
+{
+    CoverStoryCoverageFileData *fileData = cache->_fileData;
+    NSInteger hitCount                   = [fileData hitCountForLineAtIndex:index];
+    NSNumber *key                        = @(index);
+    CSCachedRow *row                     = cache->_rows[key];
+    if (!row || (row->_hitCount != hitCount))
+    {
+        if (!_lineAttributes)
+        {
+            [self loadAttributes];
+        }
+        row            = [[CSCachedRow alloc] init];
+        row->_hitCount = hitCount;
+        row->_string   = [[NSAttributedString alloc] initWithString:[fileData lineAtIndex:index]
+                                                        attributes:_lineAttributes[CSLineKindForHitCount(hitCount)]];
+        cache->_rows[key] = row;
+    }
+    row->_lastUse = ++cache->_clock;
+    [cache evictIfNeeded];
+    return row->_string;
+}
+
+- (NSAttributedString *)sourceLineStringForLineData:(CoverStoryCoverageLineData *)lineData
+{
+    CoverStoryCoverageFileData *fileData = [lineData coverageFile];
+    NSUInteger index                     = [lineData lineIndex];
+    if (!fileData || (index == NSNotFound))
+    {
+        // a line on its own, nothing to cache it by
+        if (!_lineAttributes)
+        {
+            [self loadAttributes];
+        }
+        NSDictionary *attributes = _lineAttributes[CSLineKindForHitCount([lineData hitCount])];
+        return [[NSAttributedString alloc] initWithString:[lineData line] attributes:attributes];
+    }
+    return [self rowInCache:[self rowCacheForFileData:fileData] atIndex:index];
+}
+
+- (void)prefetchRows:(NSRange)rows ofFileData:(CoverStoryCoverageFileData *)fileData
+{
+    if (!fileData)
+    {
+        return;
+    }
+    NSUInteger lineCount = [fileData lineCount];
+    if (rows.location >= lineCount)
+    {
+        return;
+    }
+    rows.length           = MIN(rows.length, lineCount - rows.location);
+    CSFileRowCache *cache = [self rowCacheForFileData:fileData];
+    // keep room for what's asked for, w/ some left for scrolling back
+    cache->_capacity = MAX(kCSMinimumCachedRows, rows.length * 2);
+    for (NSUInteger x = rows.location; x < NSMaxRange(rows); ++x)
+    {
+        [self rowInCache:cache atIndex:x];
+    }
+}
+
+@end
@@ -19,8 +19,10 @@
 
 #import <Cocoa/Cocoa.h>
 
+@class CoverStoryCoverageFileData;
+
 @interface CoverStoryCodeViewTableView : NSTableView
 
-- (void)setCoverageData:(NSArray*)coverageData;
+- (void)setCoverageData:(CoverStoryCoverageFileData*)coverageData;
 
 @end
@@ -17,6 +17,7 @@
 //
 
 #import "CoverStoryCodeViewTableView.h"
+#import "CoverStoryCodeRenderingCache.h"
 #import "CoverStoryScroller.h"
 #import "CoverStoryPreferenceKeys.h"
 #import "GTMDefines.h"
@@ -26,6 +27,7 @@
 
 @interface CoverStoryCodeViewTableView ()
 @property (strong) NSArray *prefsToWatch;
+@property (weak) CoverStoryCoverageFileData *coverageData;
 @end
 
 
@@ -68,6 +70,7 @@
     [self.prefsToWatch enumerateObjectsUsingBlock:^(id obj, NSUInteger idx, BOOL *stop) {
         if ([keyPath isEqualToString:[NSUserDefaultsController cs_valuesKey:obj]])
         {
+            [[CoverStoryCodeRenderingCache sharedCache] invalidate];
             [self reloadData];
             handled = YES;
             *stop = YES;
@@ -80,12 +83,28 @@
     }
 }
 
-- (void)setCoverageData:(NSArray *)coverageData
+- (void)setCoverageData:(CoverStoryCoverageFileData *)coverageData
 {
     NSScrollView *scrollView     = [self enclosingScrollView];
     CoverStoryScroller *scroller = (CoverStoryScroller *)[scrollView verticalScroller];
     [scroller setEnabled:coverageData ? YES: NO];
     [scroller setCoverageData:coverageData];
+    self.coverageData = coverageData;
+}
+
+- (void)drawRect:(NSRect)dirtyRect
+{
+    // Build the rows a page either side of what's showing before the cells
+    // ask for them, so a scroll doesn't have to.
+    NSRange visible = [self rowsInRect:[self visibleRect]];
+    if (self.coverageData && visible.length)
+    {
+        NSUInteger margin = visible.length;
+        NSUInteger start  = (visible.location > margin) ? visible.location - margin : 0;
+        [[CoverStoryCodeRenderingCache sharedCache] prefetchRows:NSMakeRange(start, NSMaxRange(visible) + margin - start)
+                                                      ofFileData:self.coverageData];
+    }
+    [super drawRect:dirtyRect];
 }
 
 - (void)keyDown:(NSEvent *)event
@@ -0,0 +1,72 @@
+//
+//  CoverStoryCoverageCache.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// On disk cache of the coverage read for each gcda file so reloading (or
+// reopening) a build folder only has to process the units that changed.  Each
+// gcda gets one entry file holding the columns of every source file it
+// produced; entries are mapped back in and the text/line ranges are used right
+// out of the mapping.  An entry is only used if the gcda path, size and mtime,
+// a digest of the .gcno next to it, and the version of the gcov that would be
+// run on it all still match.
+
+#import <Foundation/Foundation.h>
+
+@class CoverStoryDocument;
+@class CoverStoryCoverageFileData;
+
+// Snapshot of everything an entry depends on, taken before the unit is
+// processed (so a gcda that changes while we read it gets redone next time).
+@interface CoverStoryCoverageCacheKey : NSObject {
+@private
+    NSString *_gcdaPath;
+    NSData *_header;
+}
+@property (readonly, nonatomic, copy) NSString *gcdaPath;
+@end
+
+@interface CoverStoryCoverageCache : NSObject {
+@private
+    NSString *_directory;
+    NSUInteger _hitCount;
+    NSUInteger _missCount;
+    NSUInteger _storeCount;
+}
+
+// The directory to use based on the user defaults, nil if the cache is turned
+// off.
++ (NSString *)defaultDirectory;
+
+- (id)initWithDirectory:(NSString *)directory;
+
+@property (readonly, nonatomic, copy) NSString *directory;
+
+// Returns nil if the gcda or gcno can't be read.  |gcovVersion| is what the
+// gcov that would be used for the file says it is (see GCovVersionManager).
+- (CoverStoryCoverageCacheKey *)keyForGCDAPath:(NSString *)gcdaPath gcovVersion:(NSString *)gcovVersion;
+
+// The file datas stored for |key|, nil (and counted as a miss) if there isn't
+// a current entry.  Safe to call from any thread.
+- (NSArray *)fileDatasForKey:(CoverStoryCoverageCacheKey *)key document:(CoverStoryDocument *)document;
+
+// Encodes |fileData| as it is right now, for building up an entry while the
+// file datas are being handed off elsewhere (and possibly merged into).
++ (NSData *)recordForFileData:(CoverStoryCoverageFileData *)fileData;
+
+// Writes the entry for |key|.  Safe to call from any thread.
+- (BOOL)storeRecords:(NSArray *)records forKey:(CoverStoryCoverageCacheKey *)key;
+- (BOOL)storeFileDatas:(NSArray *)fileDatas forKey:(CoverStoryCoverageCacheKey *)key;
+
+- (BOOL)removeAllEntries;
+
+// Instrumentation
+@property (readonly) NSUInteger hitCount;
+@property (readonly) NSUInteger missCount;
+@property (readonly) NSUInteger storeCount;
+@property (readonly) float hitRate;  // 0-1
+- (void)resetStatistics;
+- (NSString *)statisticsDescription;
+
+@end
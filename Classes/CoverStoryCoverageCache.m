@@ -0,0 +1,443 @@
+//
+//  CoverStoryCoverageCache.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "CoverStoryCoverageCache.h"
+#import "CoverStoryCoverageFileData.h"
+#import "CoverStoryPreferenceKeys.h"
+#import "CoverStoryMappedData.h"
+#import <CommonCrypto/CommonDigest.h>
+#include <sys/stat.h>
+
+// Entry layout (native byte order, everything 8 byte aligned):
+//   CSCacheKeyHeader, gcda path, gcov version, padding   <- the key
+//   uint32_t record count, uint32_t unused
+//   records: CSCacheRecordHeader, source path, warnings (each NUL
+//   terminated), padding, text, padding, line ranges, hit counts
+// Bump the format version whenever any of this changes (or whatever goes into
+// the columns changes), old entries then just stop matching.
+static const char kCSCacheMagic[4]         = { 'C', 'S', 'C', 'C' };
+static const uint32_t kCSCacheFormatVersion = 2;
+static NSString *const kCSCacheEntryExtension = @"cscov";
+
+typedef struct {
+    char magic[4];
+    uint32_t formatVersion;
+    uint64_t gcdaSize;
+    int64_t gcdaModSeconds;
+    int64_t gcdaModNanoseconds;
+    uint8_t gcnoDigest[CC_SHA1_DIGEST_LENGTH];
+    uint32_t gcdaPathLength;
+    uint32_t gcovVersionLength;
+} CSCacheKeyHeader;
+
+typedef struct {
+    uint32_t sourcePathLength;
+    uint32_t warningsLength;
+    uint32_t textLength;
+    uint32_t lineCount;
+} CSCacheRecordHeader;
+
+static NSString *CSCacheHexDigest(const void *bytes, NSUInteger length)
+{
+    uint8_t digest[CC_SHA1_DIGEST_LENGTH];
+    CC_SHA1(bytes, (CC_LONG)length, digest);
+    NSMutableString *result = [NSMutableString stringWithCapacity:CC_SHA1_DIGEST_LENGTH * 2];
+    for (size_t x = 0; x < CC_SHA1_DIGEST_LENGTH; ++x)
+    {
+        [result appendFormat:@"%02x", digest[x]];
+    }
+    return result;
+}
+
+@interface CoverStoryCoverageCacheKey ()
+- (id)initWithGCDAPath:(NSString *)gcdaPath header:(NSData *)header;
+- (NSData *)header;
+@end
+
+@implementation CoverStoryCoverageCacheKey
+
+@synthesize gcdaPath = _gcdaPath;
+
+- (id)initWithGCDAPath:(NSString *)gcdaPath header:(NSData *)header
+{
+    if ((self = [super init]))
+    {
+        _gcdaPath = [gcdaPath copy];
+        _header   = header;
+    }
+    return self;
+}
+
+- (NSData *)header
+{
+    return _header;
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"%@ <%p>: %@", [self class], self, _gcdaPath];
+}
+
+@end
+
+@interface CoverStoryCoverageCache ()
+- (NSString *)entryPathForKey:(CoverStoryCoverageCacheKey *)key;
+- (NSArray *)fileDatasFromEntry:(NSData *)entry
+                     headerSize:(NSUInteger)headerSize
+                       document:(CoverStoryDocument *)document;
+@end
+
+@implementation CoverStoryCoverageCache
+
+@synthesize directory = _directory;
+
++ (NSString *)defaultDirectory
+{
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    if (![defaults boolForKey:kCoverStoryUseCoverageCacheKey])
+    {
+        return nil;
+    }
+    NSString *directory = [defaults stringForKey:kCoverStoryCoverageCacheDirectoryKey];
+    if ([directory length])
+    {
+        return [directory stringByStandardizingPath];
+    }
+    NSArray *cacheDirs = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
+    if ([cacheDirs count] == 0)
+    {
+        return nil;
+    }
+    NSString *appName = [[NSBundle mainBundle] bundleIdentifier];
+    if ([appName length] == 0)
+    {
+        appName = @"CoverStory";
+    }
+    return [[cacheDirs[0] stringByAppendingPathComponent:appName] stringByAppendingPathComponent:@"Coverage"];
+}
+
+- (id)init
+{
+    return [self initWithDirectory:nil];
+}
+
+- (id)initWithDirectory:(NSString *)directory
+{
+    if ((self = [super init]))
+    {
+        if ([directory length] == 0)
+        {
+            return nil;
+        }
+        _directory = [directory copy];
+    }
+    return self;
+}
+
+- (CoverStoryCoverageCacheKey *)keyForGCDAPath:(NSString *)gcdaPath gcovVersion:(NSString *)gcovVersion
+{
+    struct stat gcdaInfo;
+    if (![gcdaPath length] || (stat([gcdaPath fileSystemRepresentation], &gcdaInfo) != 0))
+    {
+        return nil;
+    }
+    NSString *gcnoPath = [[gcdaPath stringByDeletingPathExtension] stringByAppendingPathExtension:@"gcno"];
+    NSData *gcno       = [NSData dataWithContentsOfFile:gcnoPath options:NSDataReadingMappedIfSafe error:NULL];
+    if (!gcno)
+    {
+        return nil;
+    }
+    NSData *gcdaPathUTF8    = [gcdaPath dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *gcovVersionUTF8 = [(gcovVersion ?: @"") dataUsingEncoding:NSUTF8StringEncoding];
+
+    CSCacheKeyHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kCSCacheMagic, sizeof(header.magic));
+    header.formatVersion      = kCSCacheFormatVersion;
+    header.gcdaSize           = (uint64_t)gcdaInfo.st_size;
+    header.gcdaModSeconds     = (int64_t)gcdaInfo.st_mtimespec.tv_sec;
+    header.gcdaModNanoseconds = (int64_t)gcdaInfo.st_mtimespec.tv_nsec;
+    CC_SHA1([gcno bytes], (CC_LONG)[gcno length], header.gcnoDigest);
+    header.gcdaPathLength     = (uint32_t)[gcdaPathUTF8 length];
+    header.gcovVersionLength  = (uint32_t)[gcovVersionUTF8 length];
+
+    NSMutableData *headerData = [NSMutableData dataWithBytes:&header length:sizeof(header)];
+    [headerData appendData:gcdaPathUTF8];
+    [headerData appendData:gcovVersionUTF8];
+    mappedDataAppendPadding(headerData);
+    return [[CoverStoryCoverageCacheKey alloc] initWithGCDAPath:gcdaPath header:headerData];
+}
+
+- (NSString *)entryPathForKey:(CoverStoryCoverageCacheKey *)key
+{
+    const char *path = [[key gcdaPath] fileSystemRepresentation];
+    NSString *name   = [CSCacheHexDigest(path, strlen(path)) stringByAppendingPathExtension:kCSCacheEntryExtension];
+    return [_directory stringByAppendingPathComponent:name];
+}
+
+- (NSArray *)fileDatasForKey:(CoverStoryCoverageCacheKey *)key document:(CoverStoryDocument *)document
+{
+    NSArray *result = nil;
+    if (key)
+    {
+        NSData *header = [key header];
+        NSData *entry  = [NSData dataWithContentsOfFile:[self entryPathForKey:key]
+                                                options:NSDataReadingMappedAlways
+                                                  error:NULL];
+        if (([entry length] >= [header length]) &&
+            (memcmp([entry bytes], [header bytes], [header length]) == 0))
+        {
+            result = [self fileDatasFromEntry:entry headerSize:[header length] document:document];
+        }
+    }
+    @synchronized(self)
+    {
+        if (result)
+        {
+            ++_hitCount;
+        }
+        else
+        {
+            ++_missCount;
+        }
+    }
+    return result;
+}
+
+- (NSArray *)fileDatasFromEntry:(NSData *)entry
+                     headerSize:(NSUInteger)headerSize
+                       document:(CoverStoryDocument *)document
+{
+    const uint8_t *bytes = [entry bytes];
+    NSUInteger length    = [entry length];
+    NSUInteger offset    = headerSize;
+    if (length - offset < 2 * sizeof(uint32_t))
+    {
+        return nil;
+    }
+    uint32_t recordCount;
+    memcpy(&recordCount, bytes + offset, sizeof(recordCount));
+    offset += 2 * sizeof(uint32_t);
+
+    NSMutableArray *fileDatas = [NSMutableArray arrayWithCapacity:recordCount];
+    for (uint32_t x = 0; x < recordCount; ++x)
+    {
+        CSCacheRecordHeader record;
+        if ((offset > length) || (length - offset < sizeof(record)))
+        {
+            return nil;
+        }
+        memcpy(&record, bytes + offset, sizeof(record));
+        offset += sizeof(record);
+
+        // Work out where everything is and make sure it's all really there
+        // before touching any of it (the counts are 32 bit, so this can't
+        // overflow).
+        uint64_t pathOffset     = offset;
+        uint64_t warningsOffset = pathOffset + record.sourcePathLength;
+        uint64_t textOffset     = mappedDataAligned(warningsOffset + record.warningsLength);
+        uint64_t rangesOffset   = mappedDataAligned(textOffset + record.textLength);
+        uint64_t hitsOffset     = rangesOffset + (uint64_t)record.lineCount * sizeof(CoverStoryLineRange);
+        uint64_t endOffset      = hitsOffset + (uint64_t)record.lineCount * sizeof(int64_t);
+        if (endOffset > length)
+        {
+            return nil;
+        }
+        NSString *sourcePath = [[NSString alloc] initWithBytes:bytes + pathOffset
+                                                        length:record.sourcePathLength
+                                                      encoding:NSUTF8StringEncoding];
+        if (!sourcePath)
+        {
+            return nil;
+        }
+        NSArray *warnings = mappedDataWarningsFromBytes(bytes + warningsOffset, record.warningsLength);
+
+        const CoverStoryLineRange *ranges = (const CoverStoryLineRange *)(bytes + rangesOffset);
+        for (uint32_t y = 0; y < record.lineCount; ++y)
+        {
+            if ((uint64_t)ranges[y].offset + ranges[y].length > record.textLength)
+            {
+                return nil;
+            }
+        }
+
+        NSData *text       = [[CoverStoryMappedDataSlice alloc] initWithData:entry
+                                                                       range:NSMakeRange(textOffset, record.textLength)];
+        NSData *lineRanges = [[CoverStoryMappedDataSlice alloc] initWithData:entry
+                                                                       range:NSMakeRange(rangesOffset, hitsOffset - rangesOffset)];
+        NSData *hitCounts  = [[CoverStoryMappedDataSlice alloc] initWithData:entry
+                                                                       range:NSMakeRange(hitsOffset, endOffset - hitsOffset)];
+        // The markers were already applied before it was stored.
+        CoverStoryCoverageFileData *fileData =
+            [[CoverStoryCoverageFileData alloc] initWithSourcePath:sourcePath
+                                                              text:text
+                                                        lineRanges:lineRanges
+                                                         hitCounts:hitCounts
+                                           applyNonFeasibleMarkers:NO
+                                                          document:document];
+        if (!fileData)
+        {
+            return nil;
+        }
+        [fileData queueWarnings:warnings];
+        [fileDatas addObject:fileData];
+        offset = (NSUInteger)mappedDataAligned(endOffset);
+    }
+    return fileDatas;
+}
+
++ (NSData *)recordForFileData:(CoverStoryCoverageFileData *)fileData
+{
+    NSData *sourcePath = [[fileData sourcePath] dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *text       = [fileData textData];
+    NSData *lineRanges = [fileData lineRangeData];
+    NSUInteger lines   = [fileData lineCount];
+    if (!sourcePath || ([sourcePath length] > UINT32_MAX) || ([text length] > UINT32_MAX) ||
+        (lines > UINT32_MAX) || ([lineRanges length] != lines * sizeof(CoverStoryLineRange)))
+    {
+        return nil;
+    }
+    NSData *warnings = mappedDataWarnings([fileData queuedWarnings]);
+
+    CSCacheRecordHeader header;
+    header.sourcePathLength = (uint32_t)[sourcePath length];
+    header.warningsLength   = (uint32_t)[warnings length];
+    header.textLength       = (uint32_t)[text length];
+    header.lineCount        = (uint32_t)lines;
+
+    NSMutableData *record = [NSMutableData dataWithCapacity:sizeof(header) + [sourcePath length] + [warnings length] +
+                                                            [text length] + lines * 16 + 24];
+    [record appendBytes:&header length:sizeof(header)];
+    [record appendData:sourcePath];
+    [record appendData:warnings];
+    mappedDataAppendPadding(record);
+    [record appendData:text];
+    mappedDataAppendPadding(record);
+    [record appendData:lineRanges];
+    [record appendBytes:[fileData hitCounts] length:lines * sizeof(int64_t)];
+    return record;
+}
+
+- (BOOL)storeRecords:(NSArray *)records forKey:(CoverStoryCoverageCacheKey *)key
+{
+    if (!key || ([records count] == 0) || ([records count] > UINT32_MAX))
+    {
+        return NO;
+    }
+    NSMutableData *entry = [NSMutableData dataWithData:[key header]];
+    uint32_t counts[2]   = { (uint32_t)[records count], 0 };
+    [entry appendBytes:counts length:sizeof(counts)];
+    for (NSData *record in records)
+    {
+        [entry appendData:record];
+        mappedDataAppendPadding(entry);
+    }
+
+    NSFileManager *fm = [[NSFileManager alloc] init];
+    if (![fm createDirectoryAtPath:_directory withIntermediateDirectories:YES attributes:nil error:NULL])
+    {
+        return NO;
+    }
+    // Atomic so a reader (or another writer) never sees half an entry.
+    BOOL stored = [entry writeToFile:[self entryPathForKey:key] options:NSDataWritingAtomic error:NULL];
+    if (stored)
+    {
+        @synchronized(self)
+        {
+            ++_storeCount;
+        }
+    }
+    return stored;
+}
+
+- (BOOL)storeFileDatas:(NSArray *)fileDatas forKey:(CoverStoryCoverageCacheKey *)key
+{
+    NSMutableArray *records = [NSMutableArray arrayWithCapacity:[fileDatas count]];
+    for (CoverStoryCoverageFileData *fileData in fileDatas)
+    {
+        NSData *record = [[self class] recordForFileData:fileData];
+        if (!record)
+        {
+            return NO;
+        }
+        [records addObject:record];
+    }
+    return [self storeRecords:records forKey:key];
+}
+
+- (BOOL)removeAllEntries
+{
+    NSFileManager *fm = [[NSFileManager alloc] init];
+    BOOL result       = YES;
+    for (NSString *name in [fm contentsOfDirectoryAtPath:_directory error:NULL])
+    {
+        if ([[name pathExtension] isEqualToString:kCSCacheEntryExtension])
+        {
+            result &= [fm removeItemAtPath:[_directory stringByAppendingPathComponent:name] error:NULL];
+        }
+    }
+    return result;
+}
+
+- (NSUInteger)hitCount
+{
+    @synchronized(self)
+    {
+        return _hitCount;
+    }
+}
+
+- (NSUInteger)missCount
+{
+    @synchronized(self)
+    {
+        return _missCount;
+    }
+}
+
+- (NSUInteger)storeCount
+{
+    @synchronized(self)
+    {
+        return _storeCount;
+    }
+}
+
+- (float)hitRate
+{
+    @synchronized(self)
+    {
+        NSUInteger lookups = _hitCount + _missCount;
+        return lookups ? (float)_hitCount / lookups : 0.0f;
+    }
+}
+
+- (void)resetStatistics
+{
+    @synchronized(self)
+    {
+        _hitCount   = 0;
+        _missCount  = 0;
+        _storeCount = 0;
+    }
+}
+
+- (NSString *)statisticsDescription
+{
+    NSUInteger hits = [self hitCount];
+    return [NSString stringWithFormat:@"Coverage cache: %lu of %lu gcda files were current (%.0f%% hit rate), "
+                                      @"%lu entries updated.",
+                                      (unsigned long)hits, (unsigned long)(hits + [self missCount]),
+                                      [self hitRate] * 100.0f, (unsigned long)[self storeCount]];
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"%@ <%p>: %@", [self class], self, _directory];
+}
+
+@end
@@ -0,0 +1,109 @@
+//
+//  CoverStoryCoverageDiff.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// What changed in the coverage between two runs (a base, ie - the last good
+// build, and the current one), for gating on "no newly missed lines".
+//
+// The sources are lined up by sourcePath w/ one hash table of the base, and
+// each pair's hit counts are compared in one straight pass when the text is
+// the same.  When it isn't, the lines are matched up by hash first (the common
+// ends, then a Myers diff of what's left in between, or just the lines that
+// are unique on both sides if that's too far apart), and the current lines
+// w/o a match count as new.  The sources are spread over a queue of workers.
+//
+// For a line in the current run:
+//   now missed:    0 hits, and it wasn't a missed line before (it was hit,
+//                  wasn't code, or is new)
+//   now covered:   hit, and it was a missed line before
+//   count changed: hit in both, but a different number of times
+
+#import <Foundation/Foundation.h>
+#import "CoverStoryProtocols.h"
+
+@class CoverStoryCoverageFileData;
+
+typedef NS_ENUM(NSInteger, CoverStoryFileDiffKind)
+{
+    kCoverStoryFileDiffChanged = 0,
+    kCoverStoryFileDiffAdded,     // only in the current run
+    kCoverStoryFileDiffRemoved    // only in the base
+};
+
+@interface CoverStoryFileCoverageDiff : NSObject {
+@private
+    NSString *_sourcePath;
+    CoverStoryFileDiffKind _kind;
+    BOOL _realigned;
+    CoverStoryLineCounts _baseLineCounts;
+    CoverStoryLineCounts _currentLineCounts;
+    NSIndexSet *_nowMissedLines;
+    NSIndexSet *_nowCoveredLines;
+    NSIndexSet *_countChangedLines;
+}
+
+@property (readonly, nonatomic, copy) NSString *sourcePath;
+@property (readonly, nonatomic, assign) CoverStoryFileDiffKind kind;
+// The text changed, so the lines had to be matched up.
+@property (readonly, nonatomic, assign) BOOL realigned;
+@property (readonly, nonatomic, assign) CoverStoryLineCounts baseLineCounts;
+@property (readonly, nonatomic, assign) CoverStoryLineCounts currentLineCounts;
+// Indexes of lines in the current file (empty for a removed one).
+@property (readonly, nonatomic, strong) NSIndexSet *nowMissedLines;
+@property (readonly, nonatomic, strong) NSIndexSet *nowCoveredLines;
+@property (readonly, nonatomic, strong) NSIndexSet *countChangedLines;
+
+// The JSON-able form that goes in the report, the lines are 1 based.
+- (NSDictionary *)reportDictionary;
+
+@end
+
+@interface CoverStoryCoverageDiff : NSObject {
+@private
+    NSArray *_fileDiffs;
+    NSDictionary *_fileDiffsBySourcePath;
+    CoverStoryLineCounts _baseLineCounts;
+    CoverStoryLineCounts _currentLineCounts;
+    NSUInteger _baseSourceCount;
+    NSUInteger _currentSourceCount;
+    NSUInteger _nowMissedCount;
+    NSUInteger _nowCoveredCount;
+    NSUInteger _countChangedCount;
+    NSUInteger _addedSourceCount;
+    NSUInteger _removedSourceCount;
+}
+
+// Just the sources that changed (in their order in the current run, then the
+// removed ones in their order in the base).
+@property (readonly, nonatomic, strong) NSArray *fileDiffs;
+@property (readonly, nonatomic, assign) CoverStoryLineCounts baseLineCounts;
+@property (readonly, nonatomic, assign) CoverStoryLineCounts currentLineCounts;
+@property (readonly, nonatomic, assign) NSUInteger baseSourceCount;
+@property (readonly, nonatomic, assign) NSUInteger currentSourceCount;
+@property (readonly, nonatomic, assign) NSUInteger nowMissedCount;
+@property (readonly, nonatomic, assign) NSUInteger nowCoveredCount;
+@property (readonly, nonatomic, assign) NSUInteger countChangedCount;
+@property (readonly, nonatomic, assign) NSUInteger addedSourceCount;
+@property (readonly, nonatomic, assign) NSUInteger removedSourceCount;
+
+// Both are arrays of CoverStoryCoverageFileData w/ one per sourcePath (ie - a
+// set's fileDatas), neither can be merged into while this runs.
+// |maxConcurrency| of 0 means one worker per core.
+- (id)initWithBaseFileDatas:(NSArray *)baseFileDatas
+           currentFileDatas:(NSArray *)currentFileDatas
+             maxConcurrency:(NSUInteger)maxConcurrency;
+
+// nil if |sourcePath| didn't change.
+- (CoverStoryFileCoverageDiff *)fileDiffForSourcePath:(NSString *)sourcePath;
+
+// "3 newly missed, 10 newly covered lines (72.5% -> 73.0%)"
+- (NSString *)summaryString;
+
+// The totals and every changed source, as JSON.
+- (NSDictionary *)reportDictionary;
+- (NSData *)reportJSONData;
+- (BOOL)writeReportToFile:(NSString *)path error:(NSError **)error;
+
+@end
@@ -0,0 +1,618 @@
+//
+//  CoverStoryCoverageDiff.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "CoverStoryCoverageDiff.h"
+#import "CoverStoryCoverageFileData.h"
+#import "CodeCoverage.h"
+#include <stdlib.h>
+
+// The base count for a current line that has nothing to compare to.
+static const int64_t kCSDiffNoBaseLine = INT64_MIN;
+// Myers keeps a trace that grows w/ the square of the edits, past this many
+// the lines are matched up by the ones that are unique on both sides instead.
+static const NSInteger kCSDiffMaxEditDistance = 1024;
+// How many sources each worker takes at a time.
+static const NSUInteger kCSDiffSourcesPerOperation = 64;
+// How many hit counts are compared at a time before looking at them one by
+// one (a multiple of the vector width, so the compiler can use it).
+static const NSUInteger kCSDiffHitCountBlock = 8;
+
+// FNV-1a, same as the shards use for lines.
+static uint64_t CSDiffHash(const char *bytes, NSUInteger length)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (NSUInteger x = 0; x < length; ++x)
+    {
+        hash ^= (unsigned char)bytes[x];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// One per line, free() it when done.
+static uint64_t *CSDiffLineHashes(CoverStoryCoverageFileData *fileData)
+{
+    NSUInteger count                  = [fileData lineCount];
+    const char *text                  = [[fileData textData] bytes];
+    const CoverStoryLineRange *ranges = [[fileData lineRangeData] bytes];
+    uint64_t *hashes                  = malloc(MAX(count, (NSUInteger)1) * sizeof(uint64_t));
+    for (NSUInteger x = 0; x < count; ++x)
+    {
+        hashes[x] = CSDiffHash(text + ranges[x].offset, ranges[x].length);
+    }
+    return hashes;
+}
+
+// Myers' O((n+m)D) diff of |base| against |current|, filling in |outMatch|
+// (one per current line) w/ the base line each current line matches.  NO if
+// it's more than kCSDiffMaxEditDistance edits.
+static BOOL CSDiffMatchMyers(const uint64_t *base, NSInteger n,
+                             const uint64_t *current, NSInteger m,
+                             NSInteger *outMatch)
+{
+    NSInteger maxD   = MIN(n + m, kCSDiffMaxEditDistance);
+    NSInteger offset = maxD + 1;
+    int32_t *v       = calloc(2 * maxD + 3, sizeof(int32_t));
+    // what v was going into each step, step d's (2d + 1) entries start at d*d
+    int32_t *trace   = malloc((maxD + 1) * (maxD + 1) * sizeof(int32_t));
+    BOOL found       = NO;
+    NSInteger d      = 0;
+    NSInteger x      = 0;
+    NSInteger y      = 0;
+    for (d = 0; (d <= maxD) && !found; ++d)
+    {
+        memcpy(trace + d * d, v + offset - d, (2 * d + 1) * sizeof(int32_t));
+        for (NSInteger k = -d; k <= d; k += 2)
+        {
+            if ((k == -d) || ((k != d) && (v[offset + k - 1] < v[offset + k + 1])))
+            {
+                x = v[offset + k + 1];
+            }
+            else
+            {
+                x = v[offset + k - 1] + 1;
+            }
+            y = x - k;
+            while ((x < n) && (y < m) && (base[x] == current[y]))
+            {
+                ++x;
+                ++y;
+            }
+            v[offset + k] = (int32_t)x;
+            if ((x >= n) && (y >= m))
+            {
+                found = YES;
+                break;
+            }
+        }
+    }
+    if (found)
+    {
+        // walk the edits back from the end, the diagonals in between are the
+        // matches
+        x = n;
+        y = m;
+        for (d = d - 1; d > 0; --d)
+        {
+            const int32_t *vd = trace + d * d + d;  // so vd[k] works
+            NSInteger k       = x - y;
+            NSInteger prevK   = ((k == -d) || ((k != d) && (vd[k - 1] < vd[k + 1]))) ? k + 1 : k - 1;
+            NSInteger prevX   = vd[prevK];
+            NSInteger prevY   = prevX - prevK;
+            while ((x > prevX) && (y > prevY))
+            {
+                outMatch[--y] = --x;
+            }
+            x = prevX;
+            y = prevY;
+        }
+        while ((x > 0) && (y > 0))
+        {
+            outMatch[--y] = --x;
+        }
+    }
+    free(trace);
+    free(v);
+    return found;
+}
+
+typedef struct {
+    uint64_t hash;
+    NSInteger index;
+} CSDiffLine;
+
+static int CSDiffCompareLines(const void *a, const void *b)
+{
+    const CSDiffLine *lineA = a;
+    const CSDiffLine *lineB = b;
+    if (lineA->hash != lineB->hash)
+    {
+        return (lineA->hash < lineB->hash) ? -1 : 1;
+    }
+    return (lineA->index < lineB->index) ? -1 : ((lineA->index > lineB->index) ? 1 : 0);
+}
+
+static CSDiffLine *CSDiffSortedLines(const uint64_t *hashes, NSInteger count)
+{
+    CSDiffLine *lines = malloc(MAX(count, (NSInteger)1) * sizeof(CSDiffLine));
+    for (NSInteger x = 0; x < count; ++x)
+    {
+        lines[x].hash  = hashes[x];
+        lines[x].index = x;
+    }
+    qsort(lines, count, sizeof(CSDiffLine), CSDiffCompareLines);
+    return lines;
+}
+
+// When they're too far apart for Myers: the lines that appear once in each
+// are taken to be the same line.
+static void CSDiffMatchUnique(const uint64_t *base, NSInteger n,
+                              const uint64_t *current, NSInteger m,
+                              NSInteger *outMatch)
+{
+    CSDiffLine *baseLines    = CSDiffSortedLines(base, n);
+    CSDiffLine *currentLines = CSDiffSortedLines(current, m);
+    NSInteger x              = 0;
+    NSInteger y              = 0;
+    while ((x < n) && (y < m))
+    {
+        uint64_t hash = baseLines[x].hash;
+        if (hash < currentLines[y].hash)
+        {
+            ++x;
+            continue;
+        }
+        if (hash > currentLines[y].hash)
+        {
+            ++y;
+            continue;
+        }
+        NSInteger baseEnd    = x + 1;
+        NSInteger currentEnd = y + 1;
+        while ((baseEnd < n) && (baseLines[baseEnd].hash == hash))
+        {
+            ++baseEnd;
+        }
+        while ((currentEnd < m) && (currentLines[currentEnd].hash == hash))
+        {
+            ++currentEnd;
+        }
+        if ((baseEnd == x + 1) && (currentEnd == y + 1))
+        {
+            outMatch[currentLines[y].index] = baseLines[x].index;
+        }
+        x = baseEnd;
+        y = currentEnd;
+    }
+    free(currentLines);
+    free(baseLines);
+}
+
+// The base line (or NSNotFound) for each current line, free() it when done.
+static NSInteger *CSDiffMatchLines(CoverStoryCoverageFileData *baseData, CoverStoryCoverageFileData *currentData)
+{
+    NSInteger n        = (NSInteger)[baseData lineCount];
+    NSInteger m        = (NSInteger)[currentData lineCount];
+    uint64_t *base     = CSDiffLineHashes(baseData);
+    uint64_t *current  = CSDiffLineHashes(currentData);
+    NSInteger *match   = malloc(MAX(m, (NSInteger)1) * sizeof(NSInteger));
+    for (NSInteger y = 0; y < m; ++y)
+    {
+        match[y] = NSNotFound;
+    }
+    // the ends usually match, only what's between them needs diffing
+    NSInteger prefix = 0;
+    while ((prefix < n) && (prefix < m) && (base[prefix] == current[prefix]))
+    {
+        match[prefix] = prefix;
+        ++prefix;
+    }
+    NSInteger suffix = 0;
+    while ((suffix < n - prefix) && (suffix < m - prefix) && (base[n - 1 - suffix] == current[m - 1 - suffix]))
+    {
+        match[m - 1 - suffix] = n - 1 - suffix;
+        ++suffix;
+    }
+    NSInteger middleN = n - prefix - suffix;
+    NSInteger middleM = m - prefix - suffix;
+    if ((middleN > 0) && (middleM > 0))
+    {
+        NSInteger *middle = malloc(middleM * sizeof(NSInteger));
+        for (NSInteger y = 0; y < middleM; ++y)
+        {
+            middle[y] = NSNotFound;
+        }
+        if (!CSDiffMatchMyers(base + prefix, middleN, current + prefix, middleM, middle))
+        {
+            CSDiffMatchUnique(base + prefix, middleN, current + prefix, middleM, middle);
+        }
+        for (NSInteger y = 0; y < middleM; ++y)
+        {
+            if (middle[y] != NSNotFound)
+            {
+                match[prefix + y] = prefix + middle[y];
+            }
+        }
+        free(middle);
+    }
+    free(current);
+    free(base);
+    return match;
+}
+
+static void CSDiffClassifyLine(NSUInteger index, int64_t was, int64_t now,
+                               NSMutableIndexSet *nowMissed,
+                               NSMutableIndexSet *nowCovered,
+                               NSMutableIndexSet *countChanged)
+{
+    if (was == now)
+    {
+        return;
+    }
+    if (now == 0)
+    {
+        [nowMissed addIndex:index];
+    }
+    else if (now > 0)
+    {
+        if (was == 0)
+        {
+            [nowCovered addIndex:index];
+        }
+        else if (was > 0)
+        {
+            [countChanged addIndex:index];
+        }
+    }
+}
+
+// |was| has the base count for each current line (kCSDiffNoBaseLine for new
+// ones).  Most blocks of counts are the same, so they're checked w/o any
+// branches first and only the ones w/ a difference are looked at a line at
+// a time.
+static void CSDiffClassifyLines(const int64_t *was, const int64_t *now, NSUInteger count,
+                                NSMutableIndexSet *nowMissed,
+                                NSMutableIndexSet *nowCovered,
+                                NSMutableIndexSet *countChanged)
+{
+    NSUInteger x = 0;
+    for (; x + kCSDiffHitCountBlock <= count; x += kCSDiffHitCountBlock)
+    {
+        uint64_t differences = 0;
+        for (NSUInteger y = 0; y < kCSDiffHitCountBlock; ++y)
+        {
+            differences |= (uint64_t)(was[x + y] ^ now[x + y]);
+        }
+        if (!differences)
+        {
+            continue;
+        }
+        for (NSUInteger y = x; y < x + kCSDiffHitCountBlock; ++y)
+        {
+            CSDiffClassifyLine(y, was[y], now[y], nowMissed, nowCovered, countChanged);
+        }
+    }
+    for (; x < count; ++x)
+    {
+        CSDiffClassifyLine(x, was[x], now[x], nowMissed, nowCovered, countChanged);
+    }
+}
+
+static NSDictionary *CSDiffCountsDictionary(CoverStoryLineCounts counts)
+{
+    float coverage = codeCoverage(counts.codeLines, counts.hitCodeLines, NULL);
+    return @{ @"lines": @(counts.totalLines),
+              @"codeLines": @(counts.codeLines),
+              @"hitCodeLines": @(counts.hitCodeLines),
+              @"nonFeasibleLines": @(counts.nonFeasibleLines),
+              @"coverage": @(coverage) };
+}
+
+static NSArray *CSDiffLineNumbers(NSIndexSet *lines)
+{
+    NSMutableArray *numbers = [NSMutableArray arrayWithCapacity:[lines count]];
+    [lines enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+        [numbers addObject:@(index + 1)];
+    }];
+    return numbers;
+}
+
+@interface CoverStoryFileCoverageDiff ()
+// nil if nothing changed, either one (but not both) can be nil.
++ (CoverStoryFileCoverageDiff *)diffOfBase:(CoverStoryCoverageFileData *)base
+                                   current:(CoverStoryCoverageFileData *)current;
+@end
+
+@implementation CoverStoryFileCoverageDiff
+
+@synthesize sourcePath = _sourcePath;
+@synthesize kind = _kind;
+@synthesize realigned = _realigned;
+@synthesize baseLineCounts = _baseLineCounts;
+@synthesize currentLineCounts = _currentLineCounts;
+@synthesize nowMissedLines = _nowMissedLines;
+@synthesize nowCoveredLines = _nowCoveredLines;
+@synthesize countChangedLines = _countChangedLines;
+
++ (CoverStoryFileCoverageDiff *)diffOfBase:(CoverStoryCoverageFileData *)base
+                                   current:(CoverStoryCoverageFileData *)current
+{
+    NSMutableIndexSet *nowMissed    = [NSMutableIndexSet indexSet];
+    NSMutableIndexSet *nowCovered   = [NSMutableIndexSet indexSet];
+    NSMutableIndexSet *countChanged = [NSMutableIndexSet indexSet];
+    CoverStoryFileDiffKind kind     = kCoverStoryFileDiffChanged;
+    BOOL realigned                  = NO;
+    NSUInteger count                = [current lineCount];
+    const int64_t *now              = [current hitCounts];
+    if (!current)
+    {
+        kind = kCoverStoryFileDiffRemoved;
+    }
+    else if (!base)
+    {
+        // every missed line in a new file is a newly missed one
+        kind = kCoverStoryFileDiffAdded;
+        for (NSUInteger x = 0; x < count; ++x)
+        {
+            if (now[x] == 0)
+            {
+                [nowMissed addIndex:x];
+            }
+        }
+    }
+    else if ((count == [base lineCount]) &&
+             [[current lineRangeData] isEqualToData:[base lineRangeData]] &&
+             [[current textData] isEqualToData:[base textData]])
+    {
+        const int64_t *was = [base hitCounts];
+        if (memcmp(was, now, count * sizeof(int64_t)) != 0)
+        {
+            CSDiffClassifyLines(was, now, count, nowMissed, nowCovered, countChanged);
+        }
+    }
+    else
+    {
+        realigned          = YES;
+        const int64_t *old = [base hitCounts];
+        NSInteger *match   = CSDiffMatchLines(base, current);
+        int64_t *was       = malloc(MAX(count, (NSUInteger)1) * sizeof(int64_t));
+        for (NSUInteger x = 0; x < count; ++x)
+        {
+            was[x] = (match[x] == NSNotFound) ? kCSDiffNoBaseLine : old[match[x]];
+        }
+        CSDiffClassifyLines(was, now, count, nowMissed, nowCovered, countChanged);
+        free(was);
+        free(match);
+    }
+
+    CoverStoryLineCounts zero          = { 0, 0, 0, 0 };
+    CoverStoryLineCounts baseCounts    = base ? [base lineCounts] : zero;
+    CoverStoryLineCounts currentCounts = current ? [current lineCounts] : zero;
+    // an edit that didn't move the coverage isn't a change
+    if ((kind == kCoverStoryFileDiffChanged) &&
+        ![nowMissed count] && ![nowCovered count] && ![countChanged count] &&
+        (baseCounts.codeLines == currentCounts.codeLines) &&
+        (baseCounts.hitCodeLines == currentCounts.hitCodeLines) &&
+        (baseCounts.nonFeasibleLines == currentCounts.nonFeasibleLines))
+    {
+        return nil;
+    }
+    CoverStoryFileCoverageDiff *diff = [[self alloc] init];
+    diff->_sourcePath                = [(current ? current : base) sourcePath];
+    diff->_kind                      = kind;
+    diff->_realigned                 = realigned;
+    diff->_baseLineCounts            = baseCounts;
+    diff->_currentLineCounts         = currentCounts;
+    diff->_nowMissedLines            = nowMissed;
+    diff->_nowCoveredLines           = nowCovered;
+    diff->_countChangedLines         = countChanged;
+    return diff;
+}
+
+- (NSDictionary *)reportDictionary
+{
+    static NSString *const kKindNames[] = { @"changed", @"added", @"removed" };
+    return @{ @"sourcePath": _sourcePath,
+              @"status": kKindNames[_kind],
+              @"realigned": @(_realigned),
+              @"base": CSDiffCountsDictionary(_baseLineCounts),
+              @"current": CSDiffCountsDictionary(_currentLineCounts),
+              @"newlyMissed": CSDiffLineNumbers(_nowMissedLines),
+              @"newlyCovered": CSDiffLineNumbers(_nowCoveredLines),
+              @"changedCounts": CSDiffLineNumbers(_countChangedLines) };
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"%@ <%p>: %@ %lu newly missed, %lu newly covered, %lu changed",
+                                      [self class], self, _sourcePath,
+                                      (unsigned long)[_nowMissedLines count],
+                                      (unsigned long)[_nowCoveredLines count],
+                                      (unsigned long)[_countChangedLines count]];
+}
+
+@end
+
+@implementation CoverStoryCoverageDiff
+
+@synthesize fileDiffs = _fileDiffs;
+@synthesize baseLineCounts = _baseLineCounts;
+@synthesize currentLineCounts = _currentLineCounts;
+@synthesize baseSourceCount = _baseSourceCount;
+@synthesize currentSourceCount = _currentSourceCount;
+@synthesize nowMissedCount = _nowMissedCount;
+@synthesize nowCoveredCount = _nowCoveredCount;
+@synthesize countChangedCount = _countChangedCount;
+@synthesize addedSourceCount = _addedSourceCount;
+@synthesize removedSourceCount = _removedSourceCount;
+
+- (id)init
+{
+    return [self initWithBaseFileDatas:@[] currentFileDatas:@[] maxConcurrency:0];
+}
+
+- (id)initWithBaseFileDatas:(NSArray *)baseFileDatas
+           currentFileDatas:(NSArray *)currentFileDatas
+             maxConcurrency:(NSUInteger)maxConcurrency
+{
+    if ((self = [super init]))
+    {
+        // the join is on sourcePath, w/ the base as the table
+        NSMutableDictionary *baseBySourcePath = [NSMutableDictionary dictionaryWithCapacity:[baseFileDatas count]];
+        for (CoverStoryCoverageFileData *fileData in baseFileDatas)
+        {
+            baseBySourcePath[[fileData sourcePath]] = fileData;
+            _baseLineCounts = coverageAddLineCounts(_baseLineCounts, [fileData lineCounts]);
+        }
+        _baseSourceCount = [baseFileDatas count];
+
+        // each worker takes a run of the current sources and fills in its slot
+        NSUInteger count        = [currentFileDatas count];
+        NSUInteger batchCount   = (count + kCSDiffSourcesPerOperation - 1) / kCSDiffSourcesPerOperation;
+        NSMutableArray *batches = [NSMutableArray arrayWithCapacity:batchCount];
+        for (NSUInteger x = 0; x < batchCount; ++x)
+        {
+            [batches addObject:[NSNull null]];
+        }
+        NSMutableArray *operations = [NSMutableArray arrayWithCapacity:batchCount];
+        for (NSUInteger batch = 0; batch < batchCount; ++batch)
+        {
+            NSRange range = NSMakeRange(batch * kCSDiffSourcesPerOperation,
+                                        MIN(kCSDiffSourcesPerOperation, count - batch * kCSDiffSourcesPerOperation));
+            [operations addObject:[NSBlockOperation blockOperationWithBlock:^{
+                @autoreleasepool {
+                    NSMutableArray *diffs = [NSMutableArray array];
+                    for (NSUInteger x = range.location; x < NSMaxRange(range); ++x)
+                    {
+                        CoverStoryCoverageFileData *current = currentFileDatas[x];
+                        CoverStoryCoverageFileData *base    = baseBySourcePath[[current sourcePath]];
+                        CoverStoryFileCoverageDiff *diff    = [CoverStoryFileCoverageDiff diffOfBase:base
+                                                                                             current:current];
+                        if (diff)
+                        {
+                            [diffs addObject:diff];
+                        }
+                    }
+                    @synchronized(batches)
+                    {
+                        batches[batch] = diffs;
+                    }
+                }
+            }]];
+        }
+        if (batchCount > 1)
+        {
+            NSOperationQueue *queue = [[NSOperationQueue alloc] init];
+            if (maxConcurrency)
+            {
+                [queue setMaxConcurrentOperationCount:maxConcurrency];
+            }
+            [queue addOperations:operations waitUntilFinished:YES];
+        }
+        else
+        {
+            [[operations lastObject] start];
+        }
+
+        NSMutableArray *fileDiffs          = [NSMutableArray array];
+        NSMutableDictionary *bySourcePath  = [NSMutableDictionary dictionary];
+        NSMutableSet *currentSourcePaths   = [NSMutableSet setWithCapacity:count];
+        for (CoverStoryCoverageFileData *fileData in currentFileDatas)
+        {
+            [currentSourcePaths addObject:[fileData sourcePath]];
+            _currentLineCounts = coverageAddLineCounts(_currentLineCounts, [fileData lineCounts]);
+        }
+        _currentSourceCount = count;
+        for (NSArray *diffs in batches)
+        {
+            [fileDiffs addObjectsFromArray:diffs];
+        }
+        for (CoverStoryCoverageFileData *fileData in baseFileDatas)
+        {
+            if (![currentSourcePaths containsObject:[fileData sourcePath]])
+            {
+                [fileDiffs addObject:[CoverStoryFileCoverageDiff diffOfBase:fileData current:nil]];
+            }
+        }
+        for (CoverStoryFileCoverageDiff *diff in fileDiffs)
+        {
+            bySourcePath[[diff sourcePath]] = diff;
+            _nowMissedCount    += [[diff nowMissedLines] count];
+            _nowCoveredCount   += [[diff nowCoveredLines] count];
+            _countChangedCount += [[diff countChangedLines] count];
+            if ([diff kind] == kCoverStoryFileDiffAdded)
+            {
+                ++_addedSourceCount;
+            }
+            else if ([diff kind] == kCoverStoryFileDiffRemoved)
+            {
+                ++_removedSourceCount;
+            }
+        }
+        _fileDiffs             = fileDiffs;
+        _fileDiffsBySourcePath = bySourcePath;
+    }
+    return self;
+}
+
+- (CoverStoryFileCoverageDiff *)fileDiffForSourcePath:(NSString *)sourcePath
+{
+    return sourcePath ? _fileDiffsBySourcePath[sourcePath] : nil;
+}
+
+- (NSString *)summaryString
+{
+    NSString *baseCoverage    = nil;
+    NSString *currentCoverage = nil;
+    codeCoverage(_baseLineCounts.codeLines, _baseLineCounts.hitCodeLines, &baseCoverage);
+    codeCoverage(_currentLineCounts.codeLines, _currentLineCounts.hitCodeLines, &currentCoverage);
+    return [NSString stringWithFormat:@"%lu newly missed, %lu newly covered lines (%@%% -> %@%%)",
+                                      (unsigned long)_nowMissedCount, (unsigned long)_nowCoveredCount,
+                                      baseCoverage, currentCoverage];
+}
+
+- (NSDictionary *)reportDictionary
+{
+    NSMutableDictionary *base    = [CSDiffCountsDictionary(_baseLineCounts) mutableCopy];
+    NSMutableDictionary *current = [CSDiffCountsDictionary(_currentLineCounts) mutableCopy];
+    base[@"sources"]             = @(_baseSourceCount);
+    current[@"sources"]          = @(_currentSourceCount);
+    NSMutableArray *sources      = [NSMutableArray arrayWithCapacity:[_fileDiffs count]];
+    for (CoverStoryFileCoverageDiff *diff in _fileDiffs)
+    {
+        [sources addObject:[diff reportDictionary]];
+    }
+    return @{ @"base": base,
+              @"current": current,
+              @"newlyMissedLines": @(_nowMissedCount),
+              @"newlyCoveredLines": @(_nowCoveredCount),
+              @"changedCountLines": @(_countChangedCount),
+              @"addedSources": @(_addedSourceCount),
+              @"removedSources": @(_removedSourceCount),
+              @"sources": sources };
+}
+
+- (NSData *)reportJSONData
+{
+    return [NSJSONSerialization dataWithJSONObject:[self reportDictionary]
+                                           options:NSJSONWritingPrettyPrinted
+                                             error:NULL];
+}
+
+- (BOOL)writeReportToFile:(NSString *)path error:(NSError **)error
+{
+    NSData *data = [self reportJSONData];
+    return data && [data writeToFile:path options:NSDataWritingAtomic error:error];
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"%@ <%p>: %lu sources changed, %@",
+                                      [self class], self, (unsigned long)[_fileDiffs count], [self summaryString]];
+}
+
+@end
@@ -12,30 +12,102 @@
 
 @class CoverStoryCoverageLineData;
 @class CoverStoryDocument;
+@class CoverStoryMissIndex;
 
+// Where the text for a line lives in a CoverStoryCoverageFileData's text buffer.
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+} CoverStoryLineRange;
+
+// The lines are kept as columns rather than an object per line: one buffer
+// with all the source text, an array of CoverStoryLineRange into it, and an
+// array of hit counts.  CoverStoryCoverageLineData objects are only made when
+// something asks for them via |lines|.
 @interface CoverStoryCoverageFileData : NSObject<CoverStoryLineCoverageProtocol> {
 @private
-    NSMutableArray *_lines;
+    NSData *_text;
+    NSData *_lineRanges;         // of CoverStoryLineRange
+    NSMutableData *_hitCounts;   // of int64_t
+    NSUInteger _lineCount;
     NSString *_sourcePath;
+    NSData *_sourcePathUTF8;     // NUL terminated, for the filters
     NSMutableArray *_warnings;
+    CoverStoryMissIndex *_missIndex;
+    float _coverageSortKey;      // redone by updateCounts
+    NSNumber *_coverage;         // boxed on demand, dropped by updateCounts
 }
 
 @property (nonatomic, weak) CoverStoryDocument *document;
 @property (readonly, nonatomic, copy) NSString *sourcePath;
-@property (readonly, nonatomic, strong) NSArray *lines; // of CoverStoryCoverageLineData
+@property (readonly, nonatomic, assign) NSUInteger lineCount;
+// of CoverStoryCoverageLineData, made on demand so avoid it in loops.
+@property (readonly, nonatomic, strong) NSArray *lines;
 
-// this is only vended for the table to sort with
+// this is only vended for KVC, sorting should use coverageSortKey
 @property (readonly) NSNumber *coverage;
 
 + (id)newCoverageFileDataFromPath:(NSString *)path document:(CoverStoryDocument *)document messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver;
 - (id)initWithPath:(NSString *)path document:(CoverStoryDocument *)document messageReceiver:(id<CoverStoryCoverageProcessingProtocol> )receiver;
+// The same from a .gcov that's already in memory (ie - one chunk of gcov -t),
+// |path| is just what errors are reported against.
++ (id)newCoverageFileDataFromGCovData:(NSData *)contents path:(NSString *)path document:(CoverStoryDocument *)document messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver;
+- (id)initWithGCovData:(NSData *)contents path:(NSString *)path document:(CoverStoryDocument *)document messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver;
+// For readers that count the lines themselves (gcda, lcov, llvm-cov):
+// |hitCounts| has an int64_t per line starting w/ line 1
+// (kCoverStoryNotExecutedMarker for lines that aren't code), and the text is
+// read from |readPath| now, on the caller's thread.  Lines past the end of the
+// source read "/*EOF*/" like gcov shows them, and the non feasible markers are
+// applied.  A missing source is reported to |receiver| and comes out as all
+// EOF lines, nil if the source is too big to keep.
++ (id)newCoverageFileDataWithSourcePath:(NSString *)sourcePath
+                               readPath:(NSString *)readPath
+                              hitCounts:(NSData *)hitCounts
+                               document:(CoverStoryDocument *)document
+                        messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver;
+- (id)initWithSourcePath:(NSString *)sourcePath
+                readPath:(NSString *)readPath
+               hitCounts:(NSData *)hitCounts
+                document:(CoverStoryDocument *)document
+         messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver;
+// Designated initializer.  |lineRanges| index into |text|, and there must be
+// one int64_t in |hitCounts| per range.
+- (id)initWithSourcePath:(NSString *)sourcePath
+                    text:(NSData *)text
+              lineRanges:(NSData *)lineRanges
+               hitCounts:(NSData *)hitCounts
+ applyNonFeasibleMarkers:(BOOL)applyMarkers
+                document:(CoverStoryDocument *)document;
+
+// Direct access to the columns.
+- (NSData *)textData;
+- (NSData *)lineRangeData;  // of CoverStoryLineRange
+// |sourcePath| as a C string, made once so filtering doesn't convert it.
+- (const char *)sourcePathUTF8String;
+- (const int64_t *)hitCounts;
+// The counts and the coverage percentage as of the last change to the hit
+// counts, nothing is recounted or boxed to get them.
+- (CoverStoryLineCounts)lineCounts;
+- (float)coverageSortKey;
+- (NSInteger)hitCountForLineAtIndex:(NSUInteger)index;
+- (const char *)lineBytesAtIndex:(NSUInteger)index length:(NSUInteger *)outLength;
+- (NSString *)lineAtIndex:(NSUInteger)index;
+- (void)addHits:(NSInteger)newHits toLineAtIndex:(NSUInteger)index;
+// The runs of missed lines, made when first asked for and again after the hit
+// counts change.
+- (CoverStoryMissIndex *)missIndex;
 
 - (BOOL)addFileData:(CoverStoryCoverageFileData *)fileData messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver;
 - (NSArray *)queuedWarnings;
+// For data that was read w/o applying the markers (ie - from a cache), puts
+// back the warnings that applying them produced.
+- (void)queueWarnings:(NSArray *)warnings;
 
 @end
 
 
+#if !COVERSTORY_HEADLESS
 @interface CoverStoryCoverageFileData (ScriptingMethods)
 - (NSScriptObjectSpecifier *)objectSpecifierForLineData:(CoverStoryCoverageLineData *)data;
 @end
+#endif
@@ -8,8 +8,232 @@
 
 #import "CoverStoryCoverageFileData.h"
 #import "CoverStoryCoverageLineData.h"
+#import "CoverStoryMissIndex.h"
+#if !COVERSTORY_HEADLESS
 #import "CoverStoryDocument.h"
-#import "GTMRegex.h"
+#endif
+
+// Bits returned by CSGCovNonFeasibleMarkers()
+enum {
+    kCSNonFeasibleLine       = 1 << 0,  // COV_NF_LINE
+    kCSNonFeasibleRangeStart = 1 << 1,  // COV_NF_START
+    kCSNonFeasibleRangeEnd   = 1 << 2,  // COV_NF_END
+};
+
+// Text gcov uses for lines past the end of the source file.
+static const char kCSGCovEOFLine[] = "/*EOF*/";
+
+// Walks the bytes of a .gcov file a line at a time.
+typedef struct {
+    const char *cursor;
+    const char *end;
+    const char *nextLF;  // cached location of the next '\n' (or end)
+} CSGCovLineScanner;
+
+// One line of a .gcov file, the text points back into the scanned bytes.
+typedef struct {
+    NSInteger hitCount;
+    const char *text;
+    size_t textLength;
+} CSGCovLine;
+
+// gcov just copies the source bytes through, so these are almost always UTF-8
+// or MacRoman (math.h in the system headers is MacRoman), both of which are
+// handled a line at a time when the text is decoded.  The odd UTF-16 file
+// (they have a BOM) gets transcoded to UTF-8 up front so the scanner only
+// ever has to deal w/ 8 bit data.
+static NSData *CSGCovScannableContents(NSData *contents)
+{
+    if ([contents length] >= 2)
+    {
+        const unsigned char *bytes = [contents bytes];
+        if (((bytes[0] == 0xFE) && (bytes[1] == 0xFF)) ||
+            ((bytes[0] == 0xFF) && (bytes[1] == 0xFE)))
+        {
+            NSString *string = [[NSString alloc] initWithData:contents
+                                                     encoding:NSUnicodeStringEncoding];
+            contents = [string dataUsingEncoding:NSUTF8StringEncoding];
+        }
+    }
+    return contents;
+}
+
+// Loads the raw bytes of a .gcov file.  The file is mapped rather than copied
+// when possible.
+static NSData *CSGCovFileContents(NSString *path, NSError **outError)
+{
+    return [NSData dataWithContentsOfFile:path
+                                  options:NSDataReadingMappedIfSafe
+                                    error:outError];
+}
+
+static void CSGCovLineScannerInit(CSGCovLineScanner *scanner, NSData *contents)
+{
+    scanner->cursor = [contents bytes];
+    scanner->end    = scanner->cursor + [contents length];
+    scanner->nextLF = NULL;
+    // skip a UTF-8 BOM
+    if (((scanner->end - scanner->cursor) >= 3) && (memcmp(scanner->cursor, "\xEF\xBB\xBF", 3) == 0))
+    {
+        scanner->cursor += 3;
+    }
+}
+
+// Matches what -[NSString intValue] did for us: leading whitespace, an
+// optional sign, then digits.
+static NSInteger CSGCovParseInteger(const char *start, const char *end)
+{
+    while ((start < end) && ((*start == ' ') || (*start == '\t')))
+    {
+        ++start;
+    }
+    BOOL negative = NO;
+    if ((start < end) && ((*start == '-') || (*start == '+')))
+    {
+        negative = (*start == '-');
+        ++start;
+    }
+    NSInteger value = 0;
+    while ((start < end) && (*start >= '0') && (*start <= '9'))
+    {
+        value = (value * 10) + (*start - '0');
+        ++start;
+    }
+    return negative ? -value : value;
+}
+
+// Splits out the next "hitcount:linenumber:text" line.  Lines can end in CR,
+// LF or CRLF (and the last one might not have an end at all).
+static BOOL CSGCovLineScannerNext(CSGCovLineScanner *scanner, CSGCovLine *outLine)
+{
+    const char *start = scanner->cursor;
+    const char *end   = scanner->end;
+    if (start >= end)
+    {
+        return NO;
+    }
+    
+    // Find the end of the line.  memchr for the LF is remembered so a file
+    // of nothing but CRs doesn't rescan to the end of the file for each line.
+    if (!scanner->nextLF || (scanner->nextLF < start))
+    {
+        scanner->nextLF = memchr(start, '\n', end - start);
+        if (!scanner->nextLF)
+        {
+            scanner->nextLF = end;
+        }
+    }
+    const char *lineEnd = scanner->nextLF;
+    const char *cr      = memchr(start, '\r', lineEnd - start);
+    if (cr)
+    {
+        lineEnd = cr;
+    }
+    
+    // hit count
+    const char *colon = memchr(start, ':', lineEnd - start);
+    const char *hitEnd = colon ? colon : lineEnd;
+    NSInteger hitCount = 0;
+    if (hitEnd > start)
+    {
+        hitCount = CSGCovParseInteger(start, hitEnd);
+        if ((hitCount == 0) && (*(hitEnd - 1) != '#'))
+        {
+            hitCount = kCoverStoryNotExecutedMarker;
+        }
+    }
+    
+    // skip the line number to get to the code line
+    const char *text = lineEnd;
+    if (colon)
+    {
+        const char *lineNumberEnd = memchr(colon + 1, ':', lineEnd - (colon + 1));
+        if (lineNumberEnd)
+        {
+            text = lineNumberEnd + 1;
+        }
+    }
+    outLine->hitCount   = hitCount;
+    outLine->text       = text;
+    outLine->textLength = lineEnd - text;
+    
+    // skip over the end of line marker (CR, LF, CRLF), and it's possible
+    // on the end of the file that there is none of them.
+    while ((lineEnd < end) && ((*lineEnd == '\r') || (*lineEnd == '\n')))
+    {
+        ++lineEnd;
+    }
+    scanner->cursor = lineEnd;
+    return YES;
+}
+
+// Splits the source into lines (on '\n', dropping a '\r' before it).
+static NSData *CSSourceLineRanges(NSData *source)
+{
+    NSMutableData *ranges = [NSMutableData data];
+    const char *start     = [source bytes];
+    const char *end       = start + [source length];
+    const char *cursor    = start;
+    while (cursor < end)
+    {
+        const char *lf      = memchr(cursor, '\n', end - cursor);
+        const char *lineEnd = lf ? lf : end;
+        const char *textEnd = lineEnd;
+        if ((textEnd > cursor) && (textEnd[-1] == '\r'))
+        {
+            --textEnd;
+        }
+        CoverStoryLineRange range = { (uint32_t)(cursor - start), (uint32_t)(textEnd - cursor) };
+        [ranges appendBytes:&range length:sizeof(range)];
+        cursor = lf ? lf + 1 : end;
+    }
+    return ranges;
+}
+
+// Looks for "//[[:blank:]]*COV_NF_(LINE|START|END)" in a line of source.
+// Most lines don't have a comment at all, so the memchr for a '/' gets us out
+// quickly, and we only compare the marker text once we've found a "//".
+static unsigned CSGCovNonFeasibleMarkers(const char *text, size_t length)
+{
+    static const char kMarkerPrefix[] = "COV_NF_";
+    const size_t kMarkerPrefixLength  = sizeof(kMarkerPrefix) - 1;
+    unsigned markers  = 0;
+    const char *end   = text + length;
+    const char *slash = text;
+    while ((slash = memchr(slash, '/', end - slash)) && (slash + 1 < end))
+    {
+        if (slash[1] != '/')
+        {
+            ++slash;
+            continue;
+        }
+        const char *marker = slash + 2;
+        while ((marker < end) && ((*marker == ' ') || (*marker == '\t')))
+        {
+            ++marker;
+        }
+        size_t remaining = end - marker;
+        if ((remaining > kMarkerPrefixLength) && (memcmp(marker, kMarkerPrefix, kMarkerPrefixLength) == 0))
+        {
+            marker    += kMarkerPrefixLength;
+            remaining -= kMarkerPrefixLength;
+            if ((remaining >= 4) && (memcmp(marker, "LINE", 4) == 0))
+            {
+                markers |= kCSNonFeasibleLine;
+            }
+            else if ((remaining >= 5) && (memcmp(marker, "START", 5) == 0))
+            {
+                markers |= kCSNonFeasibleRangeStart;
+            }
+            else if ((remaining >= 3) && (memcmp(marker, "END", 3) == 0))
+            {
+                markers |= kCSNonFeasibleRangeEnd;
+            }
+        }
+        ++slash;
+    }
+    return markers;
+}
 
 @interface CoverStoryCoverageFileData ()
 
@@ -17,6 +241,48 @@
 @property (readwrite, nonatomic, assign) NSInteger codeLines;
 @property (readwrite, nonatomic, assign) NSInteger nonfeasible;
 
+- (void)applyNonFeasibleMarkers;
+- (void)updateCounts;
+
+@end
+
+// Vends the lines of a CoverStoryCoverageFileData as an array, but only makes
+// the CoverStoryCoverageLineData objects as they are asked for (the table
+// view and scripting want objects, nothing else does).
+@interface CoverStoryCoverageFileLines : NSArray {
+@private
+    CoverStoryCoverageFileData *_fileData;
+}
+- (id)initWithFileData:(CoverStoryCoverageFileData *)fileData;
+@end
+
+@implementation CoverStoryCoverageFileLines
+
+- (id)initWithFileData:(CoverStoryCoverageFileData *)fileData
+{
+    if ((self = [super init]))
+    {
+        _fileData = fileData;
+    }
+    return self;
+}
+
+- (NSUInteger)count
+{
+    return [_fileData lineCount];
+}
+
+- (id)objectAtIndex:(NSUInteger)index
+{
+    if (index >= [_fileData lineCount])
+    {
+        [NSException raise:NSRangeException
+                    format:@"index %lu beyond bounds [0 .. %lu]",
+                           (unsigned long)index, (unsigned long)[_fileData lineCount]];
+    }
+    return [CoverStoryCoverageLineData newCoverageLineDataWithIndex:index coverageFile:_fileData];
+}
+
 @end
 
 @implementation CoverStoryCoverageFileData
@@ -26,12 +292,172 @@
     return [[self alloc] initWithPath:path document:document messageReceiver:receiver];
 }
 
++ (id)newCoverageFileDataFromGCovData:(NSData *)contents path:(NSString *)path document:(CoverStoryDocument *)document messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver
+{
+    return [[self alloc] initWithGCovData:contents path:path document:document messageReceiver:receiver];
+}
+
++ (id)newCoverageFileDataWithSourcePath:(NSString *)sourcePath
+                               readPath:(NSString *)readPath
+                              hitCounts:(NSData *)hitCounts
+                               document:(CoverStoryDocument *)document
+                        messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver
+{
+    return [[self alloc] initWithSourcePath:sourcePath
+                                   readPath:readPath
+                                  hitCounts:hitCounts
+                                   document:document
+                            messageReceiver:receiver];
+}
+
+- (id)initWithSourcePath:(NSString *)sourcePath
+                readPath:(NSString *)readPath
+               hitCounts:(NSData *)hitCounts
+                document:(CoverStoryDocument *)document
+         messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver
+{
+    NSData *source = [NSData dataWithContentsOfFile:readPath];
+    if (!source)
+    {
+        [receiver coverageErrorForPath:sourcePath message:@"cannot open source file"];
+        source = [NSData data];
+    }
+    NSData *sourceRanges   = CSSourceLineRanges(source);
+    NSUInteger sourceLines = [sourceRanges length] / sizeof(CoverStoryLineRange);
+    NSUInteger countLines  = [hitCounts length] / sizeof(int64_t);
+    // every line of the file, and then any counted lines past the end of it
+    NSUInteger lineCount   = MAX(sourceLines, countLines);
+    NSData *text           = source;
+    NSMutableData *ranges  = [NSMutableData dataWithData:sourceRanges];
+    if (lineCount > sourceLines)
+    {
+        NSMutableData *withEOF  = [NSMutableData dataWithData:source];
+        CoverStoryLineRange eof = { (uint32_t)[withEOF length], (uint32_t)strlen(kCSGCovEOFLine) };
+        [withEOF appendBytes:kCSGCovEOFLine length:eof.length];
+        for (NSUInteger x = sourceLines; x < lineCount; ++x)
+        {
+            [ranges appendBytes:&eof length:sizeof(eof)];
+        }
+        text = withEOF;
+    }
+    if ([text length] > UINT32_MAX)
+    {
+        return nil;
+    }
+    NSMutableData *lineHits = [NSMutableData dataWithLength:lineCount * sizeof(int64_t)];
+    int64_t *hits           = [lineHits mutableBytes];
+    const int64_t *counted  = [hitCounts bytes];
+    for (NSUInteger x = 0; x < lineCount; ++x)
+    {
+        hits[x] = (x < countLines) ? counted[x] : kCoverStoryNotExecutedMarker;
+    }
+    return [self initWithSourcePath:[sourcePath stringByStandardizingPath]
+                               text:text
+                         lineRanges:ranges
+                          hitCounts:lineHits
+            applyNonFeasibleMarkers:YES
+                           document:document];
+}
+
 - (id)initWithPath:(NSString *)path document:(CoverStoryDocument *)document messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver
+{
+    NSError *error = nil;
+    NSData *contents = CSGCovFileContents(path, &error);
+    if (!contents)
+    {
+        [receiver coverageErrorForPath:path message:@"failed to open file %@", error];
+        return nil;
+    }
+    return [self initWithGCovData:contents path:path document:document messageReceiver:receiver];
+}
+
+- (id)initWithGCovData:(NSData *)contents path:(NSString *)path document:(CoverStoryDocument *)document messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver
+{
+    // Scan in our data and split it into the line columns.
+    // TODO(dmaclach): make this routine a little more "error tolerant"
+    contents          = CSGCovScannableContents(contents);
+    NSUInteger length = [contents length];
+    if (length > UINT32_MAX)
+    {
+        [receiver coverageErrorForPath:path message:@"file is too large"];
+        return nil;
+    }
+    
+    // Walk the raw bytes once.  Only the source text of each line is copied
+    // (into one buffer for the whole file), it isn't turned into an NSString
+    // until someone actually asks for the line.
+    char *text                   = malloc(MAX(length, (NSUInteger)1));
+    uint32_t textUsed            = 0;
+    NSMutableData *lineRanges    = [NSMutableData dataWithCapacity:(length / 32) * sizeof(CoverStoryLineRange)];
+    NSMutableData *hitCounts     = [NSMutableData dataWithCapacity:(length / 32) * sizeof(int64_t)];
+    NSString *sourcePath         = nil;
+    NSUInteger headerLines       = 0;
+    CSGCovLineScanner scanner;
+    CSGCovLine gcovLine;
+    CSGCovLineScannerInit(&scanner, contents);
+    while (CSGCovLineScannerNext(&scanner, &gcovLine))
+    {
+        // The first five lines are not data we want to show to the user
+        if (headerLines < 5)
+        {
+            if (headerLines == 0)
+            {
+                // The first line contains the path to our source.
+                sourcePath = coverageLineString(gcovLine.text, gcovLine.textLength);
+            }
+            ++headerLines;
+            continue;
+        }
+        CoverStoryLineRange range = { textUsed, (uint32_t)gcovLine.textLength };
+        memcpy(text + textUsed, gcovLine.text, gcovLine.textLength);
+        textUsed += gcovLine.textLength;
+        int64_t hitCount = gcovLine.hitCount;
+        [lineRanges appendBytes:&range length:sizeof(range)];
+        [hitCounts appendBytes:&hitCount length:sizeof(hitCount)];
+    }
+    
+    if (([hitCounts length] == 0) || ([sourcePath length] < 7))
+    {
+        free(text);
+        [receiver coverageErrorForPath:path message:@"illegal file format"];
+        // something bad
+        return nil;
+    }
+    
+    // Give back what the hit count columns took up.
+    text = reallocf(text, MAX(textUsed, (uint32_t)1));
+    NSData *textData = [NSData dataWithBytesNoCopy:text length:textUsed freeWhenDone:YES];
+    
+    // Most projects use paths relative to the project, so just incase they walk
+    // into a neighbor directory, resolve them.
+    sourcePath = [[sourcePath substringFromIndex:7] stringByStandardizingPath];
+    return [self initWithSourcePath:sourcePath
+                               text:textData
+                         lineRanges:lineRanges
+                          hitCounts:hitCounts
+            applyNonFeasibleMarkers:YES
+                           document:document];
+}
+
+- (id)initWithSourcePath:(NSString *)sourcePath
+                    text:(NSData *)text
+              lineRanges:(NSData *)lineRanges
+               hitCounts:(NSData *)hitCounts
+ applyNonFeasibleMarkers:(BOOL)applyMarkers
+                document:(CoverStoryDocument *)document
 {
     if ((self = [super init]))
     {
-        _document = document;
-        _lines    = [[NSMutableArray alloc] init];
+        NSAssert([lineRanges length] / sizeof(CoverStoryLineRange) == [hitCounts length] / sizeof(int64_t),
+                 @"Need a hit count for every line");
+        _document   = document;
+        _sourcePath = [sourcePath copy];
+        _text       = text;
+        _lineRanges = lineRanges;
+        _hitCounts  = [hitCounts mutableCopy];
+        _lineCount  = [hitCounts length] / sizeof(int64_t);
+        const char *utf8Path = [_sourcePath UTF8String] ?: "";
+        _sourcePathUTF8      = [NSData dataWithBytes:utf8Path length:strlen(utf8Path) + 1];
         // The dirty secret: we queue up warnings and don't report them in realtime.
         // Why?  if we report them now, then if the directory with multiple arches
         // we'll send the warning for each arch, and if the file occures in more
@@ -40,156 +466,88 @@
         // send them over to the receiver until it's added to a set, and only if
         // it's new, this way we're sure we only send them once.
         _warnings = [[NSMutableArray alloc] init];
-        
-        // Scan in our data and create up out CoverStoryCoverageLineData objects.
-        // TODO(dmaclach): make this routine a little more "error tolerant"
-        
-        // Let NSString try to handle the encoding when opening
-        NSStringEncoding encoding;
-        NSError *error = nil;
-        NSString *string = [NSString stringWithContentsOfFile:path usedEncoding:&encoding error:&error];
-        
-        if (!string)
+        if (applyMarkers)
         {
-            // Sadly, NSString doesn't detect/handle NSMacOSRomanStringEncoding very
-            // well, so we have to manually try Roman.  math.h in the system headers
-            // is in MacRoman easily causes us errors w/o this extra code.
-            // (we don't care about the error here, we'll just report the parent
-            // error)
-            string = [NSString stringWithContentsOfFile:path
-                                               encoding:NSMacOSRomanStringEncoding
-                                                  error:NULL];
+            [self applyNonFeasibleMarkers];
         }
-        if (!string)
+        // get out counts
+        [self updateCounts];
+    }
+    return self;
+}
+
+- (void)applyNonFeasibleMarkers
+{
+    const CoverStoryLineRange *ranges = [_lineRanges bytes];
+    const char *text                  = [_text bytes];
+    int64_t *hitCounts                = [_hitCounts mutableBytes];
+    BOOL inNonFeasibleRange           = NO;
+    for (NSUInteger x = 0; x < _lineCount; ++x)
+    {
+        int64_t hitCount = hitCounts[x];
+        unsigned markers = CSGCovNonFeasibleMarkers(text + ranges[x].offset, ranges[x].length);
+        if (!markers && !inNonFeasibleRange)
         {
-            [receiver coverageErrorForPath:path message:@"failed to open file %@", error];
-            self = nil;
+            continue;
+        }
+        // handle the non feasible markers
+        if (inNonFeasibleRange)
+        {
+            if (hitCount > 0)
+            {
+                NSString *warning = [NSString stringWithFormat:@"Line %lu is in a Non Feasible block, but was executed.", (unsigned long)x + 1];
+                [_warnings addObject:warning];
+            }
+            
+            // if the line was gonna count, mark it as non feasible (we only mark
+            // the lines that would have counted so the total number of non
+            // feasible lines isn't too high (otherwise comment lines, blank
+            // lines, etc. count as non feasible).
+            if (hitCount != kCoverStoryNotExecutedMarker)
+            {
+                hitCount = kCoverStoryNonFeasibleMarker;
+            }
+            // if it has the end marker, clear our state
+            if (markers & kCSNonFeasibleRangeEnd)
+            {
+                inNonFeasibleRange = NO;
+            }
         }
         else
         {
-            NSCharacterSet *linefeeds   = [NSCharacterSet newlineCharacterSet];
-            GTMRegex *nfLineRegex       = [GTMRegex regexWithPattern:@"//[[:blank:]]*COV_NF_LINE"];
-            GTMRegex *nfRangeStartRegex = [GTMRegex regexWithPattern:@"//[[:blank:]]*COV_NF_START"];
-            GTMRegex *nfRangeEndRegex   = [GTMRegex regexWithPattern:@"//[[:blank:]]*COV_NF_END"];
-            BOOL inNonFeasibleRange     = NO;
-            NSScanner *scanner          = [NSScanner scannerWithString:string];
-            [scanner setCharactersToBeSkipped:nil];
-            while (![scanner isAtEnd])
+            // if it matches the line marker, don't count it
+            if (markers & kCSNonFeasibleLine)
             {
-                NSString *segment;
-                // scan in hit count
-                BOOL goodScan = [scanner scanUpToString:@":" intoString:&segment];
-                [scanner setScanLocation:[scanner scanLocation] + 1];
-                NSInteger hitCount = 0;
-                if (goodScan)
-                {
-                    hitCount = [segment intValue];
-                    if (hitCount == 0)
-                    {
-                        if ([segment characterAtIndex:[segment length] - 1] != '#')
-                        {
-                            hitCount = kCoverStoryNotExecutedMarker;
-                        }
-                    }
-                }
-                // scan in line number
-                goodScan = [scanner scanUpToString:@":" intoString:&segment];
-                if (goodScan)
+                if (hitCount > 0)
                 {
-                    [scanner setScanLocation:[scanner scanLocation] + 1];
-                    // scan in the code line
-                    goodScan = [scanner scanUpToCharactersFromSet:linefeeds  intoString:&segment];
+                    NSString *warning = [NSString stringWithFormat:@"Line %lu is marked as a Non Feasible line, but was executed.", (unsigned long)x + 1];
+                    [_warnings addObject:warning];
                 }
-                if (!goodScan)
-                {
-                    segment = @"";
-                }
-                // skip over the end of line marker (CR, LF, CRLF), and it's possible
-                // on the end of the file that there is none of them.
-                [scanner scanCharactersFromSet:linefeeds intoString:NULL];
-                // handle the non feasible markers
-                if (inNonFeasibleRange)
+                hitCount = kCoverStoryNonFeasibleMarker;
+            }
+            // if it matches the start marker, don't count it and set state
+            else if (markers & kCSNonFeasibleRangeStart)
+            {
+                if (hitCount > 0)
                 {
-                    if (hitCount > 0)
-                    {
-                        NSString *warning = [NSString stringWithFormat:@"Line %lu is in a Non Feasible block, but was executed.", (unsigned long)[_lines count] - 4];
-                        [_warnings addObject:warning];
-                    }
-                    
-                    // if the line was gonna count, mark it as non feasible (we only mark
-                    // the lines that would have counted so the total number of non
-                    // feasible lines isn't too high (otherwise comment lines, blank
-                    // lines, etc. count as non feasible).
-                    if (hitCount != kCoverStoryNotExecutedMarker)
-                    {
-                        hitCount = kCoverStoryNonFeasibleMarker;
-                    }
-                    // if it has the end marker, clear our state
-                    if ([nfRangeEndRegex matchesSubStringInString:segment])
-                    {
-                        inNonFeasibleRange = NO;
-                    }
+                    NSString *warning = [NSString stringWithFormat:@"Line %lu is in a Non Feasible block, but was executed.", (unsigned long)x + 1];
+                    [_warnings addObject:warning];
                 }
-                else
+                // if the line was gonna count, mark it as non feasible (we only mark
+                // the lines that would have counted so the total number of non
+                // feasible lines isn't too high (otherwise comment lines, blank
+                // lines, etc. count as non feasible).
+                if (hitCount != kCoverStoryNotExecutedMarker)
                 {
-                    // if it matches the line marker, don't count it
-                    if ([nfLineRegex matchesSubStringInString:segment])
-                    {
-                        if (hitCount > 0)
-                        {
-                            NSString *warning = [NSString stringWithFormat:@"Line %lu is marked as a Non Feasible line, but was executed.", (unsigned long)[_lines count] - 4];
-                            [_warnings addObject:warning];
-                        }
-                        hitCount = kCoverStoryNonFeasibleMarker;
-                    }
-                    // if it matches the start marker, don't count it and set state
-                    else if ([nfRangeStartRegex matchesSubStringInString:segment])
-                    {
-                        if (hitCount > 0)
-                        {
-                            NSString *warning = [NSString stringWithFormat:@"Line %lu is in a Non Feasible block, but was executed.", (unsigned long)[_lines count] - 4];
-                            [_warnings addObject:warning];
-                        }
-                        // if the line was gonna count, mark it as non feasible (we only mark
-                        // the lines that would have counted so the total number of non
-                        // feasible lines isn't too high (otherwise comment lines, blank
-                        // lines, etc. count as non feasible).
-                        if (hitCount != kCoverStoryNotExecutedMarker)
-                        {
-                            hitCount = kCoverStoryNonFeasibleMarker;
-                        }
-                        inNonFeasibleRange = YES;
-                    }
+                    hitCount = kCoverStoryNonFeasibleMarker;
                 }
-                [_lines addObject:[CoverStoryCoverageLineData newCoverageLineDataWithLine:segment hitCount:hitCount coverageFile:self]];
-            }
-            
-            // The first five lines are not data we want to show to the user
-            if ([_lines count] > 5)
-            {
-                // The first line contains the path to our source.  Most projects use
-                // paths relative to the project, so just incase they walk into a
-                // neighbor directory, resolve them.
-                NSString *srcPath = [[[_lines objectAtIndex:0] line] substringFromIndex:7];
-                _sourcePath = [srcPath stringByStandardizingPath];
-                [_lines removeObjectsInRange:NSMakeRange(0, 5)];
-                // get out counts
-                [self updateCounts];
-            }
-            else
-            {
-                [receiver coverageErrorForPath:path message:@"illegal file format"];
-                
-                // something bad
-                self = nil;
+                inNonFeasibleRange = YES;
             }
         }
+        hitCounts[x] = hitCount;
     }
-    
-    return self;
 }
 
-
 - (BOOL)isEqual:(id)object
 {
     BOOL equal = NO;
@@ -205,15 +563,86 @@
     return [_sourcePath hash];
 }
 
+- (NSArray *)lines
+{
+    return [[CoverStoryCoverageFileLines alloc] initWithFileData:self];
+}
+
+- (NSData *)textData
+{
+    return _text;
+}
+
+- (NSData *)lineRangeData
+{
+    return _lineRanges;
+}
+
+- (const char *)sourcePathUTF8String
+{
+    return [_sourcePathUTF8 bytes];
+}
+
+- (const int64_t *)hitCounts
+{
+    return [_hitCounts bytes];
+}
+
+- (NSInteger)hitCountForLineAtIndex:(NSUInteger)index
+{
+    NSParameterAssert(index < _lineCount);
+    return (NSInteger)((const int64_t *)[_hitCounts bytes])[index];
+}
+
+- (const char *)lineBytesAtIndex:(NSUInteger)index length:(NSUInteger *)outLength
+{
+    NSParameterAssert(index < _lineCount);
+    CoverStoryLineRange range = ((const CoverStoryLineRange *)[_lineRanges bytes])[index];
+    if (outLength)
+    {
+        *outLength = range.length;
+    }
+    return (const char *)[_text bytes] + range.offset;
+}
+
+- (NSString *)lineAtIndex:(NSUInteger)index
+{
+    NSUInteger length = 0;
+    const char *bytes = [self lineBytesAtIndex:index length:&length];
+    return coverageLineString(bytes, length);
+}
+
+- (void)addHits:(NSInteger)newHits toLineAtIndex:(NSUInteger)index
+{
+    NSParameterAssert(index < _lineCount);
+    int64_t *hitCounts = [_hitCounts mutableBytes];
+    NSAssert2((newHits <= 0) || (hitCounts[index] >= kCoverStoryNotExecutedMarker),
+              @"how was it not feasible in only one version? (hitCount = %lld, line %lu)",
+              (long long)hitCounts[index], (unsigned long)index);
+    hitCounts[index] = coverageMergeHitCounts(hitCounts[index], newHits);
+    [self updateCounts];
+}
+
+// KVC accessors for "lines" so scripting doesn't need the whole array.
+- (NSUInteger)countOfLines
+{
+    return _lineCount;
+}
+
+- (CoverStoryCoverageLineData *)objectInLinesAtIndex:(NSUInteger)index
+{
+    return [CoverStoryCoverageLineData newCoverageLineDataWithIndex:index coverageFile:self];
+}
+
 - (void)updateCounts
 {
-    NSInteger hitLines    = 0;
-    NSInteger codeLines   = 0;
-    NSInteger nonfeasible = 0;
-    for (CoverStoryCoverageLineData *dataPoint in _lines)
+    NSInteger hitLines         = 0;
+    NSInteger codeLines        = 0;
+    NSInteger nonfeasible      = 0;
+    const int64_t *hitCounts   = [_hitCounts bytes];
+    for (NSUInteger x = 0; x < _lineCount; ++x)
     {
-        NSInteger hitCount = [dataPoint hitCount];
-        switch (hitCount) {
+        switch (hitCounts[x]) {
             case kCoverStoryNonFeasibleMarker:
                 ++nonfeasible;
                 break;
@@ -234,6 +663,18 @@
     [self setCodeLines:codeLines];
     [self setHitLines:hitLines];
     [self setNonfeasible:nonfeasible];
+    _coverageSortKey = codeCoverage(codeLines, hitLines, NULL);
+    _coverage        = nil;
+    _missIndex       = nil;
+}
+
+- (CoverStoryMissIndex *)missIndex
+{
+    if (!_missIndex)
+    {
+        _missIndex = [[CoverStoryMissIndex alloc] initWithHitCounts:[_hitCounts bytes] lineCount:_lineCount];
+    }
+    return _missIndex;
 }
 
 - (NSArray *)queuedWarnings
@@ -241,16 +682,29 @@
     return _warnings;
 }
 
+- (void)queueWarnings:(NSArray *)warnings
+{
+    [_warnings addObjectsFromArray:warnings];
+}
+
 - (NSNumber *)coverage
 {
-    float result = 0.0f;
-    [self coverageTotalLines:NULL
-                   codeLines:NULL
-                hitCodeLines:NULL
-            nonFeasibleLines:NULL
-              coverageString:NULL
-                    coverage:&result];
-    return @(result);
+    if (!_coverage)
+    {
+        _coverage = @(_coverageSortKey);
+    }
+    return _coverage;
+}
+
+- (float)coverageSortKey
+{
+    return _coverageSortKey;
+}
+
+- (CoverStoryLineCounts)lineCounts
+{
+    CoverStoryLineCounts counts = { (NSInteger)_lineCount, _codeLines, _hitLines, _nonfeasible };
+    return counts;
 }
 
 - (void)coverageTotalLines:(NSInteger *)outTotal
@@ -262,7 +716,7 @@
 {
     if (outTotal)
     {
-        *outTotal = [_lines count];
+        *outTotal = _lineCount;
     }
     if (outCode)
     {
@@ -276,13 +730,13 @@
     {
         *outNonFeasible = [self nonfeasible];
     }
-    if (outCoverageString || outCoverage)
+    if (outCoverageString)
     {
-        float coverage = codeCoverage(_codeLines, _hitLines, outCoverageString);
-        if (outCoverage)
-        {
-            *outCoverage = coverage;
-        }
+        codeCoverage(_codeLines, _hitLines, outCoverageString);
+    }
+    if (outCoverage)
+    {
+        *outCoverage = _coverageSortKey;
     }
 }
 
@@ -301,31 +755,33 @@
     }
     
     // make sure the source file lines actually match
-    NSArray *newLines = [fileData lines];
-    if ([newLines count] != [_lines count])
+    NSUInteger newLineCount = [fileData lineCount];
+    if (newLineCount != _lineCount)
     {
         if (receiver)
         {
             [receiver coverageErrorForPath:_sourcePath message:@"coverage source (%@) has different line count '%lu' vs '%lu'",
              [fileData sourcePath],
-             (unsigned long)[newLines count],
-             (unsigned long)[_lines count]];
+             (unsigned long)newLineCount,
+             (unsigned long)_lineCount];
         }
         return NO;
     }
-    for (NSUInteger x = 0, max = [newLines count]; x < max; ++x )
+    for (NSUInteger x = 0; x < newLineCount; ++x )
     {
-        CoverStoryCoverageLineData *lineNew = [newLines objectAtIndex:x];
-        CoverStoryCoverageLineData *lineMe  = [_lines objectAtIndex:x];
+        NSUInteger newLength = 0;
+        NSUInteger myLength  = 0;
+        const char *lineNew  = [fileData lineBytesAtIndex:x length:&newLength];
+        const char *lineMe   = [self lineBytesAtIndex:x length:&myLength];
         
-        // string match the lines (since the Non Feasible support is via comments,
+        // byte match the lines (since the Non Feasible support is via comments,
         // this makes sure they also match)
-        if (![[lineNew line] isEqual:[lineMe line]])
+        if ((newLength != myLength) || (memcmp(lineNew, lineMe, myLength) != 0))
         {
             if (receiver)
             {
                 [receiver coverageErrorForPath:_sourcePath message:@"coverage source (%@) line %lu doesn't match, '%@' vs '%@'",
-                 [fileData sourcePath], (unsigned long)x, [lineNew line], [lineMe line]];
+                 [fileData sourcePath], (unsigned long)x, [fileData lineAtIndex:x], [self lineAtIndex:x]];
             }
             return NO;
         }
@@ -335,11 +791,11 @@
     }
     
     // spin though once more summing the counts
-    for (NSUInteger x = 0, max = [newLines count]; x < max; ++x )
+    const int64_t *newHits = [fileData hitCounts];
+    int64_t *myHits        = [_hitCounts mutableBytes];
+    for (NSUInteger x = 0; x < newLineCount; ++x )
     {
-        CoverStoryCoverageLineData *lineNew = [newLines objectAtIndex:x];
-        CoverStoryCoverageLineData *lineMe  = [_lines objectAtIndex:x];
-        [lineMe addHits:[lineNew hitCount]];
+        myHits[x] = coverageMergeHitCounts(myHits[x], newHits[x]);
     }
     
     // then add the number
@@ -350,7 +806,7 @@
 - (NSString *)description
 {
     return [NSString stringWithFormat:@"%@: %lu total lines, %ld lines non-feasible, %ld lines of code, %ld lines hit",
-                                        _sourcePath, (unsigned long)[_lines count],
+                                        _sourcePath, (unsigned long)_lineCount,
                                         (long)_nonfeasible, (long)_codeLines, (long)_hitLines];
 }
 
@@ -358,6 +814,8 @@
 @end
 
 
+#if !COVERSTORY_HEADLESS
+
 @implementation CoverStoryCoverageFileData (ScriptingMethods)
 
 - (NSScriptObjectSpecifier *)objectSpecifier
@@ -375,7 +833,11 @@
 {
     NSScriptObjectSpecifier *containerSpec = [self objectSpecifier];
     NSScriptClassDescription *containterClassDesc = [containerSpec keyClassDescription];
-    NSInteger index = [[self lines] indexOfObject:data];
+    NSUInteger index = [data lineIndex];
+    if (index == NSNotFound)
+    {
+        index = [[self lines] indexOfObject:data];
+    }
     return [[NSIndexSpecifier alloc] initWithContainerClassDescription:containterClassDesc
                                                     containerSpecifier:containerSpec
                                                                    key:@"lines"
@@ -383,3 +845,5 @@
 }
 
 @end
+
+#endif  // !COVERSTORY_HEADLESS
@@ -0,0 +1,63 @@
+//
+//  CoverStoryCoverageImporter.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// Reads coverage that other tools wrote into CoverStoryCoverageFileData: lcov
+// tracefiles (.info) and llvm-cov export JSON (clang's source based coverage,
+// from `llvm-cov export -format=text`).
+//
+// The file is read a piece at a time and split into one record per source (an
+// lcov "SF:" ... "end_of_record" block, or one entry of llvm-cov's "files"),
+// and the records are parsed on a queue of workers.  Reading stops while
+// |maxRecordsInFlight| records are waiting or being parsed, so the memory used
+// is bounded by that many records, not by the size of the file.  Each source
+// is read by the worker that parses its record (so nothing is read for records
+// that haven't come up yet), and the COV_NF_ markers are applied as for gcov.
+//
+// A source that shows up in more than one record (lcov writes one per test
+// name) comes out once per record, they (and gcov's for the same source) are
+// merged w/ addFileData: like any other.
+
+#import <Foundation/Foundation.h>
+#import "CoverStoryProtocols.h"
+
+@class CoverStoryDocument;
+@class CoverStoryCoverageFileData;
+
+typedef NS_ENUM(NSInteger, CoverStoryImportFormat)
+{
+    kCoverStoryImportFormatNone = 0,  // not one we read
+    kCoverStoryImportFormatLCov,
+    kCoverStoryImportFormatLLVMCov
+};
+
+// Called on a worker for each record, safe to call from more than one at a
+// time.
+typedef void (^CoverStoryCoverageImportHandler)(CoverStoryCoverageFileData *fileData);
+
+@interface CoverStoryCoverageImporter : NSObject
+
+// By extension (.info/.lcov, or .json), and a look at the start of the file.
++ (CoverStoryImportFormat)formatOfFileAtPath:(NSString *)path;
+
+// |maxConcurrency| of 0 means one worker per core, |maxRecordsInFlight| of 0
+// means four per worker.
+- (id)initWithMaxConcurrency:(NSUInteger)maxConcurrency
+          maxRecordsInFlight:(NSUInteger)maxRecordsInFlight;
+
+// Reads |path| (in the format it's in), handing each record's file data to
+// |handler| as it's parsed, and returns once they all have been.  Relative
+// source paths are taken to be relative to the file's folder.  Records that
+// can't be parsed are reported to |receiver| and skipped, NO if the file
+// couldn't be read at all.
+- (BOOL)importFileAtPath:(NSString *)path
+                document:(CoverStoryDocument *)document
+         messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver
+                 handler:(CoverStoryCoverageImportHandler)handler;
+
+// How many records the last import parsed.
+- (NSUInteger)recordCount;
+
+@end
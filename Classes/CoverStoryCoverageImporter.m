@@ -0,0 +1,664 @@
+//
+//  CoverStoryCoverageImporter.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "CoverStoryCoverageImporter.h"
+#import "CoverStoryCoverageFileData.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// How much of the file is read at a time.
+static const size_t kCSImportReadSize = 1024 * 1024;
+// How many records each worker can have waiting by default.
+static const NSUInteger kCSImportRecordsPerWorker = 4;
+// How much of a file is looked at to tell what it is.
+static const NSUInteger kCSImportSniffLength = 4096;
+
+// The containers the JSON splitter keeps track of, an llvm-cov export is
+//   { "data": [ { "files": [ {record}, ... ], "functions": [...] } ], ... }
+// so a record is an object that opens four deep.  Only keys up to
+// kCSImportJSONMaxKeyLength long are captured to see if they're ones we want.
+enum {
+    kCSImportJSONRecordDepth  = 4,
+    kCSImportJSONTrackedDepth = kCSImportJSONRecordDepth + 1,
+    kCSImportJSONMaxKeyLength = 8,
+};
+
+// What each open container is: an array or an object, and the key it's under.
+enum {
+    kCSImportJSONArray    = 1 << 0,
+    kCSImportJSONKeyData  = 1 << 1,
+    kCSImportJSONKeyFiles = 1 << 2,
+};
+
+// An llvm-cov segment: [line, column, count, hasCount, isRegionEntry,
+// (isGapRegion)], the last one only in newer exports.
+enum {
+    kCSImportSegmentLine = 0,
+    kCSImportSegmentCount = 2,
+    kCSImportSegmentHasCount = 3,
+    kCSImportSegmentIsRegionEntry = 4,
+    kCSImportSegmentIsGapRegion = 5,
+    kCSImportSegmentMinFields = 5,
+};
+
+static const char *CSImportSkipBlanks(const char *cursor, const char *end)
+{
+    while ((cursor < end) && ((*cursor == ' ') || (*cursor == '\t') || (*cursor == '\r') || (*cursor == '\n')))
+    {
+        ++cursor;
+    }
+    return cursor;
+}
+
+static BOOL CSImportHasPrefix(const char *cursor, const char *end, const char *prefix)
+{
+    size_t length = strlen(prefix);
+    return ((size_t)(end - cursor) >= length) && (memcmp(cursor, prefix, length) == 0);
+}
+
+// Trims the '\r' of a CRLF line.
+static const char *CSImportLineEnd(const char *lineStart, const char *lineEnd)
+{
+    if ((lineEnd > lineStart) && (lineEnd[-1] == '\r'))
+    {
+        --lineEnd;
+    }
+    return lineEnd;
+}
+
+// Sets line |line| (1 based) of |hitCounts| to |count|, adding to what's
+// there, and grows it (w/ the lines in between not code) if needed.
+static void CSImportAddLineCount(NSMutableData *hitCounts, NSUInteger line, int64_t count)
+{
+    NSUInteger haveLines = [hitCounts length] / sizeof(int64_t);
+    if (line > haveLines)
+    {
+        [hitCounts setLength:line * sizeof(int64_t)];
+        int64_t *grown = [hitCounts mutableBytes];
+        for (NSUInteger x = haveLines; x < line; ++x)
+        {
+            grown[x] = kCoverStoryNotExecutedMarker;
+        }
+    }
+    int64_t *lineCount = (int64_t *)[hitCounts mutableBytes] + line - 1;
+    if (*lineCount == kCoverStoryNotExecutedMarker)
+    {
+        *lineCount = 0;
+    }
+    *lineCount = (INT64_MAX - *lineCount < count) ? INT64_MAX : *lineCount + count;
+}
+
+static NSString *CSImportReadPath(NSString *sourcePath, NSString *folder)
+{
+    return [sourcePath isAbsolutePath] ? sourcePath : [folder stringByAppendingPathComponent:sourcePath];
+}
+
+// Parses an unsigned decimal, NO if there isn't one at |*cursor|.
+static BOOL CSImportParseCount(const char **cursor, const char *end, uint64_t *outValue)
+{
+    const char *digits = *cursor;
+    uint64_t value     = 0;
+    while ((*cursor < end) && (**cursor >= '0') && (**cursor <= '9'))
+    {
+        uint64_t digit = (uint64_t)(**cursor - '0');
+        value          = (value > (UINT64_MAX - digit) / 10) ? UINT64_MAX : value * 10 + digit;
+        ++*cursor;
+    }
+    *outValue = value;
+    return *cursor > digits;
+}
+
+// "SF:<path>" then "DA:<line>,<count>[,<checksum>]" for each line w/ code,
+// the function and branch lines are skipped.  Returns nil w/o an error for a
+// record that has no lines.
+static CoverStoryCoverageFileData *CSImportLCovRecord(NSData *record,
+                                                      NSString *folder,
+                                                      CoverStoryDocument *document,
+                                                      id<CoverStoryCoverageProcessingProtocol> receiver,
+                                                      NSString **outError)
+{
+    NSString *sourcePath     = nil;
+    NSMutableData *hitCounts = [NSMutableData data];
+    const char *lineStart    = [record bytes];
+    const char *end          = lineStart + [record length];
+    while (lineStart < end)
+    {
+        const char *lf       = memchr(lineStart, '\n', end - lineStart);
+        const char *lineEnd  = CSImportLineEnd(lineStart, lf ? lf : end);
+        const char *cursor   = CSImportSkipBlanks(lineStart, lineEnd);
+        if (CSImportHasPrefix(cursor, lineEnd, "SF:"))
+        {
+            cursor    += 3;
+            sourcePath = [[NSString alloc] initWithBytes:cursor length:lineEnd - cursor encoding:NSUTF8StringEncoding];
+        }
+        else if (CSImportHasPrefix(cursor, lineEnd, "DA:"))
+        {
+            cursor        += 3;
+            uint64_t line  = 0;
+            uint64_t count = 0;
+            // lcov 2 writes a negative count for lines it couldn't count,
+            // those are left as not code
+            if (!CSImportParseCount(&cursor, lineEnd, &line) || (line == 0) || (line > UINT32_MAX) ||
+                (cursor == lineEnd) || (*cursor++ != ',') || !CSImportParseCount(&cursor, lineEnd, &count))
+            {
+                if (!memchr(lineStart, '-', lineEnd - lineStart))
+                {
+                    *outError = [NSString stringWithFormat:@"bad line '%@'",
+                                 [[NSString alloc] initWithBytes:lineStart
+                                                          length:lineEnd - lineStart
+                                                        encoding:NSUTF8StringEncoding]];
+                    return nil;
+                }
+            }
+            else
+            {
+                CSImportAddLineCount(hitCounts, (NSUInteger)line, (count > INT64_MAX) ? INT64_MAX : (int64_t)count);
+            }
+        }
+        lineStart = lf ? lf + 1 : end;
+    }
+    if (![sourcePath length])
+    {
+        *outError = @"record has no source file";
+        return nil;
+    }
+    if (![hitCounts length])
+    {
+        return nil;
+    }
+    NSString *readPath = CSImportReadPath(sourcePath, folder);
+    CoverStoryCoverageFileData *fileData =
+        [CoverStoryCoverageFileData newCoverageFileDataWithSourcePath:readPath
+                                                             readPath:readPath
+                                                            hitCounts:hitCounts
+                                                             document:document
+                                                      messageReceiver:receiver];
+    if (!fileData)
+    {
+        *outError = [NSString stringWithFormat:@"source '%@' is too large", readPath];
+    }
+    return fileData;
+}
+
+static BOOL CSImportSegmentIsStartOfRegion(NSArray *segment)
+{
+    return [segment[kCSImportSegmentHasCount] boolValue] &&
+           [segment[kCSImportSegmentIsRegionEntry] boolValue] &&
+           !(([segment count] > kCSImportSegmentIsGapRegion) && [segment[kCSImportSegmentIsGapRegion] boolValue]);
+}
+
+static int64_t CSImportSegmentCount(NSArray *segment)
+{
+    unsigned long long count = [segment[kCSImportSegmentCount] unsignedLongLongValue];
+    return (count > INT64_MAX) ? INT64_MAX : (int64_t)count;
+}
+
+// One entry of "files": {"filename": ..., "segments": [...], ...}.  The line
+// counts come from the segments the same way llvm-cov show does it: a line is
+// code if a region starts on it or one that has a count runs through it
+// (unless it starts a skipped region), and its count is the highest of those.
+static CoverStoryCoverageFileData *CSImportLLVMCovRecord(NSData *record,
+                                                         NSString *folder,
+                                                         CoverStoryDocument *document,
+                                                         id<CoverStoryCoverageProcessingProtocol> receiver,
+                                                         NSString **outError)
+{
+    NSError *error     = nil;
+    NSDictionary *file = [NSJSONSerialization JSONObjectWithData:record options:0 error:&error];
+    if (![file isKindOfClass:[NSDictionary class]])
+    {
+        *outError = [error localizedDescription] ?: @"record isn't an object";
+        return nil;
+    }
+    NSString *sourcePath = file[@"filename"];
+    NSArray *segments    = file[@"segments"];
+    if (![sourcePath isKindOfClass:[NSString class]] || ![sourcePath length] ||
+        ![segments isKindOfClass:[NSArray class]])
+    {
+        *outError = @"record has no filename or segments";
+        return nil;
+    }
+    for (NSArray *segment in segments)
+    {
+        if (![segment isKindOfClass:[NSArray class]] || ([segment count] < kCSImportSegmentMinFields))
+        {
+            *outError = [NSString stringWithFormat:@"bad segment in '%@'", sourcePath];
+            return nil;
+        }
+    }
+    NSUInteger segmentCount = [segments count];
+    if (!segmentCount)
+    {
+        return nil;
+    }
+
+    NSUInteger lastLine      = [[segments lastObject][kCSImportSegmentLine] unsignedIntegerValue];
+    NSMutableData *hitCounts = [NSMutableData dataWithLength:lastLine * sizeof(int64_t)];
+    int64_t *hits            = [hitCounts mutableBytes];
+    NSArray *wrapped         = nil;  // the last segment before the line
+    NSUInteger next          = 0;
+    for (NSUInteger line = 1; line <= lastLine; ++line)
+    {
+        while ((next < segmentCount) && ([segments[next][kCSImportSegmentLine] unsignedIntegerValue] < line))
+        {
+            wrapped = segments[next++];
+        }
+        NSUInteger first = next;
+        while ((next < segmentCount) && ([segments[next][kCSImportSegmentLine] unsignedIntegerValue] == line))
+        {
+            ++next;
+        }
+        NSUInteger regionStarts = 0;
+        int64_t count           = wrapped ? CSImportSegmentCount(wrapped) : 0;
+        for (NSUInteger x = first; x < next; ++x)
+        {
+            if (CSImportSegmentIsStartOfRegion(segments[x]))
+            {
+                ++regionStarts;
+                count = MAX(count, CSImportSegmentCount(segments[x]));
+            }
+        }
+        BOOL startsSkipped = (first < next) &&
+                             ![segments[first][kCSImportSegmentHasCount] boolValue] &&
+                             [segments[first][kCSImportSegmentIsRegionEntry] boolValue];
+        BOOL isCode        = !startsSkipped &&
+                             (regionStarts || (wrapped && [wrapped[kCSImportSegmentHasCount] boolValue]));
+        hits[line - 1]     = isCode ? count : kCoverStoryNotExecutedMarker;
+        if (next > first)
+        {
+            wrapped = segments[next - 1];
+        }
+    }
+    NSString *readPath = CSImportReadPath(sourcePath, folder);
+    CoverStoryCoverageFileData *fileData =
+        [CoverStoryCoverageFileData newCoverageFileDataWithSourcePath:readPath
+                                                             readPath:readPath
+                                                            hitCounts:hitCounts
+                                                             document:document
+                                                      messageReceiver:receiver];
+    if (!fileData)
+    {
+        *outError = [NSString stringWithFormat:@"source '%@' is too large", readPath];
+    }
+    return fileData;
+}
+
+@interface CoverStoryCoverageImporter () {
+@private
+    NSOperationQueue *_queue;
+    NSCondition *_inFlightCondition;  // guards the next two
+    NSUInteger _inFlight;
+    NSUInteger _maxInFlight;
+    NSUInteger _recordCount;
+    // the import going on
+    CoverStoryImportFormat _format;
+    NSString *_path;
+    NSString *_folder;
+    __weak CoverStoryDocument *_document;
+    id<CoverStoryCoverageProcessingProtocol> _receiver;
+    CoverStoryCoverageImportHandler _handler;
+    NSMutableData *_buffer;       // starts w/ the record being read, if any
+    NSUInteger _scanned;          // how much of |_buffer| has been looked at
+    BOOL _inRecord;
+    // the JSON splitter
+    NSUInteger _depth;
+    uint8_t _containers[kCSImportJSONTrackedDepth];
+    uint8_t _pendingKey;
+    BOOL _inString;
+    BOOL _escaped;
+    char _string[kCSImportJSONMaxKeyLength];
+    NSUInteger _stringLength;
+}
+- (void)scanLCovAtEnd:(BOOL)atEnd;
+- (void)scanJSON;
+- (void)handOffRecordWithBytes:(const char *)bytes length:(NSUInteger)length;
+- (void)finishedRecord;
+@end
+
+@implementation CoverStoryCoverageImporter
+
++ (CoverStoryImportFormat)formatOfFileAtPath:(NSString *)path
+{
+    NSString *extension  = [[path pathExtension] lowercaseString];
+    NSFileHandle *handle = [NSFileHandle fileHandleForReadingAtPath:path];
+    NSData *head         = nil;
+    @try {
+        head = [handle readDataOfLength:kCSImportSniffLength];
+    }
+    @catch (NSException *e) {
+        return kCoverStoryImportFormatNone;
+    }
+    [handle closeFile];
+    const char *cursor = [head bytes];
+    const char *end    = cursor + [head length];
+    cursor             = CSImportSkipBlanks(cursor, end);
+    if ([extension isEqualToString:@"json"])
+    {
+        // llvm-cov puts "data" first (and "type" at the very end)
+        if ((cursor < end) && (*cursor == '{') &&
+            CSImportHasPrefix(CSImportSkipBlanks(cursor + 1, end), end, "\"data\""))
+        {
+            return kCoverStoryImportFormatLLVMCov;
+        }
+        return kCoverStoryImportFormatNone;
+    }
+    if ([extension isEqualToString:@"info"] || [extension isEqualToString:@"lcov"] ||
+        CSImportHasPrefix(cursor, end, "TN:") || CSImportHasPrefix(cursor, end, "SF:"))
+    {
+        return head ? kCoverStoryImportFormatLCov : kCoverStoryImportFormatNone;
+    }
+    return kCoverStoryImportFormatNone;
+}
+
+- (id)init
+{
+    return [self initWithMaxConcurrency:0 maxRecordsInFlight:0];
+}
+
+- (id)initWithMaxConcurrency:(NSUInteger)maxConcurrency
+          maxRecordsInFlight:(NSUInteger)maxRecordsInFlight
+{
+    if ((self = [super init]))
+    {
+        if (maxConcurrency == 0)
+        {
+            maxConcurrency = [[NSProcessInfo processInfo] activeProcessorCount];
+        }
+        maxConcurrency = MAX(maxConcurrency, (NSUInteger)1);
+        if (maxRecordsInFlight == 0)
+        {
+            maxRecordsInFlight = maxConcurrency * kCSImportRecordsPerWorker;
+        }
+        _queue = [[NSOperationQueue alloc] init];
+        [_queue setMaxConcurrentOperationCount:maxConcurrency];
+        _inFlightCondition = [[NSCondition alloc] init];
+        _maxInFlight       = maxRecordsInFlight;
+    }
+    return self;
+}
+
+- (BOOL)importFileAtPath:(NSString *)path
+                document:(CoverStoryDocument *)document
+         messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver
+                 handler:(CoverStoryCoverageImportHandler)handler
+{
+    _format = [[self class] formatOfFileAtPath:path];
+    if (_format == kCoverStoryImportFormatNone)
+    {
+        [receiver coverageErrorForPath:path message:@"not an lcov tracefile or llvm-cov export"];
+        return NO;
+    }
+    int fd = open([path fileSystemRepresentation], O_RDONLY);
+    if (fd < 0)
+    {
+        [receiver coverageErrorForPath:path message:@"failed to open file (%s)", strerror(errno)];
+        return NO;
+    }
+    _path        = [path copy];
+    _folder      = [path stringByDeletingLastPathComponent];
+    _document    = document;
+    _receiver    = receiver;
+    _handler     = [handler copy];
+    _buffer      = [[NSMutableData alloc] init];
+    _scanned     = 0;
+    _inRecord    = NO;
+    _depth       = 0;
+    _pendingKey  = 0;
+    _inString    = NO;
+    _escaped     = NO;
+    _recordCount = 0;
+
+    BOOL isGood               = YES;
+    NSMutableData *readBuffer = [NSMutableData dataWithLength:kCSImportReadSize];
+    for (;;)
+    {
+        ssize_t bytesRead = read(fd, [readBuffer mutableBytes], kCSImportReadSize);
+        if ((bytesRead < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        if (bytesRead < 0)
+        {
+            [receiver coverageErrorForPath:path message:@"failed to read file (%s)", strerror(errno)];
+            isGood = NO;
+            break;
+        }
+        if (bytesRead == 0)
+        {
+            break;
+        }
+        [_buffer appendBytes:[readBuffer bytes] length:(NSUInteger)bytesRead];
+        if (_format == kCoverStoryImportFormatLCov)
+        {
+            [self scanLCovAtEnd:NO];
+        }
+        else
+        {
+            [self scanJSON];
+        }
+    }
+    close(fd);
+    if (_format == kCoverStoryImportFormatLCov)
+    {
+        [self scanLCovAtEnd:YES];
+    }
+    if (_inRecord && isGood)
+    {
+        [receiver coverageErrorForPath:path message:@"file ends in the middle of a record"];
+    }
+    [_queue waitUntilAllOperationsAreFinished];
+
+    _buffer   = nil;
+    _receiver = nil;
+    _handler  = nil;
+    return isGood;
+}
+
+// Hands off each "SF:" ... "end_of_record" block, and leaves |_buffer|
+// starting w/ the one still coming in.  Only whole lines are looked at unless
+// it's |atEnd|, where a last record w/o its end_of_record still counts.
+- (void)scanLCovAtEnd:(BOOL)atEnd
+{
+    const char *base        = [_buffer bytes];
+    const char *end         = base + [_buffer length];
+    const char *lineStart   = base + _scanned;
+    const char *recordStart = base;
+    while (lineStart < end)
+    {
+        const char *lf = memchr(lineStart, '\n', end - lineStart);
+        if (!lf && !atEnd)
+        {
+            break;
+        }
+        const char *nextLine = lf ? lf + 1 : end;
+        const char *lineEnd  = CSImportLineEnd(lineStart, lf ? lf : end);
+        const char *text     = CSImportSkipBlanks(lineStart, lineEnd);
+        if (CSImportHasPrefix(text, lineEnd, "SF:"))
+        {
+            if (_inRecord)
+            {
+                // the last one didn't end, it's still all there is for it
+                [self handOffRecordWithBytes:recordStart length:lineStart - recordStart];
+            }
+            recordStart = lineStart;
+            _inRecord   = YES;
+        }
+        else if (_inRecord && CSImportHasPrefix(text, lineEnd, "end_of_record"))
+        {
+            [self handOffRecordWithBytes:recordStart length:lineStart - recordStart];
+            _inRecord = NO;
+        }
+        lineStart = nextLine;
+    }
+    if (atEnd && _inRecord && (lineStart > recordStart))
+    {
+        [self handOffRecordWithBytes:recordStart length:lineStart - recordStart];
+        _inRecord = NO;
+    }
+    const char *keep = _inRecord ? recordStart : lineStart;
+    _scanned         = lineStart - keep;
+    if (keep > base)
+    {
+        [_buffer replaceBytesInRange:NSMakeRange(0, keep - base) withBytes:NULL length:0];
+    }
+}
+
+// Walks the JSON a byte at a time, keeping just enough state (the open
+// containers, and whether it's in a string) to know when an entry of "files"
+// starts and ends.  Everything outside of those is dropped as it's read.
+- (void)scanJSON
+{
+    const char *base        = [_buffer bytes];
+    const char *end         = base + [_buffer length];
+    const char *recordStart = base;
+    for (const char *cursor = base + _scanned; cursor < end; ++cursor)
+    {
+        char c = *cursor;
+        if (_inString)
+        {
+            if (_escaped)
+            {
+                _escaped      = NO;
+                _stringLength = kCSImportJSONMaxKeyLength + 1;  // not a key we want
+            }
+            else if (c == '\\')
+            {
+                _escaped = YES;
+            }
+            else if (c == '"')
+            {
+                _inString = NO;
+            }
+            else if (_stringLength < kCSImportJSONMaxKeyLength)
+            {
+                _string[_stringLength++] = c;
+            }
+            else
+            {
+                _stringLength = kCSImportJSONMaxKeyLength + 1;
+            }
+            continue;
+        }
+        switch (c)
+        {
+            case '"':
+                _inString     = YES;
+                _stringLength = 0;
+                break;
+            case ':':
+                _pendingKey = 0;
+                if ((_stringLength == 4) && (memcmp(_string, "data", 4) == 0))
+                {
+                    _pendingKey = kCSImportJSONKeyData;
+                }
+                else if ((_stringLength == 5) && (memcmp(_string, "files", 5) == 0))
+                {
+                    _pendingKey = kCSImportJSONKeyFiles;
+                }
+                break;
+            case ',':
+                _pendingKey = 0;
+                break;
+            case '{':
+            case '[':
+                if ((c == '{') && !_inRecord && (_depth == kCSImportJSONRecordDepth) &&
+                    !(_containers[0] & kCSImportJSONArray) &&
+                    (_containers[1] == (kCSImportJSONArray | kCSImportJSONKeyData)) &&
+                    !(_containers[2] & kCSImportJSONArray) &&
+                    (_containers[3] == (kCSImportJSONArray | kCSImportJSONKeyFiles)))
+                {
+                    _inRecord   = YES;
+                    recordStart = cursor;
+                }
+                if (_depth < kCSImportJSONTrackedDepth)
+                {
+                    _containers[_depth] = ((c == '[') ? kCSImportJSONArray : 0) | _pendingKey;
+                }
+                ++_depth;
+                _pendingKey = 0;
+                break;
+            case '}':
+            case ']':
+                if (_depth)
+                {
+                    --_depth;
+                }
+                if (_inRecord && (_depth == kCSImportJSONRecordDepth))
+                {
+                    [self handOffRecordWithBytes:recordStart length:cursor + 1 - recordStart];
+                    _inRecord = NO;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    const char *keep = _inRecord ? recordStart : end;
+    _scanned         = end - keep;
+    if (keep > base)
+    {
+        [_buffer replaceBytesInRange:NSMakeRange(0, keep - base) withBytes:NULL length:0];
+    }
+}
+
+- (void)handOffRecordWithBytes:(const char *)bytes length:(NSUInteger)length
+{
+    [_inFlightCondition lock];
+    while (_inFlight >= _maxInFlight)
+    {
+        [_inFlightCondition wait];
+    }
+    ++_inFlight;
+    [_inFlightCondition unlock];
+    NSUInteger index                                  = ++_recordCount;
+    NSData *record                                    = [NSData dataWithBytes:bytes length:length];
+    CoverStoryImportFormat format                     = _format;
+    NSString *path                                    = _path;
+    NSString *folder                                  = _folder;
+    CoverStoryDocument *document                      = _document;
+    id<CoverStoryCoverageProcessingProtocol> receiver = _receiver;
+    CoverStoryCoverageImportHandler handler           = _handler;
+    [_queue addOperationWithBlock:^{
+        @autoreleasepool {
+            NSString *error = nil;
+            CoverStoryCoverageFileData *fileData =
+                (format == kCoverStoryImportFormatLCov)
+                    ? CSImportLCovRecord(record, folder, document, receiver, &error)
+                    : CSImportLLVMCovRecord(record, folder, document, receiver, &error);
+            if (error)
+            {
+                [receiver coverageErrorForPath:path message:@"record %lu: %@", (unsigned long)index, error];
+            }
+            else if (fileData && handler)
+            {
+                handler(fileData);
+            }
+            [self finishedRecord];
+        }
+    }];
+}
+
+- (void)finishedRecord
+{
+    [_inFlightCondition lock];
+    --_inFlight;
+    [_inFlightCondition signal];
+    [_inFlightCondition unlock];
+}
+
+- (NSUInteger)recordCount
+{
+    return _recordCount;
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"%@ <%p>: %lu records", [self class], self, (unsigned long)_recordCount];
+}
+
+@end
@@ -10,18 +10,26 @@
 #import "CoverStoryCoverageFileData.h"
 #import "CodeCoverage.h"
 
-// Keeps track of the number of times a line of code has been hit. There is
-// one CoverStoryCoverageLineData object per line of code in the file.
+// Keeps track of the number of times a line of code has been hit.  The file
+// data keeps its lines in columns, so these are made on demand as a view onto
+// one line of a CoverStoryCoverageFileData (and are cheap to throw away).  A
+// line can also stand on its own w/ its own text and hit count.
 
 @interface CoverStoryCoverageLineData : NSObject {
 }
 
 @property (readonly, nonatomic, assign) NSInteger hitCount; // how many times this line has been hit
 @property (readonly, nonatomic, copy) NSString *line; //  the line
-@property (weak) CoverStoryCoverageFileData *coverageFile;
+@property (readonly, nonatomic, strong) CoverStoryCoverageFileData *coverageFile;
+// index of the line w/in |coverageFile|, NSNotFound for a standalone line.
+@property (readonly, nonatomic, assign) NSUInteger lineIndex;
 
 + (id)newCoverageLineDataWithLine:(NSString *)line hitCount:(NSInteger)hitCount coverageFile:(CoverStoryCoverageFileData *)coverageFile;
 - (id)initWithLine:(NSString *)line hitCount:(NSInteger)hitCount coverageFile:(CoverStoryCoverageFileData *)coverageFile;
+
++ (id)newCoverageLineDataWithIndex:(NSUInteger)index coverageFile:(CoverStoryCoverageFileData *)coverageFile;
+- (id)initWithIndex:(NSUInteger)index coverageFile:(CoverStoryCoverageFileData *)coverageFile;
+
 - (void)addHits:(NSInteger)newHits;
 
 @end
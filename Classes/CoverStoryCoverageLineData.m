@@ -15,6 +15,9 @@
 
 @implementation CoverStoryCoverageLineData
 
+@synthesize hitCount = _hitCount;
+@synthesize line = _line;
+
 + (id)newCoverageLineDataWithLine:(NSString *)line
                          hitCount:(NSInteger)hitCount
                      coverageFile:(CoverStoryCoverageFileData *)coverageFile
@@ -31,26 +34,78 @@
         _hitCount     = hitCount;
         _line         = [line copy];
         _coverageFile = coverageFile;
+        _lineIndex    = NSNotFound;
     }
     return self;
 }
 
++ (id)newCoverageLineDataWithIndex:(NSUInteger)index
+                      coverageFile:(CoverStoryCoverageFileData *)coverageFile
+{
+    return [[self alloc] initWithIndex:index coverageFile:coverageFile];
+}
+
+- (id)initWithIndex:(NSUInteger)index
+       coverageFile:(CoverStoryCoverageFileData *)coverageFile
+{
+    NSParameterAssert(coverageFile);
+    if ((self = [super init]))
+    {
+        _coverageFile = coverageFile;
+        _lineIndex    = index;
+    }
+    return self;
+}
+
+- (NSInteger)hitCount
+{
+    if (_lineIndex != NSNotFound)
+    {
+        return [_coverageFile hitCountForLineAtIndex:_lineIndex];
+    }
+    return _hitCount;
+}
+
+- (NSString *)line
+{
+    if (!_line && (_lineIndex != NSNotFound))
+    {
+        _line = [_coverageFile lineAtIndex:_lineIndex];
+    }
+    return _line;
+}
 
 - (void)addHits:(NSInteger)newHits
 {
-    // we could be processing big and little endian runs, and w/ ifdefs one set of
-    // lines would be ignored in one run, but not in the other. so...  if we were
-    // a not hit line, we just take the new hits, otherwise we add any real hits
-    // to our count.
-    if (self.hitCount == kCoverStoryNotExecutedMarker)
+    if (_lineIndex != NSNotFound)
     {
-        self.hitCount = newHits;
+        [_coverageFile addHits:newHits toLineAtIndex:_lineIndex];
+        return;
     }
-    else if (newHits > 0)
+    NSAssert1((newHits <= 0) || (self.hitCount >= kCoverStoryNotExecutedMarker),
+              @"how was it not feasible in only one version? (hitCount_ = %ld)", (long)_hitCount);
+    self.hitCount = (NSInteger)coverageMergeHitCounts(self.hitCount, newHits);
+}
+
+// Lines backed by a file are made on demand, so two of them for the same line
+// need to compare equal (the table view and scripting both count on it).
+- (BOOL)isEqual:(id)object
+{
+    if (_lineIndex == NSNotFound || ![object isKindOfClass:[CoverStoryCoverageLineData class]])
     {
-        NSAssert1(self.hitCount >= 0, @"how was it not feasible in only one version? (hitCount_ = %ld)", (long)_hitCount);
-        self.hitCount += newHits;
+        return [super isEqual:object];
     }
+    CoverStoryCoverageLineData *other = object;
+    return ((other->_lineIndex == _lineIndex) && (other->_coverageFile == _coverageFile));
+}
+
+- (NSUInteger)hash
+{
+    if (_lineIndex == NSNotFound)
+    {
+        return [super hash];
+    }
+    return [_coverageFile hash] ^ _lineIndex;
 }
 
 - (NSString *)description
@@ -62,13 +117,14 @@
 
 
 
-
 @implementation CoverStoryCoverageLineData (ScriptingMethods)
 
+#if !COVERSTORY_HEADLESS
 - (NSScriptObjectSpecifier *)objectSpecifier
 {
     return [[self coverageFile] objectSpecifierForLineData:self];
 }
+#endif
 
 // For scripting, we don't want to return any negative hit counts
 - (NSInteger)adjustedHitCount
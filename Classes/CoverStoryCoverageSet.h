@@ -4,8 +4,49 @@
 #import "CoverStoryProtocols.h"
 #import "CoverStoryCoverageFileData.h"
 
+@class CoverStoryCoverageTotals;
+
+// |fileData| was already in the set and has been merged into, |before| is what
+// it counted until then.
+typedef void (^CoverStoryCoverageSetCountsHandler)(CoverStoryCoverageFileData *fileData,
+                                                   CoverStoryLineCounts before);
+
+@interface CoverStoryCoverageSet : NSObject<CoverStoryLineCoverageProtocol> {
+@private
+    NSMutableDictionary *_indexesBySourcePath;    // sourcePath -> index in fileDatas
+    NSMutableDictionary *_contributionsByOrigin;  // origin -> (sourcePath -> file data)
+    NSMutableDictionary *_originsBySourcePath;    // sourcePath -> origins, in the order added
+    CoverStoryCoverageTotals *_totals;            // of fileDatas, kept as they change
+    NSUInteger _contentGeneration;
+}
+// When set, what is added is also kept by the origin it came from (the folder
+// of .gcda files it was read from), so one origin can be swapped out later w/o
+// reading the others again.  Set it before adding anything.
+@property (nonatomic, assign) BOOL keepsOrigins;
+// Merging into a file that's already in fileDatas doesn't post a change (the
+// array is the same), this is called for each one instead, on the thread
+// doing the adding.
+@property (nonatomic, copy) CoverStoryCoverageSetCountsHandler countsChangedHandler;
+// Bumped every time a file data is added to, replaced in or removed from
+// fileDatas (merging into one that's there doesn't count), so anything made
+// from the array can tell whether it's still good.
+@property (readonly, nonatomic, assign) NSUInteger contentGeneration;
 
-@interface CoverStoryCoverageSet : NSObject<CoverStoryLineCoverageProtocol>
 - (void)removeAllData;
 - (BOOL)addFileData:(CoverStoryCoverageFileData *)fileData messageReceiver :(id<CoverStoryCoverageProcessingProtocol>)receiver;
+// Adds/merges a whole batch of file datas, the new ones are inserted (in order)
+// at the end of fileDatas w/ a single KVO change.  Returns NO if any of the
+// merges failed.
+- (BOOL)addFileDatas:(NSArray *)fileDatas messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver;
+// Same, and filed under |origin| if the set keepsOrigins.
+- (BOOL)addFileDatas:(NSArray *)fileDatas
+          fromOrigin:(NSString *)origin
+     messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver;
+// Swaps out everything that came from each origin in |fileDatasByOrigin|
+// (origin -> NSArray of file datas, empty to drop the origin).  Only the
+// sources those origins touch are rebuilt; ones that come out the same keep
+// their file data, the rest are replaced in place (or removed/appended), w/ a
+// KVO change for each kind.  Only for a set that keepsOrigins.
+- (BOOL)replaceFileDatasByOrigin:(NSDictionary *)fileDatasByOrigin
+                 messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver;
 @end
@@ -8,12 +8,45 @@
 
 #import "CoverStoryCoverageSet.h"
 #import "CoverStoryCoverageFileData.h"
+#import "CoverStoryCoverageTotals.h"
 #import "CodeCoverage.h"
 
 @interface CoverStoryCoverageSet ()
 @property (readonly) NSMutableArray *fileDatas;
+- (void)noteCountsBeforeMergingAtIndex:(NSUInteger)index into:(NSMutableDictionary *)countsBefore;
+- (void)updateTotalsForMerges:(NSDictionary *)countsBefore replacements:(NSDictionary *)replacements;
+- (BOOL)addFileDatas:(NSArray *)fileDatas
+      toOriginNamed:(id)origin
+    messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver;
+- (CoverStoryCoverageFileData *)rebuiltFileDataForSourcePath:(NSString *)sourcePath
+                                             messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver;
 @end
 
+// A file data of its own w/ the same lines and counts, for merging the other
+// origins into w/o touching the one it came from.
+static CoverStoryCoverageFileData *CSCopyOfFileData(CoverStoryCoverageFileData *fileData)
+{
+    NSData *hitCounts = [NSData dataWithBytes:[fileData hitCounts] length:[fileData lineCount] * sizeof(int64_t)];
+    CoverStoryCoverageFileData *copy = [[CoverStoryCoverageFileData alloc] initWithSourcePath:[fileData sourcePath]
+                                                                                          text:[fileData textData]
+                                                                                    lineRanges:[fileData lineRangeData]
+                                                                                     hitCounts:hitCounts
+                                                                       applyNonFeasibleMarkers:NO
+                                                                                      document:[fileData document]];
+    [copy queueWarnings:[fileData queuedWarnings]];
+    return copy;
+}
+
+static BOOL CSFileDatasMatch(CoverStoryCoverageFileData *a, CoverStoryCoverageFileData *b)
+{
+    NSUInteger lineCount = [a lineCount];
+    return ((a == b) ||
+            ((lineCount == [b lineCount]) &&
+             (memcmp([a hitCounts], [b hitCounts], lineCount * sizeof(int64_t)) == 0) &&
+             [[a lineRangeData] isEqualToData:[b lineRangeData]] &&
+             [[a textData] isEqualToData:[b textData]]));
+}
+
 
 
 @implementation CoverStoryCoverageSet
@@ -22,47 +55,405 @@
 {
     if ((self = [super init]))
     {
-        _fileDatas = [[NSMutableArray alloc] init];
+        _fileDatas           = [[NSMutableArray alloc] init];
+        _indexesBySourcePath   = [[NSMutableDictionary alloc] init];
+        _contributionsByOrigin = [[NSMutableDictionary alloc] init];
+        _originsBySourcePath   = [[NSMutableDictionary alloc] init];
+        _totals                = [[CoverStoryCoverageTotals alloc] init];
     }
     return self;
 }
 
+// What the file at |index| counts before the first merge into it in a batch.
+- (void)noteCountsBeforeMergingAtIndex:(NSUInteger)index into:(NSMutableDictionary *)countsBefore
+{
+    NSNumber *key = @(index);
+    if (!countsBefore[key])
+    {
+        CoverStoryLineCounts counts = [_fileDatas[index] lineCounts];
+        countsBefore[key]           = [NSValue valueWithBytes:&counts objCType:@encode(CoverStoryLineCounts)];
+    }
+}
+
+// Re-counts the files merged into (index -> counts before) once they're
+// done, the ones in |replacements| are already in fileDatas in their place.
+- (void)updateTotalsForMerges:(NSDictionary *)countsBefore replacements:(NSDictionary *)replacements
+{
+    for (NSNumber *idx in countsBefore)
+    {
+        CoverStoryLineCounts before;
+        [countsBefore[idx] getValue:&before];
+        CoverStoryCoverageFileData *fileData = _fileDatas[[idx unsignedIntegerValue]];
+        if (coverageLineCountsEqual(before, [fileData lineCounts]))
+        {
+            continue;
+        }
+        [_totals fileData:fileData changedFromLineCounts:before];
+        if (_countsChangedHandler && !replacements[idx])
+        {
+            _countsChangedHandler(fileData, before);
+        }
+    }
+}
+
 
 - (BOOL)addFileData:(CoverStoryCoverageFileData *)fileData messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver
 {
-    BOOL wasGood   = NO;
-    NSUInteger idx = [_fileDatas indexOfObject:fileData];
-    if (idx != NSNotFound)
-    {
-        CoverStoryCoverageFileData *currentData = [_fileDatas objectAtIndex:idx];
-        // we need to merge them
-        // (this is needed for headers w/ inlines where if you process >1 gcno/gcda
-        // then you could get that header reported >1 time)
-        wasGood = [currentData addFileData:fileData messageReceiver:receiver];
-    }
-    else
-    {
-        // it's new, save it
-        NSUInteger index = [_fileDatas count];
-        [self willChange:NSKeyValueChangeInsertion valuesAtIndexes:[NSIndexSet indexSetWithIndex:index] forKey:@"fileDatas"];
-        [_fileDatas insertObject:fileData atIndex:index];
-        [self didChange:NSKeyValueChangeInsertion valuesAtIndexes:[NSIndexSet indexSetWithIndex:index] forKey:@"fileDatas"];
-        
-        // send the queued up warnings since this is the first time we've seen the
-        // file.
-        // TODO: this is really a hack, we would be better (since these currently
-        // are line specific) is to extend the structure to allow warnings to be
-        // hung on the line data along w/ the hit counts.  Then w/in the UI indicate
-        // how many warnings are on a file in the files list, and in the source
-        // display show the warnings inline (sorta like Xcode 3).  The other option
-        // would be to keep this basic structure, but be able to relay info w/ the
-        // warning so our warning/error ui could take clicks and open to the right
-        // file/line so the user can take action on the message.
+    return [self addFileDatas:@[fileData] messageReceiver:receiver];
+}
+
+- (BOOL)addFileDatas:(NSArray *)fileDatas messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver
+{
+    return [self addFileDatas:fileDatas fromOrigin:nil messageReceiver:receiver];
+}
+
+- (BOOL)addFileDatas:(NSArray *)fileDatas
+          fromOrigin:(NSString *)origin
+     messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver
+{
+    if (_keepsOrigins)
+    {
+        return [self addFileDatas:fileDatas toOriginNamed:(origin ?: (id)[NSNull null]) messageReceiver:receiver];
+    }
+    BOOL wasGood                      = YES;
+    NSUInteger firstIndex             = [_fileDatas count];
+    NSMutableArray *newOnes           = [NSMutableArray array];
+    NSMutableDictionary *countsBefore = [NSMutableDictionary dictionary];  // NSNumber index -> NSValue
+    for (CoverStoryCoverageFileData *fileData in fileDatas)
+    {
+        NSString *sourcePath = [fileData sourcePath];
+        NSNumber *idx        = [_indexesBySourcePath objectForKey:sourcePath];
+        if (idx)
+        {
+            // we need to merge them
+            // (this is needed for headers w/ inlines where if you process >1 gcno/gcda
+            // then you could get that header reported >1 time)
+            NSUInteger index = [idx unsignedIntegerValue];
+            if (index < firstIndex)
+            {
+                [self noteCountsBeforeMergingAtIndex:index into:countsBefore];
+            }
+            CoverStoryCoverageFileData *currentData = (index < firstIndex) ?
+                [_fileDatas objectAtIndex:index] : [newOnes objectAtIndex:index - firstIndex];
+            if (![currentData addFileData:fileData messageReceiver:receiver])
+            {
+                wasGood = NO;
+            }
+        }
+        else
+        {
+            // it's new, save it
+            [_indexesBySourcePath setObject:@(firstIndex + [newOnes count]) forKey:sourcePath];
+            [newOnes addObject:fileData];
+        }
+    }
+    [self updateTotalsForMerges:countsBefore replacements:nil];
+    if ([newOnes count] == 0)
+    {
+        return wasGood;
+    }
+    
+    NSIndexSet *indexes = [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(firstIndex, [newOnes count])];
+    [self willChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:@"fileDatas"];
+    [_fileDatas addObjectsFromArray:newOnes];
+    for (CoverStoryCoverageFileData *newOne in newOnes)
+    {
+        [_totals addFileData:newOne];
+    }
+    ++_contentGeneration;
+    [self didChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:@"fileDatas"];
+    
+    // send the queued up warnings since this is the first time we've seen the
+    // file.
+    // TODO: this is really a hack, we would be better (since these currently
+    // are line specific) is to extend the structure to allow warnings to be
+    // hung on the line data along w/ the hit counts.  Then w/in the UI indicate
+    // how many warnings are on a file in the files list, and in the source
+    // display show the warnings inline (sorta like Xcode 3).  The other option
+    // would be to keep this basic structure, but be able to relay info w/ the
+    // warning so our warning/error ui could take clicks and open to the right
+    // file/line so the user can take action on the message.
+    for (CoverStoryCoverageFileData *fileData in newOnes)
+    {
+        for (NSString *warning in [fileData queuedWarnings])
+        {
+            [receiver coverageWarningForPath:[fileData sourcePath] message:@"%@", warning];
+        }
+    }
+    return wasGood;
+}
+
+// Like the above, but each origin's part of a source is kept to itself.  A
+// source w/ one origin shares that origin's file data, once a second origin
+// shows up it gets a copy for them to be merged into.
+- (BOOL)addFileDatas:(NSArray *)fileDatas
+      toOriginNamed:(id)origin
+    messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver
+{
+    BOOL wasGood                       = YES;
+    NSUInteger firstIndex              = [_fileDatas count];
+    NSMutableArray *newOnes            = [NSMutableArray array];
+    NSMutableDictionary *replacements  = [NSMutableDictionary dictionary];  // NSNumber index -> file data
+    NSMutableDictionary *countsBefore  = [NSMutableDictionary dictionary];  // NSNumber index -> NSValue
+    NSMutableDictionary *contributions = _contributionsByOrigin[origin];
+    if (!contributions)
+    {
+        contributions                  = [NSMutableDictionary dictionary];
+        _contributionsByOrigin[origin] = contributions;
+    }
+    for (CoverStoryCoverageFileData *fileData in fileDatas)
+    {
+        NSString *sourcePath = [fileData sourcePath];
+        NSNumber *idx        = _indexesBySourcePath[sourcePath];
+        if (!idx)
+        {
+            // it's new, save it
+            contributions[sourcePath]        = fileData;
+            _originsBySourcePath[sourcePath] = [NSMutableArray arrayWithObject:origin];
+            _indexesBySourcePath[sourcePath] = @(firstIndex + [newOnes count]);
+            [newOnes addObject:fileData];
+            continue;
+        }
+        NSUInteger index = [idx unsignedIntegerValue];
+        if (index < firstIndex)
+        {
+            [self noteCountsBeforeMergingAtIndex:index into:countsBefore];
+        }
+        CoverStoryCoverageFileData *currentData = replacements[idx] ?:
+            ((index < firstIndex) ? _fileDatas[index] : newOnes[index - firstIndex]);
+        CoverStoryCoverageFileData *existing = contributions[sourcePath];
+        if (existing)
+        {
+            // more of what this origin already has
+            if (![existing addFileData:fileData messageReceiver:receiver])
+            {
+                wasGood = NO;
+            }
+            if (currentData != existing)
+            {
+                [currentData addFileData:fileData messageReceiver:nil];
+            }
+            continue;
+        }
+        NSMutableArray *origins = _originsBySourcePath[sourcePath];
+        id firstOrigin          = origins[0];
+        contributions[sourcePath] = fileData;
+        [origins addObject:origin];
+        if (currentData == _contributionsByOrigin[firstOrigin][sourcePath])
+        {
+            // it was sharing its only origin's, it needs its own now
+            CoverStoryCoverageFileData *merged = CSCopyOfFileData(currentData);
+            if (index < firstIndex)
+            {
+                replacements[idx] = merged;
+            }
+            else
+            {
+                newOnes[index - firstIndex] = merged;
+            }
+            currentData = merged;
+        }
+        if (![currentData addFileData:fileData messageReceiver:receiver])
+        {
+            wasGood = NO;
+        }
+    }
+    if ([replacements count])
+    {
+        NSMutableIndexSet *replacedIndexes = [NSMutableIndexSet indexSet];
+        for (NSNumber *idx in replacements)
+        {
+            [replacedIndexes addIndex:[idx unsignedIntegerValue]];
+        }
+        NSMutableArray *objects = [NSMutableArray arrayWithCapacity:[replacements count]];
+        [replacedIndexes enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+            [objects addObject:replacements[@(index)]];
+        }];
+        [self willChange:NSKeyValueChangeReplacement valuesAtIndexes:replacedIndexes forKey:@"fileDatas"];
+        [_fileDatas replaceObjectsAtIndexes:replacedIndexes withObjects:objects];
+        ++_contentGeneration;
+        [self didChange:NSKeyValueChangeReplacement valuesAtIndexes:replacedIndexes forKey:@"fileDatas"];
+    }
+    // (a replaced file was merged into, so its old counts were noted)
+    [self updateTotalsForMerges:countsBefore replacements:replacements];
+    if ([newOnes count])
+    {
+        NSIndexSet *indexes = [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(firstIndex, [newOnes count])];
+        [self willChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:@"fileDatas"];
+        [_fileDatas addObjectsFromArray:newOnes];
+        for (CoverStoryCoverageFileData *newOne in newOnes)
+        {
+            [_totals addFileData:newOne];
+        }
+        ++_contentGeneration;
+        [self didChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:@"fileDatas"];
+        for (CoverStoryCoverageFileData *fileData in newOnes)
+        {
+            for (NSString *warning in [fileData queuedWarnings])
+            {
+                [receiver coverageWarningForPath:[fileData sourcePath] message:@"%@", warning];
+            }
+        }
+    }
+    return wasGood;
+}
+
+// What |sourcePath| comes to from the origins it has now, nil if none.
+- (CoverStoryCoverageFileData *)rebuiltFileDataForSourcePath:(NSString *)sourcePath
+                                             messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver
+{
+    NSArray *origins = _originsBySourcePath[sourcePath];
+    NSUInteger count = [origins count];
+    if (count == 0)
+    {
+        return nil;
+    }
+    CoverStoryCoverageFileData *first = _contributionsByOrigin[origins[0]][sourcePath];
+    if (count == 1)
+    {
+        return first;
+    }
+    CoverStoryCoverageFileData *merged = CSCopyOfFileData(first);
+    for (NSUInteger x = 1; x < count; ++x)
+    {
+        [merged addFileData:_contributionsByOrigin[origins[x]][sourcePath] messageReceiver:receiver];
+    }
+    return merged;
+}
+
+- (BOOL)replaceFileDatasByOrigin:(NSDictionary *)fileDatasByOrigin
+                 messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver
+{
+    NSAssert(_keepsOrigins, @"only a set that keeps origins can replace them");
+    BOOL wasGood                  = YES;
+    NSMutableOrderedSet *affected = [NSMutableOrderedSet orderedSet];
+    for (id origin in fileDatasByOrigin)
+    {
+        // take out what it had...
+        NSDictionary *old = _contributionsByOrigin[origin];
+        for (NSString *sourcePath in old)
+        {
+            [_originsBySourcePath[sourcePath] removeObject:origin];
+            [affected addObject:sourcePath];
+        }
+        [_contributionsByOrigin removeObjectForKey:origin];
+
+        // ...and file what it has now
+        NSMutableDictionary *contributions = [NSMutableDictionary dictionary];
+        for (CoverStoryCoverageFileData *fileData in fileDatasByOrigin[origin])
+        {
+            NSString *sourcePath                 = [fileData sourcePath];
+            CoverStoryCoverageFileData *existing = contributions[sourcePath];
+            if (existing)
+            {
+                if (![existing addFileData:fileData messageReceiver:receiver])
+                {
+                    wasGood = NO;
+                }
+                continue;
+            }
+            contributions[sourcePath] = fileData;
+            NSMutableArray *origins   = _originsBySourcePath[sourcePath];
+            if (!origins)
+            {
+                origins                          = [NSMutableArray array];
+                _originsBySourcePath[sourcePath] = origins;
+            }
+            [origins addObject:origin];
+            [affected addObject:sourcePath];
+        }
+        if ([contributions count])
+        {
+            _contributionsByOrigin[origin] = contributions;
+        }
+    }
+
+    NSMutableIndexSet *replacedIndexes = [NSMutableIndexSet indexSet];
+    NSMutableDictionary *replacements  = [NSMutableDictionary dictionary];  // NSNumber index -> file data
+    NSMutableIndexSet *removedIndexes  = [NSMutableIndexSet indexSet];
+    NSMutableArray *newOnes            = [NSMutableArray array];
+    NSMutableArray *changed            = [NSMutableArray array];
+    for (NSString *sourcePath in affected)
+    {
+        CoverStoryCoverageFileData *rebuilt = [self rebuiltFileDataForSourcePath:sourcePath
+                                                                 messageReceiver:receiver];
+        NSNumber *idx = _indexesBySourcePath[sourcePath];
+        if (!rebuilt)
+        {
+            [_originsBySourcePath removeObjectForKey:sourcePath];
+            if (idx)
+            {
+                [removedIndexes addIndex:[idx unsignedIntegerValue]];
+            }
+            continue;
+        }
+        if (!idx)
+        {
+            [newOnes addObject:rebuilt];
+            [changed addObject:rebuilt];
+            continue;
+        }
+        if (!CSFileDatasMatch(_fileDatas[[idx unsignedIntegerValue]], rebuilt))
+        {
+            [replacedIndexes addIndex:[idx unsignedIntegerValue]];
+            replacements[idx] = rebuilt;
+            [changed addObject:rebuilt];
+        }
+    }
+
+    // Each kind of change goes into a new array, so anything holding on to
+    // the old one sees it changed.
+    if ([replacedIndexes count])
+    {
+        NSMutableArray *objects = [NSMutableArray arrayWithCapacity:[replacedIndexes count]];
+        [replacedIndexes enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+            [objects addObject:replacements[@(index)]];
+        }];
+        [self willChange:NSKeyValueChangeReplacement valuesAtIndexes:replacedIndexes forKey:@"fileDatas"];
+        _fileDatas = [_fileDatas mutableCopy];
+        [replacedIndexes enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+            [_totals removeFileData:_fileDatas[index]];
+            [_totals addFileData:replacements[@(index)]];
+        }];
+        [_fileDatas replaceObjectsAtIndexes:replacedIndexes withObjects:objects];
+        ++_contentGeneration;
+        [self didChange:NSKeyValueChangeReplacement valuesAtIndexes:replacedIndexes forKey:@"fileDatas"];
+    }
+    if ([removedIndexes count])
+    {
+        [self willChange:NSKeyValueChangeRemoval valuesAtIndexes:removedIndexes forKey:@"fileDatas"];
+        _fileDatas = [_fileDatas mutableCopy];
+        [removedIndexes enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+            [_totals removeFileData:_fileDatas[index]];
+        }];
+        [_fileDatas removeObjectsAtIndexes:removedIndexes];
+        [_indexesBySourcePath removeAllObjects];
+        [_fileDatas enumerateObjectsUsingBlock:^(CoverStoryCoverageFileData *fileData, NSUInteger index, BOOL *stop) {
+            _indexesBySourcePath[[fileData sourcePath]] = @(index);
+        }];
+        ++_contentGeneration;
+        [self didChange:NSKeyValueChangeRemoval valuesAtIndexes:removedIndexes forKey:@"fileDatas"];
+    }
+    if ([newOnes count])
+    {
+        NSUInteger firstIndex = [_fileDatas count];
+        NSIndexSet *indexes   = [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(firstIndex, [newOnes count])];
+        [self willChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:@"fileDatas"];
+        _fileDatas = [_fileDatas mutableCopy];
+        [newOnes enumerateObjectsUsingBlock:^(CoverStoryCoverageFileData *fileData, NSUInteger index, BOOL *stop) {
+            _indexesBySourcePath[[fileData sourcePath]] = @(firstIndex + index);
+            [_totals addFileData:fileData];
+        }];
+        [_fileDatas addObjectsFromArray:newOnes];
+        ++_contentGeneration;
+        [self didChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:@"fileDatas"];
+    }
+    for (CoverStoryCoverageFileData *fileData in changed)
+    {
         for (NSString *warning in [fileData queuedWarnings])
         {
             [receiver coverageWarningForPath:[fileData sourcePath] message:@"%@", warning];
         }
-        wasGood = YES;
     }
     return wasGood;
 }
@@ -74,14 +465,13 @@
             coverageString:(NSString * *)outCoverageString
                   coverage:(float *)outCoverage
 {
-    // use the enum helper
-    NSEnumerator *enumerator = [_fileDatas objectEnumerator];
-    [enumerator coverageTotalLines:outTotal
-                         codeLines:outCode
-                      hitCodeLines:outHitCode
-                  nonFeasibleLines:outNonFeasible
-                    coverageString:outCoverageString
-                          coverage:outCoverage];
+    // kept up to date as files are added and merged
+    [_totals coverageTotalLines:outTotal
+                      codeLines:outCode
+                   hitCodeLines:outHitCode
+               nonFeasibleLines:outNonFeasible
+                 coverageString:outCoverageString
+                       coverage:outCoverage];
 }
 
 - (void)removeAllData
@@ -90,6 +480,11 @@
     NSIndexSet *fullSet = [NSIndexSet indexSetWithIndexesInRange:fullRange];
     [self willChange:NSKeyValueChangeRemoval valuesAtIndexes:fullSet forKey:@"fileDatas"];
     [_fileDatas removeAllObjects];
+    [_indexesBySourcePath removeAllObjects];
+    [_contributionsByOrigin removeAllObjects];
+    [_originsBySourcePath removeAllObjects];
+    [_totals removeAll];
+    ++_contentGeneration;
     [self didChange:NSKeyValueChangeRemoval
     valuesAtIndexes:fullSet forKey:@"fileDatas"];
 }
@@ -0,0 +1,55 @@
+//
+//  CoverStoryCoverageShard.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// A compact binary snapshot of the coverage for a set of source files, so test
+// runs sharded across machines can each write one and have them combined
+// without copying the .gcda files around and running gcov on all of them
+// again.  Each source keeps its lines (just the source bytes, packed), a hash
+// of the text and of every line, and the hit counts w/ the non-feasible
+// markers already applied.  Shards are mapped in, so opening one only costs
+// building the file datas around the mapping.
+//
+// Merging combines shards pairwise as a tree across a queue of workers, w/ the
+// same results as adding them to a CoverStoryCoverageSet one after another in
+// order: a not executed line takes the next shard's count, real hits are
+// summed, and a shard whose lines don't match the first shard w/ that source
+// is left out w/ an error.
+
+#import <Foundation/Foundation.h>
+#import "CoverStoryProtocols.h"
+
+@class CoverStoryDocument;
+
+
+@interface CoverStoryCoverageShard : NSObject {
+@private
+    NSString *_path;
+    NSData *_data;
+    NSArray *_recordRanges;  // of NSValue (NSRange), validated
+}
+
+@property (readonly, nonatomic, copy) NSString *path;
+@property (readonly, nonatomic, assign) NSUInteger sourceCount;
+
+// Maps in and checks the shard at |path|.
+- (id)initWithContentsOfFile:(NSString *)path error:(NSError **)error;
+
+// The sources in the shard, in the order they were written.
+- (NSArray *)fileDatasWithDocument:(CoverStoryDocument *)document;
+
++ (NSData *)shardDataForFileDatas:(NSArray *)fileDatas;
++ (BOOL)writeFileDatas:(NSArray *)fileDatas toFile:(NSString *)path error:(NSError **)error;
+
+// The merged sources of all the shards at |paths|, in the order they first
+// appear.  Shards that can't be read and sources that don't match are
+// reported to |receiver| (from the calling thread, once all the work is done).
+// |maxConcurrency| of 0 means one worker per core.
++ (NSArray *)fileDatasByMergingShardsAtPaths:(NSArray *)paths
+                              maxConcurrency:(NSUInteger)maxConcurrency
+                                    document:(CoverStoryDocument *)document
+                             messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver;
+
+@end
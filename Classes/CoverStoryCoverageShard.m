@@ -0,0 +1,653 @@
+//
+//  CoverStoryCoverageShard.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "CoverStoryCoverageShard.h"
+#import "CoverStoryCoverageFileData.h"
+#import "CodeCoverage.h"
+#import "CoverStoryMappedData.h"
+
+// Layout (native byte order, everything 8 byte aligned):
+//   CSShardHeader
+//   records: CSShardRecordHeader, source path, warnings (each NUL
+//   terminated), padding, text, padding, line ranges, line hashes, hit counts
+// The text is just the bytes of the lines, one after another, so two sources
+// w/ the same lines have the same text and line ranges.  Bump the format
+// version whenever any of this changes.
+static const char kCSShardMagic[4]         = { 'C', 'S', 'S', 'H' };
+static const uint32_t kCSShardFormatVersion = 1;
+
+typedef struct {
+    char magic[4];
+    uint32_t formatVersion;
+    uint32_t sourceCount;
+    uint32_t unused;
+} CSShardHeader;
+
+typedef struct {
+    uint32_t sourcePathLength;
+    uint32_t warningsLength;
+    uint32_t textLength;
+    uint32_t lineCount;
+    uint64_t textHash;
+} CSShardRecordHeader;
+
+// Where everything in one record is, offsets are from the start of the shard.
+typedef struct {
+    CSShardRecordHeader header;
+    NSUInteger pathOffset;
+    NSUInteger warningsOffset;
+    NSUInteger textOffset;
+    NSUInteger rangesOffset;
+    NSUInteger hashesOffset;
+    NSUInteger hitsOffset;
+    NSUInteger endOffset;
+} CSShardRecordLayout;
+
+// While merging, each line of a source is kept as what the hits from the
+// shards merged so far do to a count that comes before them: a not executed
+// count becomes |notExecuted|, a non-feasible one |nonFeasible|, and anything
+// else gets |hits| added (see coverageMergeHitCounts()).  Unlike the counts
+// themselves these combine the same way no matter how the shards are grouped,
+// so the tree gives the same answer as merging one shard at a time, and the
+// merged count is |notExecuted| (what the first shard's count would be taken
+// as).
+typedef struct {
+    int64_t notExecuted;
+    int64_t nonFeasible;
+    int64_t hits;
+} CSShardLineState;
+
+// FNV-1a, enough to tell lines apart quickly (they're still compared byte for
+// byte before they're treated as the same).
+static uint64_t CSShardHash(const void *bytes, NSUInteger length)
+{
+    const uint8_t *data = bytes;
+    uint64_t hash       = 14695981039346656037ULL;
+    for (NSUInteger x = 0; x < length; ++x)
+    {
+        hash ^= data[x];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int64_t CSShardApplyState(const CSShardLineState *state, int64_t hitCount)
+{
+    if (hitCount == kCoverStoryNotExecutedMarker)
+    {
+        return state->notExecuted;
+    }
+    if (hitCount == kCoverStoryNonFeasibleMarker)
+    {
+        return state->nonFeasible;
+    }
+    return hitCount + state->hits;
+}
+
+static NSError *CSShardError(NSString *format, ...) NS_FORMAT_FUNCTION(1, 2);
+static NSError *CSShardError(NSString *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    NSString *description = [[NSString alloc] initWithFormat:format arguments:list];
+    va_end(list);
+    return [NSError errorWithDomain:kCoverStoryErrorDomain
+                               code:kCoverStoryShardError
+                           userInfo:@{NSLocalizedDescriptionKey : description}];
+}
+
+// Works out where everything in the record at |offset| is and makes sure it's
+// all really there (the counts are 32 bit, so this can't overflow).
+static BOOL CSShardLayoutRecord(const uint8_t *bytes, NSUInteger length, NSUInteger offset,
+                                CSShardRecordLayout *layout)
+{
+    if ((offset > length) || (length - offset < sizeof(CSShardRecordHeader)))
+    {
+        return NO;
+    }
+    memcpy(&layout->header, bytes + offset, sizeof(layout->header));
+    const CSShardRecordHeader *header = &layout->header;
+    uint64_t pathOffset     = offset + sizeof(CSShardRecordHeader);
+    uint64_t warningsOffset = pathOffset + header->sourcePathLength;
+    uint64_t textOffset     = mappedDataAligned(warningsOffset + header->warningsLength);
+    uint64_t rangesOffset   = mappedDataAligned(textOffset + header->textLength);
+    uint64_t hashesOffset   = rangesOffset + (uint64_t)header->lineCount * sizeof(CoverStoryLineRange);
+    uint64_t hitsOffset     = hashesOffset + (uint64_t)header->lineCount * sizeof(uint64_t);
+    uint64_t endOffset      = hitsOffset + (uint64_t)header->lineCount * sizeof(int64_t);
+    if (endOffset > length)
+    {
+        return NO;
+    }
+    const CoverStoryLineRange *ranges = (const CoverStoryLineRange *)(bytes + rangesOffset);
+    for (uint32_t x = 0; x < header->lineCount; ++x)
+    {
+        if ((uint64_t)ranges[x].offset + ranges[x].length > header->textLength)
+        {
+            return NO;
+        }
+    }
+    layout->pathOffset     = (NSUInteger)pathOffset;
+    layout->warningsOffset = (NSUInteger)warningsOffset;
+    layout->textOffset     = (NSUInteger)textOffset;
+    layout->rangesOffset   = (NSUInteger)rangesOffset;
+    layout->hashesOffset   = (NSUInteger)hashesOffset;
+    layout->hitsOffset     = (NSUInteger)hitsOffset;
+    layout->endOffset      = (NSUInteger)endOffset;
+    return YES;
+}
+
+// One version of a source's lines while merging, and the shards that had it.
+@interface CSShardVariant : NSObject {
+@public
+    NSData *_data;  // the shard it came from
+    NSString *_shardPath;
+    CSShardRecordLayout _layout;
+    NSMutableData *_states;  // of CSShardLineState
+    NSUInteger _shardCount;
+}
+- (BOOL)hasSameLinesAs:(CSShardVariant *)other;
+- (void)mergeVariant:(CSShardVariant *)other;
+@end
+
+@implementation CSShardVariant
+
+- (BOOL)hasSameLinesAs:(CSShardVariant *)other
+{
+    const CSShardRecordHeader *mine   = &_layout.header;
+    const CSShardRecordHeader *theirs = &other->_layout.header;
+    if ((mine->lineCount != theirs->lineCount) || (mine->textLength != theirs->textLength) ||
+        (mine->textHash != theirs->textHash))
+    {
+        return NO;
+    }
+    // the text is packed, so the same lines means the same text and ranges
+    const uint8_t *myBytes    = [_data bytes];
+    const uint8_t *theirBytes = [other->_data bytes];
+    return ((memcmp(myBytes + _layout.textOffset, theirBytes + other->_layout.textOffset, mine->textLength) == 0) &&
+            (memcmp(myBytes + _layout.rangesOffset, theirBytes + other->_layout.rangesOffset,
+                    mine->lineCount * sizeof(CoverStoryLineRange)) == 0));
+}
+
+- (void)mergeVariant:(CSShardVariant *)other
+{
+    // |other| comes after us, so its changes apply to the results of ours
+    CSShardLineState *mine         = [_states mutableBytes];
+    const CSShardLineState *theirs = [other->_states bytes];
+    NSUInteger lineCount           = _layout.header.lineCount;
+    for (NSUInteger x = 0; x < lineCount; ++x)
+    {
+        mine[x].notExecuted = CSShardApplyState(&theirs[x], mine[x].notExecuted);
+        mine[x].nonFeasible = CSShardApplyState(&theirs[x], mine[x].nonFeasible);
+        mine[x].hits       += theirs[x].hits;
+    }
+    _shardCount += other->_shardCount;
+}
+
+@end
+
+// Everything merged from a run of shards: the sources in the order they first
+// showed up, and the shards that couldn't be read.
+@interface CSShardPartial : NSObject {
+@public
+    NSMutableArray *_sourcePaths;
+    NSMutableDictionary *_variantsBySourcePath;  // -> NSMutableArray, first shard first
+    NSMutableArray *_failures;                   // of @[ path, message ]
+}
+- (void)mergePartial:(CSShardPartial *)other;
+@end
+
+@implementation CSShardPartial
+
+- (id)init
+{
+    if ((self = [super init]))
+    {
+        _sourcePaths          = [[NSMutableArray alloc] init];
+        _variantsBySourcePath = [[NSMutableDictionary alloc] init];
+        _failures             = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (void)mergePartial:(CSShardPartial *)other
+{
+    for (NSString *sourcePath in other->_sourcePaths)
+    {
+        NSMutableArray *theirs = other->_variantsBySourcePath[sourcePath];
+        NSMutableArray *mine   = _variantsBySourcePath[sourcePath];
+        if (!mine)
+        {
+            [_sourcePaths addObject:sourcePath];
+            _variantsBySourcePath[sourcePath] = theirs;
+            continue;
+        }
+        for (CSShardVariant *variant in theirs)
+        {
+            BOOL merged = NO;
+            for (CSShardVariant *existing in mine)
+            {
+                if ([existing hasSameLinesAs:variant])
+                {
+                    [existing mergeVariant:variant];
+                    merged = YES;
+                    break;
+                }
+            }
+            if (!merged)
+            {
+                [mine addObject:variant];
+            }
+        }
+    }
+    [_failures addObjectsFromArray:other->_failures];
+}
+
+@end
+
+@interface CoverStoryCoverageShard ()
+- (CSShardPartial *)partial;
+@end
+
+@implementation CoverStoryCoverageShard
+
+@synthesize path = _path;
+
+- (id)init
+{
+    return [self initWithContentsOfFile:nil error:NULL];
+}
+
+- (id)initWithContentsOfFile:(NSString *)path error:(NSError **)error
+{
+    if ((self = [super init]))
+    {
+        NSError *readError = nil;
+        NSData *data       = [path length] ? [NSData dataWithContentsOfFile:path
+                                                                    options:NSDataReadingMappedIfSafe
+                                                                      error:&readError]
+                                           : nil;
+        const uint8_t *bytes = [data bytes];
+        NSUInteger length    = [data length];
+        CSShardHeader header;
+        if (!data)
+        {
+            if (error)
+            {
+                *error = readError ?: CSShardError(@"couldn't read shard");
+            }
+            return nil;
+        }
+        if (length < sizeof(header))
+        {
+            if (error)
+            {
+                *error = CSShardError(@"'%@' is too short to be a shard", path);
+            }
+            return nil;
+        }
+        memcpy(&header, bytes, sizeof(header));
+        if ((memcmp(header.magic, kCSShardMagic, sizeof(header.magic)) != 0) ||
+            (header.formatVersion != kCSShardFormatVersion))
+        {
+            if (error)
+            {
+                *error = CSShardError(@"'%@' isn't a shard this version of CoverStory can read", path);
+            }
+            return nil;
+        }
+        NSMutableArray *recordRanges = [NSMutableArray arrayWithCapacity:header.sourceCount];
+        NSUInteger offset            = sizeof(header);
+        for (uint32_t x = 0; x < header.sourceCount; ++x)
+        {
+            CSShardRecordLayout layout;
+            if (!CSShardLayoutRecord(bytes, length, offset, &layout))
+            {
+                if (error)
+                {
+                    *error = CSShardError(@"'%@' is damaged (source %u of %u)", path, x + 1, header.sourceCount);
+                }
+                return nil;
+            }
+            [recordRanges addObject:[NSValue valueWithRange:NSMakeRange(offset, layout.endOffset - offset)]];
+            offset = (NSUInteger)mappedDataAligned(layout.endOffset);
+        }
+        _path         = [path copy];
+        _data         = data;
+        _recordRanges = recordRanges;
+    }
+    return self;
+}
+
+- (NSUInteger)sourceCount
+{
+    return [_recordRanges count];
+}
+
+static NSString *CSShardSourcePath(NSData *data, const CSShardRecordLayout *layout)
+{
+    return [[NSString alloc] initWithBytes:(const uint8_t *)[data bytes] + layout->pathOffset
+                                    length:layout->header.sourcePathLength
+                                  encoding:NSUTF8StringEncoding];
+}
+
+static CoverStoryCoverageFileData *CSShardFileData(NSData *data,
+                                                   const CSShardRecordLayout *layout,
+                                                   NSData *hitCounts,
+                                                   CoverStoryDocument *document)
+{
+    NSString *sourcePath = CSShardSourcePath(data, layout);
+    if (!sourcePath)
+    {
+        return nil;
+    }
+    NSData *text       = [[CoverStoryMappedDataSlice alloc] initWithData:data
+                                                                   range:NSMakeRange(layout->textOffset,
+                                                                                     layout->header.textLength)];
+    NSData *lineRanges = [[CoverStoryMappedDataSlice alloc] initWithData:data
+                                                                   range:NSMakeRange(layout->rangesOffset,
+                                                                                     layout->hashesOffset - layout->rangesOffset)];
+    if (!hitCounts)
+    {
+        hitCounts = [[CoverStoryMappedDataSlice alloc] initWithData:data
+                                                              range:NSMakeRange(layout->hitsOffset,
+                                                                                layout->endOffset - layout->hitsOffset)];
+    }
+    // The markers were already applied before it was written.
+    CoverStoryCoverageFileData *fileData =
+        [[CoverStoryCoverageFileData alloc] initWithSourcePath:sourcePath
+                                                          text:text
+                                                    lineRanges:lineRanges
+                                                     hitCounts:hitCounts
+                                       applyNonFeasibleMarkers:NO
+                                                      document:document];
+    [fileData queueWarnings:mappedDataWarningsFromBytes((const uint8_t *)[data bytes] + layout->warningsOffset,
+                                                      layout->header.warningsLength)];
+    return fileData;
+}
+
+- (NSArray *)fileDatasWithDocument:(CoverStoryDocument *)document
+{
+    const uint8_t *bytes      = [_data bytes];
+    NSMutableArray *fileDatas = [NSMutableArray arrayWithCapacity:[_recordRanges count]];
+    for (NSValue *recordRange in _recordRanges)
+    {
+        CSShardRecordLayout layout;
+        CSShardLayoutRecord(bytes, [_data length], [recordRange rangeValue].location, &layout);
+        CoverStoryCoverageFileData *fileData = CSShardFileData(_data, &layout, nil, document);
+        if (fileData)
+        {
+            [fileDatas addObject:fileData];
+        }
+    }
+    return fileDatas;
+}
+
+- (CSShardPartial *)partial
+{
+    CSShardPartial *partial = [[CSShardPartial alloc] init];
+    const uint8_t *bytes    = [_data bytes];
+    for (NSValue *recordRange in _recordRanges)
+    {
+        CSShardVariant *variant = [[CSShardVariant alloc] init];
+        variant->_data          = _data;
+        variant->_shardPath     = _path;
+        variant->_shardCount    = 1;
+        CSShardLayoutRecord(bytes, [_data length], [recordRange rangeValue].location, &variant->_layout);
+        NSString *sourcePath = CSShardSourcePath(_data, &variant->_layout);
+        if (!sourcePath)
+        {
+            continue;
+        }
+        NSUInteger lineCount   = variant->_layout.header.lineCount;
+        const int64_t *hits    = (const int64_t *)(bytes + variant->_layout.hitsOffset);
+        variant->_states       = [NSMutableData dataWithLength:lineCount * sizeof(CSShardLineState)];
+        CSShardLineState *state = [variant->_states mutableBytes];
+        for (NSUInteger x = 0; x < lineCount; ++x)
+        {
+            // what merging in |hits[x]| does (see coverageMergeHitCounts())
+            state[x].notExecuted = hits[x];
+            state[x].nonFeasible = coverageMergeHitCounts(kCoverStoryNonFeasibleMarker, hits[x]);
+            state[x].hits        = (hits[x] > 0) ? hits[x] : 0;
+        }
+        NSMutableArray *variants = partial->_variantsBySourcePath[sourcePath];
+        if (variants)
+        {
+            // the same source twice in one shard, merge it like any other
+            CSShardPartial *again = [[CSShardPartial alloc] init];
+            [again->_sourcePaths addObject:sourcePath];
+            again->_variantsBySourcePath[sourcePath] = [NSMutableArray arrayWithObject:variant];
+            [partial mergePartial:again];
+        }
+        else
+        {
+            [partial->_sourcePaths addObject:sourcePath];
+            partial->_variantsBySourcePath[sourcePath] = [NSMutableArray arrayWithObject:variant];
+        }
+    }
+    return partial;
+}
+
++ (NSData *)shardDataForFileDatas:(NSArray *)fileDatas
+{
+    CSShardHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kCSShardMagic, sizeof(header.magic));
+    header.formatVersion = kCSShardFormatVersion;
+    header.sourceCount   = (uint32_t)[fileDatas count];
+    NSMutableData *shard = [NSMutableData dataWithBytes:&header length:sizeof(header)];
+
+    for (CoverStoryCoverageFileData *fileData in fileDatas)
+    {
+        NSData *sourcePath = [[fileData sourcePath] dataUsingEncoding:NSUTF8StringEncoding];
+        NSUInteger lines   = [fileData lineCount];
+        NSMutableData *text       = [NSMutableData data];
+        NSMutableData *lineRanges = [NSMutableData dataWithCapacity:lines * sizeof(CoverStoryLineRange)];
+        NSMutableData *lineHashes = [NSMutableData dataWithCapacity:lines * sizeof(uint64_t)];
+        for (NSUInteger x = 0; x < lines; ++x)
+        {
+            NSUInteger length         = 0;
+            const char *line          = [fileData lineBytesAtIndex:x length:&length];
+            CoverStoryLineRange range = { (uint32_t)[text length], (uint32_t)length };
+            uint64_t hash             = CSShardHash(line, length);
+            [text appendBytes:line length:length];
+            [lineRanges appendBytes:&range length:sizeof(range)];
+            [lineHashes appendBytes:&hash length:sizeof(hash)];
+        }
+        if (!sourcePath || ([sourcePath length] > UINT32_MAX) || ([text length] > UINT32_MAX) ||
+            (lines > UINT32_MAX))
+        {
+            return nil;
+        }
+        NSData *warnings = mappedDataWarnings([fileData queuedWarnings]);
+
+        CSShardRecordHeader record;
+        record.sourcePathLength = (uint32_t)[sourcePath length];
+        record.warningsLength   = (uint32_t)[warnings length];
+        record.textLength       = (uint32_t)[text length];
+        record.lineCount        = (uint32_t)lines;
+        record.textHash         = CSShardHash([text bytes], [text length]);
+        [shard appendBytes:&record length:sizeof(record)];
+        [shard appendData:sourcePath];
+        [shard appendData:warnings];
+        mappedDataAppendPadding(shard);
+        [shard appendData:text];
+        mappedDataAppendPadding(shard);
+        [shard appendData:lineRanges];
+        [shard appendData:lineHashes];
+        [shard appendBytes:[fileData hitCounts] length:lines * sizeof(int64_t)];
+        mappedDataAppendPadding(shard);
+    }
+    return shard;
+}
+
++ (BOOL)writeFileDatas:(NSArray *)fileDatas toFile:(NSString *)path error:(NSError **)error
+{
+    NSData *shard = [self shardDataForFileDatas:fileDatas];
+    if (!shard)
+    {
+        if (error)
+        {
+            *error = CSShardError(@"the coverage is too big for a shard");
+        }
+        return NO;
+    }
+    return [shard writeToFile:path options:NSDataWritingAtomic error:error];
+}
+
+// The first line where |variant| differs from |reference|, for the error.
+static NSUInteger CSShardFirstDifferentLine(CSShardVariant *reference, CSShardVariant *variant)
+{
+    NSUInteger lineCount            = reference->_layout.header.lineCount;
+    const uint8_t *refBytes         = [reference->_data bytes];
+    const uint8_t *bytes            = [variant->_data bytes];
+    const uint64_t *refHashes       = (const uint64_t *)(refBytes + reference->_layout.hashesOffset);
+    const uint64_t *hashes          = (const uint64_t *)(bytes + variant->_layout.hashesOffset);
+    const CoverStoryLineRange *refs = (const CoverStoryLineRange *)(refBytes + reference->_layout.rangesOffset);
+    const CoverStoryLineRange *rngs = (const CoverStoryLineRange *)(bytes + variant->_layout.rangesOffset);
+    for (NSUInteger x = 0; x < lineCount; ++x)
+    {
+        if ((refHashes[x] != hashes[x]) || (refs[x].length != rngs[x].length) ||
+            (memcmp(refBytes + reference->_layout.textOffset + refs[x].offset,
+                    bytes + variant->_layout.textOffset + rngs[x].offset, refs[x].length) != 0))
+        {
+            return x;
+        }
+    }
+    return NSNotFound;
+}
+
+static NSString *CSShardLine(CSShardVariant *variant, NSUInteger index)
+{
+    const uint8_t *bytes             = [variant->_data bytes];
+    const CoverStoryLineRange *range = (const CoverStoryLineRange *)(bytes + variant->_layout.rangesOffset) + index;
+    return coverageLineString((const char *)bytes + variant->_layout.textOffset + range->offset, range->length);
+}
+
++ (NSArray *)fileDatasByMergingShardsAtPaths:(NSArray *)paths
+                              maxConcurrency:(NSUInteger)maxConcurrency
+                                    document:(CoverStoryDocument *)document
+                             messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver
+{
+    if ([paths count] == 0)
+    {
+        return @[];
+    }
+    if (maxConcurrency == 0)
+    {
+        maxConcurrency = [[NSProcessInfo processInfo] activeProcessorCount];
+    }
+    NSOperationQueue *queue = [[NSOperationQueue alloc] init];
+    [queue setMaxConcurrentOperationCount:MAX(maxConcurrency, (NSUInteger)1)];
+
+    // The leaves: read each shard.
+    NSMutableArray *level = [NSMutableArray arrayWithCapacity:[paths count]];
+    for (NSUInteger x = 0; x < [paths count]; ++x)
+    {
+        [level addObject:[NSNull null]];
+    }
+    [paths enumerateObjectsUsingBlock:^(NSString *path, NSUInteger index, BOOL *stop) {
+        [queue addOperationWithBlock:^{
+            @autoreleasepool {
+                NSError *error                 = nil;
+                CoverStoryCoverageShard *shard = [[CoverStoryCoverageShard alloc] initWithContentsOfFile:path
+                                                                                                   error:&error];
+                CSShardPartial *partial = [shard partial];
+                if (!partial)
+                {
+                    partial = [[CSShardPartial alloc] init];
+                    [partial->_failures addObject:@[path, [error localizedDescription] ?: @"couldn't read shard"]];
+                }
+                @synchronized(level)
+                {
+                    level[index] = partial;
+                }
+            }
+        }];
+    }];
+    [queue waitUntilAllOperationsAreFinished];
+
+    // Then merge neighbors until there's one left, each one only ever merges
+    // w/ the one after it, so the order is kept.
+    while ([level count] > 1)
+    {
+        NSUInteger count    = [level count];
+        NSMutableArray *next = [NSMutableArray arrayWithCapacity:(count + 1) / 2];
+        for (NSUInteger x = 0; x < count; x += 2)
+        {
+            CSShardPartial *left = level[x];
+            [next addObject:left];
+            if (x + 1 < count)
+            {
+                CSShardPartial *right = level[x + 1];
+                [queue addOperationWithBlock:^{
+                    @autoreleasepool {
+                        [left mergePartial:right];
+                    }
+                }];
+            }
+        }
+        [queue waitUntilAllOperationsAreFinished];
+        level = next;
+    }
+
+    CSShardPartial *merged = level[0];
+    for (NSArray *failure in merged->_failures)
+    {
+        [receiver coverageErrorForPath:failure[0] message:@"%@", failure[1]];
+    }
+    NSMutableArray *fileDatas = [NSMutableArray arrayWithCapacity:[merged->_sourcePaths count]];
+    for (NSString *sourcePath in merged->_sourcePaths)
+    {
+        NSArray *variants          = merged->_variantsBySourcePath[sourcePath];
+        CSShardVariant *reference  = variants[0];
+        NSUInteger lineCount       = reference->_layout.header.lineCount;
+        NSMutableData *hitCounts   = [NSMutableData dataWithLength:lineCount * sizeof(int64_t)];
+        int64_t *hits              = [hitCounts mutableBytes];
+        const CSShardLineState *state = [reference->_states bytes];
+        for (NSUInteger x = 0; x < lineCount; ++x)
+        {
+            hits[x] = state[x].notExecuted;
+        }
+        CoverStoryCoverageFileData *fileData = CSShardFileData(reference->_data, &reference->_layout,
+                                                               hitCounts, document);
+        if (fileData)
+        {
+            [fileDatas addObject:fileData];
+        }
+
+        // Anything that didn't match the first one was left out.
+        for (NSUInteger x = 1; x < [variants count]; ++x)
+        {
+            CSShardVariant *variant = variants[x];
+            NSUInteger otherCount   = variant->_layout.header.lineCount;
+            if (otherCount != lineCount)
+            {
+                [receiver coverageErrorForPath:sourcePath
+                                       message:@"coverage source in %@ (and %lu other shards) has different line count '%lu' vs '%lu'",
+                                               variant->_shardPath, (unsigned long)(variant->_shardCount - 1),
+                                               (unsigned long)otherCount, (unsigned long)lineCount];
+                continue;
+            }
+            NSUInteger line = CSShardFirstDifferentLine(reference, variant);
+            if (line == NSNotFound)
+            {
+                // only if a shard wasn't packed the way we write them
+                [receiver coverageErrorForPath:sourcePath
+                                       message:@"coverage source in %@ (and %lu other shards) doesn't match",
+                                               variant->_shardPath, (unsigned long)(variant->_shardCount - 1)];
+                continue;
+            }
+            [receiver coverageErrorForPath:sourcePath
+                                   message:@"coverage source in %@ (and %lu other shards) line %lu doesn't match, '%@' vs '%@'",
+                                           variant->_shardPath, (unsigned long)(variant->_shardCount - 1),
+                                           (unsigned long)line, CSShardLine(variant, line), CSShardLine(reference, line)];
+        }
+    }
+    return fileDatas;
+}
+
+@end
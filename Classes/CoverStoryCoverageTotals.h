@@ -0,0 +1,34 @@
+//
+//  CoverStoryCoverageTotals.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// Running line counts for a group of file datas (a set, or what's arranged in
+// the file list).  Files are added and taken out as they come and go, and a
+// file that's merged into is re-counted from what it had before, so nothing
+// has to walk the whole group to get a total.
+
+#import <Foundation/Foundation.h>
+#import "CoverStoryProtocols.h"
+
+@class CoverStoryCoverageFileData;
+
+@interface CoverStoryCoverageTotals : NSObject<CoverStoryLineCoverageProtocol, NSCopying> {
+@private
+    CoverStoryLineCounts _lineCounts;
+    NSUInteger _sourceCount;
+}
+
+@property (readonly, nonatomic, assign) CoverStoryLineCounts lineCounts;
+@property (readonly, nonatomic, assign) NSUInteger sourceCount;
+
+- (void)addFileData:(CoverStoryCoverageFileData *)fileData;
+// Takes out what |fileData| counts now, so it has to be called before it's
+// merged into (or use fileData:changedFromLineCounts:).
+- (void)removeFileData:(CoverStoryCoverageFileData *)fileData;
+// |fileData| is already counted, but had |before| at the time.
+- (void)fileData:(CoverStoryCoverageFileData *)fileData changedFromLineCounts:(CoverStoryLineCounts)before;
+- (void)removeAll;
+
+@end
@@ -0,0 +1,90 @@
+//
+//  CoverStoryCoverageTotals.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "CoverStoryCoverageTotals.h"
+#import "CoverStoryCoverageFileData.h"
+#import "CodeCoverage.h"
+
+@implementation CoverStoryCoverageTotals
+
+@synthesize lineCounts = _lineCounts;
+@synthesize sourceCount = _sourceCount;
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    CoverStoryCoverageTotals *copy = [[[self class] allocWithZone:zone] init];
+    copy->_lineCounts              = _lineCounts;
+    copy->_sourceCount             = _sourceCount;
+    return copy;
+}
+
+- (void)addFileData:(CoverStoryCoverageFileData *)fileData
+{
+    _lineCounts = coverageAddLineCounts(_lineCounts, [fileData lineCounts]);
+    ++_sourceCount;
+}
+
+- (void)removeFileData:(CoverStoryCoverageFileData *)fileData
+{
+    NSAssert(_sourceCount > 0, @"removing from empty totals");
+    _lineCounts = coverageSubtractLineCounts(_lineCounts, [fileData lineCounts]);
+    --_sourceCount;
+}
+
+- (void)fileData:(CoverStoryCoverageFileData *)fileData changedFromLineCounts:(CoverStoryLineCounts)before
+{
+    _lineCounts = coverageAddLineCounts(coverageSubtractLineCounts(_lineCounts, before), [fileData lineCounts]);
+}
+
+- (void)removeAll
+{
+    CoverStoryLineCounts zero = { 0, 0, 0, 0 };
+    _lineCounts               = zero;
+    _sourceCount              = 0;
+}
+
+- (void)coverageTotalLines:(NSInteger *)outTotal
+                 codeLines:(NSInteger *)outCode
+              hitCodeLines:(NSInteger *)outHitCode
+          nonFeasibleLines:(NSInteger *)outNonFeasible
+            coverageString:(NSString * *)outCoverageString
+                  coverage:(float *)outCoverage
+{
+    if (outTotal)
+    {
+        *outTotal = _lineCounts.totalLines;
+    }
+    if (outCode)
+    {
+        *outCode = _lineCounts.codeLines;
+    }
+    if (outHitCode)
+    {
+        *outHitCode = _lineCounts.hitCodeLines;
+    }
+    if (outNonFeasible)
+    {
+        *outNonFeasible = _lineCounts.nonFeasibleLines;
+    }
+    if (outCoverageString || outCoverage)
+    {
+        float coverage = codeCoverage(_lineCounts.codeLines, _lineCounts.hitCodeLines, outCoverageString);
+        if (outCoverage)
+        {
+            *outCoverage = coverage;
+        }
+    }
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"%@ <%p>: %lu sources, %ld lines of code, %ld lines hit",
+                                      [self class], self, (unsigned long)_sourceCount,
+                                      (long)_lineCounts.codeLines, (long)_lineCounts.hitCodeLines];
+}
+
+@end
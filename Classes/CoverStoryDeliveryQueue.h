@@ -0,0 +1,43 @@
+//
+//  CoverStoryDeliveryQueue.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// Coalesces work headed for the main thread.  Any number of threads push
+// objects on (lock free), and the main thread is woken up at most once per
+// interval to hand them to the handler in bounded batches, so a big load
+// doesn't bury the main thread in one performSelectorOnMainThread per item.
+
+#import <Foundation/Foundation.h>
+
+typedef void (^CoverStoryDeliveryHandler)(NSArray *batch);
+
+@interface CoverStoryDeliveryQueue : NSObject
+
+// |handler| is always called on the main thread, w/ the items in the order
+// they were pushed (items from one thread stay in order).
+- (id)initWithHandler:(CoverStoryDeliveryHandler)handler;
+
+// Safe to call from any thread.
+- (void)push:(id)item;
+
+// Hands everything queued so far to the handler, main thread only.
+- (void)drain;
+
+// Most items handed to the handler at once, and how long to wait after the
+// first push before waking up the main thread.
+@property (nonatomic, assign) NSUInteger maxBatchSize;
+@property (nonatomic, assign) NSTimeInterval coalesceInterval;
+
+// Instrumentation
+@property (readonly) NSUInteger depth;          // items waiting right now
+@property (readonly) NSUInteger maxDepth;       // most waiting at once
+@property (readonly) NSUInteger deliveredCount; // items handed to the handler
+@property (readonly) NSUInteger batchCount;     // calls to the handler
+@property (readonly) NSTimeInterval maxLatency; // longest push to delivery
+@property (readonly) NSTimeInterval averageLatency;
+- (void)resetStatistics;
+- (NSString *)statisticsDescription;
+
+@end
@@ -0,0 +1,250 @@
+//
+//  CoverStoryDeliveryQueue.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "CoverStoryDeliveryQueue.h"
+#import <stdatomic.h>
+
+// The queue is an intrusive singly linked list w/ a stub node (Vyukov's MPSC
+// queue): producers swap themselves in as the head w/ one atomic exchange and
+// then link the old head to them, the (single) consumer walks from the tail.
+// A producer that has swapped but not yet linked just looks like the end of
+// the queue to the consumer, the item shows up on the next drain.
+typedef struct CSDeliveryNode {
+    _Atomic(struct CSDeliveryNode *) next;
+    CFTypeRef item;
+    CFAbsoluteTime pushedAt;
+} CSDeliveryNode;
+
+static const NSUInteger kCSDefaultMaxBatchSize         = 500;
+static const NSTimeInterval kCSDefaultCoalesceInterval = 1.0 / 30.0;
+
+@interface CoverStoryDeliveryQueue () {
+@private
+    CoverStoryDeliveryHandler _handler;
+    _Atomic(CSDeliveryNode *) _head;  // producers
+    CSDeliveryNode *_tail;            // consumer (main thread) only
+    atomic_bool _scheduled;
+    atomic_size_t _depth;
+    atomic_size_t _maxDepth;
+    // stats, main thread only
+    NSUInteger _deliveredCount;
+    NSUInteger _batchCount;
+    NSTimeInterval _maxLatency;
+    NSTimeInterval _totalLatency;
+}
+- (void)drainScheduled;
+- (NSUInteger)deliverBatch;
+@end
+
+@implementation CoverStoryDeliveryQueue
+
+@synthesize maxBatchSize = _maxBatchSize;
+@synthesize coalesceInterval = _coalesceInterval;
+
+- (id)init
+{
+    return [self initWithHandler:nil];
+}
+
+- (id)initWithHandler:(CoverStoryDeliveryHandler)handler
+{
+    if ((self = [super init]))
+    {
+        _handler          = [handler copy];
+        _maxBatchSize     = kCSDefaultMaxBatchSize;
+        _coalesceInterval = kCSDefaultCoalesceInterval;
+        CSDeliveryNode *stub = calloc(1, sizeof(CSDeliveryNode));
+        if (!stub)
+        {
+            return nil;
+        }
+        atomic_init(&stub->next, NULL);
+        atomic_init(&_head, stub);
+        _tail = stub;
+        atomic_init(&_scheduled, false);
+        atomic_init(&_depth, 0);
+        atomic_init(&_maxDepth, 0);
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    CSDeliveryNode *node = _tail;
+    while (node)
+    {
+        CSDeliveryNode *next = atomic_load_explicit(&node->next, memory_order_acquire);
+        if (node->item)
+        {
+            CFRelease(node->item);
+        }
+        free(node);
+        node = next;
+    }
+}
+
+- (void)push:(id)item
+{
+    if (!item)
+    {
+        return;
+    }
+    CSDeliveryNode *node = malloc(sizeof(CSDeliveryNode));
+    if (!node)
+    {
+        return;
+    }
+    atomic_init(&node->next, NULL);
+    node->item     = CFBridgingRetain(item);
+    node->pushedAt = CFAbsoluteTimeGetCurrent();
+
+    // count it before it is visible so the consumer never sees it go negative
+    size_t depth   = atomic_fetch_add_explicit(&_depth, 1, memory_order_relaxed) + 1;
+    size_t maxSeen = atomic_load_explicit(&_maxDepth, memory_order_relaxed);
+    while ((depth > maxSeen) &&
+           !atomic_compare_exchange_weak_explicit(&_maxDepth, &maxSeen, depth,
+                                                  memory_order_relaxed, memory_order_relaxed))
+    {
+        // maxSeen was reloaded, try again
+    }
+
+    CSDeliveryNode *prev = atomic_exchange_explicit(&_head, node, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+
+    // Only the first push after a drain wakes up the main thread.
+    if (!atomic_exchange_explicit(&_scheduled, true, memory_order_acq_rel))
+    {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_coalesceInterval * NSEC_PER_SEC)),
+                       dispatch_get_main_queue(), ^{
+                           [self drainScheduled];
+                       });
+    }
+}
+
+- (void)drainScheduled
+{
+    // Clear the flag first so a push that races w/ this drain schedules
+    // another one.
+    atomic_store_explicit(&_scheduled, false, memory_order_release);
+    [self deliverBatch];
+    if ((atomic_load_explicit(&_depth, memory_order_acquire) > 0) &&
+        !atomic_exchange_explicit(&_scheduled, true, memory_order_acq_rel))
+    {
+        // More waiting, let the run loop handle events before the next batch.
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self drainScheduled];
+        });
+    }
+}
+
+- (void)drain
+{
+    NSAssert([NSThread isMainThread], @"only drain on the main thread");
+    while ([self deliverBatch])
+    {
+        // keep going
+    }
+}
+
+// Pops up to maxBatchSize items and hands them to the handler, returns how
+// many it delivered.
+- (NSUInteger)deliverBatch
+{
+    NSMutableArray *batch = nil;
+    CFAbsoluteTime now    = CFAbsoluteTimeGetCurrent();
+    NSUInteger limit      = MAX(_maxBatchSize, (NSUInteger)1);
+    while ([batch count] < limit)
+    {
+        CSDeliveryNode *tail = _tail;
+        CSDeliveryNode *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+        if (!next)
+        {
+            break;
+        }
+        if (!batch)
+        {
+            batch = [NSMutableArray arrayWithCapacity:MIN(limit, atomic_load_explicit(&_depth, memory_order_relaxed))];
+        }
+        // |next| becomes the new stub.
+        id item    = CFBridgingRelease(next->item);
+        next->item = NULL;
+        _tail      = next;
+        free(tail);
+        atomic_fetch_sub_explicit(&_depth, 1, memory_order_relaxed);
+
+        NSTimeInterval latency = now - next->pushedAt;
+        _totalLatency += latency;
+        _maxLatency    = MAX(_maxLatency, latency);
+        [batch addObject:item];
+    }
+    NSUInteger count = [batch count];
+    if (count)
+    {
+        _deliveredCount += count;
+        ++_batchCount;
+        if (_handler)
+        {
+            _handler(batch);
+        }
+    }
+    return count;
+}
+
+- (NSUInteger)depth
+{
+    return atomic_load_explicit(&_depth, memory_order_relaxed);
+}
+
+- (NSUInteger)maxDepth
+{
+    return atomic_load_explicit(&_maxDepth, memory_order_relaxed);
+}
+
+- (NSUInteger)deliveredCount
+{
+    return _deliveredCount;
+}
+
+- (NSUInteger)batchCount
+{
+    return _batchCount;
+}
+
+- (NSTimeInterval)maxLatency
+{
+    return _maxLatency;
+}
+
+- (NSTimeInterval)averageLatency
+{
+    return _deliveredCount ? _totalLatency / _deliveredCount : 0;
+}
+
+- (void)resetStatistics
+{
+    atomic_store_explicit(&_maxDepth, atomic_load_explicit(&_depth, memory_order_relaxed), memory_order_relaxed);
+    _deliveredCount = 0;
+    _batchCount     = 0;
+    _maxLatency     = 0;
+    _totalLatency   = 0;
+}
+
+- (NSString *)statisticsDescription
+{
+    return [NSString stringWithFormat:@"Delivered %lu items in %lu batches (max queue depth %lu, "
+                                      @"latency avg %.1fms, max %.1fms).",
+                                      (unsigned long)[self deliveredCount], (unsigned long)[self batchCount],
+                                      (unsigned long)[self maxDepth],
+                                      [self averageLatency] * 1000.0, [self maxLatency] * 1000.0];
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"%@ <%p>: %lu waiting", [self class], self, (unsigned long)[self depth]];
+}
+
+@end
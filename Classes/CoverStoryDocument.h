@@ -25,6 +25,12 @@
 @class CoverStoryArrayController;
 @class CoverStoryCodeViewTableView;
 @class CoverStoryCoverageSet;
+@class CoverStoryDeliveryQueue;
+@class CoverStoryCoverageCache;
+@class CoverStoryCoverageDiff;
+@class CoverStoryFolderWatcher;
+@class CoverStoryQueryServer;
+@class CoverStoryTracer;
 
 @interface CoverStoryDocument : NSDocument<CoverStoryCoverageProcessingProtocol, NSAnimationDelegate> {
  @private
@@ -50,6 +56,19 @@
   NSViewAnimation *currentAnimation_;
   NSString *commonPathPrefix_;
   NSOperation *doneOperation_;
+  CoverStoryDeliveryQueue *deliveryQueue_;  // worker -> main thread results
+  CoverStoryCoverageCache *coverageCache_;  // nil if turned off
+  BOOL watchingForChanges_;
+  BOOL restoringSelection_;
+  CoverStoryFolderWatcher *folderWatcher_;    // nil unless watching a folder
+  NSMutableSet *changedFolders_;              // waiting to be reloaded
+  NSMutableDictionary *refreshedFileDatas_;   // folder -> what's been reloaded
+  CoverStoryTracer *tracer_;                  // nil unless tracing loads
+  BOOL streamGCov_;                           // parse gcov -t output as it comes
+  CoverStoryCoverageDiff *diff_;              // nil unless comparing w/ a baseline
+  NSArray *diffBaseFileDatas_;                // the baseline's file datas
+  NSString *diffBasePath_;                    // the shard they came from
+  CoverStoryQueryServer *queryServer_;        // nil unless answering queries
 
 #if DEBUG
   NSDate *startDate_;
@@ -67,6 +86,13 @@
 - (IBAction)toggleSDKSourcesShown:(id)sender;
 - (IBAction)toggleUnittestSourcesShown:(id)sender;
 - (IBAction)toggleRemoveCommonSourcePrefix:(id)sender;
+// Reloads just the folders whose .gcda files change while a folder is open.
+- (IBAction)toggleWatchingForChanges:(id)sender;
+// Compares what's loaded w/ a coverage shard (ie - one coverstory-cli wrote for
+// the last good build) and lists just the files that changed, again to stop.
+- (IBAction)compareWithBaseline:(id)sender;
+// Writes the comparison out as JSON.
+- (IBAction)saveDiffReport:(id)sender;
 - (void)setCommonPathPrefix:(NSString *)newPrefix;
 - (NSString *)commonPathPrefix;
 - (BOOL)hideSDKSources;
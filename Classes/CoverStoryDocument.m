@@ -28,18 +28,27 @@
 #import "GTMScriptRunner.h"
 #import "GTMNSFileManager+Path.h"
 #import "GTMNSEnumerator+Filter.h"
-#import "GTMNSString+HTML.h"
 #import "GTMLocalizedString.h"
 #import "CoverStoryValueTransformers.h"
 #import "GCovVersionManager.h"
+#import "CoverStoryGCovDataReader.h"
+#import "CoverStoryDeliveryQueue.h"
+#import "CoverStoryCoverageCache.h"
+#import "CoverStoryCoverageShard.h"
+#import "CoverStoryCoverageDiff.h"
+#import "CoverStoryCoverageImporter.h"
+#import "CoverStoryFolderWatcher.h"
+#import "CoverStoryHTMLExporter.h"
+#import "CoverStoryMissIndex.h"
+#import "CoverStoryTracer.h"
+#import "CoverStoryGCovStream.h"
+#import "CoverStoryLineIndex.h"
+#import "CoverStoryQueryServer.h"
 
 const NSInteger kCoverStorySDKToolbarTag          = 1026;
 const NSInteger kCoverStoryUnittestToolbarTag     = 1027;
 const NSInteger kCoverStoryCommonPrefixToolbarTag = 1028;
 
-NSString *const kCoverStoryErrorDomain = @"CoverStoryErrorDomain";
-const NSInteger kCoverStoryExportError = 1;
-
 @interface NSWindow (CoverStoryExportToHTML)
 // Script command that we want NSWindow to handle
 - (id)cs_handleExportHTMLScriptCommand:(NSScriptCommand *)command;
@@ -47,8 +56,23 @@ const NSInteger kCoverStoryExportError = 1;
 
 @interface NSOperationQueue (CoverStorySharedOpQueue)
 + (NSOperationQueue *)cs_sharedOperationQueue;
++ (NSOperationQueue *)cs_gcovOperationQueue;
 @end
 
+// gcov has a startup cost, so don't split a directory up into runs smaller
+// than this.
+static const NSUInteger kCSMinFilesPerGCovRun = 8;
+
+// How many of the slowest files/folders a traced load reports.
+static const NSUInteger kCSTraceSummaryLimit = 5;
+
+// When streaming gcov's output, how many sources (per core) can be waiting to
+// be parsed before reading it stops.
+static const NSUInteger kCSStreamedChunksPerCore = 4;
+// gcov is run w/o xargs when streaming, so the files are split up into runs
+// w/ at most this much in paths.
+static const NSUInteger kCSMaxGCovArgumentBytes = 128 * 1024;
+
 @interface NSFileManager (CoverStoryThreading)
 + (NSFileManager *)threadSafeManager;
 @end
@@ -60,22 +84,101 @@ typedef NS_ENUM(NSInteger, CSMessageType)
     kCSMessageTypeInfo
 };
 
+// How long the .gcda files have to be left alone before a watched folder is
+// reloaded (a test run rewrites them all as it exits).
+static const NSTimeInterval kCSWatchLatency = 0.5;
+
+// A file data on its way to the main thread w/ the folder it was read from,
+// when the data set is keeping them by folder.
+@interface CSFolderFileData : NSObject {
+@public
+    CoverStoryCoverageFileData *_fileData;
+    NSString *_origin;
+}
+@end
+
+@implementation CSFolderFileData
+@end
+
+// The watcher reports real paths (and the document may have been opened
+// through a symlink), so folders are compared after resolving them.
+static NSString *CSOriginForFolder(NSString *folderPath)
+{
+    return [[folderPath stringByResolvingSymlinksInPath] stringByStandardizingPath];
+}
+
 @interface CoverStoryDocument ()
 - (void)openFolderInThread:(NSString *)path;
 - (void)openFileInThread:(NSString *)path;
+- (void)importFileInThread:(NSString *)path;
 - (void)backgroundWorkDone:(id)sender;
 - (void)setOpenThreadState:(BOOL)threadRunning;
 - (BOOL)processCoverageForFolder:(NSString *)path;
 - (void)cleanupTempDir:(NSString *)tempDir;
-- (void)loadCoveragePath:(NSString *)fullPath;
+- (void)deliverFileData:(CoverStoryCoverageFileData *)fileData origin:(NSString *)origin;
+- (CoverStoryCoverageFileData *)readCoveragePath:(NSString *)fullPath;
+- (CoverStoryCoverageFileData *)readCoverageData:(NSData *)gcovData path:(NSString *)path;
+- (NSOperation *)loadOperationForGCovPath:(NSString *)fullPath
+                                     data:(NSData *)gcovData
+                                   origin:(NSString *)origin
+                                cacheStem:(NSString *)stem
+                             cacheRecords:(NSMutableDictionary *)cacheRecords
+                                  storeOp:(NSOperation *)storeOp;
+- (NSOperation *)storeOperationForCacheKeys:(NSDictionary *)cacheKeys
+                               cacheRecords:(NSMutableDictionary *)cacheRecords;
+- (void)reportGCovErrors:(NSString *)stdErr;
 - (BOOL)processCoverageForFiles:(NSArray *)filenames inFolder:(NSString *)folderPath;
+- (void)queueCoverageForFiles:(NSArray *)filenames inFolder:(NSString *)folderPath;
+- (BOOL)processCoverageForFiles:(NSArray *)filenames
+                       inFolder:(NSString *)folderPath
+                        tempDir:(NSString *)tempDir
+                      cleanupOp:(NSOperation *)cleanupOp;
+- (BOOL)runGCovForFiles:(NSArray *)filenames
+               inFolder:(NSString *)folderPath
+                tempDir:(NSString *)tempDir
+              cleanupOp:(NSOperation *)cleanupOp;
+- (BOOL)runGCov:(NSString *)gcovPath
+       forFiles:(NSArray *)filenames
+       inFolder:(NSString *)folderPath
+        tempDir:(NSString *)tempDir
+         origin:(NSString *)origin
+      cacheKeys:(NSDictionary *)cacheKeys
+      cleanupOp:(NSOperation *)cleanupOp;
+- (BOOL)streamGCov:(NSString *)gcovPath
+          forFiles:(NSArray *)filenames
+          inFolder:(NSString *)folderPath
+           tempDir:(NSString *)tempDir
+            origin:(NSString *)origin
+         cacheKeys:(NSDictionary *)cacheKeys
+         cleanupOp:(NSOperation *)cleanupOp
+            loaded:(BOOL *)outLoaded;
 - (BOOL)addFileData:(CoverStoryCoverageFileData *)fileData;
+- (BOOL)addFileDatas:(NSArray *)fileDatas;
+- (BOOL)addFileDatas:(NSArray *)fileDatas fromOrigin:(NSString *)origin;
 - (void)addMessageFromThread:(NSString *)message path:(NSString *)path messageType:(CSMessageType)msgType;
 - (void)addMessageFromThread:(NSString *)message messageType:(CSMessageType)msgType;
 - (void)addMessage:(NSDictionary *)msgInfo;
+- (void)addMessages:(NSArray *)msgInfos;
+- (void)deliverBatch:(NSArray *)batch;
 - (BOOL)isClosed;
 - (void)moveSelection:(NSUInteger)offset;
 - (void)finishedLoadingFileDatas:(id)ignored;
+- (CoverStoryHTMLExporter *)htmlExporterWithError:(NSError * *)outError;
+- (BOOL)isFolderDocument;
+- (void)startWatching;
+- (void)stopWatching;
+- (void)foldersChanged:(NSSet *)folders;
+- (void)reloadChangedFolders;
+- (void)reloadFoldersInThread:(NSSet *)folders;
+- (void)reloadFoldersDone:(id)sender;
+- (void)finishedReloadingFolders;
+- (void)reportTrace;
+- (void)compareWithBaselineAtPath:(NSString *)path;
+- (void)compareWithBaseFileDatas:(NSArray *)baseFileDatas;
+- (void)showDiff:(CoverStoryCoverageDiff *)diff;
+- (void)stopComparing;
+- (BOOL)selectDiffLinesOfFileData:(CoverStoryCoverageFileData *)fileData;
+- (void)updateQueryIndex;
 @end
 
 
@@ -86,7 +189,12 @@ typedef NS_ENUM(NSInteger, CSMessageType)
     NSUserDefaults *defaults       = [NSUserDefaults standardUserDefaults];
     NSDictionary *documentDefaults = @{
         kCoverStoryFilterStringTypeKey: @(kCoverStoryFilterStringTypeWildcardPattern),
-        kCoverStoryRemoveCommonSourcePrefixKey: @YES
+        kCoverStoryRemoveCommonSourcePrefixKey: @YES,
+        kCoverStoryUseCoverageCacheKey: @YES,
+        kCoverStoryWatchForChangesKey: @NO,
+        kCoverStoryTraceLoadsKey: @NO,
+        kCoverStoryStreamGCovKey: @NO,
+        kCoverStoryQuerySocketFolderKey: @""
     };
     [defaults registerDefaults:documentDefaults];
 }
@@ -98,6 +206,12 @@ typedef NS_ENUM(NSInteger, CSMessageType)
         
         dataSet_ = [[CoverStoryCoverageSet alloc] init];
         
+        // Everything the worker threads produce comes back through here.
+        __weak CoverStoryDocument *weakSelf = self;
+        deliveryQueue_ = [[CoverStoryDeliveryQueue alloc] initWithHandler:^(NSArray *batch) {
+            [weakSelf deliverBatch:batch];
+        }];
+        
         NSString *path;
         NSFileWrapper *wrapper;
         NSBundle *mainBundle = [NSBundle mainBundle];
@@ -118,6 +232,13 @@ typedef NS_ENUM(NSInteger, CSMessageType)
         hideSDKSources_           = [ud boolForKey:kCoverStoryHideSystemSourcesKey];
         hideUnittestSources_      = [ud boolForKey:kCoverStoryHideUnittestSourcesKey];
         removeCommonSourcePrefix_ = [ud boolForKey:kCoverStoryRemoveCommonSourcePrefixKey];
+        watchingForChanges_       = [ud boolForKey:kCoverStoryWatchForChangesKey];
+        changedFolders_           = [[NSMutableSet alloc] init];
+        streamGCov_               = [ud boolForKey:kCoverStoryStreamGCovKey];
+        if ([ud boolForKey:kCoverStoryTraceLoadsKey])
+        {
+            tracer_ = [[CoverStoryTracer alloc] init];
+        }
     }
     return self;
 }
@@ -139,6 +260,12 @@ typedef NS_ENUM(NSInteger, CSMessageType)
                                 context:nil];
     NSSortDescriptor *ascending = [[NSSortDescriptor alloc] initWithKey:@"coverage" ascending:YES];
     [sourceFilesController_ setSortDescriptors:@[ascending]];
+    // merging into a file that's listed doesn't change the set's array, so the
+    // file list's totals are told directly
+    __weak CoverStoryArrayController *weakController = sourceFilesController_;
+    [dataSet_ setCountsChangedHandler:^(CoverStoryCoverageFileData *fileData, CoverStoryLineCounts before) {
+        [weakController fileData:fileData changedFromLineCounts:before];
+    }];
 }
 
 - (NSString *)windowNibName
@@ -151,7 +278,7 @@ typedef NS_ENUM(NSInteger, CSMessageType)
     return dataSet_;
 }
 
-// Called as a performSelectorOnMainThread, so must check to make sure
+// Called on the main thread (after the fact), so must check to make sure
 // we haven't been closed.
 - (BOOL)addFileData:(CoverStoryCoverageFileData *)fileData
 {
@@ -160,7 +287,28 @@ typedef NS_ENUM(NSInteger, CSMessageType)
         return NO;
     }
     ++numFileDatas_;
-    BOOL isGood = [[self dataSet] addFileData:fileData messageReceiver:self];
+    uint64_t start = CoverStoryTraceNow(tracer_);
+    BOOL isGood    = [[self dataSet] addFileData:fileData messageReceiver:self];
+    [tracer_ endSpan:@"merge" start:start queued:0 detail:nil];
+    return isGood;
+}
+
+// Same as addFileData:, but for a batch (so the set only posts one change).
+- (BOOL)addFileDatas:(NSArray *)fileDatas
+{
+    return [self addFileDatas:fileDatas fromOrigin:nil];
+}
+
+- (BOOL)addFileDatas:(NSArray *)fileDatas fromOrigin:(NSString *)origin
+{
+    if ([self isClosed])
+    {
+        return NO;
+    }
+    numFileDatas_ += [fileDatas count];
+    uint64_t start = CoverStoryTraceNow(tracer_);
+    BOOL isGood    = [[self dataSet] addFileDatas:fileDatas fromOrigin:origin messageReceiver:self];
+    [tracer_ endSpan:@"merge" start:start queued:0 detail:origin];
     return isGood;
 }
 
@@ -170,6 +318,15 @@ typedef NS_ENUM(NSInteger, CSMessageType)
 {
     BOOL isGood = NO;
     numFileDatas_ = 0;
+    [deliveryQueue_ resetStatistics];
+    // pick up any changes to the cache defaults
+    NSString *cacheDirectory = [CoverStoryCoverageCache defaultDirectory];
+    if (![[coverageCache_ directory] isEqualToString:cacheDirectory])
+    {
+        coverageCache_ = [[CoverStoryCoverageCache alloc] initWithDirectory:cacheDirectory];
+    }
+    [coverageCache_ resetStatistics];
+    [tracer_ reset];
 #if DEBUG
     startDate_ = [NSDate date];
 #endif
@@ -177,6 +334,18 @@ typedef NS_ENUM(NSInteger, CSMessageType)
     // the wrapper doesn't have the full path, but it's already set on us, so
     // use that instead.
     NSString *path = [[self fileURL] path];
+    // only a folder can be watched, and what's read has to be kept by the
+    // folder it came from to reload just part of it later
+    BOOL watch = [fileWrapper isDirectory] && watchingForChanges_;
+    [dataSet_ setKeepsOrigins:watch];
+    if (watch)
+    {
+        [self startWatching];
+    }
+    else
+    {
+        [self stopWatching];
+    }
     if ([fileWrapper isDirectory])
     {
         NSString *message = [NSString stringWithFormat:@"Scanning for coverage data in '%@'", path];
@@ -205,6 +374,31 @@ typedef NS_ENUM(NSInteger, CSMessageType)
             [self addMessageFromThread:@"Failed to load gcov data" path:path messageType:kCSMessageTypeError];
         }
     }
+    else if ([typeName isEqualToString:@kCoverageShardTypeName])
+    {
+        NSString *message = [NSString stringWithFormat:@"Reading coverage shard '%@'", path];
+        [self addMessageFromThread:message messageType:kCSMessageTypeInfo];
+        NSError *error                 = nil;
+        CoverStoryCoverageShard *shard = [[CoverStoryCoverageShard alloc] initWithContentsOfFile:path
+                                                                                           error:&error];
+        if (shard)
+        {
+            isGood = [self addFileDatas:[shard fileDatasWithDocument:self]];
+        }
+        else
+        {
+            [self addMessageFromThread:[error localizedDescription] path:path messageType:kCSMessageTypeError];
+        }
+    }
+    else if ([typeName isEqualToString:@kLCovTypeName] || [typeName isEqualToString:@kLLVMCovTypeName])
+    {
+        NSString *message = [NSString stringWithFormat:@"Importing coverage from '%@'", path];
+        [self addMessageFromThread:message messageType:kCSMessageTypeInfo];
+        [NSThread detachNewThreadSelector:@selector(importFileInThread:)
+                                 toTarget:self
+                               withObject:path];
+        isGood = YES;
+    }
     else
     {
         NSString *message =
@@ -261,7 +455,9 @@ typedef NS_ENUM(NSInteger, CSMessageType)
                                              selector:@selector(backgroundWorkDone:)
                                                object:@"ignored"];
         @try {
+            uint64_t start = CoverStoryTraceNow(tracer_);
             [self processCoverageForFolder:path];
+            [tracer_ endSpan:@"scan" start:start queued:0 detail:path];
         }
         @catch (NSException *e) {
             NSString *msg =
@@ -312,13 +508,52 @@ typedef NS_ENUM(NSInteger, CSMessageType)
     }
 }
 
+- (void)importFileInThread:(NSString *)path
+{
+    @autoreleasepool {
+        [self setOpenThreadState:YES];
+        // We'll use this to know when we're done.
+        doneOperation_ =
+        [[NSInvocationOperation alloc] initWithTarget:self
+                                             selector:@selector(backgroundWorkDone:)
+                                               object:@"ignored"];
+        @try {
+            uint64_t start                       = CoverStoryTraceNow(tracer_);
+            CoverStoryCoverageImporter *importer = [[CoverStoryCoverageImporter alloc] initWithMaxConcurrency:0
+                                                                                           maxRecordsInFlight:0];
+            [importer importFileAtPath:path
+                              document:self
+                       messageReceiver:self
+                               handler:^(CoverStoryCoverageFileData *fileData) {
+                                   [self deliverFileData:fileData origin:nil];
+                               }];
+            [tracer_ endSpan:@"import" start:start queued:0 detail:path];
+        }
+        @catch (NSException *e) {
+            NSString *msg =
+            [NSString stringWithFormat:@"Internal error while importing file (%@ - %@).",
+             [e name], [e reason]];
+            [self addMessageFromThread:msg path:path messageType:kCSMessageTypeError];
+        }
+        
+        [[NSOperationQueue cs_sharedOperationQueue] addOperation:doneOperation_];
+        doneOperation_ = nil;
+    }
+}
+
 - (void)backgroundWorkDone:(id)sender
 {
-    // signal that we're done
-    [self performSelectorOnMainThread:@selector(finishedLoadingFileDatas:)
-                           withObject:@"ignored"
-                        waitUntilDone:NO];
-    [self setOpenThreadState:NO];
+    // signal that we're done, this goes through the delivery queue so it
+    // happens after everything the workers sent has been added.
+    [deliveryQueue_ push:[^{
+        [self finishedLoadingFileDatas:@"ignored"];
+        [self updateQueryIndex];
+        [self setOpenThreadState:NO];
+        // a reload w/ a baseline open is compared again
+        [self compareWithBaseFileDatas:diffBaseFileDatas_];
+        // anything that changed while loading
+        [self reloadChangedFolders];
+    } copy]];
 }
 
 - (BOOL)processCoverageForFolder:(NSString *)path
@@ -376,16 +611,11 @@ typedef NS_ENUM(NSInteger, CSMessageType)
                 }
                 else
                 {
-                    // process what's in the list
-                    if (![self processCoverageForFiles:currentFileList inFolder:currentFolder])
-                    {
-                        NSString *message = [NSString stringWithFormat:@"failed to process files: %@", currentFileList];
-                        [self addMessageFromThread:message path:currentFolder  messageType:kCSMessageTypeError];
-                    }
+                    // hand off what's in the list
+                    [self queueCoverageForFiles:currentFileList inFolder:currentFolder];
                     // restart the collecting w/ this filename
-                    currentFolder = [filename stringByDeletingLastPathComponent];
-                    [currentFileList removeAllObjects];
-                    [currentFileList addObject:[filename lastPathComponent]];
+                    currentFolder   = [filename stringByDeletingLastPathComponent];
+                    currentFileList = [NSMutableArray arrayWithObject:[filename lastPathComponent]];
                 }
                 
                 // Bail if we get closed
@@ -395,16 +625,70 @@ typedef NS_ENUM(NSInteger, CSMessageType)
                 }
             }
             // process whatever what we were collecting when we hit the end
-            if (![self processCoverageForFiles:currentFileList inFolder:currentFolder])
-            {
-                NSString *message = [NSString stringWithFormat:@"failed to process files: %@", currentFileList];
-                [self addMessageFromThread:message path:currentFolder messageType:kCSMessageTypeError];
-            }
+            [self queueCoverageForFiles:currentFileList inFolder:currentFolder];
         }
     }
     return YES;
 }
 
+// Splits the files for a directory into runs of gcov and queues them up on the
+// gcov queue so the directories (and big directories) get spread over all the
+// cores.  Each run gets its own scratch directory.  The cleanup op for each run
+// is made here (and not when the run happens) so it is a dependency of the done
+// operation before that gets queued; the run queues the cleanup op when it is
+// done w/ its scratch directory.
+- (void)queueCoverageForFiles:(NSArray *)filenames inFolder:(NSString *)folderPath
+{
+    NSUInteger fileCount = [filenames count];
+    if (fileCount == 0)
+    {
+        return;
+    }
+    NSUInteger maxRuns  = MAX([[NSProcessInfo processInfo] activeProcessorCount], (NSUInteger)1);
+    NSUInteger runCount = MIN(maxRuns, (fileCount + kCSMinFilesPerGCovRun - 1) / kCSMinFilesPerGCovRun);
+    NSUInteger runSize  = (fileCount + runCount - 1) / runCount;
+    NSOperationQueue *gcovQueue = [NSOperationQueue cs_gcovOperationQueue];
+    for (NSUInteger start = 0; start < fileCount; start += runSize)
+    {
+        NSRange range      = NSMakeRange(start, MIN(runSize, fileCount - start));
+        NSArray *runFiles  = [filenames subarrayWithRange:range];
+        NSString *tempDir  = [self tempDirName];
+        NSInvocationOperation *cleanupOp
+        = [[NSInvocationOperation alloc] initWithTarget:self
+                                               selector:@selector(cleanupTempDir:)
+                                                 object:tempDir];
+        // The done operation will depend on this cleanup op to know when things
+        // finish.
+        [doneOperation_ addDependency:cleanupOp];
+        CoverStoryTracer *tracer = tracer_;
+        uint64_t queued          = CoverStoryTraceNow(tracer);
+        NSBlockOperation *runOp  = [NSBlockOperation blockOperationWithBlock:^{
+            @autoreleasepool {
+                @try {
+                    uint64_t runStart = CoverStoryTraceNow(tracer);
+                    if (![self processCoverageForFiles:runFiles
+                                              inFolder:folderPath
+                                               tempDir:tempDir
+                                             cleanupOp:cleanupOp] &&
+                        ![self isClosed])
+                    {
+                        NSString *message = [NSString stringWithFormat:@"failed to process files: %@", runFiles];
+                        [self addMessageFromThread:message path:folderPath messageType:kCSMessageTypeError];
+                    }
+                    [tracer endSpan:@"batch" start:runStart queued:queued detail:folderPath];
+                }
+                @catch (NSException *e) {
+                    NSString *msg =
+                    [NSString stringWithFormat:@"Internal error while processing directory (%@ - %@).",
+                     [e name], [e reason]];
+                    [self addMessageFromThread:msg path:folderPath messageType:kCSMessageTypeError];
+                }
+            }
+        }];
+        [gcovQueue addOperation:runOp];
+    }
+}
+
 - (NSString *)tempDirName
 {
     // go w/ temp dir if anything goes wrong
@@ -440,10 +724,17 @@ typedef NS_ENUM(NSInteger, CSMessageType)
     
     NSFileManager *fm = [NSFileManager threadSafeManager];
     
+    // a run that bailed early may never have made it
+    if (![fm fileExistsAtPath:tempDir])
+    {
+        return;
+    }
+    uint64_t start = CoverStoryTraceNow(tracer_);
     if (![fm removeItemAtPath:tempDir error:&error])
     {
         [self addMessageFromThread:@"failed to remove our tempdir" path:tempDir messageType:kCSMessageTypeError];
     }
+    [tracer_ endSpan:@"cleanup" start:start queued:0 detail:tempDir];
     if (error != nil)
     {
         NSString *msg = [NSString stringWithFormat:@"Internal error trying to cleanup tempdir (%@ - %@).",
@@ -453,37 +744,222 @@ typedef NS_ENUM(NSInteger, CSMessageType)
     }
 }
 
-- (void)loadCoveragePath:(NSString *)fullPath
+// |origin| is the folder it was read from if the set is keeping them (nil
+// otherwise).
+- (void)deliverFileData:(CoverStoryCoverageFileData *)fileData origin:(NSString *)origin
+{
+    if (!origin)
+    {
+        [deliveryQueue_ push:fileData];
+        return;
+    }
+    CSFolderFileData *folderFileData = [[CSFolderFileData alloc] init];
+    folderFileData->_fileData        = fileData;
+    folderFileData->_origin          = origin;
+    [deliveryQueue_ push:folderFileData];
+}
+
+- (CoverStoryCoverageFileData *)readCoveragePath:(NSString *)fullPath
+{
+    @try {
+        return [CoverStoryCoverageFileData newCoverageFileDataFromPath:fullPath
+                                                             document:self
+                                                      messageReceiver:self];
+    }
+    @catch (NSException *e) {
+        NSString *msg = [NSString stringWithFormat:@"Internal error trying load coverage data (%@ - %@).",
+           [e name], [e reason]];
+        [self addMessageFromThread:msg messageType:kCSMessageTypeError];
+    }
+    return nil;
+}
+
+- (CoverStoryCoverageFileData *)readCoverageData:(NSData *)gcovData path:(NSString *)path
 {
     @try {
-        // load it and add it to our set
-        CoverStoryCoverageFileData *fileData = [CoverStoryCoverageFileData newCoverageFileDataFromPath:fullPath
-                                                                                              document:self
-                                                                                       messageReceiver:self];
-        if (fileData)
-        {
-            [self performSelectorOnMainThread:@selector(addFileData:) withObject:fileData waitUntilDone:NO];
-        }
+        return [CoverStoryCoverageFileData newCoverageFileDataFromGCovData:gcovData
+                                                                      path:path
+                                                                  document:self
+                                                           messageReceiver:self];
     }
     @catch (NSException *e) {
         NSString *msg = [NSString stringWithFormat:@"Internal error trying load coverage data (%@ - %@).",
            [e name], [e reason]];
         [self addMessageFromThread:msg messageType:kCSMessageTypeError];
     }
+    return nil;
+}
+
+// Loads |fullPath| (or |gcovData|, the same from a gcov -t run, if it's not
+// nil) and delivers it.  If |stem| isn't nil, what's loaded is also filed in
+// |cacheRecords| under it for |storeOp|, which is made to wait on the load.
+- (NSOperation *)loadOperationForGCovPath:(NSString *)fullPath
+                                     data:(NSData *)gcovData
+                                   origin:(NSString *)origin
+                                cacheStem:(NSString *)stem
+                             cacheRecords:(NSMutableDictionary *)cacheRecords
+                                  storeOp:(NSOperation *)storeOp
+{
+    CoverStoryTracer *tracer = tracer_;
+    uint64_t queued          = CoverStoryTraceNow(tracer);
+    NSOperation *op          = [NSBlockOperation blockOperationWithBlock:^{
+        uint64_t parseStart                  = CoverStoryTraceNow(tracer);
+        CoverStoryCoverageFileData *fileData = (gcovData
+                                                ? [self readCoverageData:gcovData path:fullPath]
+                                                : [self readCoveragePath:fullPath]);
+        [tracer endSpan:@"parse" start:parseStart queued:queued detail:fullPath];
+        if (!stem)
+        {
+            if (fileData)
+            {
+                [self deliverFileData:fileData origin:origin];
+            }
+            return;
+        }
+        NSData *record = nil;
+        if (fileData)
+        {
+            record = [CoverStoryCoverageCache recordForFileData:fileData];
+            [self deliverFileData:fileData origin:origin];
+        }
+        @synchronized(cacheRecords)
+        {
+            NSMutableArray *records = cacheRecords[stem];
+            if (!record)
+            {
+                cacheRecords[stem] = [NSNull null];
+            }
+            else if (!records)
+            {
+                cacheRecords[stem] = [NSMutableArray arrayWithObject:record];
+            }
+            else if ([records isKindOfClass:[NSMutableArray class]])
+            {
+                [records addObject:record];
+            }
+        }
+    }];
+    if (stem)
+    {
+        [storeOp addDependency:op];
+    }
+    return op;
+}
+
+// The cache entries for the gcda files gcov handled are built up as its output
+// is loaded (each file data is encoded before it is handed off, since it can
+// get merged into after that), and written once it's all loaded.  A unit w/ a
+// file that didn't load doesn't get an entry.  nil if nothing is to be cached.
+- (NSOperation *)storeOperationForCacheKeys:(NSDictionary *)cacheKeys
+                               cacheRecords:(NSMutableDictionary *)cacheRecords
+{
+    if (![cacheKeys count])
+    {
+        return nil;
+    }
+    CoverStoryCoverageCache *cache = coverageCache_;
+    return [NSBlockOperation blockOperationWithBlock:^{
+        for (NSString *stem in cacheRecords)
+        {
+            NSArray *records = cacheRecords[stem];
+            if ([records isKindOfClass:[NSArray class]] && ![self isClosed])
+            {
+                [cache storeRecords:records forKey:cacheKeys[stem]];
+            }
+        }
+    }];
+}
+
+- (void)reportGCovErrors:(NSString *)stdErr
+{
+    NSEnumerator *enumerator = [[stdErr componentsSeparatedByString:@"\n"] objectEnumerator];
+    NSString *message;
+    while ((message = [enumerator nextObject]))
+    {
+        NSRange range  = [message rangeOfString:@":"];
+        NSString *path = nil;
+        if (range.length != 0)
+        {
+            path    = [message substringToIndex:range.location];
+            message = [message substringFromIndex:NSMaxRange(range)];
+        }
+        if ([message hasSuffix:@"'404*', prefer '402*'"])// || [message hasSuffix:@"cannot open source file"])
+        {
+            continue;
+        }
+        [self addMessageFromThread:message
+                              path:path
+                       messageType:kCSMessageTypeError];
+    }
+}
+
+// gcov -l names its output <gcda name>##<source>.gcov, this gets back to the
+// gcda name w/o its extension (which is what the cache keys are filed under).
+static NSString *CSGCDAStemForGCovPath(NSString *gcovPath)
+{
+    NSString *name = [gcovPath lastPathComponent];
+    NSRange range  = [name rangeOfString:@"##"];
+    if (range.location == NSNotFound)
+    {
+        return [[name stringByDeletingPathExtension] stringByDeletingPathExtension];
+    }
+    return [[name substringToIndex:range.location] stringByDeletingPathExtension];
 }
 
 - (BOOL)processCoverageForFiles:(NSArray *)filenames
                        inFolder:(NSString *)folderPath
 {
-    
-    if (([filenames count] == 0) || ([folderPath length] == 0))
+    NSString *tempDir = [self tempDirName];
+    // create our cleanup op since it will use the other ops as dependencies
+    NSInvocationOperation *cleanupOp
+    = [[NSInvocationOperation alloc] initWithTarget:self
+                                           selector:@selector(cleanupTempDir:)
+                                             object:tempDir];
+    // The done operation will depend on this cleanup op to know when things
+    // finish.
+    [doneOperation_ addDependency:cleanupOp];
+    uint64_t start = CoverStoryTraceNow(tracer_);
+    BOOL result    = [self processCoverageForFiles:filenames
+                                          inFolder:folderPath
+                                           tempDir:tempDir
+                                         cleanupOp:cleanupOp];
+    [tracer_ endSpan:@"batch" start:start queued:0 detail:folderPath];
+    return result;
+}
+
+// Runs gcov over |filenames| in |tempDir| and queues up the loading of the
+// results.  |cleanupOp| is always queued (the done operation is waiting on it),
+// once everything using |tempDir| has been queued ahead of it.
+- (BOOL)processCoverageForFiles:(NSArray *)filenames
+                       inFolder:(NSString *)folderPath
+                        tempDir:(NSString *)tempDir
+                      cleanupOp:(NSOperation *)cleanupOp
+{
+    NSOperationQueue *opQueue = [NSOperationQueue cs_sharedOperationQueue];
+    @try {
+        return [self runGCovForFiles:filenames
+                            inFolder:folderPath
+                             tempDir:tempDir
+                           cleanupOp:cleanupOp];
+    }
+    @finally {
+        // now put in the cleanup operation
+        [opQueue addOperation:cleanupOp];
+    }
+}
+
+- (BOOL)runGCovForFiles:(NSArray *)filenames
+               inFolder:(NSString *)folderPath
+                tempDir:(NSString *)tempDir
+              cleanupOp:(NSOperation *)cleanupOp
+{
+    if (([filenames count] == 0) || ([folderPath length] == 0) || [self isClosed])
     {
         return NO;
     }
     
     @autoreleasepool {
         
-        NSString *tempDir = [self tempDirName];
         // make sure all the filenames are just leaves
         for (NSString *filename in filenames)
         {
@@ -497,20 +973,145 @@ typedef NS_ENUM(NSInteger, CSMessageType)
             }
         }
         
+        // what gets read here is kept under this when watching
+        NSString *origin = [dataSet_ keepsOrigins] ? CSOriginForFolder(folderPath) : nil;
+
         // make sure it ends in a slash
         if (![folderPath hasSuffix:@"/"])
         {
             folderPath = [folderPath stringByAppendingString:@"/"];
         }
         
-        // Figure out what version of gcov to use.
-        // NOTE: To be 100% correct, we should check *each* file and split them into
-        // sets based on what version of gcov will be invoked.  But we're assuming
-        // most people will only set the gcc version of a per Xcode target level (at
-        // the lowest).
+        // Use what's still current in the cache, then read what we can
+        // directly, only what's left needs gcov.
         GCovVersionManager *gcovVerMgr = [GCovVersionManager defaultManager];
-        NSString *aFullPath = [folderPath stringByAppendingPathComponent:filenames[0]];
-        NSString *gcovPath = [gcovVerMgr gcovForGCovFile:aFullPath];
+        CoverStoryCoverageCache *cache = coverageCache_;
+        NSMutableArray *gcovFilenames  = [NSMutableArray arrayWithCapacity:[filenames count]];
+        NSMutableDictionary *cacheKeys = [NSMutableDictionary dictionary];  // gcda stem -> key for gcov's results
+        for (NSString *filename in filenames)
+        {
+            NSString *fullPath = [folderPath stringByAppendingPathComponent:filename];
+            CoverStoryCoverageCacheKey *cacheKey = nil;
+            if (cache)
+            {
+                NSString *gcovPath = [gcovVerMgr gcovForGCovFile:fullPath];
+                cacheKey           = [cache keyForGCDAPath:fullPath gcovVersion:[gcovVerMgr versionOfGCov:gcovPath]];
+            }
+            NSArray *fileDatas = [cache fileDatasForKey:cacheKey document:self];
+            if (!fileDatas)
+            {
+                uint64_t start = CoverStoryTraceNow(tracer_);
+                fileDatas      = [CoverStoryGCovDataReader coverageFileDatasForGCDAPath:fullPath
+                                                                               document:self
+                                                                        messageReceiver:self];
+                [tracer_ endSpan:@"read" start:start queued:0 detail:fullPath];
+                // store it before anything can get merged into it
+                if (fileDatas && cacheKey)
+                {
+                    [cache storeFileDatas:fileDatas forKey:cacheKey];
+                }
+            }
+            if (!fileDatas)
+            {
+                [gcovFilenames addObject:filename];
+                if (cacheKey)
+                {
+                    cacheKeys[[filename stringByDeletingPathExtension]] = cacheKey;
+                }
+                continue;
+            }
+            for (CoverStoryCoverageFileData *fileData in fileDatas)
+            {
+                [self deliverFileData:fileData origin:origin];
+            }
+            if ([self isClosed])
+            {
+                return YES;
+            }
+        }
+        if ([gcovFilenames count] == 0)
+        {
+            return YES;
+        }
+        filenames = gcovFilenames;
+        
+        // Each file gets the gcov for the compiler that built it, so a run w/
+        // files from more than one is split up and the gcovs run side by side
+        // (each in its own part of |tempDir|).
+        NSDictionary *filesByGCov = [gcovVerMgr filesByGCovForFiles:filenames inFolder:folderPath];
+        NSArray *noGCovFiles      = filesByGCov[[NSNull null]];
+        for (NSString *filename in noGCovFiles)
+        {
+            [self addMessageFromThread:@"found no gcov to process it with"
+                                  path:[folderPath stringByAppendingPathComponent:filename]
+                           messageType:kCSMessageTypeError];
+        }
+        NSMutableArray *gcovPaths = [[filesByGCov allKeys] mutableCopy];
+        [gcovPaths removeObject:[NSNull null]];
+        if ([gcovPaths count] <= 1)
+        {
+            return [self runGCov:[gcovPaths lastObject]
+                        forFiles:filesByGCov[[gcovPaths lastObject]]
+                        inFolder:folderPath
+                         tempDir:tempDir
+                          origin:origin
+                       cacheKeys:cacheKeys
+                       cleanupOp:cleanupOp];
+        }
+        [gcovPaths sortUsingSelector:@selector(compare:)];
+        __block BOOL result = NO;
+        dispatch_apply([gcovPaths count], dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t x) {
+            @autoreleasepool {
+                NSString *gcovPath = gcovPaths[x];
+                NSString *partDir  = [tempDir stringByAppendingPathComponent:
+                                      [NSString stringWithFormat:@"%zu", x]];
+                if ([self runGCov:gcovPath
+                         forFiles:filesByGCov[gcovPath]
+                         inFolder:folderPath
+                          tempDir:partDir
+                           origin:origin
+                        cacheKeys:cacheKeys
+                        cleanupOp:cleanupOp])
+                {
+                    @synchronized(gcovPaths)
+                    {
+                        result = YES;
+                    }
+                }
+            }
+        });
+        return result;
+    }
+}
+
+// Runs |gcovPath| over |filenames| (all built by the compiler it goes w/) in
+// |tempDir|, and queues up the loading of the results ahead of |cleanupOp|.
+- (BOOL)runGCov:(NSString *)gcovPath
+       forFiles:(NSArray *)filenames
+       inFolder:(NSString *)folderPath
+        tempDir:(NSString *)tempDir
+         origin:(NSString *)origin
+      cacheKeys:(NSDictionary *)cacheKeys
+      cleanupOp:(NSOperation *)cleanupOp
+{
+    if (([gcovPath length] == 0) || ([filenames count] == 0))
+    {
+        return NO;
+    }
+    BOOL loaded = NO;
+    if (streamGCov_ && [self streamGCov:gcovPath
+                               forFiles:filenames
+                               inFolder:folderPath
+                                tempDir:tempDir
+                                 origin:origin
+                              cacheKeys:cacheKeys
+                              cleanupOp:cleanupOp
+                                 loaded:&loaded])
+    {
+        return loaded;
+    }
+    CoverStoryTracer *tracer = tracer_;
+    @autoreleasepool {
         
         // we write all the full file paths into a file w/ null chars after each
         // so we can feed it into xargs -0
@@ -549,14 +1150,6 @@ typedef NS_ENUM(NSInteger, CSMessageType)
                                 error:NULL])
         {
             NSOperationQueue *opQueue = [NSOperationQueue cs_sharedOperationQueue];
-            // create our cleanup op since it will use the other ops as dependencies
-            NSInvocationOperation *cleanupOp
-            = [[NSInvocationOperation alloc] initWithTarget:self
-                                                   selector:@selector(cleanupTempDir:)
-                                                     object:tempDir];
-            // The done operation will depend on this cleanup op to know when things
-            // finish.
-            [doneOperation_ addDependency:cleanupOp];
             
             // now write out our file
             NSString *fileListPath = [tempDir stringByAppendingPathComponent:@"filelists.txt"];
@@ -564,33 +1157,18 @@ typedef NS_ENUM(NSInteger, CSMessageType)
             {
                 // run gcov (it writes to current directory, so we cd into our dir first)
                 // we use xargs to batch up the files into as few of runs of gcov as
-                // possible.  (we could use -P [num_cpus] to do things in parallell)
+                // possible.  (the folder was already split into runs across the cpus
+                // by queueCoverageForFiles:inFolder:)
                 NSString *script = [NSString stringWithFormat:@"cd \"%@\" && /usr/bin/xargs -0 \"%@\" -l -o \"%@\" < \"%@\"", tempDir, gcovPath, folderPath, fileListPath];
                 NSString *stdErr = nil;
+                uint64_t start   = CoverStoryTraceNow(tracer);
                 NSString *stdOut = [runner run:script standardError:&stdErr];
+                [tracer endSpan:@"gcov" start:start queued:0 detail:folderPath];
                 if (([stdOut length] == 0) || ([stdErr length] > 0))
                 {
                     // we don't actually care about stdout since it's just the files
                     // that did work.
-                    NSEnumerator *enumerator = [[stdErr componentsSeparatedByString:@"\n"] objectEnumerator];
-                    NSString *message;
-                    while ((message = [enumerator nextObject]))
-                    {
-                        NSRange range  = [message rangeOfString:@":"];
-                        NSString *path = nil;
-                        if (range.length != 0)
-                        {
-                            path    = [message substringToIndex:range.location];
-                            message = [message substringFromIndex:NSMaxRange(range)];
-                        }
-                        if ([message hasSuffix:@"'404*', prefer '402*'"])// || [message hasSuffix:@"cannot open source file"])
-                        {
-                            continue;
-                        }
-                        [self addMessageFromThread:message
-                                              path:path
-                                       messageType:kCSMessageTypeError];
-                    }
+                    [self reportGCovErrors:stdErr];
                 }
                 
                 // since we batch process, we might have gotten some data even w/ an error
@@ -599,14 +1177,26 @@ typedef NS_ENUM(NSInteger, CSMessageType)
                 // collect the gcov files
                 NSArray *resultPaths = [fm gtm_filePathsWithExtension:@"gcov"
                                                           inDirectory:tempDir];
+                
+                NSMutableDictionary *cacheRecords = [NSMutableDictionary dictionary];
+                NSOperation *storeOp              = [self storeOperationForCacheKeys:cacheKeys
+                                                                        cacheRecords:cacheRecords];
+                if (storeOp)
+                {
+                    [cleanupOp addDependency:storeOp];
+                }
+                
                 NSEnumerator *resultPathsEnum = [resultPaths objectEnumerator];
                 NSString *fullPath;
                 while ((fullPath = [resultPathsEnum nextObject]) && ![self isClosed])
                 {
-                    NSInvocationOperation *op
-                    = [[NSInvocationOperation alloc] initWithTarget:self
-                                                           selector:@selector(loadCoveragePath:)
-                                                             object:fullPath];
+                    NSString *stem  = CSGCDAStemForGCovPath(fullPath);
+                    NSOperation *op = [self loadOperationForGCovPath:fullPath
+                                                                data:nil
+                                                              origin:origin
+                                                           cacheStem:(storeOp && cacheKeys[stem]) ? stem : nil
+                                                        cacheRecords:cacheRecords
+                                                             storeOp:storeOp];
                     // cleanup can't be done until all our other ops are done
                     [cleanupOp addDependency:op];
                     
@@ -614,6 +1204,10 @@ typedef NS_ENUM(NSInteger, CSMessageType)
                     [opQueue addOperation:op];
                     result = YES;
                 }
+                if (storeOp)
+                {
+                    [opQueue addOperation:storeOp];
+                }
             }
             else
             {
@@ -622,48 +1216,184 @@ typedef NS_ENUM(NSInteger, CSMessageType)
                                       path:fileListPath
                                messageType:kCSMessageTypeError];
             }
-            
-            // now put in the cleanup operation
-            [opQueue addOperation:cleanupOp];
         }
         
         return result;
     }
 }
 
-- (void)observeValueForKeyPath:(NSString *)keyPath
-                      ofObject:(id)object
-                        change:(NSDictionary *)change
-                       context:(void *)context
+// Runs |gcovPath| -t over |filenames| and queues up the loading of each
+// source's part of its output (ahead of |cleanupOp|) as it comes out, so
+// nothing is written to disk and the parsing overlaps gcov.  NO if gcov
+// rejected -t (it's too old to know it), so it can be run the usual way;
+// otherwise YES, w/ |outLoaded| saying if gcov put anything out.
+- (BOOL)streamGCov:(NSString *)gcovPath
+          forFiles:(NSArray *)filenames
+          inFolder:(NSString *)folderPath
+           tempDir:(NSString *)tempDir
+            origin:(NSString *)origin
+         cacheKeys:(NSDictionary *)cacheKeys
+         cleanupOp:(NSOperation *)cleanupOp
+            loaded:(BOOL *)outLoaded
 {
-    BOOL handled = NO;
-    if ([object isEqualTo:sourceFilesController_] &&
-        [keyPath isEqualToString:NSSelectionIndexesBinding])
-    {
-        NSArray *selectedObjects         = [object selectedObjects];
-        CoverStoryCoverageFileData *data = nil;
-        if ([selectedObjects count])
+    CoverStoryTracer *tracer = tracer_;
+    @autoreleasepool {
+        
+        // w/o xargs to do it, the files are split into runs here
+        NSMutableArray *runs = [NSMutableArray array];
+        NSMutableArray *run  = nil;
+        NSUInteger runBytes  = 0;
+        for (NSString *filename in filenames)
         {
-            data = (CoverStoryCoverageFileData *)selectedObjects[0];
+            NSString *fullPath = [folderPath stringByAppendingPathComponent:filename];
+            NSUInteger bytes   = [fullPath lengthOfBytesUsingEncoding:NSUTF8StringEncoding] + 1;
+            if (!run || (runBytes + bytes > kCSMaxGCovArgumentBytes))
+            {
+                run      = [NSMutableArray array];
+                runBytes = 0;
+                [runs addObject:run];
+            }
+            [run addObject:fullPath];
+            runBytes += bytes;
         }
-        if (data)
+
+        // -t means nothing gets written, it's still run from the temp folder
+        // so the sources resolve the same as w/ the usual way.
+        if (![[NSFileManager threadSafeManager] createDirectoryAtPath:tempDir
+                                          withIntermediateDirectories:YES
+                                                           attributes:nil
+                                                                error:NULL])
         {
-            // Update our scroll bar
-            [codeTableView_ setCoverageData:[data lines]];
-            
-            // Jump to first missing code block
-            [self moveSelection:1];
+            return NO;
         }
-        handled = YES;
-    }
-    if (!handled)
-    {
-        LOG(@"Unexpected observance of %@ of %@ (%@)", keyPath, object, change);
-    }
-}
-
-- (NSString *)filterString
-{
+        NSOperationQueue *opQueue         = [NSOperationQueue cs_sharedOperationQueue];
+        NSMutableDictionary *cacheRecords = [NSMutableDictionary dictionary];
+        NSOperation *storeOp              = [self storeOperationForCacheKeys:cacheKeys
+                                                                cacheRecords:cacheRecords];
+        if (storeOp)
+        {
+            [cleanupOp addDependency:storeOp];
+        }
+        NSUInteger cores      = MAX([[NSProcessInfo processInfo] activeProcessorCount], (NSUInteger)1);
+        NSUInteger maxPending = kCSStreamedChunksPerCore * cores;
+        CoverStoryGCovStream *stream
+        = [[CoverStoryGCovStream alloc] initWithMaxPendingChunks:maxPending
+                                                         handler:^(CoverStoryGCovStream *chunkStream, NSData *chunk) {
+            if ([self isClosed])
+            {
+                [chunkStream finishedChunk];
+                return;
+            }
+            // The chunk has no name of its own, errors go against the gcda
+            // it came from.
+            NSString *dataName = [[CoverStoryGCovStream dataPathForChunk:chunk] lastPathComponent];
+            NSString *stem     = [dataName stringByDeletingPathExtension];
+            NSString *path     = dataName ? [folderPath stringByAppendingPathComponent:dataName] : folderPath;
+            NSOperation *op    = [self loadOperationForGCovPath:path
+                                                           data:chunk
+                                                         origin:origin
+                                                      cacheStem:(storeOp && stem && cacheKeys[stem]) ? stem : nil
+                                                   cacheRecords:cacheRecords
+                                                        storeOp:storeOp];
+            [op setCompletionBlock:^{
+                [chunkStream finishedChunk];
+            }];
+            [cleanupOp addDependency:op];
+            [opQueue addOperation:op];
+        }];
+        
+        NSMutableString *stdErr = [NSMutableString string];
+        BOOL rejected           = NO;
+        for (NSArray *runPaths in runs)
+        {
+            if ([self isClosed])
+            {
+                break;
+            }
+            NSTask *task = [[NSTask alloc] init];
+            [task setLaunchPath:gcovPath];
+            [task setArguments:[@[ @"-t", @"-o", folderPath ] arrayByAddingObjectsFromArray:runPaths]];
+            [task setCurrentDirectoryPath:tempDir];
+            NSData *stdErrData = nil;
+            BOOL exitedOK      = NO;
+            uint64_t start     = CoverStoryTraceNow(tracer);
+            @try {
+                exitedOK = [stream runTask:task standardError:&stdErrData];
+            }
+            @catch (NSException *e) {
+                NSString *msg = [NSString stringWithFormat:@"failed to run gcov (%@ - %@)", [e name], [e reason]];
+                [self addMessageFromThread:msg path:gcovPath messageType:kCSMessageTypeError];
+                break;
+            }
+            [tracer endSpan:@"gcov" start:start queued:0 detail:folderPath];
+            if (!exitedOK && ([stream chunkCount] == 0) &&
+                [CoverStoryGCovStream standardErrorRejectsStreaming:stdErrData])
+            {
+                rejected = YES;
+                break;
+            }
+            NSString *runStdErr = [[NSString alloc] initWithData:stdErrData encoding:NSUTF8StringEncoding];
+            if (runStdErr)
+            {
+                [stdErr appendString:runStdErr];
+            }
+        }
+        
+        // the store op has to run either way, the cleanup is waiting on it
+        if (storeOp)
+        {
+            [opQueue addOperation:storeOp];
+        }
+        if (rejected)
+        {
+            return NO;
+        }
+        if ([stdErr length])
+        {
+            [self reportGCovErrors:stdErr];
+        }
+        *outLoaded = ([stream chunkCount] > 0);
+        return YES;
+    }
+}
+
+- (void)observeValueForKeyPath:(NSString *)keyPath
+                      ofObject:(id)object
+                        change:(NSDictionary *)change
+                       context:(void *)context
+{
+    BOOL handled = NO;
+    if ([object isEqualTo:sourceFilesController_] &&
+        [keyPath isEqualToString:NSSelectionIndexesBinding])
+    {
+        NSArray *selectedObjects         = [object selectedObjects];
+        CoverStoryCoverageFileData *data = nil;
+        if ([selectedObjects count])
+        {
+            data = (CoverStoryCoverageFileData *)selectedObjects[0];
+        }
+        if (data)
+        {
+            // Update our scroll bar
+            [codeTableView_ setCoverageData:data];
+            
+            // Jump to first missing code block, or what's newly missed when
+            // comparing (unless a reload is putting back where we were)
+            if (!restoringSelection_ && ![self selectDiffLinesOfFileData:data])
+            {
+                [self moveSelection:1];
+            }
+        }
+        handled = YES;
+    }
+    if (!handled)
+    {
+        LOG(@"Unexpected observance of %@ of %@ (%@)", keyPath, object, change);
+    }
+}
+
+- (NSString *)filterString
+{
     return filterString_;
 }
 
@@ -766,6 +1496,20 @@ typedef NS_ENUM(NSInteger, CSMessageType)
         {
             isGood = [self completelyOpened];
         }
+        else if (action == @selector(toggleWatchingForChanges:))
+        {
+            isGood = [self isFolderDocument] && [self completelyOpened];
+            [menuItem setState:(watchingForChanges_ && [self isFolderDocument]) ? NSOnState : NSOffState];
+        }
+        else if (action == @selector(compareWithBaseline:))
+        {
+            isGood = [self completelyOpened] || diffBaseFileDatas_;
+            [menuItem setState:diffBaseFileDatas_ ? NSOnState : NSOffState];
+        }
+        else if (action == @selector(saveDiffReport:))
+        {
+            isGood = (diff_ != nil);
+        }
         else
         {
             isGood = [super validateMenuItem:menuItem];
@@ -794,77 +1538,26 @@ typedef NS_ENUM(NSInteger, CSMessageType)
     if (![selection count])
         return;
     
-    // Start with the current selection
+    // Start with the current selection, the file's miss index finds the next
+    // block in the direction we're going.
     CoverStoryCoverageFileData *fileData = selection[0];
-    NSArray *lines                       = [fileData lines];
+    CoverStoryMissIndex *missIndex       = [fileData missIndex];
     NSIndexSet *currentSel               = [codeTableView_ selectedRowIndexes];
-    
-    // Choose direction based on key and set offset and stopping conditions
-    // as well as start.
-    NSUInteger stoppingCond = 0;
-    NSRange range           = NSMakeRange(0, 0);
-    
-    if (offset > 0)
-    {
-        stoppingCond = [lines count] - 1;
-        if ([lines count] == 0)
-        {
-            stoppingCond = 0;
-        }
-    }
-    NSUInteger startLine = 0;
+    NSRange range                        = NSMakeRange(0, 0);
+    NSUInteger first                     = NSNotFound;
+    NSUInteger last                      = NSNotFound;
     if ([currentSel count])
     {
-        NSUInteger first = [currentSel firstIndex];
-        NSUInteger last  = [currentSel lastIndex];
-        range     = NSMakeRange(first, last - first);
-        startLine = offset == 1 ? last : first;
+        first = [currentSel firstIndex];
+        last  = [currentSel lastIndex];
+        range = NSMakeRange(first, last - first);
     }
-    
-    // From start, look for first line in our given direction that has
-    // zero hits
-    NSUInteger i;
-    for (i = startLine + offset; i != stoppingCond; i += offset)
-    {
-        CoverStoryCoverageLineData *lineData = lines[i];
-        if ([lineData hitCount] == 0)
-        {
-            break;
-        }
-    }
-    
-    // Check to see if we hit end of page (or beginning depending which way
-    // we went
-    if (i != stoppingCond)
+    NSRange missed = (offset == 1) ? [missIndex nextMissedRangeAfterLine:last]
+                                   : [missIndex previousMissedRangeBeforeLine:first];
+    if (missed.location != NSNotFound)
     {
-        // Now select "forward" everything that is zero
-        NSUInteger j;
-        for (j = i; j != stoppingCond; j += offset)
-        {
-            CoverStoryCoverageLineData *lineData = lines[j];
-            if ([lineData hitCount] != 0)
-            {
-                break;
-            }
-        }
-        
-        // Now if we started in a block, select "backwards"
-        NSUInteger k;
-        stoppingCond = offset == 1 ? 0 : [lines count] - 1;
-        offset      *= -1;
-        for (k = i; k != stoppingCond; k += offset)
-        {
-            CoverStoryCoverageLineData *lineData = lines[k];
-            if ([lineData hitCount] != 0)
-            {
-                k -= offset;
-                break;
-            }
-        }
-        
         // Update our selection
-        range = k > j ? NSMakeRange(j + 1, k - j) : NSMakeRange(k, j - k);
-        
+        range = missed;
         [codeTableView_ selectRowIndexes:[NSIndexSet indexSetWithIndexesInRange:range]
                     byExtendingSelection:NO];
     }
@@ -913,6 +1606,343 @@ typedef NS_ENUM(NSInteger, CSMessageType)
     [drawer_ toggle:self];
 }
 
+- (IBAction)toggleWatchingForChanges:(id)sender
+{
+    watchingForChanges_ = !watchingForChanges_;
+    [[NSUserDefaults standardUserDefaults] setBool:watchingForChanges_ forKey:kCoverStoryWatchForChangesKey];
+    if (!watchingForChanges_)
+    {
+        [self stopWatching];
+        [dataSet_ setKeepsOrigins:NO];
+        return;
+    }
+    if ([dataSet_ keepsOrigins])
+    {
+        [self startWatching];
+        return;
+    }
+    // what's loaded wasn't kept by folder, so it has to be read once more
+    [self reloadData:sender];
+}
+
+- (IBAction)compareWithBaseline:(id)sender
+{
+    if (diffBaseFileDatas_)
+    {
+        [self stopComparing];
+        return;
+    }
+    NSOpenPanel *panel = [NSOpenPanel openPanel];
+    [panel setAllowedFileTypes:@[ @"csshard" ]];
+    [panel setMessage:NSLocalizedString(@"Choose the coverage shard to compare with.", nil)];
+    [panel beginSheetModalForWindow:[self windowForSheet] completionHandler:^(NSInteger result) {
+        if (result == NSFileHandlingPanelOKButton)
+        {
+            [self compareWithBaselineAtPath:[[panel URL] path]];
+        }
+    }];
+}
+
+// The shard is read (and the comparison made) off the main thread, it can be
+// the size of everything that's loaded.
+- (void)compareWithBaselineAtPath:(NSString *)path
+{
+    NSString *message = [NSString stringWithFormat:@"Comparing with '%@'", path];
+    [self addMessageFromThread:message messageType:kCSMessageTypeInfo];
+    NSArray *fileDatas = [[dataSet_ valueForKey:@"fileDatas"] copy];
+    [[NSOperationQueue cs_sharedOperationQueue] addOperationWithBlock:^{
+        @autoreleasepool {
+            NSError *error                 = nil;
+            CoverStoryCoverageShard *shard = [[CoverStoryCoverageShard alloc] initWithContentsOfFile:path
+                                                                                               error:&error];
+            if (!shard)
+            {
+                [self addMessageFromThread:[error localizedDescription] path:path messageType:kCSMessageTypeError];
+                return;
+            }
+            NSArray *baseFileDatas       = [shard fileDatasWithDocument:nil];
+            CoverStoryCoverageDiff *diff = [[CoverStoryCoverageDiff alloc] initWithBaseFileDatas:baseFileDatas
+                                                                                currentFileDatas:fileDatas
+                                                                                  maxConcurrency:0];
+            [deliveryQueue_ push:[^{
+                diffBaseFileDatas_ = baseFileDatas;
+                diffBasePath_      = [path copy];
+                [self showDiff:diff];
+            } copy]];
+        }
+    }];
+}
+
+// After a reload, what's loaded now is compared w/ the same baseline.
+- (void)compareWithBaseFileDatas:(NSArray *)baseFileDatas
+{
+    if (!baseFileDatas || [self isClosed])
+    {
+        return;
+    }
+    NSArray *fileDatas = [[dataSet_ valueForKey:@"fileDatas"] copy];
+    [[NSOperationQueue cs_sharedOperationQueue] addOperationWithBlock:^{
+        @autoreleasepool {
+            CoverStoryCoverageDiff *diff = [[CoverStoryCoverageDiff alloc] initWithBaseFileDatas:baseFileDatas
+                                                                                currentFileDatas:fileDatas
+                                                                                  maxConcurrency:0];
+            [deliveryQueue_ push:[^{
+                // unless comparing stopped (or started over) in the meantime
+                if (diffBaseFileDatas_ == baseFileDatas)
+                {
+                    [self showDiff:diff];
+                }
+            } copy]];
+        }
+    }];
+}
+
+- (void)showDiff:(CoverStoryCoverageDiff *)diff
+{
+    if ([self isClosed])
+    {
+        return;
+    }
+    diff_ = diff;
+    [sourceFilesController_ setOnlySourcePaths:[NSSet setWithArray:[[diff fileDiffs] valueForKey:@"sourcePath"]]];
+    NSString *message = [NSString stringWithFormat:@"Against '%@': %@ in %lu changed files.",
+                                                   [diffBasePath_ lastPathComponent], [diff summaryString],
+                                                   (unsigned long)[[diff fileDiffs] count]];
+    [self addMessageFromThread:message
+                   messageType:[diff nowMissedCount] ? kCSMessageTypeWarning : kCSMessageTypeInfo];
+}
+
+- (void)stopComparing
+{
+    diff_              = nil;
+    diffBaseFileDatas_ = nil;
+    diffBasePath_      = nil;
+    [sourceFilesController_ setOnlySourcePaths:nil];
+}
+
+// Selects (and scrolls to) |fileData|'s newly missed lines when comparing,
+// or the newly covered ones if there aren't any.  NO if it has neither.
+- (BOOL)selectDiffLinesOfFileData:(CoverStoryCoverageFileData *)fileData
+{
+    CoverStoryFileCoverageDiff *fileDiff = [diff_ fileDiffForSourcePath:[fileData sourcePath]];
+    NSIndexSet *lines                    = [fileDiff nowMissedLines];
+    if (![lines count])
+    {
+        lines = [fileDiff nowCoveredLines];
+    }
+    if (![lines count])
+    {
+        return NO;
+    }
+    [codeTableView_ selectRowIndexes:lines byExtendingSelection:NO];
+    [codeTableView_ scrollRowToVisible:[lines lastIndex]];
+    [codeTableView_ scrollRowToVisible:[lines firstIndex]];
+    return YES;
+}
+
+- (IBAction)saveDiffReport:(id)sender
+{
+    CoverStoryCoverageDiff *diff = diff_;
+    NSSavePanel *panel           = [NSSavePanel savePanel];
+    [panel setAllowedFileTypes:@[ @"json" ]];
+    [panel setNameFieldStringValue:@"coverage-diff.json"];
+    [panel beginSheetModalForWindow:[self windowForSheet] completionHandler:^(NSInteger result) {
+        if (result != NSFileHandlingPanelOKButton)
+        {
+            return;
+        }
+        NSError *error = nil;
+        if (![diff writeReportToFile:[[panel URL] path] error:&error])
+        {
+            [self presentError:error];
+        }
+    }];
+}
+
+- (BOOL)isFolderDocument
+{
+    BOOL isDir = NO;
+    NSString *path = [[self fileURL] path];
+    return path && [[NSFileManager defaultManager] fileExistsAtPath:path isDirectory:&isDir] && isDir;
+}
+
+- (void)startWatching
+{
+    NSString *path = [[self fileURL] path];
+    if (folderWatcher_ && [[folderWatcher_ path] isEqualToString:[path stringByStandardizingPath]])
+    {
+        return;
+    }
+    [self stopWatching];
+    __weak CoverStoryDocument *weakSelf = self;
+    folderWatcher_ = [[CoverStoryFolderWatcher alloc] initWithPath:path
+                                                           latency:kCSWatchLatency
+                                                           handler:^(NSSet *changedFolders) {
+        [weakSelf performSelectorOnMainThread:@selector(foldersChanged:)
+                                   withObject:changedFolders
+                                waitUntilDone:NO];
+    }];
+    if (![folderWatcher_ start])
+    {
+        folderWatcher_ = nil;
+        [self addMessageFromThread:@"couldn't watch for changes" path:path messageType:kCSMessageTypeError];
+        return;
+    }
+    NSString *message = [NSString stringWithFormat:@"Watching '%@' for changes", path];
+    [self addMessageFromThread:message messageType:kCSMessageTypeInfo];
+}
+
+- (void)stopWatching
+{
+    [folderWatcher_ stop];
+    folderWatcher_ = nil;
+    [changedFolders_ removeAllObjects];
+}
+
+// Called on the main thread by the watcher.
+- (void)foldersChanged:(NSSet *)folders
+{
+    if ([self isClosed] || !folderWatcher_)
+    {
+        return;
+    }
+    for (NSString *folder in folders)
+    {
+        [changedFolders_ addObject:CSOriginForFolder(folder)];
+    }
+    [self reloadChangedFolders];
+}
+
+// Starts reloading the folders that have changed, unless something is already
+// loading (it's called again when that finishes).
+- (void)reloadChangedFolders
+{
+    if (openingInThread_ || ([changedFolders_ count] == 0) || [self isClosed] || ![dataSet_ keepsOrigins])
+    {
+        return;
+    }
+    NSSet *folders      = [changedFolders_ copy];
+    refreshedFileDatas_ = [NSMutableDictionary dictionaryWithCapacity:[folders count]];
+    [tracer_ reset];
+    for (NSString *folder in folders)
+    {
+        refreshedFileDatas_[folder] = [NSMutableArray array];
+    }
+    [changedFolders_ removeAllObjects];
+    [self setOpenThreadState:YES];
+    [NSThread detachNewThreadSelector:@selector(reloadFoldersInThread:)
+                             toTarget:self
+                           withObject:folders];
+}
+
+// Runs just the .gcda files in |folders| through the same batches as a full
+// load (the coverage cache still skips the ones that didn't change).
+- (void)reloadFoldersInThread:(NSSet *)folders
+{
+    @autoreleasepool {
+        doneOperation_ =
+        [[NSInvocationOperation alloc] initWithTarget:self
+                                             selector:@selector(reloadFoldersDone:)
+                                               object:@"ignored"];
+        NSFileManager *fm = [NSFileManager threadSafeManager];
+        for (NSString *folder in folders)
+        {
+            NSMutableArray *filenames = [NSMutableArray array];
+            for (NSString *name in [fm contentsOfDirectoryAtPath:folder error:NULL])
+            {
+                if ([name hasSuffix:@".gcda"])
+                {
+                    [filenames addObject:name];
+                }
+            }
+            @try {
+                [self queueCoverageForFiles:[filenames sortedArrayUsingSelector:@selector(compare:)]
+                                   inFolder:folder];
+            }
+            @catch (NSException *e) {
+                NSString *msg =
+                [NSString stringWithFormat:@"Internal error while reloading directory (%@ - %@).",
+                 [e name], [e reason]];
+                [self addMessageFromThread:msg path:folder messageType:kCSMessageTypeError];
+            }
+        }
+        [[NSOperationQueue cs_sharedOperationQueue] addOperation:doneOperation_];
+        doneOperation_ = nil;
+    }
+}
+
+- (void)reloadFoldersDone:(id)sender
+{
+    [deliveryQueue_ push:[^{
+        [self finishedReloadingFolders];
+        [self updateQueryIndex];
+        [self reportTrace];
+        [self compareWithBaseFileDatas:diffBaseFileDatas_];
+        [self setOpenThreadState:NO];
+        [self reloadChangedFolders];
+    } copy]];
+}
+
+// Swaps what the changed folders read now in for what they had, and puts the
+// selection (and the spot in the source) back where it was.
+- (void)finishedReloadingFolders
+{
+    NSDictionary *fileDatasByOrigin = refreshedFileDatas_;
+    refreshedFileDatas_             = nil;
+    if ([self isClosed] || ![dataSet_ keepsOrigins])
+    {
+        return;
+    }
+    NSArray *selectedObjects  = [sourceFilesController_ selectedObjects];
+    NSArray *selectedPaths    = [selectedObjects valueForKey:@"sourcePath"];
+    NSIndexSet *selectedLines = [codeTableView_ selectedRowIndexes];
+    NSRect visibleLines       = [codeTableView_ visibleRect];
+
+    // the replaced file datas drop out of the selection, so it's put back by
+    // path, w/o jumping to the first miss
+    restoringSelection_ = YES;
+    uint64_t start = CoverStoryTraceNow(tracer_);
+    [dataSet_ replaceFileDatasByOrigin:fileDatasByOrigin messageReceiver:self];
+    [tracer_ endSpan:@"merge" start:start queued:0 detail:nil];
+    if (![[[sourceFilesController_ selectedObjects] valueForKey:@"sourcePath"] isEqualToArray:selectedPaths])
+    {
+        NSSet *paths             = [NSSet setWithArray:selectedPaths];
+        NSMutableArray *selected = [NSMutableArray arrayWithCapacity:[paths count]];
+        for (CoverStoryCoverageFileData *fileData in [sourceFilesController_ arrangedObjects])
+        {
+            if ([paths containsObject:[fileData sourcePath]])
+            {
+                [selected addObject:fileData];
+            }
+        }
+        [sourceFilesController_ setSelectedObjects:selected];
+    }
+    if (![[sourceFilesController_ selectedObjects] isEqualToArray:selectedObjects])
+    {
+        // same lines as far as the new version of the file goes
+        NSInteger rowCount       = [codeTableView_ numberOfRows];
+        NSMutableIndexSet *lines = [selectedLines mutableCopy];
+        if (rowCount >= 0)
+        {
+            [lines removeIndexesInRange:NSMakeRange((NSUInteger)rowCount, NSUIntegerMax - (NSUInteger)rowCount)];
+        }
+        [codeTableView_ selectRowIndexes:lines byExtendingSelection:NO];
+        [codeTableView_ scrollRectToVisible:visibleLines];
+    }
+    restoringSelection_ = NO;
+
+    NSString *message = nil;
+    if ([fileDatasByOrigin count] == 1)
+    {
+        message = [NSString stringWithFormat:@"Reloaded '%@'.", [[fileDatasByOrigin allKeys] lastObject]];
+    }
+    else
+    {
+        message = [NSString stringWithFormat:@"Reloaded %lu changed folders.", (unsigned long)[fileDatasByOrigin count]];
+    }
+    [self addMessageFromThread:message messageType:kCSMessageTypeInfo];
+}
+
 - (void)setCommonPathPrefix:(NSString *)newPrefix
 {
     // we cheat, and if the pref is set, we just make sure we return no prefix
@@ -1073,6 +2103,96 @@ typedef NS_ENUM(NSInteger, CSMessageType)
         [self addMessageFromThread:elapsedStr messageType:kCSMessageTypeInfo];
     }
 #endif  // DEBUG
+    BOOL showStatistics = [[NSUserDefaults standardUserDefaults] boolForKey:kCoverStoryShowLoadStatisticsKey];
+#if DEBUG
+    showStatistics = YES;
+#endif  // DEBUG
+    if (showStatistics)
+    {
+        [self addMessageFromThread:[deliveryQueue_ statisticsDescription]
+                       messageType:kCSMessageTypeInfo];
+        if (coverageCache_)
+        {
+            [self addMessageFromThread:[coverageCache_ statisticsDescription]
+                           messageType:kCSMessageTypeInfo];
+        }
+    }
+    LOG(@"%@", [deliveryQueue_ statisticsDescription]);
+    LOG(@"%@", [coverageCache_ statisticsDescription]);
+    [self reportTrace];
+}
+
+// Where the time went in the last load, and the whole trace written out for a
+// closer look.
+- (void)reportTrace
+{
+    if (!tracer_ || ([tracer_ spanCount] == 0))
+    {
+        return;
+    }
+    NSArray *summaries = @[ @[ @"Slowest files: ", @[ @"read", @"parse" ] ],
+                            @[ @"Slowest folders: ", @[ @"batch" ] ] ];
+    for (NSArray *summary in summaries)
+    {
+        NSArray *slowest = [tracer_ slowestDetailsForSpansNamed:summary[1] limit:kCSTraceSummaryLimit];
+        if ([slowest count] == 0)
+        {
+            continue;
+        }
+        NSMutableArray *parts = [NSMutableArray arrayWithCapacity:[slowest count]];
+        for (NSArray *pair in slowest)
+        {
+            [parts addObject:[NSString stringWithFormat:@"%@ (%.1fms)",
+                              [pair[0] lastPathComponent], [pair[1] doubleValue] * 1000.0]];
+        }
+        NSString *message = [summary[0] stringByAppendingString:[parts componentsJoinedByString:@", "]];
+        [self addMessageFromThread:message messageType:kCSMessageTypeInfo];
+    }
+    NSString *name = [NSString stringWithFormat:@"CoverStory-%@-%.0f.json",
+                      [[self displayName] stringByDeletingPathExtension],
+                      [NSDate timeIntervalSinceReferenceDate]];
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:name];
+    if ([tracer_ writeChromeTraceToFile:path error:NULL])
+    {
+        NSString *message = [NSString stringWithFormat:@"Wrote a trace of %lu spans (open it in chrome://tracing)",
+                             (unsigned long)[tracer_ spanCount]];
+        [self addMessageFromThread:message path:path messageType:kCSMessageTypeInfo];
+    }
+    else
+    {
+        [self addMessageFromThread:@"failed to write the load trace" path:path messageType:kCSMessageTypeError];
+    }
+}
+
+// Gives the query server (started the first time, if the default for it is
+// set) a snapshot of what's loaded now.
+- (void)updateQueryIndex
+{
+    if ([self isClosed])
+    {
+        return;
+    }
+    if (!queryServer_)
+    {
+        NSString *folder = [[NSUserDefaults standardUserDefaults] stringForKey:kCoverStoryQuerySocketFolderKey];
+        if (![folder length])
+        {
+            return;
+        }
+        NSString *name                = [[[self fileURL] path] lastPathComponent] ?: [self displayName];
+        NSString *path                = [[folder stringByExpandingTildeInPath]
+                                         stringByAppendingPathComponent:[name stringByAppendingPathExtension:@"sock"]];
+        CoverStoryQueryServer *server = [[CoverStoryQueryServer alloc] initWithSocketPath:path];
+        NSError *error                = nil;
+        if (![server startWithError:&error])
+        {
+            [self addMessageFromThread:[error localizedDescription] path:path messageType:kCSMessageTypeError];
+            return;
+        }
+        queryServer_ = server;
+        [self addMessageFromThread:@"Answering coverage queries" path:path messageType:kCSMessageTypeInfo];
+    }
+    [queryServer_ setIndex:[[CoverStoryLineIndex alloc] initWithFileDatas:[dataSet_ valueForKey:@"fileDatas"]]];
 }
 
 - (void)setOpenThreadState:(BOOL)threadRunning
@@ -1091,7 +2211,65 @@ typedef NS_ENUM(NSInteger, CSMessageType)
 - (void)addMessageFromThread:(NSString *)message messageType:(CSMessageType)msgType
 {
     NSDictionary *messageInfo = @{@"message" : message, @"msgType" : @(msgType)};
-    [self performSelectorOnMainThread:@selector(addMessage:) withObject:messageInfo waitUntilDone:NO];
+    [deliveryQueue_ push:messageInfo];
+}
+
+// Called on the main thread w/ whatever the workers have queued up.  Runs of
+// file datas and messages are each handed off in one go, blocks are run in
+// order between them.
+- (void)deliverBatch:(NSArray *)batch
+{
+    NSMutableArray *fileDatas              = [NSMutableArray array];
+    NSMutableDictionary *fileDatasByOrigin = [NSMutableDictionary dictionary];
+    NSMutableArray *messages               = [NSMutableArray array];
+    void (^flush)(void) = ^{
+        if ([fileDatas count])
+        {
+            [self addFileDatas:fileDatas];
+            [fileDatas removeAllObjects];
+        }
+        for (NSString *origin in fileDatasByOrigin)
+        {
+            [self addFileDatas:fileDatasByOrigin[origin] fromOrigin:origin];
+        }
+        [fileDatasByOrigin removeAllObjects];
+        if ([messages count])
+        {
+            [self addMessages:messages];
+            [messages removeAllObjects];
+        }
+    };
+    for (id item in batch)
+    {
+        if ([item isKindOfClass:[CoverStoryCoverageFileData class]])
+        {
+            [fileDatas addObject:item];
+        }
+        else if ([item isKindOfClass:[CSFolderFileData class]])
+        {
+            // what a folder being reloaded reads is held until it's all in
+            CSFolderFileData *folderFileData = item;
+            NSString *origin                 = folderFileData->_origin;
+            NSMutableArray *originFileDatas  = refreshedFileDatas_[origin] ?: fileDatasByOrigin[origin];
+            if (!originFileDatas)
+            {
+                originFileDatas           = [NSMutableArray array];
+                fileDatasByOrigin[origin] = originFileDatas;
+            }
+            [originFileDatas addObject:folderFileData->_fileData];
+        }
+        else if ([item isKindOfClass:[NSDictionary class]])
+        {
+            [messages addObject:item];
+        }
+        else
+        {
+            flush();
+            void (^block)(void) = item;
+            block();
+        }
+    }
+    flush();
 }
 
 - (void)addMessageFromThread:(NSString *)message
@@ -1129,6 +2307,9 @@ typedef NS_ENUM(NSInteger, CSMessageType)
 - (void)close
 {
     documentClosed_ = YES;
+    [self stopWatching];
+    [queryServer_ stop];
+    queryServer_ = nil;
     [super close];
 }
 
@@ -1248,32 +2429,41 @@ typedef NS_ENUM(NSInteger, CSMessageType)
     return YES;
 }
 
-// Called as a performSelectorOnMainThread, so must check to make sure
-// we haven't been closed.
+// Called on the main thread, so must check to make sure we haven't been
+// closed.
 - (void)addMessage:(NSDictionary *)msgInfo
+{
+    [self addMessages:@[msgInfo]];
+}
+
+// Appends a batch of messages to the drawer w/ a single edit of the text
+// storage (and one display).
+- (void)addMessages:(NSArray *)msgInfos
 {
     if ([self isClosed])
         return;
     
-    NSString *message     = msgInfo[@"message"];
-    CSMessageType msgType = [msgInfo[@"msgType"] intValue];
-    if (message)
+    NSMutableParagraphStyle *paraStyle = [[NSParagraphStyle defaultParagraphStyle] mutableCopy];
+    [paraStyle setFirstLineHeadIndent:0];
+    [paraStyle setHeadIndent:12];
+    
+    NSMutableAttributedString *batchString = [[NSMutableAttributedString alloc] init];
+    NSRange lastProblemRange               = NSMakeRange(NSNotFound, 0);
+    for (NSDictionary *msgInfo in msgInfos)
     {
-        // for non-info make sure the drawer is open
-        if (msgType != kCSMessageTypeInfo)
+        NSString *message     = msgInfo[@"message"];
+        CSMessageType msgType = [msgInfo[@"msgType"] intValue];
+        if (!message)
         {
-            [drawer_ open];
+            continue;
         }
-        
         // make sure it ends in a newline
         if (![message hasSuffix:@"\n"])
         {
             message = [message stringByAppendingString:@"\n"];
         }
         
-        // add the message, color, and scroll
-        size_t length          = [[messageView_ string] length];
-        NSRange appendRange    = NSMakeRange(length, 0);
+        // add the message and color
         NSTextAttachment *icon = nil;
         NSColor *textColor     = nil;
         switch (msgType) {
@@ -1294,201 +2484,44 @@ typedef NS_ENUM(NSInteger, CSMessageType)
         NSAttributedString *attrMessage = [[NSAttributedString alloc] initWithString:message];
         [attrIconAndMessage appendAttributedString:attrMessage];
         
-        NSMutableParagraphStyle *paraStyle = [[NSParagraphStyle defaultParagraphStyle] mutableCopy];
-        [paraStyle setFirstLineHeadIndent:0];
-        [paraStyle setHeadIndent:12];
         NSDictionary *attrs = @{NSForegroundColorAttributeName : textColor, NSParagraphStyleAttributeName : paraStyle};
         
         [attrIconAndMessage addAttributes:attrs range:NSMakeRange(0, [attrMessage length])];
-        NSTextStorage *storage = [messageView_ textStorage];
-        [storage replaceCharactersInRange:appendRange withAttributedString:attrIconAndMessage];
         if (msgType != kCSMessageTypeInfo) // only scroll to the warnings/errors
         {
-            NSRange visibleRange = NSMakeRange(appendRange.location, [attrIconAndMessage length]);
-            [messageView_ scrollRangeToVisible:visibleRange];
+            lastProblemRange = NSMakeRange([batchString length], [attrIconAndMessage length]);
         }
-        [messageView_ display];
+        [batchString appendAttributedString:attrIconAndMessage];
     }
-}
-
-- (NSString *)htmlFileListTableData
-{
-    NSArray *fileDatas         = [sourceFilesController_ arrangedObjects];
-    NSMutableString *filesHtml = [NSMutableString string];
-    CGFloat values[6]          = {25.0, 35.0, 45.0, 55.0, 65.0, 75.0};
-    NSArray *classes           = @[@"filelessthan25percent", @"filelessthan35percent", @"filelessthan45percent", @"filelessthan55percent", @"filelessthan65percent", @"filelessthan75percent"];
-    
-    for (CoverStoryCoverageFileData *fileData in fileDatas)
-    {
-        NSString *name     = [[fileData sourcePath] lastPathComponent];
-        NSString *linkName = [name gtm_stringByEscapingForHTML];
-        NSString *link     = [[name stringByAppendingPathExtension:@"html"]
-                              stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
-        float percent;
-        [fileData coverageTotalLines:NULL
-                           codeLines:NULL
-                        hitCodeLines:NULL
-                    nonFeasibleLines:NULL
-                      coverageString:NULL
-                            coverage:&percent];
-        
-        NSString *classString = @"filegoodcoveragepercent";
-        
-        for (size_t i = 0; i < 6; ++i)
-        {
-            if (percent < values[i])
-            {
-                classString = classes[i];
-                break;
-            }
-        }
-        [filesHtml appendFormat:
-         @"<tr class='fileline'>\n"
-         @"<td class='filename'><a href='%@'>%@</a></td>\n"
-         @"<td class='filepercent'><span class='%@'>%.2f</span></td>\n"
-         @"</tr>\n", link, linkName, classString, percent];
+    if ([batchString length] == 0)
+    {
+        return;
     }
-    return filesHtml;
-}
-
-- (NSString *)htmlSourceTableData:(CoverStoryCoverageFileData *)fileData
-{
-    unichar nbsp                = 0xA0;
-    NSString *tabReplacement    = [NSString stringWithFormat:@"%C ", nbsp];
-    NSMutableString *sourceHtml = [NSMutableString string];
-    for (CoverStoryCoverageLineData *line in [fileData lines])
+    
+    // for non-info make sure the drawer is open
+    if (lastProblemRange.location != NSNotFound)
     {
-        NSString *lineSource = [line line];
-        lineSource = [lineSource stringByReplacingOccurrencesOfString:@"\t" withString:tabReplacement];
-        lineSource = [lineSource stringByReplacingOccurrencesOfString:@"  "
-                                                withString:tabReplacement];
-        lineSource = [lineSource gtm_stringByEscapingForHTML];
-        NSInteger hitCount       = [line hitCount];
-        NSString *hitCountString = nil;
-        NSString *hitStyle       = @"sourcelinehit";
-        if (hitCount == kCoverStoryNotExecutedMarker)
-        {
-            hitStyle       = @"sourcelineskipped";
-            hitCountString = @"";
-        }
-        else if (hitCount == kCoverStoryNonFeasibleMarker)
-        {
-            hitStyle       = @"sourcelinenonfeasible";
-            hitCountString = @"";
-        }
-        else if (hitCount == 0)
-        {
-            hitStyle = @"sourcelinemissed";
-        }
-        if (!hitCountString)
-        {
-            hitCountString = [NSString stringWithFormat:@"%ld", (long)hitCount];
-        }
-        [sourceHtml appendFormat:@"<tr class='sourceline'>\n"
-                                 @"<td class='sourcelinehitcount'>%@</td>\n"
-                                 @"<td class='%@'>%@</td>\n"
-                                 @"</tr>\n", hitCountString, hitStyle, lineSource];
+        [drawer_ open];
     }
-    return sourceHtml;
-}
-
-- (BOOL)mutateString:(NSMutableString *)string
-         byReplacing:(NSString *)value
-                with:(NSString *)replacement
-               error:(NSError * *)error
-{
-    NSRange replaceRange = [string rangeOfString:value];
-    if (replaceRange.length == 0)
+    NSTextStorage *storage = [messageView_ textStorage];
+    NSUInteger length      = [storage length];
+    [storage beginEditing];
+    [storage replaceCharactersInRange:NSMakeRange(length, 0) withAttributedString:batchString];
+    [storage endEditing];
+    if (lastProblemRange.location != NSNotFound)
     {
-        if (error)
-        {
-            NSString *errString = [NSString stringWithFormat:@"Unable to find %@", value];
-            NSDictionary *dict = @{NSLocalizedDescriptionKey : errString};
-            
-            *error = [NSError errorWithDomain:kCoverStoryErrorDomain
-                                         code:kCoverStoryExportError
-                                     userInfo:dict];
-        }
-        return NO;
+        lastProblemRange.location += length;
+        [messageView_ scrollRangeToVisible:lastProblemRange];
     }
-    [string replaceCharactersInRange:replaceRange withString:replacement];
-    return YES;
+    [messageView_ display];
 }
 
-- (NSFileWrapper *)fileWrapperOfType:(NSString *)typeName
-                               error:(NSError * *)outError
+- (CoverStoryHTMLExporter *)htmlExporterWithError:(NSError * *)outError
 {
-    NSString *fileList = [self htmlFileListTableData];
-    NSArray *fileDatas = [sourceFilesController_ arrangedObjects];
-    NSString *name = NSStringFromClass([LineCoverageToCoverageShortSummaryTransformer class]);
-    NSValueTransformer *transformer = [NSValueTransformer valueTransformerForName:name];
-    NSString *summary = [transformer transformedValue:fileDatas];
-    
-    summary = [summary gtm_stringByEscapingForHTML];
-    name = NSStringFromClass([FileLineCoverageToCoverageSummaryTransformer class]);
-    transformer = [NSValueTransformer valueTransformerForName:name];
-    
-    NSFileWrapper *finalWrapper = [[NSFileWrapper alloc] initDirectoryWithFileWrappers:nil];
-    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
-    [formatter setDateStyle:kCFDateFormatterShortStyle];
-    [formatter setTimeStyle:kCFDateFormatterShortStyle];
-    
-    NSString *date = [formatter stringFromDate:[NSDate date]];
-    date = [date gtm_stringByEscapingForHTML];
-    NSString *redirectURL        = nil;
-    NSString *htmlExportTemplate = GTMLocalizedStringFromTable(@"HTMLExportTemplate",
-                                                               @"HTMLExport", @"");
-    for (CoverStoryCoverageFileData *fileData in fileDatas)
-    {
-        @autoreleasepool {
-            NSString *sourcePath     = [fileData sourcePath];
-            NSString *fileName       = [sourcePath lastPathComponent];
-            NSString *htmlFileName   = [fileName stringByAppendingPathExtension:@"html"];
-            NSString *coverageString = [transformer transformedValue:fileData];
-            sourcePath     = [sourcePath gtm_stringByEscapingForHTML];
-            fileName       = [fileName gtm_stringByEscapingForHTML];
-            coverageString = [coverageString gtm_stringByEscapingForHTML];
-            NSString *sourceHTML           = [self htmlSourceTableData:fileData];
-            NSMutableString *htmlString    = [htmlExportTemplate mutableCopy];
-            NSDictionary *htmlReplacements = @{ @"__TITLE__" :  fileName,
-                                            @"__SOURCE_NAME__" :  fileName,
-                                            @"__SOURCE_PATH__" :  sourcePath,
-                                            @"__SOURCE_DATE__" :  date,
-                                            @"__FILE_SUMMARY__" :  summary,
-                                            @"__FILE_DATA__" :  fileList,
-                                            @"__SOURCE_SUMMARY__" :  coverageString,
-                                            @"__SOURCE_DATA__" :  sourceHTML, };
-            
-            for (NSString *token in htmlReplacements)
-            {
-                if (![self mutateString:htmlString byReplacing:token with:htmlReplacements[token] error:outError])
-                {
-                    return NO;
-                }
-            }
-            
-            NSData *data = [htmlString dataUsingEncoding:NSUTF8StringEncoding];
-            [finalWrapper addRegularFileWithContents:data preferredFilename:htmlFileName];
-            if (!redirectURL)
-            {
-                // Not autoreleased because we want it outside of our pool.
-                redirectURL = [[NSString alloc] initWithFormat:@"./%@",
-                   [htmlFileName stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
-            }
-        }
-    }
-    if (redirectURL)
-    {
-        NSMutableString *indexHTML = [NSLocalizedStringFromTable (@"HTMLIndexTemplate",
-                                       @"HTMLExport",
-                                       @"")mutableCopy];
-        if (![self mutateString:indexHTML byReplacing:@"__REDIRECT_URL__" with:redirectURL error:outError])
-        {
-            return NO;
-        }
-        NSData *indexData = [indexHTML dataUsingEncoding:NSUTF8StringEncoding];
-        [finalWrapper addRegularFileWithContents:indexData preferredFilename:@"index.html"];
-    }
+    NSString *pageTemplate  = GTMLocalizedStringFromTable(@"HTMLExportTemplate", @"HTMLExport", @"");
+    NSString *indexTemplate = NSLocalizedStringFromTable(@"HTMLIndexTemplate", @"HTMLExport", @"");
+    CoverStoryHTMLExporter *exporter = [[CoverStoryHTMLExporter alloc] initWithPageTemplate:pageTemplate
+                                                                              indexTemplate:indexTemplate];
 
     NSString *cssPath = [[NSBundle mainBundle] pathForResource:@"coverstory" ofType:@"css"];
     NSError *error = nil;
@@ -1508,14 +2541,15 @@ typedef NS_ENUM(NSInteger, CSMessageType)
     {
         NSUserDefaultsController *defaults  = [NSUserDefaultsController sharedUserDefaultsController];
         id values = [defaults values];
-        NSDictionary *sourceLineColorMap = @{
-            kCoverStoryMissedLineColorKey: @"$$SOURCE_LINE_MISSED_COLOR$$",
-            kCoverStoryUnexecutableLineColorKey: @"$$SOURCE_LINE_SKIPPED_COLOR$$",
-            kCoverStoryNonFeasibleLineColorKey: @"$$SOURCE_LINE_NONFEASIBLE_COLOR$$",
-            kCoverStoryExecutedLineColorKey: @"$$SOURCE_LINE_HIT_COLOR$$"
-        };
+        NSMutableDictionary *lineColors = [NSMutableDictionary dictionary];
+        NSArray *colorKeys = @[
+            kCoverStoryMissedLineColorKey,
+            kCoverStoryUnexecutableLineColorKey,
+            kCoverStoryNonFeasibleLineColorKey,
+            kCoverStoryExecutedLineColorKey
+        ];
         
-        for (NSString *colorKey in [sourceLineColorMap allKeys])
+        for (NSString *colorKey in colorKeys)
         {
             NSData *colorData = [values valueForKey:colorKey];
             NSColor *color    = nil;
@@ -1532,21 +2566,33 @@ typedef NS_ENUM(NSInteger, CSMessageType)
             color = [color colorUsingColorSpace:[NSColorSpace genericRGBColorSpace]];
             CGFloat components[4];
             [color getComponents:components];
-            int redInt         = (int)(components[0] * 255);
-            int greenInt       = (int)(components[1] * 255);
-            int blueInt        = (int)(components[2] * 255);
-            NSString *newColor = [NSString stringWithFormat:@"#%02X%02X%02X", redInt, greenInt, blueInt];
-            NSString *replacee = sourceLineColorMap[colorKey];
-            cssString = [cssString stringByReplacingOccurrencesOfString:replacee withString:newColor];
+            int redInt   = (int)(components[0] * 255);
+            int greenInt = (int)(components[1] * 255);
+            int blueInt  = (int)(components[2] * 255);
+            lineColors[colorKey] = [NSString stringWithFormat:@"#%02X%02X%02X", redInt, greenInt, blueInt];
         }
-        NSData *cssData = [cssString dataUsingEncoding:NSUTF8StringEncoding];
-        [finalWrapper addRegularFileWithContents:cssData preferredFilename:@"coverstory.css"];
+        [exporter setStylesheet:[CoverStoryHTMLExporter stylesheetFromTemplate:cssString lineColors:lineColors]];
     }
     NSString *jsPath = [[NSBundle mainBundle] pathForResource:@"coverstory" ofType:@"js"];
-    NSData *jsData = [NSData dataWithContentsOfFile:jsPath];
-    [finalWrapper addRegularFileWithContents:jsData preferredFilename:@"coverstory.js"];
+    [exporter setJavaScript:[NSData dataWithContentsOfFile:jsPath]];
 
-    return finalWrapper;
+    return exporter;
+}
+
+// The export is streamed into the folder rather than built up in a file
+// wrapper, so big projects don't have to fit in memory.
+- (BOOL)writeToURL:(NSURL *)absoluteURL
+            ofType:(NSString *)typeName
+             error:(NSError * *)outError
+{
+    CoverStoryHTMLExporter *exporter = [self htmlExporterWithError:outError];
+    if (!exporter)
+    {
+        return NO;
+    }
+    return [exporter writeFileDatas:[sourceFilesController_ arrangedObjects]
+                        toDirectory:[absoluteURL path]
+                              error:outError];
 }
 
 - (id)handleExportHTMLScriptCommand:(NSScriptCommand *)command
@@ -1591,14 +2637,30 @@ typedef NS_ENUM(NSInteger, CSMessageType)
     // GrandCentral on 10.6+ means all the queues work together, but on 10.5, they
     // don't, so without a shared queue, multiple windows would really hammer the
     // machine.
+    // The gcov runs ask for it from several threads at once on the first load.
     static NSOperationQueue *s_sharedQueue;
-    if (!s_sharedQueue)
-    {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
         s_sharedQueue = [[NSOperationQueue alloc] init];
-    }
+    });
     return s_sharedQueue;
 }
 
++ (NSOperationQueue *)cs_gcovOperationQueue
+{
+    // Running gcov is mostly waiting on a child process, so these get their own
+    // queue bounded by the number of cores (shared across windows for the same
+    // reason as above) rather than tying up the shared queue.
+    static NSOperationQueue *s_gcovQueue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        s_gcovQueue = [[NSOperationQueue alloc] init];
+        [s_gcovQueue setMaxConcurrentOperationCount:[[NSProcessInfo processInfo] activeProcessorCount]];
+        [s_gcovQueue setName:@"CoverStory gcov"];
+    });
+    return s_gcovQueue;
+}
+
 @end
 
 @implementation NSFileManager (CoverStoryThreading)
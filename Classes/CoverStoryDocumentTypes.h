@@ -31,6 +31,12 @@
 #define kGCNOTypeNameRaw GNU Compiler Notes File
 #define kGCDATypeNameRaw GNU Compiler Data Arcs File
 #define kGCOVTypeNameRaw GNU Compiler Coverage File
+#define kCoverageShardTypeNameRaw CoverStory Coverage Shard
+#define kLCovTypeNameRaw LCOV Coverage Tracefile
+#define kLLVMCovTypeNameRaw LLVM Coverage Export
 #define kGCNOTypeName TO_STRING(kGCNOTypeNameRaw)
 #define kGCDATypeName TO_STRING(kGCDATypeNameRaw)
 #define kGCOVTypeName TO_STRING(kGCOVTypeNameRaw)
+#define kCoverageShardTypeName TO_STRING(kCoverageShardTypeNameRaw)
+#define kLCovTypeName TO_STRING(kLCovTypeNameRaw)
+#define kLLVMCovTypeName TO_STRING(kLLVMCovTypeNameRaw)
@@ -17,15 +17,48 @@
 //  the License.
 //
 
+#if COVERSTORY_HEADLESS
+#import <Foundation/Foundation.h>
+#else
 #import <Cocoa/Cocoa.h>
+#endif
 
 @class CoverStoryDocument;
+@class CSCompiledFileFilter;
 
 @interface CoverStoryFilePredicate : NSPredicate {
 @private
+#if !COVERSTORY_HEADLESS
     IBOutlet NSSearchField *searchField_;
     IBOutlet CoverStoryDocument *document_;
+#endif
+    BOOL hideSDKSources_;
+    BOOL hideUnittestSources_;
+    NSString *filterString_;
+    CSCompiledFileFilter *compiledFilter_;  // rebuilt when the settings change
+    // The last filteredArrayFromArray:contentGeneration:, so typing more of a
+    // filter only looks at what already matched.
+    CSCompiledFileFilter *lastFilter_;
+    NSArray *lastInput_;
+    NSUInteger lastInputGeneration_;
+    NSArray *lastResult_;
 }
 
 + (void)registerDefaults;
+
+// For use w/o a document (the nib hooks up the document and search field
+// instead).  The filter string type comes from the defaults either way.
+- (id)initWithHideSDKSources:(BOOL)hideSDKSources
+         hideUnittestSources:(BOOL)hideUnittestSources
+                filterString:(NSString *)filterString;
+
+// The objects (anything w/ a sourcePath) that pass the filter, in their
+// original order.  Large arrays are split across processors.
+- (NSArray *)filteredArrayFromArray:(NSArray *)objects;
+// Same, but if |objects| is the same array w/ the same |generation| as last
+// time and the filter only got narrower (text appended to a wildcard filter,
+// or more hiding), just the last result is rechecked.  The caller has to
+// change |generation| whenever the array's contents change (see
+// -[CoverStoryCoverageSet contentGeneration]).
+- (NSArray *)filteredArrayFromArray:(NSArray *)objects contentGeneration:(NSUInteger)generation;
 @end
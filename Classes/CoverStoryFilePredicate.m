@@ -18,20 +18,222 @@
 //
 #import "CoverStoryFilePredicate.h"
 #import "CoverStoryPreferenceKeys.h"
+#if COVERSTORY_HEADLESS
+#import <Foundation/NSRegularExpression.h>
+#else
 #import "CoverStoryDocument.h"
 #import "GTMRegex.h"
+#endif
 #import <fnmatch.h>
 
-@interface NSString (CoverStoryStringMatching)
-- (BOOL)cs_isRegularExpressionEqual:(NSString *)string;
-- (BOOL)cs_isWildcardPatternEqual:(NSString *)string;
-- (BOOL)cs_isMatchForPatternArray:(NSArray *)patterns;
-@end
-
 // the one key in our array of dictionaries.  we uses an array of dicts instead
 // of an array of strings, because then we can KVC the UI for editing them.
 static NSString * const kFilter = @"filter";
 
+// Below this many files it isn't worth farming the filtering out.
+static const NSUInteger kCSParallelFilterMinimum = 4096;
+static const NSUInteger kCSFilterChunkSize       = 1024;
+
+// The filter settings turned into what fnmatch/regexec want, once per change
+// rather than once per file.  Immutable, so the chunks of a parallel filter
+// can share one.
+@interface CSCompiledFileFilter : NSObject {
+@private
+    BOOL _hideSDKSources;
+    BOOL _hideUnittestSources;
+    NSArray *_sdkPatterns;
+    NSArray *_unittestPatterns;
+    NSString *_filterString;
+    CoverStoryFilterStringType _filterType;
+    NSData *_sdkPatternData;       // of const char *
+    NSData *_unittestPatternData;  // of const char *
+    NSMutableArray *_patternStrings;  // keeps the UTF-8 above alive
+    NSData *_wildcard;
+#if COVERSTORY_HEADLESS
+    NSRegularExpression *_regex;
+#else
+    GTMRegex *_regex;
+#endif
+}
+- (id)initWithHideSDKSources:(BOOL)hideSDKSources
+                 sdkPatterns:(NSArray *)sdkPatterns
+         hideUnittestSources:(BOOL)hideUnittestSources
+            unittestPatterns:(NSArray *)unittestPatterns
+                filterString:(NSString *)filterString
+                  filterType:(CoverStoryFilterStringType)filterType;
+- (BOOL)isForHideSDKSources:(BOOL)hideSDKSources
+        hideUnittestSources:(BOOL)hideUnittestSources
+               filterString:(NSString *)filterString;
+// YES if everything this passes, |filter| also passed (so filtering |filter|'s
+// results gives the same answer as starting over).
+- (BOOL)isNarrowingOf:(CSCompiledFileFilter *)filter;
+- (BOOL)matchesPath:(NSString *)path UTF8String:(const char *)utf8Path;
+@end
+
+@implementation CSCompiledFileFilter
+
+- (NSData *)compilePatterns:(NSArray *)patterns
+{
+    NSMutableData *compiled = [NSMutableData data];
+    for (NSDictionary *patternDict in patterns)
+    {
+        NSString *pattern = patternDict[kFilter];
+        if ([pattern length] > 0)
+        {
+            NSData *utf8 = [pattern dataUsingEncoding:NSUTF8StringEncoding];
+            NSMutableData *cString = [NSMutableData dataWithData:utf8];
+            [cString appendBytes:"" length:1];
+            [_patternStrings addObject:cString];
+            const char *bytes = [cString bytes];
+            [compiled appendBytes:&bytes length:sizeof(bytes)];
+        }
+    }
+    return compiled;
+}
+
+- (id)initWithHideSDKSources:(BOOL)hideSDKSources
+                 sdkPatterns:(NSArray *)sdkPatterns
+         hideUnittestSources:(BOOL)hideUnittestSources
+            unittestPatterns:(NSArray *)unittestPatterns
+                filterString:(NSString *)filterString
+                  filterType:(CoverStoryFilterStringType)filterType
+{
+    if ((self = [super init]))
+    {
+        _hideSDKSources      = hideSDKSources;
+        _hideUnittestSources = hideUnittestSources;
+        _sdkPatterns         = [sdkPatterns copy];
+        _unittestPatterns    = [unittestPatterns copy];
+        _filterString        = [filterString copy];
+        _filterType          = filterType;
+        _patternStrings      = [NSMutableArray array];
+        _sdkPatternData      = hideSDKSources ? [self compilePatterns:sdkPatterns] : nil;
+        _unittestPatternData = hideUnittestSources ? [self compilePatterns:unittestPatterns] : nil;
+        if ([filterString length])
+        {
+            if (filterType == kCoverStoryFilterStringTypeRegularExpression)
+            {
+                // no point in catching errors since we do this as they type, if
+                // the pattern didn't parse, always show things
+#if COVERSTORY_HEADLESS
+                _regex = [NSRegularExpression regularExpressionWithPattern:filterString
+                                                                   options:NSRegularExpressionCaseInsensitive
+                                                                     error:NULL];
+#else
+                _regex = [GTMRegex regexWithPattern:filterString options:kGTMRegexOptionIgnoreCase];
+#endif
+            }
+            else
+            {
+                NSString *pattern = [NSString stringWithFormat:@"*%@*", filterString];
+                NSMutableData *wildcard = [NSMutableData dataWithData:[pattern dataUsingEncoding:NSUTF8StringEncoding]];
+                [wildcard appendBytes:"" length:1];
+                _wildcard = wildcard;
+            }
+        }
+    }
+    return self;
+}
+
+- (BOOL)isForHideSDKSources:(BOOL)hideSDKSources
+        hideUnittestSources:(BOOL)hideUnittestSources
+               filterString:(NSString *)filterString
+{
+    return ((hideSDKSources == _hideSDKSources) &&
+            (hideUnittestSources == _hideUnittestSources) &&
+            ((filterString == _filterString) || [filterString isEqualToString:_filterString]));
+}
+
+- (BOOL)isNarrowingOf:(CSCompiledFileFilter *)filter
+{
+    if (!filter ||
+        (filter->_hideSDKSources && !_hideSDKSources) ||
+        (filter->_hideUnittestSources && !_hideUnittestSources))
+    {
+        return NO;
+    }
+    // Hiding more is narrowing, but only if the patterns are the same.
+    if ((_hideSDKSources && filter->_hideSDKSources && ![_sdkPatterns isEqual:filter->_sdkPatterns]) ||
+        (_hideUnittestSources && filter->_hideUnittestSources &&
+         ![_unittestPatterns isEqual:filter->_unittestPatterns]))
+    {
+        return NO;
+    }
+    NSString *oldText = filter->_filterString ?: @"";
+    NSString *newText = _filterString ?: @"";
+    if ([oldText length] == 0)
+    {
+        return YES;
+    }
+    if (_filterType != filter->_filterType)
+    {
+        return NO;
+    }
+    if (_filterType == kCoverStoryFilterStringTypeRegularExpression)
+    {
+        // Adding to a regex can match more ("a" -> "a|b").
+        return [newText isEqualToString:oldText];
+    }
+    // For a wildcard, "*old*" has to match part of anything "*oldmore*" does,
+    // as long as old doesn't end in the middle of a bracket or escape.
+    return ([newText hasPrefix:oldText] &&
+            ([oldText rangeOfCharacterFromSet:[NSCharacterSet characterSetWithCharactersInString:@"[\\"]].location == NSNotFound));
+}
+
+static BOOL CSMatchesPatterns(NSData *patternData, const char *utf8Path)
+{
+    const char *const *patterns = [patternData bytes];
+    NSUInteger count            = [patternData length] / sizeof(const char *);
+    for (NSUInteger x = 0; x < count; ++x)
+    {
+        if (fnmatch(patterns[x], utf8Path, 0) == 0)
+        {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+- (BOOL)matchesPath:(NSString *)path UTF8String:(const char *)utf8Path
+{
+    if (!utf8Path)
+    {
+        return NO;
+    }
+    if (_sdkPatternData && CSMatchesPatterns(_sdkPatternData, utf8Path))
+    {
+        return NO;
+    }
+    if (_unittestPatternData && CSMatchesPatterns(_unittestPatternData, utf8Path))
+    {
+        return NO;
+    }
+    if (_wildcard)
+    {
+        return fnmatch([_wildcard bytes], utf8Path, FNM_CASEFOLD) == 0;
+    }
+    if (_regex)
+    {
+#if COVERSTORY_HEADLESS
+        return [_regex rangeOfFirstMatchInString:path options:0 range:NSMakeRange(0, [path length])].location != NSNotFound;
+#else
+        return [_regex matchesSubStringInString:path];
+#endif
+    }
+    return YES;
+}
+
+@end
+
+@interface CoverStoryFilePredicate ()
+- (BOOL)hideSDKSources;
+- (BOOL)hideUnittestSources;
+- (NSString *)filterString;
+- (CSCompiledFileFilter *)compiledFilter;
+- (void)defaultsChanged:(NSNotification *)notification;
+- (NSArray *)filteredArray:(NSArray *)candidates withFilter:(CSCompiledFileFilter *)filter;
+@end
+
 @implementation CoverStoryFilePredicate
 
 + (void)registerDefaults
@@ -55,96 +257,186 @@ static NSString * const kFilter = @"filter";
     [defaults registerDefaults:predicateDefaults];
 }
 
-- (BOOL)evaluateWithObject:(id)object
+- (id)init
 {
-    BOOL isGood = YES;
-    NSString *path = [object valueForKey:@"sourcePath"];
-    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
-    
-    BOOL hideSDKFiles = [document_ hideSDKSources];
-    if (hideSDKFiles)
+    return [self initWithHideSDKSources:NO hideUnittestSources:NO filterString:nil];
+}
+
+- (id)initWithHideSDKSources:(BOOL)hideSDKSources
+         hideUnittestSources:(BOOL)hideUnittestSources
+                filterString:(NSString *)filterString
+{
+    if ((self = [super init]))
     {
-        NSArray *systemSourcesPatterns = [defaults arrayForKey:kCoverStorySystemSourcesPatternsKey];
-        if (systemSourcesPatterns)
-        {
-            isGood = ![path cs_isMatchForPatternArray:systemSourcesPatterns];
-        }
+        hideSDKSources_      = hideSDKSources;
+        hideUnittestSources_ = hideUnittestSources;
+        filterString_        = [filterString copy];
+        // the patterns and filter type live in the defaults
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(defaultsChanged:)
+                                                     name:NSUserDefaultsDidChangeNotification
+                                                   object:nil];
     }
-    if (isGood)
+    return self;
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+- (void)defaultsChanged:(NSNotification *)notification
+{
+    @synchronized(self)
     {
-        BOOL hideUnittestFiles = [document_ hideUnittestSources];
-        if (hideUnittestFiles)
-        {
-            NSArray *unittestSourcesPatterns = [defaults arrayForKey:kCoverStoryUnittestSourcesPatternsKey];
-            if (unittestSourcesPatterns)
-            {
-                isGood = ![path cs_isMatchForPatternArray:unittestSourcesPatterns];
-            }
-        }
+        compiledFilter_ = nil;
     }
-    if (isGood)
+}
+
+- (BOOL)hideSDKSources
+{
+#if !COVERSTORY_HEADLESS
+    if (document_)
     {
-        NSString *text = [searchField_ stringValue];
-        if ([text length] == 0)
-        {
-            isGood = YES;
-        }
-        else
+        return [document_ hideSDKSources];
+    }
+#endif
+    return hideSDKSources_;
+}
+
+- (BOOL)hideUnittestSources
+{
+#if !COVERSTORY_HEADLESS
+    if (document_)
+    {
+        return [document_ hideUnittestSources];
+    }
+#endif
+    return hideUnittestSources_;
+}
+
+- (NSString *)filterString
+{
+#if !COVERSTORY_HEADLESS
+    if (searchField_)
+    {
+        return [searchField_ stringValue];
+    }
+#endif
+    return filterString_;
+}
+
+- (CSCompiledFileFilter *)compiledFilter
+{
+    BOOL hideSDKFiles      = [self hideSDKSources];
+    BOOL hideUnittestFiles = [self hideUnittestSources];
+    NSString *text         = [self filterString];
+    @synchronized(self)
+    {
+        if (![compiledFilter_ isForHideSDKSources:hideSDKFiles hideUnittestSources:hideUnittestFiles filterString:text])
         {
-            CoverStoryFilterStringType type = [defaults integerForKey:kCoverStoryFilterStringTypeKey];
-            switch (type) {
-                default:
-                case kCoverStoryFilterStringTypeWildcardPattern:
-                    isGood = [path cs_isWildcardPatternEqual:text];
-                    break;
-                    
-                case kCoverStoryFilterStringTypeRegularExpression:
-                    isGood = [path cs_isRegularExpressionEqual:text];
-                    break;
-            }
+            NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+            compiledFilter_ =
+                [[CSCompiledFileFilter alloc] initWithHideSDKSources:hideSDKFiles
+                                                         sdkPatterns:[defaults arrayForKey:kCoverStorySystemSourcesPatternsKey]
+                                                 hideUnittestSources:hideUnittestFiles
+                                                    unittestPatterns:[defaults arrayForKey:kCoverStoryUnittestSourcesPatternsKey]
+                                                        filterString:text
+                                                          filterType:[defaults integerForKey:kCoverStoryFilterStringTypeKey]];
         }
+        return compiledFilter_;
     }
-    return isGood;
 }
 
-@end
-
-@implementation NSString (CoverStoryStringMatching)
-- (BOOL)cs_isRegularExpressionEqual:(NSString *)string
+static const char *CSSourcePathUTF8String(id object, NSString *path)
 {
-    // if the pattern didn't parse, always show things
-    BOOL result = YES;
-    
-    // no point in catching errors since we do this as they type
-    GTMRegex *regex = [GTMRegex regexWithPattern:string options:kGTMRegexOptionIgnoreCase];
-    if (regex)
+    if ([object respondsToSelector:@selector(sourcePathUTF8String)])
     {
-        result = [regex matchesSubStringInString:self];
+        return [object sourcePathUTF8String];
     }
-    return result;
+    return [path UTF8String];
 }
 
-- (BOOL)cs_isWildcardPatternEqual:(NSString *)string
+- (BOOL)evaluateWithObject:(id)object
 {
-    NSString *pattern = [NSString stringWithFormat:@"*%@*", string];
-    int flags         = FNM_CASEFOLD;
-    BOOL isGood       = fnmatch([pattern UTF8String], [self UTF8String], flags) == 0;
-    return isGood;
+    NSString *path = [object valueForKey:@"sourcePath"];
+    return [[self compiledFilter] matchesPath:path UTF8String:CSSourcePathUTF8String(object, path)];
 }
 
-- (BOOL)cs_isMatchForPatternArray:(NSArray *)patterns
+- (NSArray *)filteredArrayFromArray:(NSArray *)objects
 {
-    const char *utf8Self = [self UTF8String];
-    for (NSDictionary *patternDict in patterns)
+    return [self filteredArray:objects withFilter:[self compiledFilter]];
+}
+
+- (NSArray *)filteredArrayFromArray:(NSArray *)objects contentGeneration:(NSUInteger)generation
+{
+    CSCompiledFileFilter *filter = [self compiledFilter];
+    NSArray *candidates          = objects;
+    @synchronized(self)
     {
-        NSString *pattern = patternDict[kFilter];
-        if (([pattern length] > 0) && (fnmatch([pattern UTF8String], utf8Self, 0) == 0))
+        BOOL sameInput = ((objects == lastInput_) && (generation == lastInputGeneration_));
+        if (sameInput && (filter == lastFilter_))
         {
-            return YES;
+            return lastResult_;
+        }
+        if (sameInput && [filter isNarrowingOf:lastFilter_])
+        {
+            candidates = lastResult_;
         }
     }
-    return NO;
+    NSArray *result = [self filteredArray:candidates withFilter:filter];
+    @synchronized(self)
+    {
+        lastFilter_          = filter;
+        lastInput_           = objects;
+        lastInputGeneration_ = generation;
+        lastResult_          = result;
+    }
+    return result;
 }
 
-@end
+- (NSArray *)filteredArray:(NSArray *)candidates withFilter:(CSCompiledFileFilter *)filter
+{
+    NSUInteger candidateCount = [candidates count];
+    NSMutableData *keepData   = [NSMutableData dataWithLength:candidateCount];
+    uint8_t *keep             = [keepData mutableBytes];
+    void (^filterRange)(NSRange) = ^(NSRange range) {
+        @autoreleasepool {
+            for (NSUInteger x = range.location; x < NSMaxRange(range); ++x)
+            {
+                id object      = candidates[x];
+                NSString *path = [object valueForKey:@"sourcePath"];
+                keep[x]        = [filter matchesPath:path UTF8String:CSSourcePathUTF8String(object, path)];
+            }
+        }
+    };
+    if (candidateCount < kCSParallelFilterMinimum)
+    {
+        filterRange(NSMakeRange(0, candidateCount));
+    }
+    else
+    {
+        NSOperationQueue *queue = [[NSOperationQueue alloc] init];
+        [queue setMaxConcurrentOperationCount:[[NSProcessInfo processInfo] activeProcessorCount]];
+        for (NSUInteger start = 0; start < candidateCount; start += kCSFilterChunkSize)
+        {
+            NSRange chunk = NSMakeRange(start, MIN(kCSFilterChunkSize, candidateCount - start));
+            [queue addOperationWithBlock:^{
+                filterRange(chunk);
+            }];
+        }
+        [queue waitUntilAllOperationsAreFinished];
+    }
 
+    NSMutableArray *result = [NSMutableArray arrayWithCapacity:candidateCount];
+    for (NSUInteger x = 0; x < candidateCount; ++x)
+    {
+        if (keep[x])
+        {
+            [result addObject:candidates[x]];
+        }
+    }
+    return result;
+}
+
+@end
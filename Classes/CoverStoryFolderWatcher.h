@@ -0,0 +1,32 @@
+//
+//  CoverStoryFolderWatcher.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// Watches a build folder for .gcda files being written, moved in, or removed,
+// and once things have been quiet for |latency| hands over the set of folders
+// those files are in (a test run rewrites a lot of them at once, this gets
+// them in one go).  Uses FSEvents on the Mac and inotify elsewhere, so it
+// builds headless.  The handler is called on a private thread, one call at a
+// time; changes that happen while it runs are kept for the next call.
+
+#import <Foundation/Foundation.h>
+
+typedef void (^CoverStoryFolderWatcherHandler)(NSSet *changedFolders);
+
+@interface CoverStoryFolderWatcher : NSObject
+
+@property (readonly, nonatomic, copy) NSString *path;
+
+- (id)initWithPath:(NSString *)path
+           latency:(NSTimeInterval)latency
+           handler:(CoverStoryFolderWatcherHandler)handler;
+
+// Returns NO if the folder can't be watched.
+- (BOOL)start;
+// Nothing is handed over after this returns (other than a call already
+// running).
+- (void)stop;
+
+@end
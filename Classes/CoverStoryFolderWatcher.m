@@ -0,0 +1,398 @@
+//
+//  CoverStoryFolderWatcher.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "CoverStoryFolderWatcher.h"
+
+#if defined(__APPLE__)
+#include <CoreServices/CoreServices.h>
+#else
+#include <sys/inotify.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+@interface CoverStoryFolderWatcher () {
+@private
+    NSString *_path;
+    NSTimeInterval _latency;
+    CoverStoryFolderWatcherHandler _handler;
+    NSMutableSet *_pendingFolders;  // guarded by self
+    BOOL _stopped;                  // guarded by self
+#if defined(__APPLE__)
+    FSEventStreamRef _stream;
+    dispatch_queue_t _eventQueue;   // the stream's callbacks and the handler
+    NSUInteger _generation;         // of the last change, only on |_eventQueue|
+#else
+    int _inotifyFd;
+    int _stopPipe[2];
+    NSThread *_thread;
+    NSMutableDictionary *_foldersByWatch;  // NSNumber watch descriptor -> folder
+#endif
+}
+- (void)noteChangedPath:(NSString *)path rescan:(BOOL)rescan;
+- (BOOL)hasPendingFolders;
+- (void)deliverPending;
+@end
+
+@implementation CoverStoryFolderWatcher
+
+@synthesize path = _path;
+
+- (id)init
+{
+    return [self initWithPath:nil latency:0 handler:nil];
+}
+
+- (id)initWithPath:(NSString *)path
+           latency:(NSTimeInterval)latency
+           handler:(CoverStoryFolderWatcherHandler)handler
+{
+    if ((self = [super init]))
+    {
+        if (![path length] || !handler)
+        {
+            return nil;
+        }
+        _path           = [[path stringByStandardizingPath] copy];
+        _latency        = MAX(latency, 0.01);
+        _handler        = [handler copy];
+        _pendingFolders = [[NSMutableSet alloc] init];
+#if !defined(__APPLE__)
+        _inotifyFd      = -1;
+        _stopPipe[0]    = -1;
+        _stopPipe[1]    = -1;
+        _foldersByWatch = [[NSMutableDictionary alloc] init];
+#endif
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self stop];
+#if defined(__APPLE__) && !OS_OBJECT_USE_OBJC
+    if (_eventQueue)
+    {
+        dispatch_release(_eventQueue);
+    }
+#endif
+}
+
+// |path| is a file that changed, or a folder whose contents have to be
+// looked through again (it was moved in, or the events were dropped).
+- (void)noteChangedPath:(NSString *)path rescan:(BOOL)rescan
+{
+    NSMutableSet *folders = [NSMutableSet set];
+    if (rescan)
+    {
+        NSFileManager *fm = [[NSFileManager alloc] init];
+        for (NSString *relativePath in [fm enumeratorAtPath:path])
+        {
+            if ([relativePath hasSuffix:@".gcda"])
+            {
+                [folders addObject:[[path stringByAppendingPathComponent:relativePath]
+                                    stringByDeletingLastPathComponent]];
+            }
+        }
+    }
+    else if ([path hasSuffix:@".gcda"])
+    {
+        [folders addObject:[path stringByDeletingLastPathComponent]];
+    }
+    if ([folders count])
+    {
+        @synchronized(self)
+        {
+            [_pendingFolders unionSet:folders];
+        }
+    }
+}
+
+- (BOOL)hasPendingFolders
+{
+    @synchronized(self)
+    {
+        return [_pendingFolders count] > 0;
+    }
+}
+
+- (void)deliverPending
+{
+    NSSet *folders = nil;
+    @synchronized(self)
+    {
+        if (_stopped || ([_pendingFolders count] == 0))
+        {
+            return;
+        }
+        folders = [_pendingFolders copy];
+        [_pendingFolders removeAllObjects];
+    }
+    @autoreleasepool {
+        _handler(folders);
+    }
+}
+
+#if defined(__APPLE__)
+
+static void CSFolderWatcherCallback(ConstFSEventStreamRef stream,
+                                    void *info,
+                                    size_t count,
+                                    void *paths,
+                                    const FSEventStreamEventFlags flags[],
+                                    const FSEventStreamEventId ids[])
+{
+    CoverStoryFolderWatcher *watcher = (__bridge CoverStoryFolderWatcher *)info;
+    NSArray *eventPaths              = (__bridge NSArray *)paths;
+    const FSEventStreamEventFlags kRescanFlags = kFSEventStreamEventFlagMustScanSubDirs;
+    const FSEventStreamEventFlags kMovedIn     = kFSEventStreamEventFlagItemCreated | kFSEventStreamEventFlagItemRenamed;
+    for (size_t x = 0; x < count; ++x)
+    {
+        BOOL rescan = ((flags[x] & kRescanFlags) ||
+                       ((flags[x] & kFSEventStreamEventFlagItemIsDir) && (flags[x] & kMovedIn)));
+        [watcher noteChangedPath:eventPaths[x] rescan:rescan];
+    }
+    if (![watcher hasPendingFolders])
+    {
+        return;
+    }
+    // hand them over once nothing else has changed for |_latency|
+    NSUInteger generation = ++watcher->_generation;
+    __weak CoverStoryFolderWatcher *weakWatcher = watcher;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(watcher->_latency * NSEC_PER_SEC)),
+                   watcher->_eventQueue, ^{
+        CoverStoryFolderWatcher *strongWatcher = weakWatcher;
+        if (strongWatcher && (generation == strongWatcher->_generation))
+        {
+            [strongWatcher deliverPending];
+        }
+    });
+}
+
+- (BOOL)start
+{
+    if (_stream)
+    {
+        return YES;
+    }
+    if (!_eventQueue)
+    {
+        _eventQueue = dispatch_queue_create("com.google.CoverStory.FolderWatcher", DISPATCH_QUEUE_SERIAL);
+    }
+    FSEventStreamContext context = { 0, (__bridge void *)self, NULL, NULL, NULL };
+    // the stream's own latency is kept short, the debouncing is done above
+    _stream = FSEventStreamCreate(NULL,
+                                  &CSFolderWatcherCallback,
+                                  &context,
+                                  (__bridge CFArrayRef)@[_path],
+                                  kFSEventStreamEventIdSinceNow,
+                                  0.05,
+                                  (kFSEventStreamCreateFlagUseCFTypes |
+                                   kFSEventStreamCreateFlagFileEvents |
+                                   kFSEventStreamCreateFlagNoDefer));
+    if (!_stream)
+    {
+        return NO;
+    }
+    FSEventStreamSetDispatchQueue(_stream, _eventQueue);
+    if (!FSEventStreamStart(_stream))
+    {
+        FSEventStreamInvalidate(_stream);
+        FSEventStreamRelease(_stream);
+        _stream = NULL;
+        return NO;
+    }
+    @synchronized(self)
+    {
+        _stopped = NO;
+    }
+    return YES;
+}
+
+- (void)stop
+{
+    @synchronized(self)
+    {
+        _stopped = YES;
+        [_pendingFolders removeAllObjects];
+    }
+    if (_stream)
+    {
+        FSEventStreamStop(_stream);
+        FSEventStreamInvalidate(_stream);
+        FSEventStreamRelease(_stream);
+        _stream = NULL;
+    }
+}
+
+#else  // inotify
+
+static const uint32_t kCSWatchMask = (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE |
+                                      IN_ONLYDIR);
+
+// inotify isn't recursive, so every folder in the tree gets its own watch.
+- (BOOL)watchFolderTree:(NSString *)folder
+{
+    int watch = inotify_add_watch(_inotifyFd, [folder fileSystemRepresentation], kCSWatchMask);
+    if (watch < 0)
+    {
+        return NO;
+    }
+    _foldersByWatch[@(watch)] = folder;
+    NSFileManager *fm                 = [[NSFileManager alloc] init];
+    NSDirectoryEnumerator *enumerator = [fm enumeratorAtPath:folder];
+    for (NSString *relativePath in enumerator)
+    {
+        if ([[enumerator fileAttributes][NSFileType] isEqualToString:NSFileTypeDirectory])
+        {
+            NSString *subfolder = [folder stringByAppendingPathComponent:relativePath];
+            watch               = inotify_add_watch(_inotifyFd, [subfolder fileSystemRepresentation], kCSWatchMask);
+            if (watch >= 0)
+            {
+                _foldersByWatch[@(watch)] = subfolder;
+            }
+        }
+    }
+    return YES;
+}
+
+- (void)handleEvent:(const struct inotify_event *)event
+{
+    if (event->mask & IN_Q_OVERFLOW)
+    {
+        // lost track, look through everything
+        [self noteChangedPath:_path rescan:YES];
+        return;
+    }
+    NSNumber *watch  = @(event->wd);
+    NSString *folder = _foldersByWatch[watch];
+    if (event->mask & IN_IGNORED)
+    {
+        [_foldersByWatch removeObjectForKey:watch];
+        return;
+    }
+    if (!folder || (event->len == 0))
+    {
+        return;
+    }
+    NSString *name = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:event->name
+                                                                                 length:strlen(event->name)];
+    NSString *path = [folder stringByAppendingPathComponent:name];
+    if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+    {
+        [self watchFolderTree:path];
+        [self noteChangedPath:path rescan:YES];
+    }
+    else if (!(event->mask & IN_ISDIR))
+    {
+        [self noteChangedPath:path rescan:NO];
+    }
+}
+
+- (void)readEvents
+{
+    // big enough for a burst of events, aligned for the struct
+    char buffer[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;)
+    {
+        @autoreleasepool {
+            struct pollfd fds[2] = { { _inotifyFd, POLLIN, 0 }, { _stopPipe[0], POLLIN, 0 } };
+            // only time out when there's something waiting to be handed over
+            int timeout = [self hasPendingFolders] ? (int)(_latency * 1000) : -1;
+            int ready   = poll(fds, 2, timeout);
+            if (ready < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                break;
+            }
+            if (fds[1].revents)
+            {
+                break;
+            }
+            if (ready == 0)
+            {
+                [self deliverPending];
+                continue;
+            }
+            ssize_t length;
+            while ((length = read(_inotifyFd, buffer, sizeof(buffer))) > 0)
+            {
+                for (char *event = buffer; event < buffer + length;)
+                {
+                    const struct inotify_event *inotifyEvent = (const struct inotify_event *)event;
+                    [self handleEvent:inotifyEvent];
+                    event += sizeof(struct inotify_event) + inotifyEvent->len;
+                }
+            }
+        }
+    }
+    close(_inotifyFd);
+    close(_stopPipe[0]);
+    close(_stopPipe[1]);
+    _inotifyFd   = -1;
+    _stopPipe[0] = -1;
+    _stopPipe[1] = -1;
+}
+
+- (BOOL)start
+{
+    if (_thread)
+    {
+        return YES;
+    }
+    _inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotifyFd < 0)
+    {
+        return NO;
+    }
+    if ((pipe(_stopPipe) != 0) || ![self watchFolderTree:_path])
+    {
+        close(_inotifyFd);
+        if (_stopPipe[0] >= 0)
+        {
+            close(_stopPipe[0]);
+            close(_stopPipe[1]);
+        }
+        _inotifyFd   = -1;
+        _stopPipe[0] = -1;
+        _stopPipe[1] = -1;
+        [_foldersByWatch removeAllObjects];
+        return NO;
+    }
+    @synchronized(self)
+    {
+        _stopped = NO;
+    }
+    // the thread keeps us alive until -stop
+    _thread = [[NSThread alloc] initWithTarget:self selector:@selector(readEvents) object:nil];
+    [_thread start];
+    return YES;
+}
+
+- (void)stop
+{
+    @synchronized(self)
+    {
+        _stopped = YES;
+        [_pendingFolders removeAllObjects];
+    }
+    if (_thread)
+    {
+        char stop = 0;
+        (void)write(_stopPipe[1], &stop, 1);
+        _thread = nil;
+    }
+}
+
+#endif
+
+@end
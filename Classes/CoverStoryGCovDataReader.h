@@ -0,0 +1,31 @@
+//
+//  CoverStoryGCovDataReader.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// Reads the .gcno (graph) and .gcda (arc counter) files directly and builds
+// the per line counts the same way gcov does, so we don't have to run gcov,
+// have it write .gcov files, and then parse those back in.  Only the record
+// layout used by gcc 4.0 - 4.6 (and the compilers that emulate it) is
+// understood, for anything else (or anything that doesn't check out) the
+// reader returns nil and the caller should fall back to running gcov.
+
+#import <Foundation/Foundation.h>
+#import "CoverStoryProtocols.h"
+
+@class CoverStoryDocument;
+
+@interface CoverStoryGCovDataReader : NSObject
+
+// YES if the gcda/gcno file at |path| is a version the reader understands.
++ (BOOL)canReadGCovFile:(NSString *)path;
+
+// Returns one CoverStoryCoverageFileData for each source file that has lines
+// in the graph for |gcdaPath| (the .gcno is expected next to it).  Returns nil
+// if the data couldn't be read, in which case nothing was sent to |receiver|.
++ (NSArray *)coverageFileDatasForGCDAPath:(NSString *)gcdaPath
+                                 document:(CoverStoryDocument *)document
+                          messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver;
+
+@end
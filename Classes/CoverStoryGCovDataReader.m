@@ -0,0 +1,610 @@
+//
+//  CoverStoryGCovDataReader.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "CoverStoryGCovDataReader.h"
+#import "CoverStoryCoverageFileData.h"
+#import "CodeCoverage.h"
+
+// Everything in the files is a 32 bit word in the byte order of the machine
+// that wrote it, the magic tells us if we have to flip them.
+enum {
+    kCSGCovGCNOMagic = 0x67636e6f,  // 'gcno'
+    kCSGCovGCDAMagic = 0x67636461,  // 'gcda'
+};
+
+// Record tags (see gcov-io.h)
+enum {
+    kCSGCovTagFunction  = 0x01000000,
+    kCSGCovTagBlocks    = 0x01410000,
+    kCSGCovTagArcs      = 0x01430000,
+    kCSGCovTagLines     = 0x01450000,
+    kCSGCovTagArcCounts = 0x01a10000,
+};
+
+// Arc flags
+enum {
+    kCSGCovArcOnTree = 1 << 0,  // count isn't recorded, has to be solved for
+};
+
+typedef struct {
+    const uint8_t *bytes;
+    NSUInteger wordCount;
+    BOOL flip;
+} CSGCovWords;
+
+typedef struct {
+    uint32_t src;
+    uint32_t dst;
+    uint32_t flags;
+    int64_t count;
+    BOOL valid;
+} CSGCovArc;
+
+typedef struct {
+    uint32_t block;
+    uint32_t source;
+    uint32_t line;
+} CSGCovLineEntry;
+
+// One function from the graph file.
+@interface CSGCovFunction : NSObject {
+@public
+    uint32_t _ident;
+    uint32_t _checksum;
+    uint32_t _blockCount;
+    NSMutableData *_arcs;   // of CSGCovArc
+    NSMutableData *_lines;  // of CSGCovLineEntry
+}
+@end
+
+@implementation CSGCovFunction
+
+- (id)init
+{
+    if ((self = [super init]))
+    {
+        _arcs  = [[NSMutableData alloc] init];
+        _lines = [[NSMutableData alloc] init];
+    }
+    return self;
+}
+
+@end
+
+static inline uint32_t CSGCovWordAt(const CSGCovWords *words, NSUInteger index)
+{
+    uint32_t word;
+    memcpy(&word, words->bytes + index * sizeof(uint32_t), sizeof(word));
+    return words->flip ? NSSwapInt(word) : word;
+}
+
+// Checks the magic and pulls out the version and stamp.
+static BOOL CSGCovWordsInit(CSGCovWords *words, NSData *data, uint32_t magic,
+                            uint32_t *outVersion, uint32_t *outStamp)
+{
+    if ([data length] < 3 * sizeof(uint32_t))
+    {
+        return NO;
+    }
+    words->bytes     = [data bytes];
+    words->wordCount = [data length] / sizeof(uint32_t);
+    words->flip      = NO;
+    uint32_t fileMagic = CSGCovWordAt(words, 0);
+    if (fileMagic != magic)
+    {
+        if (NSSwapInt(fileMagic) != magic)
+        {
+            return NO;
+        }
+        words->flip = YES;
+    }
+    if (outVersion)
+    {
+        *outVersion = CSGCovWordAt(words, 1);
+    }
+    if (outStamp)
+    {
+        *outStamp = CSGCovWordAt(words, 2);
+    }
+    return YES;
+}
+
+// The version is ascii digits: major, minor tens, minor ones, vendor char.
+static BOOL CSGCovVersionIsSupported(uint32_t version)
+{
+    int major    = (int)((version >> 24) & 0xff) - '0';
+    int minor10s = (int)((version >> 16) & 0xff) - '0';
+    int minor1s  = (int)((version >>  8) & 0xff) - '0';
+    if ((minor10s < 0) || (minor10s > 9) || (minor1s < 0) || (minor1s > 9))
+    {
+        return NO;
+    }
+    int minor = minor10s * 10 + minor1s;
+    // 4.7 added the cfg checksum to the function records.
+    return (major == 4) && (minor <= 6);
+}
+
+// Strings are a word count followed by the (nul padded) chars.  Returns NO if
+// it runs past |end|.
+static BOOL CSGCovReadString(const CSGCovWords *words, NSUInteger *index,
+                             NSUInteger end, NSString **outString)
+{
+    if (*index >= end)
+    {
+        return NO;
+    }
+    NSUInteger length = CSGCovWordAt(words, *index);
+    if (length > end - *index - 1)
+    {
+        return NO;
+    }
+    const char *chars = (const char *)words->bytes + (*index + 1) * sizeof(uint32_t);
+    size_t charCount  = strnlen(chars, length * sizeof(uint32_t));
+    *outString = (charCount == 0) ? nil : [[NSString alloc] initWithBytes:chars
+                                                                   length:charCount
+                                                                 encoding:NSUTF8StringEncoding];
+    *index += 1 + length;
+    return YES;
+}
+
+static uint32_t CSGCovSourceIndex(NSString *name, NSMutableArray *sources,
+                                  NSMutableDictionary *sourceIndexes)
+{
+    NSNumber *index = sourceIndexes[name];
+    if (!index)
+    {
+        index = @([sources count]);
+        [sources addObject:name];
+        sourceIndexes[name] = index;
+    }
+    return [index unsignedIntValue];
+}
+
+static NSArray *CSGCovReadGraph(NSData *data, uint32_t *outStamp,
+                                NSMutableArray *sources)
+{
+    CSGCovWords words;
+    uint32_t version;
+    if (!CSGCovWordsInit(&words, data, kCSGCovGCNOMagic, &version, outStamp) ||
+        !CSGCovVersionIsSupported(version))
+    {
+        return nil;
+    }
+    NSMutableArray *functions           = [NSMutableArray array];
+    NSMutableDictionary *sourceIndexes  = [NSMutableDictionary dictionary];
+    CSGCovFunction *function            = nil;
+    uint32_t currentSource              = UINT32_MAX;
+    NSUInteger index                    = 3;
+    while (index + 2 <= words.wordCount)
+    {
+        uint32_t tag      = CSGCovWordAt(&words, index);
+        uint32_t length   = CSGCovWordAt(&words, index + 1);
+        NSUInteger record = index + 2;
+        NSUInteger end    = record + length;
+        if (end > words.wordCount)
+        {
+            return nil;
+        }
+        switch (tag) {
+            case kCSGCovTagFunction:
+            {
+                NSString *name   = nil;
+                NSString *source = nil;
+                NSUInteger x     = record + 2;
+                if ((length < 2) ||
+                    !CSGCovReadString(&words, &x, end, &name) ||
+                    !CSGCovReadString(&words, &x, end, &source) ||
+                    !source)
+                {
+                    return nil;
+                }
+                function = [[CSGCovFunction alloc] init];
+                function->_ident    = CSGCovWordAt(&words, record);
+                function->_checksum = CSGCovWordAt(&words, record + 1);
+                [functions addObject:function];
+                // lines w/o a file name are in the function's file
+                currentSource = CSGCovSourceIndex(source, sources, sourceIndexes);
+                break;
+            }
+            case kCSGCovTagBlocks:
+                if (!function)
+                {
+                    return nil;
+                }
+                function->_blockCount = length;
+                break;
+            case kCSGCovTagArcs:
+            {
+                if (!function || (length < 1))
+                {
+                    return nil;
+                }
+                uint32_t src = CSGCovWordAt(&words, record);
+                if (src >= function->_blockCount)
+                {
+                    return nil;
+                }
+                for (NSUInteger x = record + 1; x + 1 < end; x += 2)
+                {
+                    CSGCovArc arc = { src, CSGCovWordAt(&words, x), CSGCovWordAt(&words, x + 1), 0, NO };
+                    if (arc.dst >= function->_blockCount)
+                    {
+                        return nil;
+                    }
+                    [function->_arcs appendBytes:&arc length:sizeof(arc)];
+                }
+                break;
+            }
+            case kCSGCovTagLines:
+            {
+                if (!function || (length < 1))
+                {
+                    return nil;
+                }
+                uint32_t block = CSGCovWordAt(&words, record);
+                if (block >= function->_blockCount)
+                {
+                    return nil;
+                }
+                NSUInteger x = record + 1;
+                while (x < end)
+                {
+                    uint32_t line = CSGCovWordAt(&words, x++);
+                    if (line == 0)
+                    {
+                        // a zero is followed by a file name, an empty name ends
+                        // the list
+                        NSString *name = nil;
+                        if (!CSGCovReadString(&words, &x, end, &name))
+                        {
+                            return nil;
+                        }
+                        if (!name)
+                        {
+                            break;
+                        }
+                        currentSource = CSGCovSourceIndex(name, sources, sourceIndexes);
+                    }
+                    else
+                    {
+                        CSGCovLineEntry entry = { block, currentSource, line };
+                        [function->_lines appendBytes:&entry length:sizeof(entry)];
+                    }
+                }
+                break;
+            }
+            default:
+                // nothing else in the graph matters to us
+                break;
+        }
+        index = end;
+    }
+    return functions;
+}
+
+// Pulls the arc counters out of the data file, keyed by function ident.
+static NSDictionary *CSGCovReadCounts(NSData *data, uint32_t stamp,
+                                      NSMutableDictionary *checksums)
+{
+    CSGCovWords words;
+    uint32_t version;
+    uint32_t dataStamp;
+    if (!CSGCovWordsInit(&words, data, kCSGCovGCDAMagic, &version, &dataStamp) ||
+        !CSGCovVersionIsSupported(version) ||
+        (dataStamp != stamp))
+    {
+        return nil;
+    }
+    NSMutableDictionary *counts = [NSMutableDictionary dictionary];
+    NSNumber *function          = nil;
+    NSUInteger index            = 3;
+    while (index + 2 <= words.wordCount)
+    {
+        uint32_t tag      = CSGCovWordAt(&words, index);
+        uint32_t length   = CSGCovWordAt(&words, index + 1);
+        NSUInteger record = index + 2;
+        NSUInteger end    = record + length;
+        if (end > words.wordCount)
+        {
+            return nil;
+        }
+        if (tag == kCSGCovTagFunction)
+        {
+            if (length < 1)
+            {
+                return nil;
+            }
+            function = @(CSGCovWordAt(&words, record));
+            if (length >= 2)
+            {
+                checksums[function] = @(CSGCovWordAt(&words, record + 1));
+            }
+        }
+        else if (tag == kCSGCovTagArcCounts)
+        {
+            if (!function)
+            {
+                return nil;
+            }
+            NSMutableData *values = [NSMutableData dataWithLength:(length / 2) * sizeof(int64_t)];
+            int64_t *value        = [values mutableBytes];
+            for (NSUInteger x = record; x + 1 < end; x += 2)
+            {
+                uint64_t low  = CSGCovWordAt(&words, x);
+                uint64_t high = CSGCovWordAt(&words, x + 1);
+                *value++ = (int64_t)(low | (high << 32));
+            }
+            counts[function] = values;
+        }
+        index = end;
+    }
+    return counts;
+}
+
+// Fills in the arcs that are on the spanning tree (gcc doesn't record those)
+// using the fact that what flows into a block flows out of it, and returns the
+// count for each block.  This is the same propagation gcov does.
+static NSData *CSGCovSolveFunction(CSGCovFunction *function, NSData *counters)
+{
+    NSUInteger arcCount = [function->_arcs length] / sizeof(CSGCovArc);
+    CSGCovArc *arcs     = [function->_arcs mutableBytes];
+    uint32_t blockCount = function->_blockCount;
+    const int64_t *values = [counters bytes];
+    NSUInteger valueCount = [counters length] / sizeof(int64_t);
+    NSUInteger used       = 0;
+    for (NSUInteger x = 0; x < arcCount; ++x)
+    {
+        arcs[x].valid = NO;
+        arcs[x].count = 0;
+        if (!(arcs[x].flags & kCSGCovArcOnTree))
+        {
+            // functions w/o any data in the gcda just get zeros
+            arcs[x].count = counters ? ((used < valueCount) ? values[used] : -1) : 0;
+            arcs[x].valid = YES;
+            ++used;
+        }
+    }
+    if (counters && (used != valueCount))
+    {
+        // graph and data don't match
+        return nil;
+    }
+
+    // Index the arcs by the block they leave and the block they enter.
+    NSMutableData *blockData  = [NSMutableData dataWithLength:blockCount * sizeof(int64_t)];
+    NSMutableData *stateData  = [NSMutableData dataWithLength:(blockCount * 7 + 2 + arcCount * 2) * sizeof(uint32_t)];
+    int64_t *blockCounts      = [blockData mutableBytes];
+    uint32_t *succStart       = [stateData mutableBytes];      // blockCount + 1
+    uint32_t *predStart       = succStart + blockCount + 1;    // blockCount + 1
+    uint32_t *invalidSucc     = predStart + blockCount + 1;
+    uint32_t *invalidPred     = invalidSucc + blockCount;
+    uint32_t *blockValid      = invalidPred + blockCount;
+    uint32_t *pending         = blockValid + blockCount;
+    uint32_t *work            = pending + blockCount;
+    uint32_t *succArcs        = work + blockCount;
+    uint32_t *predArcs        = succArcs + arcCount;
+    for (NSUInteger x = 0; x < arcCount; ++x)
+    {
+        ++succStart[arcs[x].src + 1];
+        ++predStart[arcs[x].dst + 1];
+        if (!arcs[x].valid)
+        {
+            ++invalidSucc[arcs[x].src];
+            ++invalidPred[arcs[x].dst];
+        }
+    }
+    for (uint32_t x = 0; x < blockCount; ++x)
+    {
+        succStart[x + 1] += succStart[x];
+        predStart[x + 1] += predStart[x];
+    }
+    // (use the work list as scratch for the fill positions)
+    memcpy(work, succStart, blockCount * sizeof(uint32_t));
+    for (uint32_t x = 0; x < arcCount; ++x)
+    {
+        succArcs[work[arcs[x].src]++] = x;
+    }
+    memcpy(work, predStart, blockCount * sizeof(uint32_t));
+    for (uint32_t x = 0; x < arcCount; ++x)
+    {
+        predArcs[work[arcs[x].dst]++] = x;
+    }
+
+    // Work list of blocks to look at, every block starts on it (a block is
+    // never on it twice, so it never holds more than blockCount).
+    NSUInteger workCount = 0;
+    for (uint32_t x = 0; x < blockCount; ++x)
+    {
+        work[workCount++] = x;
+        pending[x]        = 1;
+    }
+    while (workCount)
+    {
+        uint32_t block = work[--workCount];
+        pending[block] = 0;
+        for (int side = 0; side < 2; ++side)
+        {
+            // side 0 is the arcs out of the block, side 1 the arcs into it.
+            const uint32_t *start = side ? predStart : succStart;
+            const uint32_t *list  = side ? predArcs : succArcs;
+            uint32_t *invalid     = side ? invalidPred : invalidSucc;
+            uint32_t first        = start[block];
+            uint32_t last         = start[block + 1];
+            if ((first == last) || (blockValid[block] ? (invalid[block] != 1) : (invalid[block] != 0)))
+            {
+                continue;
+            }
+            int64_t total       = 0;
+            CSGCovArc *unsolved = NULL;
+            for (uint32_t x = first; x < last; ++x)
+            {
+                CSGCovArc *arc = &arcs[list[x]];
+                if (arc->valid)
+                {
+                    total += arc->count;
+                }
+                else
+                {
+                    unsolved = arc;
+                }
+            }
+            if (!blockValid[block])
+            {
+                // everything on this side is known, so is the block
+                blockCounts[block] = total;
+                blockValid[block]  = 1;
+                side = -1;  // go back and look at both sides w/ the count
+                continue;
+            }
+            // With the block count known, the one unknown arc on this side is
+            // whatever is left over.
+            unsolved->count = blockCounts[block] - total;
+            unsolved->valid = YES;
+            --invalidSucc[unsolved->src];
+            --invalidPred[unsolved->dst];
+            uint32_t other = side ? unsolved->src : unsolved->dst;
+            if (!pending[other])
+            {
+                work[workCount++] = other;
+                pending[other]    = 1;
+            }
+        }
+    }
+
+    for (uint32_t x = 0; x < blockCount; ++x)
+    {
+        if (!blockValid[x] || (blockCounts[x] < 0))
+        {
+            // couldn't solve it (or it went negative), don't trust any of it
+            return nil;
+        }
+    }
+    return blockData;
+}
+
+@implementation CoverStoryGCovDataReader
+
++ (BOOL)canReadGCovFile:(NSString *)path
+{
+    NSFileHandle *handle = [NSFileHandle fileHandleForReadingAtPath:path];
+    NSData *header       = [handle readDataOfLength:3 * sizeof(uint32_t)];
+    [handle closeFile];
+    CSGCovWords words;
+    uint32_t version;
+    return ((CSGCovWordsInit(&words, header, kCSGCovGCDAMagic, &version, NULL) ||
+             CSGCovWordsInit(&words, header, kCSGCovGCNOMagic, &version, NULL)) &&
+            CSGCovVersionIsSupported(version));
+}
+
++ (NSArray *)coverageFileDatasForGCDAPath:(NSString *)gcdaPath
+                                 document:(CoverStoryDocument *)document
+                          messageReceiver:(id<CoverStoryCoverageProcessingProtocol>)receiver
+{
+    NSString *gcnoPath = [[gcdaPath stringByDeletingPathExtension] stringByAppendingPathExtension:@"gcno"];
+    NSData *graph      = [NSData dataWithContentsOfFile:gcnoPath
+                                                options:NSDataReadingMappedIfSafe
+                                                  error:NULL];
+    NSData *data       = [NSData dataWithContentsOfFile:gcdaPath
+                                                options:NSDataReadingMappedIfSafe
+                                                  error:NULL];
+    if (!graph || !data)
+    {
+        return nil;
+    }
+
+    NSMutableArray *sources = [NSMutableArray array];
+    uint32_t stamp          = 0;
+    NSArray *functions      = CSGCovReadGraph(graph, &stamp, sources);
+    NSMutableDictionary *checksums = [NSMutableDictionary dictionary];
+    NSDictionary *counts    = functions ? CSGCovReadCounts(data, stamp, checksums) : nil;
+    if (!counts)
+    {
+        return nil;
+    }
+
+    // Line counts for each source, indexed by line number, lines no block
+    // covers stay as not executed.
+    NSMutableArray *lineCounts = [NSMutableArray arrayWithCapacity:[sources count]];
+    for (NSUInteger x = 0; x < [sources count]; ++x)
+    {
+        [lineCounts addObject:[NSMutableData data]];
+    }
+    for (CSGCovFunction *function in functions)
+    {
+        NSNumber *ident    = @(function->_ident);
+        NSNumber *checksum = checksums[ident];
+        if (checksum && ([checksum unsignedIntValue] != function->_checksum))
+        {
+            return nil;
+        }
+        NSData *blockData = CSGCovSolveFunction(function, counts[ident]);
+        if (!blockData)
+        {
+            return nil;
+        }
+        const int64_t *blockCounts    = [blockData bytes];
+        const CSGCovLineEntry *entry  = [function->_lines bytes];
+        NSUInteger entryCount         = [function->_lines length] / sizeof(CSGCovLineEntry);
+        for (NSUInteger x = 0; x < entryCount; ++x, ++entry)
+        {
+            if (entry->source >= [lineCounts count])
+            {
+                return nil;
+            }
+            // gcov just adds up the blocks on a line.
+            NSMutableData *sourceCounts = lineCounts[entry->source];
+            NSUInteger haveLines        = [sourceCounts length] / sizeof(int64_t);
+            if (entry->line >= haveLines)
+            {
+                [sourceCounts setLength:(entry->line + 1) * sizeof(int64_t)];
+                int64_t *grown = [sourceCounts mutableBytes];
+                for (NSUInteger y = haveLines; y <= entry->line; ++y)
+                {
+                    grown[y] = kCoverStoryNotExecutedMarker;
+                }
+            }
+            int64_t *lineCount = (int64_t *)[sourceCounts mutableBytes] + entry->line;
+            if (*lineCount == kCoverStoryNotExecutedMarker)
+            {
+                *lineCount = 0;
+            }
+            *lineCount += blockCounts[entry->block];
+        }
+    }
+
+    NSMutableArray *result = [NSMutableArray arrayWithCapacity:[sources count]];
+    NSString *folder       = [gcdaPath stringByDeletingLastPathComponent];
+    for (NSUInteger x = 0; x < [sources count]; ++x)
+    {
+        NSData *sourceCounts = lineCounts[x];
+        NSUInteger countSize = [sourceCounts length] / sizeof(int64_t);
+        if (countSize == 0)
+        {
+            // only named in a function record, nothing on any of its lines
+            continue;
+        }
+        NSString *name     = sources[x];
+        NSString *readPath = [name isAbsolutePath] ? name : [folder stringByAppendingPathComponent:name];
+        // line 0 isn't a line
+        NSData *hitCounts  = [sourceCounts subdataWithRange:NSMakeRange(sizeof(int64_t),
+                                                                        [sourceCounts length] - sizeof(int64_t))];
+        CoverStoryCoverageFileData *fileData =
+            [CoverStoryCoverageFileData newCoverageFileDataWithSourcePath:name
+                                                                 readPath:readPath
+                                                                hitCounts:hitCounts
+                                                                 document:document
+                                                          messageReceiver:receiver];
+        if (!fileData)
+        {
+            return nil;
+        }
+        [result addObject:fileData];
+    }
+    return result;
+}
+
+@end
@@ -0,0 +1,60 @@
+//
+//  CoverStoryGCovStream.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// Reads the output of gcov -t (every source's .gcov, one after another on
+// stdout) as gcov writes it, and splits it back up at the "0:Source:" line
+// each one starts with, so a source can be parsed while gcov is still working
+// on the next one and nothing goes through a scratch directory.
+//
+// The handler gets each chunk on the thread doing the reading, and can parse
+// it right there or hand it off to be parsed somewhere else.  Either way
+// finishedChunk has to be called once the chunk is done w/: when
+// |maxPendingChunks| are out, reading stops until one comes back (and gcov
+// blocks on the full pipe), so a slow parser can't make the chunks pile up
+// in memory.
+
+#import <Foundation/Foundation.h>
+
+@class CoverStoryGCovStream;
+
+typedef void (^CoverStoryGCovStreamHandler)(CoverStoryGCovStream *stream, NSData *chunk);
+
+@interface CoverStoryGCovStream : NSObject
+
+// |maxPendingChunks| of 0 is taken as 1.
+- (id)initWithMaxPendingChunks:(NSUInteger)maxPendingChunks
+                       handler:(CoverStoryGCovStreamHandler)handler;
+
+// Launches |task| w/ its stdout and stderr as pipes, and feeds its stdout
+// through here until it exits.  What it wrote on stderr comes back in
+// |outStdErr|.  YES if it exited w/ 0.  Throws if the task can't be launched,
+// like -[NSTask launch].  Can be called again for another run of gcov.
+- (BOOL)runTask:(NSTask *)task standardError:(NSData **)outStdErr;
+
+// The guts of runTask:, for feeding the output in some other way.  The
+// handler is called for every chunk that's complete.
+- (void)appendBytes:(const void *)bytes length:(NSUInteger)length;
+// Hands off whatever is left as the last chunk.
+- (void)finish;
+
+// For each chunk handed off, once the handler (or whatever it passed the
+// chunk to) is done w/ it.  Safe to call from any thread.
+- (void)finishedChunk;
+
+// How many chunks have gone to the handler.
+- (NSUInteger)chunkCount;
+
+// The gcda path from the "0:Data:" line in |chunk|'s header, nil if it
+// doesn't have one.
++ (NSString *)dataPathForChunk:(NSData *)chunk;
+
+// YES if what a gcov that failed w/o putting anything out wrote on stderr is
+// a complaint about its arguments, ie - it's too old to know -t and has to be
+// run the usual way.  Anything else is a real failure, running it again w/o
+// -t won't help.
++ (BOOL)standardErrorRejectsStreaming:(NSData *)stdErr;
+
+@end
@@ -0,0 +1,336 @@
+//
+//  CoverStoryGCovStream.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "CoverStoryGCovStream.h"
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+// How much is read from the pipes at a time.
+static const size_t kCSGCovStreamReadSize = 64 * 1024;
+// How far into a chunk to look for its "0:Data:" line (the header is the
+// first handful of lines).
+static const NSUInteger kCSGCovStreamHeaderLines = 8;
+
+// Skips the "    -:    0:" that the header lines of a .gcov start with, NULL
+// if |line| isn't one of them.
+static const char *CSGCovStreamHeaderText(const char *line, const char *end)
+{
+    while ((line < end) && ((*line == ' ') || (*line == '\t')))
+    {
+        ++line;
+    }
+    if ((line == end) || (*line++ != '-') || (line == end) || (*line++ != ':'))
+    {
+        return NULL;
+    }
+    while ((line < end) && ((*line == ' ') || (*line == '\t')))
+    {
+        ++line;
+    }
+    if ((line == end) || (*line++ != '0') || (line == end) || (*line++ != ':'))
+    {
+        return NULL;
+    }
+    return line;
+}
+
+static BOOL CSGCovStreamHeaderHasPrefix(const char *line, const char *end, const char *prefix, size_t prefixLength)
+{
+    const char *text = CSGCovStreamHeaderText(line, end);
+    return text && ((size_t)(end - text) >= prefixLength) && (memcmp(text, prefix, prefixLength) == 0);
+}
+
+static BOOL CSGCovStreamIsSourceLine(const char *line, const char *end)
+{
+    static const char kSource[] = "Source:";
+    return CSGCovStreamHeaderHasPrefix(line, end, kSource, sizeof(kSource) - 1);
+}
+
+// "count:number:text", which is every line of a .gcov (the header lines are
+// "-:0:...").  Some gcovs put a summary ("File 'foo.c'", "Lines executed:...")
+// on stdout between the files, those aren't.
+static BOOL CSGCovStreamIsCoverageLine(const char *line, const char *end)
+{
+    while ((line < end) && ((*line == ' ') || (*line == '\t')))
+    {
+        ++line;
+    }
+    const char *count = line;
+    while ((line < end) && (*line != ':') && (*line != ' ') && (*line != '\t'))
+    {
+        ++line;
+    }
+    if ((line == count) || (line == end) || (*line++ != ':'))
+    {
+        return NO;
+    }
+    while ((line < end) && ((*line == ' ') || (*line == '\t')))
+    {
+        ++line;
+    }
+    const char *number = line;
+    while ((line < end) && (*line >= '0') && (*line <= '9'))
+    {
+        ++line;
+    }
+    return (line > number) && (line < end) && (*line == ':');
+}
+
+@interface CoverStoryGCovStream () {
+@private
+    CoverStoryGCovStreamHandler _handler;
+    NSMutableData *_buffer;      // starts w/ the chunk being read
+    NSUInteger _scanned;         // start of the first line in |_buffer| not looked at
+    NSUInteger _chunkEnd;        // end of the last line in |_buffer| that's part of it
+    BOOL _inChunk;               // NO until the first "0:Source:" line
+    NSUInteger _chunkCount;
+    NSCondition *_pendingCondition;  // guards the next two
+    NSUInteger _pending;
+    NSUInteger _maxPending;
+}
+- (void)scanBufferAtEnd:(BOOL)atEnd;
+- (void)handOffChunkWithBytes:(const char *)bytes length:(NSUInteger)length;
+@end
+
+@implementation CoverStoryGCovStream
+
+- (id)init
+{
+    return [self initWithMaxPendingChunks:1 handler:nil];
+}
+
+- (id)initWithMaxPendingChunks:(NSUInteger)maxPendingChunks
+                       handler:(CoverStoryGCovStreamHandler)handler
+{
+    if ((self = [super init]))
+    {
+        _handler          = [handler copy];
+        _buffer           = [[NSMutableData alloc] init];
+        _pendingCondition = [[NSCondition alloc] init];
+        _maxPending       = MAX(maxPendingChunks, (NSUInteger)1);
+    }
+    return self;
+}
+
+- (BOOL)runTask:(NSTask *)task standardError:(NSData **)outStdErr
+{
+    NSPipe *stdOutPipe = [NSPipe pipe];
+    NSPipe *stdErrPipe = [NSPipe pipe];
+    [task setStandardOutput:stdOutPipe];
+    [task setStandardError:stdErrPipe];
+    [task launch];
+
+    // Both pipes are read as they fill, gcov could block on a full stderr
+    // just as well as on stdout.
+    NSMutableData *stdErrData = [NSMutableData data];
+    NSMutableData *readBuffer = [NSMutableData dataWithLength:kCSGCovStreamReadSize];
+    struct pollfd fds[2]      = {
+        { [[stdOutPipe fileHandleForReading] fileDescriptor], POLLIN, 0 },
+        { [[stdErrPipe fileHandleForReading] fileDescriptor], POLLIN, 0 },
+    };
+    int openCount = 2;
+    while (openCount > 0)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        for (int x = 0; x < 2; ++x)
+        {
+            if ((fds[x].fd < 0) || !(fds[x].revents & (POLLIN | POLLHUP | POLLERR)))
+            {
+                continue;
+            }
+            ssize_t bytesRead = read(fds[x].fd, [readBuffer mutableBytes], kCSGCovStreamReadSize);
+            if ((bytesRead < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+            if (bytesRead <= 0)
+            {
+                // poll skips the negative ones
+                fds[x].fd = -1;
+                --openCount;
+            }
+            else if (x == 0)
+            {
+                [self appendBytes:[readBuffer bytes] length:(NSUInteger)bytesRead];
+            }
+            else
+            {
+                [stdErrData appendBytes:[readBuffer bytes] length:(NSUInteger)bytesRead];
+            }
+        }
+    }
+    [task waitUntilExit];
+    [self finish];
+    if (outStdErr)
+    {
+        *outStdErr = stdErrData;
+    }
+    return [task terminationStatus] == 0;
+}
+
+- (void)appendBytes:(const void *)bytes length:(NSUInteger)length
+{
+    [_buffer appendBytes:bytes length:length];
+    [self scanBufferAtEnd:NO];
+}
+
+- (void)finish
+{
+    [self scanBufferAtEnd:YES];
+    if (_inChunk && _chunkEnd)
+    {
+        [self handOffChunkWithBytes:[_buffer bytes] length:_chunkEnd];
+    }
+    [_buffer setLength:0];
+    _scanned  = 0;
+    _chunkEnd = 0;
+    _inChunk  = NO;
+}
+
+// Hands off every chunk that's been ended by the start of the next one, and
+// leaves |_buffer| starting w/ the one still coming in.  Only whole lines are
+// looked at unless it's |atEnd|.
+- (void)scanBufferAtEnd:(BOOL)atEnd
+{
+    const char *base      = [_buffer bytes];
+    const char *end       = base + [_buffer length];
+    const char *chunk     = base;
+    const char *chunkEnd  = base + _chunkEnd;
+    const char *lineStart = base + _scanned;
+    while (lineStart < end)
+    {
+        const char *lineEnd = memchr(lineStart, '\n', end - lineStart);
+        if (!lineEnd && !atEnd)
+        {
+            break;
+        }
+        const char *nextLine = lineEnd ? lineEnd + 1 : end;
+        if (!lineEnd)
+        {
+            lineEnd = end;
+        }
+        if (CSGCovStreamIsSourceLine(lineStart, lineEnd))
+        {
+            if (_inChunk && (chunkEnd > chunk))
+            {
+                [self handOffChunkWithBytes:chunk length:chunkEnd - chunk];
+            }
+            chunk    = lineStart;
+            _inChunk = YES;
+            chunkEnd = nextLine;
+        }
+        else if (!_inChunk)
+        {
+            // nothing to attach it to
+            chunk = chunkEnd = nextLine;
+        }
+        else if (CSGCovStreamIsCoverageLine(lineStart, lineEnd))
+        {
+            chunkEnd = nextLine;
+        }
+        lineStart = nextLine;
+    }
+    NSUInteger used = chunk - base;
+    _scanned        = lineStart - chunk;
+    _chunkEnd       = chunkEnd - chunk;
+    if (used)
+    {
+        [_buffer replaceBytesInRange:NSMakeRange(0, used) withBytes:NULL length:0];
+    }
+}
+
+- (void)handOffChunkWithBytes:(const char *)bytes length:(NSUInteger)length
+{
+    [_pendingCondition lock];
+    while (_pending >= _maxPending)
+    {
+        [_pendingCondition wait];
+    }
+    ++_pending;
+    [_pendingCondition unlock];
+    ++_chunkCount;
+    NSData *chunk = [NSData dataWithBytes:bytes length:length];
+    if (_handler)
+    {
+        _handler(self, chunk);
+    }
+    else
+    {
+        [self finishedChunk];
+    }
+}
+
+- (void)finishedChunk
+{
+    [_pendingCondition lock];
+    NSAssert(_pending > 0, @"more chunks finished than were handed off");
+    --_pending;
+    [_pendingCondition signal];
+    [_pendingCondition unlock];
+}
+
+- (NSUInteger)chunkCount
+{
+    return _chunkCount;
+}
+
++ (NSString *)dataPathForChunk:(NSData *)chunk
+{
+    static const char kData[] = "Data:";
+    const char *lineStart     = [chunk bytes];
+    const char *end           = lineStart + [chunk length];
+    for (NSUInteger x = 0; (x < kCSGCovStreamHeaderLines) && (lineStart < end); ++x)
+    {
+        const char *lineEnd = memchr(lineStart, '\n', end - lineStart);
+        if (!lineEnd)
+        {
+            lineEnd = end;
+        }
+        const char *textEnd = lineEnd;
+        if ((textEnd > lineStart) && (textEnd[-1] == '\r'))
+        {
+            --textEnd;
+        }
+        if (CSGCovStreamHeaderHasPrefix(lineStart, textEnd, kData, sizeof(kData) - 1))
+        {
+            const char *path = CSGCovStreamHeaderText(lineStart, textEnd) + sizeof(kData) - 1;
+            return [[NSString alloc] initWithBytes:path length:textEnd - path encoding:NSUTF8StringEncoding];
+        }
+        lineStart = lineEnd + 1;
+    }
+    return nil;
+}
+
++ (BOOL)standardErrorRejectsStreaming:(NSData *)stdErr
+{
+    // gcc's getopt, its own usage text, and llvm-cov gcov's.
+    NSString *text = [[NSString alloc] initWithData:stdErr encoding:NSUTF8StringEncoding];
+    for (NSString *complaint in @[ @"invalid option", @"unrecognized option", @"unknown command line argument",
+                                   @"usage:" ])
+    {
+        if ([text rangeOfString:complaint options:NSCaseInsensitiveSearch].length)
+        {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"%@ <%p>: %lu chunks", [self class], self, (unsigned long)_chunkCount];
+}
+
+@end
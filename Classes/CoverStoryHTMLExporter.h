@@ -0,0 +1,58 @@
+//
+//  CoverStoryHTMLExporter.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// Writes the HTML export (a page per source file, an index that redirects to
+// the first one, the file list script, the stylesheet and script) for a set of
+// file datas.  The templates/colors are handed in so the app and the command
+// line tool can each get them from wherever they live.
+//
+// Pages are rendered in parallel and written out as they are made, and the
+// file list is written once to coverstory-files.js rather than into every
+// page, so memory use doesn't grow with the size of the project.  A page is
+// named after its source, w/ a hash of the full path added when two sources
+// have the same name.
+
+#import <Foundation/Foundation.h>
+#import "CoverStoryProtocols.h"
+
+@class CoverStoryCoverageFileData;
+
+@interface CoverStoryHTMLExporter : NSObject {
+@private
+    NSArray *_pageSegments;
+    NSUInteger _pageTokenMask;
+    NSString *_indexTemplate;
+    NSString *_stylesheet;
+    NSData *_javaScript;
+    NSUInteger _maxConcurrentPages;
+}
+
+// The templates are the HTMLExportTemplate and HTMLIndexTemplate entries from
+// HTMLExport.strings.
+- (id)initWithPageTemplate:(NSString *)pageTemplate indexTemplate:(NSString *)indexTemplate;
+
+// Written out as coverstory.css/coverstory.js if set.
+@property (nonatomic, copy) NSString *stylesheet;
+@property (nonatomic, copy) NSData *javaScript;
+// How many pages to render at once, 0 (the default) is one per core.
+@property (nonatomic, assign) NSUInteger maxConcurrentPages;
+
+// Fills in the line color placeholders in coverstory.css.  |colors| maps the
+// kCoverStory*LineColorKey preference keys to CSS colors ("#FF0000"), any that
+// are missing come from +defaultLineColors.
++ (NSString *)stylesheetFromTemplate:(NSString *)css lineColors:(NSDictionary *)colors;
++ (NSDictionary *)defaultLineColors;
+
+// coverstory-files.js: the file list data and the function the pages call to
+// fill in their file table from it.
+- (NSData *)fileListScriptForFileDatas:(NSArray *)fileDatas;
+- (NSString *)htmlSourceTableData:(CoverStoryCoverageFileData *)fileData;
+
+// Writes the export into |directory| (which is created if needed).  Safe to
+// call off the main thread as long as |fileDatas| isn't being changed.
+- (BOOL)writeFileDatas:(NSArray *)fileDatas toDirectory:(NSString *)directory error:(NSError **)outError;
+
+@end
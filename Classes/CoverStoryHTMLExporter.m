@@ -0,0 +1,849 @@
+//
+//  CoverStoryHTMLExporter.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "CoverStoryHTMLExporter.h"
+#import "CoverStoryCoverageFileData.h"
+#import "CoverStoryPreferenceKeys.h"
+#import "CodeCoverage.h"
+
+typedef struct {
+    unichar character;
+    const char *entity;
+} CSHTMLEscape;
+
+// The special characters from table A.2.2 of the XHTML DTDs (the set
+// -[NSString gtm_stringByEscapingForHTML] handles), sorted for bsearch.
+static const CSHTMLEscape kCSHTMLEscapes[] = {
+    { 34, "&quot;" },   { 38, "&amp;" },     { 39, "&apos;" },   { 60, "&lt;" },
+    { 62, "&gt;" },     { 338, "&OElig;" },  { 339, "&oelig;" }, { 352, "&Scaron;" },
+    { 353, "&scaron;" }, { 376, "&Yuml;" },  { 710, "&circ;" },  { 732, "&tilde;" },
+    { 8194, "&ensp;" }, { 8195, "&emsp;" },  { 8201, "&thinsp;" }, { 8204, "&zwnj;" },
+    { 8205, "&zwj;" },  { 8206, "&lrm;" },   { 8207, "&rlm;" },  { 8211, "&ndash;" },
+    { 8212, "&mdash;" }, { 8216, "&lsquo;" }, { 8217, "&rsquo;" }, { 8218, "&sbquo;" },
+    { 8220, "&ldquo;" }, { 8221, "&rdquo;" }, { 8222, "&bdquo;" }, { 8224, "&dagger;" },
+    { 8225, "&Dagger;" }, { 8240, "&permil;" }, { 8249, "&lsaquo;" }, { 8250, "&rsaquo;" },
+    { 8364, "&euro;" },
+};
+
+static int CSHTMLEscapeCompare(const void *key, const void *entry)
+{
+    unichar character = *(const unichar *)key;
+    unichar other     = ((const CSHTMLEscape *)entry)->character;
+    return (character > other) - (character < other);
+}
+
+static void CSAppendCharacters(NSMutableString *string, const unichar *characters, NSUInteger length)
+{
+    if (length)
+    {
+        NSString *run = [[NSString alloc] initWithCharactersNoCopy:(unichar *)characters
+                                                            length:length
+                                                      freeWhenDone:NO];
+        [string appendString:run];
+    }
+}
+
+static NSString *CSHTMLEscapedString(NSString *string)
+{
+    NSUInteger length = [string length];
+    if (length == 0)
+    {
+        return @"";
+    }
+    unichar *characters = malloc(length * sizeof(unichar));
+    if (!characters)
+    {
+        return nil;
+    }
+    [string getCharacters:characters range:NSMakeRange(0, length)];
+    NSMutableString *result = nil;
+    NSUInteger copied       = 0;
+    for (NSUInteger x = 0; x < length; ++x)
+    {
+        const CSHTMLEscape *escape = bsearch(&characters[x], kCSHTMLEscapes,
+                                             sizeof(kCSHTMLEscapes) / sizeof(kCSHTMLEscapes[0]),
+                                             sizeof(kCSHTMLEscapes[0]), CSHTMLEscapeCompare);
+        if (!escape)
+        {
+            continue;
+        }
+        if (!result)
+        {
+            result = [NSMutableString stringWithCapacity:length + 16];
+        }
+        CSAppendCharacters(result, characters + copied, x - copied);
+        [result appendString:@(escape->entity)];
+        copied = x + 1;
+    }
+    if (result && (copied < length))
+    {
+        CSAppendCharacters(result, characters + copied, length - copied);
+    }
+    free(characters);
+    return result ?: string;
+}
+
+// The placeholders in HTMLExportTemplate.  The file list used to be pasted
+// into every page as __FILE_DATA__, it's now written once to
+// coverstory-files.js, so that one is just dropped if a template still has it.
+typedef NS_ENUM(NSUInteger, CSPageToken)
+{
+    kCSPageTokenTitle = 0,
+    kCSPageTokenSourceName,
+    kCSPageTokenSourcePath,
+    kCSPageTokenSourceDate,
+    kCSPageTokenFileSummary,
+    kCSPageTokenSourceSummary,
+    kCSPageTokenSourceData,
+    kCSPageTokenFileData,
+    kCSPageTokenCount
+};
+
+static NSString *const kCSPageTokens[kCSPageTokenCount] = {
+    @"__TITLE__",
+    @"__SOURCE_NAME__",
+    @"__SOURCE_PATH__",
+    @"__SOURCE_DATE__",
+    @"__FILE_SUMMARY__",
+    @"__SOURCE_SUMMARY__",
+    @"__SOURCE_DATA__",
+    @"__FILE_DATA__",
+};
+
+static NSString *const kCSFileListScriptName = @"coverstory-files.js";
+
+// Splits |template| into an array of NSData (UTF-8 literal text) and NSNumber
+// (a CSPageToken) so a page is just a walk over the segments.  Sets a bit in
+// |outFoundMask| for each token seen.
+static NSArray *CSSplitPageTemplate(NSString *template, NSUInteger *outFoundMask)
+{
+    NSMutableArray *segments = [NSMutableArray array];
+    NSUInteger length        = [template length];
+    NSUInteger location      = 0;
+    NSUInteger foundMask     = 0;
+    while (location < length)
+    {
+        NSRange searchRange = NSMakeRange(location, length - location);
+        NSRange nearest     = NSMakeRange(NSNotFound, 0);
+        NSUInteger token    = 0;
+        for (NSUInteger x = 0; x < kCSPageTokenCount; ++x)
+        {
+            NSRange found = [template rangeOfString:kCSPageTokens[x] options:NSLiteralSearch range:searchRange];
+            if (found.location < nearest.location)
+            {
+                nearest = found;
+                token   = x;
+            }
+        }
+        NSUInteger literalEnd = (nearest.location == NSNotFound) ? length : nearest.location;
+        if (literalEnd > location)
+        {
+            NSString *literal = [template substringWithRange:NSMakeRange(location, literalEnd - location)];
+            [segments addObject:[literal dataUsingEncoding:NSUTF8StringEncoding]];
+        }
+        if (nearest.location == NSNotFound)
+        {
+            break;
+        }
+        [segments addObject:@(token)];
+        foundMask |= (1 << token);
+        location = NSMaxRange(nearest);
+    }
+    if (outFoundMask)
+    {
+        *outFoundMask = foundMask;
+    }
+    return segments;
+}
+
+// Growable byte buffer the page workers render into.  Only ever grows, so a
+// worker's buffer stops allocating once it has seen its biggest page.
+typedef struct {
+    char *bytes;
+    size_t length;
+    size_t capacity;
+} CSByteBuffer;
+
+static BOOL CSByteBufferReserve(CSByteBuffer *buffer, size_t extra)
+{
+    size_t needed = buffer->length + extra;
+    if (needed <= buffer->capacity)
+    {
+        return YES;
+    }
+    size_t capacity = MAX(buffer->capacity * 2, MAX(needed, (size_t)4096));
+    char *bytes     = realloc(buffer->bytes, capacity);
+    if (!bytes)
+    {
+        return NO;
+    }
+    buffer->bytes    = bytes;
+    buffer->capacity = capacity;
+    return YES;
+}
+
+static void CSByteBufferAppend(CSByteBuffer *buffer, const void *bytes, size_t length)
+{
+    if (length && CSByteBufferReserve(buffer, length))
+    {
+        memcpy(buffer->bytes + buffer->length, bytes, length);
+        buffer->length += length;
+    }
+}
+
+#define CSByteBufferAppendLiteral(buffer, literal) CSByteBufferAppend((buffer), (literal), sizeof(literal) - 1)
+
+static void CSByteBufferFree(CSByteBuffer *buffer)
+{
+    free(buffer->bytes);
+    buffer->bytes    = NULL;
+    buffer->length   = 0;
+    buffer->capacity = 0;
+}
+
+// The longest thing one input byte can turn into (&quot;), used to reserve
+// space for a line up front.
+#define kCSMaxEscapedBytesPerByte 8
+
+// Appends the line as it goes in the source table: tabs and runs of two spaces
+// become nbsp+space (so the indenting survives), and the characters
+// CSHTMLEscapedString knows about become entities.  Works on the UTF-8 bytes
+// directly; returns NO w/o touching |buffer| if they aren't valid UTF-8.
+static BOOL CSAppendSourceLine(CSByteBuffer *buffer, const uint8_t *bytes, size_t length)
+{
+    if (!CSByteBufferReserve(buffer, length * kCSMaxEscapedBytesPerByte + 2))
+    {
+        return NO;
+    }
+    char *start       = buffer->bytes + buffer->length;
+    char *out         = start;
+    BOOL pendingSpace = NO;
+    size_t x          = 0;
+    while (x < length)
+    {
+        uint8_t c = bytes[x];
+        if (c == ' ')
+        {
+            // "  " -> nbsp+space, pairing left to right like the
+            // stringByReplacingOccurrencesOfString: this replaces did.
+            if (pendingSpace)
+            {
+                *out++       = (char)0xC2;
+                *out++       = (char)0xA0;
+                *out++       = ' ';
+                pendingSpace = NO;
+            }
+            else
+            {
+                pendingSpace = YES;
+            }
+            ++x;
+            continue;
+        }
+        if (pendingSpace)
+        {
+            *out++       = ' ';
+            pendingSpace = NO;
+        }
+        if (c < 0x80)
+        {
+            const char *entity = NULL;
+            size_t entityLength = 0;
+            switch (c)
+            {
+                case '\t':
+                    // nbsp, and the space that follows can pair w/ the next one.
+                    *out++       = (char)0xC2;
+                    *out++       = (char)0xA0;
+                    pendingSpace = YES;
+                    ++x;
+                    continue;
+                case '"':  entity = "&quot;"; entityLength = 6; break;
+                case '&':  entity = "&amp;";  entityLength = 5; break;
+                case '\'': entity = "&apos;"; entityLength = 6; break;
+                case '<':  entity = "&lt;";   entityLength = 4; break;
+                case '>':  entity = "&gt;";   entityLength = 4; break;
+                default:   break;
+            }
+            if (entity)
+            {
+                memcpy(out, entity, entityLength);
+                out += entityLength;
+            }
+            else
+            {
+                *out++ = (char)c;
+            }
+            ++x;
+            continue;
+        }
+
+        // Multibyte, decode it to see if it's one w/ an entity.
+        uint32_t codePoint = 0;
+        size_t sequence    = 0;
+        if ((c >= 0xC2) && (c <= 0xDF))
+        {
+            sequence  = 2;
+            codePoint = c & 0x1F;
+        }
+        else if ((c >= 0xE0) && (c <= 0xEF))
+        {
+            sequence  = 3;
+            codePoint = c & 0x0F;
+        }
+        else if ((c >= 0xF0) && (c <= 0xF4))
+        {
+            sequence  = 4;
+            codePoint = c & 0x07;
+        }
+        if ((sequence == 0) || (x + sequence > length))
+        {
+            return NO;
+        }
+        for (size_t y = 1; y < sequence; ++y)
+        {
+            uint8_t continuation = bytes[x + y];
+            if ((continuation & 0xC0) != 0x80)
+            {
+                return NO;
+            }
+            codePoint = (codePoint << 6) | (continuation & 0x3F);
+        }
+        if (((sequence == 3) && ((codePoint < 0x800) || ((codePoint >= 0xD800) && (codePoint <= 0xDFFF)))) ||
+            ((sequence == 4) && ((codePoint < 0x10000) || (codePoint > 0x10FFFF))))
+        {
+            return NO;
+        }
+        const CSHTMLEscape *escape = NULL;
+        if (codePoint <= 0xFFFF)
+        {
+            unichar character = (unichar)codePoint;
+            escape = bsearch(&character, kCSHTMLEscapes,
+                             sizeof(kCSHTMLEscapes) / sizeof(kCSHTMLEscapes[0]),
+                             sizeof(kCSHTMLEscapes[0]), CSHTMLEscapeCompare);
+        }
+        if (escape)
+        {
+            size_t entityLength = strlen(escape->entity);
+            memcpy(out, escape->entity, entityLength);
+            out += entityLength;
+        }
+        else
+        {
+            memcpy(out, bytes + x, sequence);
+            out += sequence;
+        }
+        x += sequence;
+    }
+    if (pendingSpace)
+    {
+        *out++ = ' ';
+    }
+    buffer->length += (size_t)(out - start);
+    return YES;
+}
+
+// Appends the UTF-8 for |string| to |buffer| without an intermediate object.
+static void CSByteBufferAppendString(CSByteBuffer *buffer, NSString *string)
+{
+    NSUInteger byteLength = [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    if ((byteLength == 0) || !CSByteBufferReserve(buffer, byteLength))
+    {
+        return;
+    }
+    NSUInteger usedLength = 0;
+    [string getBytes:buffer->bytes + buffer->length
+           maxLength:byteLength
+          usedLength:&usedLength
+            encoding:NSUTF8StringEncoding
+             options:0
+               range:NSMakeRange(0, [string length])
+      remainingRange:NULL];
+    buffer->length += usedLength;
+}
+
+// Appends the rows of the source table for |fileData|, one pass over each
+// line's bytes w/ no objects made per line (unless the line isn't UTF-8).
+static void CSAppendSourceTable(CSByteBuffer *buffer, CoverStoryCoverageFileData *fileData)
+{
+    NSUInteger lineCount     = [fileData lineCount];
+    const int64_t *hitCounts = [fileData hitCounts];
+    for (NSUInteger x = 0; x < lineCount; ++x)
+    {
+        int64_t hitCount = hitCounts[x];
+        char hitCountString[24];
+        hitCountString[0] = '\0';
+        const char *hitStyle = "sourcelinehit";
+        if (hitCount == kCoverStoryNotExecutedMarker)
+        {
+            hitStyle = "sourcelineskipped";
+        }
+        else if (hitCount == kCoverStoryNonFeasibleMarker)
+        {
+            hitStyle = "sourcelinenonfeasible";
+        }
+        else
+        {
+            if (hitCount == 0)
+            {
+                hitStyle = "sourcelinemissed";
+            }
+            snprintf(hitCountString, sizeof(hitCountString), "%lld", (long long)hitCount);
+        }
+        CSByteBufferAppendLiteral(buffer, "<tr class='sourceline'>\n<td class='sourcelinehitcount'>");
+        CSByteBufferAppend(buffer, hitCountString, strlen(hitCountString));
+        CSByteBufferAppendLiteral(buffer, "</td>\n<td class='");
+        CSByteBufferAppend(buffer, hitStyle, strlen(hitStyle));
+        CSByteBufferAppendLiteral(buffer, "'>");
+
+        NSUInteger length   = 0;
+        const char *bytes   = [fileData lineBytesAtIndex:x length:&length];
+        if (!CSAppendSourceLine(buffer, (const uint8_t *)bytes, length))
+        {
+            // Not UTF-8, go through the string (MacRoman) and render that.
+            @autoreleasepool {
+                const char *utf8 = [[fileData lineAtIndex:x] UTF8String];
+                if (utf8)
+                {
+                    CSAppendSourceLine(buffer, (const uint8_t *)utf8, strlen(utf8));
+                }
+            }
+        }
+        CSByteBufferAppendLiteral(buffer, "</td>\n</tr>\n");
+    }
+}
+
+static void CSAppendCString(NSMutableData *buffer, const char *string)
+{
+    [buffer appendBytes:string length:strlen(string)];
+}
+
+// Appends |string| as a double quoted JavaScript string literal.
+static void CSAppendJSString(NSMutableData *buffer, NSString *string)
+{
+    CSAppendCString(buffer, "\"");
+    NSData *utf8        = [string dataUsingEncoding:NSUTF8StringEncoding];
+    const char *bytes   = [utf8 bytes];
+    NSUInteger length   = [utf8 length];
+    NSUInteger copied   = 0;
+    for (NSUInteger x = 0; x < length; ++x)
+    {
+        const char *escape = NULL;
+        switch (bytes[x])
+        {
+            case '"':  escape = "\\\""; break;
+            case '\\': escape = "\\\\"; break;
+            case '<':  escape = "\\x3C"; break;
+            case '\n': escape = "\\n"; break;
+            case '\r': escape = "\\r"; break;
+            default:   break;
+        }
+        if (escape)
+        {
+            [buffer appendBytes:bytes + copied length:x - copied];
+            CSAppendCString(buffer, escape);
+            copied = x + 1;
+        }
+    }
+    [buffer appendBytes:bytes + copied length:length - copied];
+    CSAppendCString(buffer, "\"");
+}
+
+static NSError *CSExportError(NSString *description)
+{
+    NSDictionary *dict = @{NSLocalizedDescriptionKey : description};
+    return [NSError errorWithDomain:kCoverStoryErrorDomain
+                               code:kCoverStoryExportError
+                           userInfo:dict];
+}
+
+// FNV-1a of the path, it only has to come out the same from run to run.
+static uint32_t CSPathHash(NSString *path)
+{
+    uint32_t hash = 2166136261U;
+    for (const char *c = [path UTF8String]; c && *c; ++c)
+    {
+        hash = (hash ^ (uint8_t)*c) * 16777619U;
+    }
+    return hash;
+}
+
+// The page name for each of |fileDatas|, in the same order.  A page is named
+// after its source, unless another source has the same name (two main.m), then
+// a hash of the full path goes on the end so every source gets its own page.
+// Names are compared w/o case since the export may go onto HFS+.
+static NSArray *CSPageFileNames(NSArray *fileDatas)
+{
+    NSCountedSet *baseNames = [[NSCountedSet alloc] initWithCapacity:[fileDatas count]];
+    for (CoverStoryCoverageFileData *fileData in fileDatas)
+    {
+        [baseNames addObject:[[[fileData sourcePath] lastPathComponent] lowercaseString]];
+    }
+    NSMutableArray *names = [NSMutableArray arrayWithCapacity:[fileDatas count]];
+    NSMutableSet *used    = [NSMutableSet setWithCapacity:[fileDatas count]];
+    for (CoverStoryCoverageFileData *fileData in fileDatas)
+    {
+        NSString *sourcePath = [fileData sourcePath];
+        NSString *name       = [sourcePath lastPathComponent];
+        if ([baseNames countForObject:[name lowercaseString]] > 1)
+        {
+            name = [NSString stringWithFormat:@"%@-%08x", name, CSPathHash(sourcePath)];
+        }
+        // Only the same source listed twice (or a hash collision) gets here.
+        NSString *unique = name;
+        for (NSUInteger x = 2; [used containsObject:[unique lowercaseString]]; ++x)
+        {
+            unique = [NSString stringWithFormat:@"%@-%lu", name, (unsigned long)x];
+        }
+        [used addObject:[unique lowercaseString]];
+        [names addObject:[unique stringByAppendingPathExtension:@"html"]];
+    }
+    return names;
+}
+
+// Shared between the page workers during a write.
+typedef struct {
+    NSUInteger nextIndex;
+    BOOL failed;
+} CSExportProgress;
+
+@interface CoverStoryHTMLExporter ()
+- (NSData *)fileListScriptForFileDatas:(NSArray *)fileDatas pageNames:(NSArray *)pageNames;
+- (BOOL)writePageForFileData:(CoverStoryCoverageFileData *)fileData
+                    pageName:(NSString *)pageName
+                 toDirectory:(NSString *)directory
+                        date:(NSString *)date
+                     summary:(NSString *)summary
+                      buffer:(CSByteBuffer *)buffer
+                       error:(NSError **)outError;
+@end
+
+@implementation CoverStoryHTMLExporter
+
+@synthesize stylesheet = _stylesheet;
+@synthesize javaScript = _javaScript;
+@synthesize maxConcurrentPages = _maxConcurrentPages;
+
++ (NSDictionary *)defaultLineColors
+{
+    // Same as the defaults CoverageLineDataToSourceLineTransformer registers.
+    return @{
+        kCoverStoryMissedLineColorKey: @"#FF0000",
+        kCoverStoryUnexecutableLineColorKey: @"#7F7F7F",
+        kCoverStoryNonFeasibleLineColorKey: @"#7F7F7F",
+        kCoverStoryExecutedLineColorKey: @"#000000"
+    };
+}
+
++ (NSString *)stylesheetFromTemplate:(NSString *)css lineColors:(NSDictionary *)colors
+{
+    NSDictionary *sourceLineColorMap = @{
+        kCoverStoryMissedLineColorKey: @"$$SOURCE_LINE_MISSED_COLOR$$",
+        kCoverStoryUnexecutableLineColorKey: @"$$SOURCE_LINE_SKIPPED_COLOR$$",
+        kCoverStoryNonFeasibleLineColorKey: @"$$SOURCE_LINE_NONFEASIBLE_COLOR$$",
+        kCoverStoryExecutedLineColorKey: @"$$SOURCE_LINE_HIT_COLOR$$"
+    };
+    NSDictionary *defaults = [self defaultLineColors];
+    for (NSString *colorKey in sourceLineColorMap)
+    {
+        NSString *color = colors[colorKey] ?: defaults[colorKey];
+        css = [css stringByReplacingOccurrencesOfString:sourceLineColorMap[colorKey] withString:color];
+    }
+    return css;
+}
+
+- (id)init
+{
+    return [self initWithPageTemplate:nil indexTemplate:nil];
+}
+
+- (id)initWithPageTemplate:(NSString *)pageTemplate indexTemplate:(NSString *)indexTemplate
+{
+    if ((self = [super init]))
+    {
+        if (!pageTemplate || !indexTemplate)
+        {
+            return nil;
+        }
+        _pageSegments = CSSplitPageTemplate(pageTemplate, &_pageTokenMask);
+        _indexTemplate = [indexTemplate copy];
+    }
+    return self;
+}
+
+- (NSData *)fileListScriptForFileDatas:(NSArray *)fileDatas
+{
+    return [self fileListScriptForFileDatas:fileDatas pageNames:CSPageFileNames(fileDatas)];
+}
+
+- (NSData *)fileListScriptForFileDatas:(NSArray *)fileDatas pageNames:(NSArray *)pageNames
+{
+    float values[6]       = {25.0, 35.0, 45.0, 55.0, 65.0, 75.0};
+    const char *classes[] = { "filelessthan25percent", "filelessthan35percent", "filelessthan45percent",
+                              "filelessthan55percent", "filelessthan65percent", "filelessthan75percent" };
+
+    NSMutableData *script = [NSMutableData dataWithCapacity:[fileDatas count] * 96 + 1024];
+    CSAppendCString(script, "// Generated by CoverStory, the file list for the pages in this folder.\n"
+                            "var coverstory_files = [\n");
+    NSUInteger index = 0;
+    for (CoverStoryCoverageFileData *fileData in fileDatas)
+    {
+        @autoreleasepool {
+            NSString *name = [[fileData sourcePath] lastPathComponent];
+            NSString *link = [pageNames[index++] stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+            float percent;
+            [fileData coverageTotalLines:NULL
+                               codeLines:NULL
+                            hitCodeLines:NULL
+                        nonFeasibleLines:NULL
+                          coverageString:NULL
+                                coverage:&percent];
+
+            const char *classString = "filegoodcoveragepercent";
+            for (size_t i = 0; i < 6; ++i)
+            {
+                if (percent < values[i])
+                {
+                    classString = classes[i];
+                    break;
+                }
+            }
+            char percentString[32];
+            snprintf(percentString, sizeof(percentString), "%.2f", percent);
+            CSAppendCString(script, "[");
+            CSAppendJSString(script, link);
+            CSAppendCString(script, ",");
+            CSAppendJSString(script, CSHTMLEscapedString(name));
+            CSAppendCString(script, ",\"");
+            CSAppendCString(script, classString);
+            CSAppendCString(script, "\",\"");
+            CSAppendCString(script, percentString);
+            CSAppendCString(script, "\"],\n");
+        }
+    }
+    CSAppendCString(script,
+        "];\n"
+        "\n"
+        "function coverstory_fill_file_list() {\n"
+        "  var table = document.getElementById('filetable');\n"
+        "  if (!table) {\n"
+        "    return;\n"
+        "  }\n"
+        "  var body = table.tBodies.length ? table.tBodies[0] : table;\n"
+        "  for (var i = 0; i < coverstory_files.length; ++i) {\n"
+        "    var file = coverstory_files[i];\n"
+        "    var row = body.insertRow(-1);\n"
+        "    row.className = 'fileline';\n"
+        "    var name = row.insertCell(-1);\n"
+        "    name.className = 'filename';\n"
+        "    name.innerHTML = \"<a href='\" + file[0] + \"'>\" + file[1] + \"</a>\";\n"
+        "    var percent = row.insertCell(-1);\n"
+        "    percent.className = 'filepercent';\n"
+        "    percent.innerHTML = \"<span class='\" + file[2] + \"'>\" + file[3] + \"</span>\";\n"
+        "  }\n"
+        "}\n");
+    return script;
+}
+
+- (NSString *)htmlSourceTableData:(CoverStoryCoverageFileData *)fileData
+{
+    CSByteBuffer buffer = { NULL, 0, 0 };
+    CSAppendSourceTable(&buffer, fileData);
+    NSString *sourceHtml = [[NSString alloc] initWithBytes:buffer.bytes ?: ""
+                                                    length:buffer.length
+                                                  encoding:NSUTF8StringEncoding];
+    CSByteBufferFree(&buffer);
+    return sourceHtml;
+}
+
+- (BOOL)writePageForFileData:(CoverStoryCoverageFileData *)fileData
+                    pageName:(NSString *)pageName
+                 toDirectory:(NSString *)directory
+                        date:(NSString *)date
+                     summary:(NSString *)summary
+                      buffer:(CSByteBuffer *)buffer
+                       error:(NSError **)outError
+{
+    NSString *sourcePath = [fileData sourcePath];
+    NSString *fileName   = CSHTMLEscapedString([sourcePath lastPathComponent]);
+    __strong NSString *values[kCSPageTokenCount] = {
+        [kCSPageTokenTitle]         = fileName,
+        [kCSPageTokenSourceName]    = fileName,
+        [kCSPageTokenSourcePath]    = CSHTMLEscapedString(sourcePath),
+        [kCSPageTokenSourceDate]    = date,
+        [kCSPageTokenFileSummary]   = summary,
+        [kCSPageTokenSourceSummary] = CSHTMLEscapedString(coverageSummaryString(fileData)),
+        [kCSPageTokenFileData]      = @"",
+    };
+
+    buffer->length = 0;
+    for (id segment in _pageSegments)
+    {
+        if ([segment isKindOfClass:[NSData class]])
+        {
+            CSByteBufferAppend(buffer, [segment bytes], [segment length]);
+            continue;
+        }
+        NSUInteger token = [segment unsignedIntegerValue];
+        if (token == kCSPageTokenSourceData)
+        {
+            CSAppendSourceTable(buffer, fileData);
+        }
+        else
+        {
+            CSByteBufferAppendString(buffer, values[token]);
+        }
+    }
+    NSString *path = [directory stringByAppendingPathComponent:pageName];
+    NSData *page   = [NSData dataWithBytesNoCopy:buffer->bytes ?: ""
+                                          length:buffer->length
+                                    freeWhenDone:NO];
+    return [page writeToFile:path options:NSDataWritingAtomic error:outError];
+}
+
+- (BOOL)writeFileDatas:(NSArray *)fileDatas toDirectory:(NSString *)directory error:(NSError **)outError
+{
+    for (NSUInteger x = 0; x < kCSPageTokenCount; ++x)
+    {
+        if ((x != kCSPageTokenFileData) && !(_pageTokenMask & (1 << x)))
+        {
+            if (outError)
+            {
+                *outError = CSExportError([NSString stringWithFormat:@"Unable to find %@", kCSPageTokens[x]]);
+            }
+            return NO;
+        }
+    }
+    NSFileManager *fm = [[NSFileManager alloc] init];
+    if (![fm createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:outError])
+    {
+        return NO;
+    }
+
+    // The small shared files first.
+    NSUInteger fileCount = [fileDatas count];
+    NSArray *pageNames   = CSPageFileNames(fileDatas);
+    if (fileCount)
+    {
+        NSString *redirectURL = [NSString stringWithFormat:@"./%@",
+                                 [pageNames[0] stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
+        NSRange replaceRange  = [_indexTemplate rangeOfString:@"__REDIRECT_URL__"];
+        if (replaceRange.length == 0)
+        {
+            if (outError)
+            {
+                *outError = CSExportError(@"Unable to find __REDIRECT_URL__");
+            }
+            return NO;
+        }
+        NSString *indexHTML = [_indexTemplate stringByReplacingCharactersInRange:replaceRange withString:redirectURL];
+        if (![[indexHTML dataUsingEncoding:NSUTF8StringEncoding] writeToFile:[directory stringByAppendingPathComponent:@"index.html"]
+                                                                    options:NSDataWritingAtomic
+                                                                      error:outError])
+        {
+            return NO;
+        }
+    }
+    NSData *fileList = [self fileListScriptForFileDatas:fileDatas pageNames:pageNames];
+    if (![fileList writeToFile:[directory stringByAppendingPathComponent:kCSFileListScriptName]
+                       options:NSDataWritingAtomic
+                         error:outError])
+    {
+        return NO;
+    }
+    if (_stylesheet &&
+        ![[_stylesheet dataUsingEncoding:NSUTF8StringEncoding] writeToFile:[directory stringByAppendingPathComponent:@"coverstory.css"]
+                                                                   options:NSDataWritingAtomic
+                                                                     error:outError])
+    {
+        return NO;
+    }
+    if (_javaScript &&
+        ![_javaScript writeToFile:[directory stringByAppendingPathComponent:@"coverstory.js"]
+                          options:NSDataWritingAtomic
+                            error:outError])
+    {
+        return NO;
+    }
+    if (fileCount == 0)
+    {
+        return YES;
+    }
+
+    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+    [formatter setDateStyle:NSDateFormatterShortStyle];
+    [formatter setTimeStyle:NSDateFormatterShortStyle];
+    NSString *date    = CSHTMLEscapedString([formatter stringFromDate:[NSDate date]]);
+    NSString *summary = CSHTMLEscapedString(coverageShortSummaryString(fileDatas));
+
+    // Each worker pulls the next page off a shared counter and renders it into
+    // its own buffer, which goes straight to disk, so memory use only depends
+    // on the number of workers, not the number of files.  The biggest files go
+    // first so one long file doesn't end up running by itself at the end.
+    NSMutableArray *indexes = [NSMutableArray arrayWithCapacity:fileCount];
+    for (NSUInteger x = 0; x < fileCount; ++x)
+    {
+        [indexes addObject:@(x)];
+    }
+    NSArray *order = [indexes sortedArrayWithOptions:NSSortStable
+                                     usingComparator:^NSComparisonResult(NSNumber *a, NSNumber *b) {
+        NSUInteger aCount = [fileDatas[[a unsignedIntegerValue]] lineCount];
+        NSUInteger bCount = [fileDatas[[b unsignedIntegerValue]] lineCount];
+        return (aCount > bCount) ? NSOrderedAscending : ((aCount < bCount) ? NSOrderedDescending : NSOrderedSame);
+    }];
+    NSUInteger workers = _maxConcurrentPages ?: [[NSProcessInfo processInfo] activeProcessorCount];
+    workers            = MAX(MIN(workers, fileCount), (NSUInteger)1);
+    CSExportProgress progress     = { 0, NO };
+    CSExportProgress *progressPtr = &progress;
+    __block NSError *firstError   = nil;
+    NSOperationQueue *queue       = [[NSOperationQueue alloc] init];
+    [queue setMaxConcurrentOperationCount:workers];
+    for (NSUInteger x = 0; x < workers; ++x)
+    {
+        [queue addOperationWithBlock:^{
+            CSByteBuffer buffer = { NULL, 0, 0 };
+            for (;;)
+            {
+                NSUInteger index = __sync_fetch_and_add(&progressPtr->nextIndex, 1);
+                if ((index >= fileCount) || progressPtr->failed)
+                {
+                    break;
+                }
+                @autoreleasepool {
+                    NSError *error       = nil;
+                    NSUInteger fileIndex = [order[index] unsignedIntegerValue];
+                    if (![self writePageForFileData:fileDatas[fileIndex]
+                                           pageName:pageNames[fileIndex]
+                                        toDirectory:directory
+                                               date:date
+                                            summary:summary
+                                             buffer:&buffer
+                                              error:&error])
+                    {
+                        @synchronized(queue)
+                        {
+                            if (!firstError)
+                            {
+                                firstError = error ?: CSExportError(@"Unable to write the export");
+                            }
+                            progressPtr->failed = YES;
+                        }
+                    }
+                }
+            }
+            CSByteBufferFree(&buffer);
+        }];
+    }
+    [queue waitUntilAllOperationsAreFinished];
+    if (firstError && outError)
+    {
+        *outError = firstError;
+    }
+    return !firstError;
+}
+
+@end
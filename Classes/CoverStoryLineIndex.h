@@ -0,0 +1,29 @@
+//
+//  CoverStoryLineIndex.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// A read only snapshot of the hit counts of a set of sources, all of them in
+// one contiguous buffer, looked up by source path.  Made once a load is done
+// (copying the counts is a memcpy per source), and then safe to read from any
+// thread while the file datas it was made from go on changing, so the query
+// server can swap in a new one w/o stopping anyone.
+
+#import <Foundation/Foundation.h>
+
+@interface CoverStoryLineIndex : NSObject
+
+@property (readonly, nonatomic, assign) NSUInteger sourceCount;
+@property (readonly, nonatomic, assign) NSUInteger lineCount;  // of all the sources
+
+// |fileDatas| are CoverStoryCoverageFileData, a source that's in there more
+// than once keeps the first.
+- (id)initWithFileDatas:(NSArray *)fileDatas;
+
+// The counts of |sourcePath|'s lines (line 1 first, w/ the not executed and
+// non-feasible markers), NULL if the index doesn't have it.  Good for as long
+// as the index is.
+- (const int64_t *)hitCountsForSourcePath:(NSString *)sourcePath lineCount:(NSUInteger *)outLineCount;
+
+@end
@@ -0,0 +1,95 @@
+//
+//  CoverStoryLineIndex.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "CoverStoryLineIndex.h"
+#import "CoverStoryCoverageFileData.h"
+
+@interface CoverStoryLineIndex () {
+@private
+    NSData *_hitCounts;                  // of int64_t, the sources back to back
+    NSData *_ranges;                     // of NSRange into |_hitCounts|, per source
+    NSDictionary *_sourceIndexesByPath;  // sourcePath -> index in |_ranges|
+    NSUInteger _sourceCount;
+    NSUInteger _lineCount;
+}
+@end
+
+@implementation CoverStoryLineIndex
+
+@synthesize sourceCount = _sourceCount;
+@synthesize lineCount = _lineCount;
+
+- (id)init
+{
+    return [self initWithFileDatas:nil];
+}
+
+- (id)initWithFileDatas:(NSArray *)fileDatas
+{
+    if ((self = [super init]))
+    {
+        NSMutableDictionary *indexes = [NSMutableDictionary dictionaryWithCapacity:[fileDatas count]];
+        NSMutableArray *sources      = [NSMutableArray arrayWithCapacity:[fileDatas count]];
+        NSUInteger lineCount         = 0;
+        for (CoverStoryCoverageFileData *fileData in fileDatas)
+        {
+            NSString *sourcePath = [fileData sourcePath];
+            if (!sourcePath || indexes[sourcePath])
+            {
+                continue;
+            }
+            indexes[sourcePath] = @([sources count]);
+            [sources addObject:fileData];
+            lineCount += [fileData lineCount];
+        }
+
+        NSMutableData *hitCounts = [NSMutableData dataWithLength:lineCount * sizeof(int64_t)];
+        NSMutableData *ranges    = [NSMutableData dataWithLength:[sources count] * sizeof(NSRange)];
+        int64_t *counts          = [hitCounts mutableBytes];
+        NSRange *range           = [ranges mutableBytes];
+        NSUInteger offset        = 0;
+        for (CoverStoryCoverageFileData *fileData in sources)
+        {
+            NSUInteger sourceLines = [fileData lineCount];
+            if (sourceLines)
+            {
+                memcpy(counts + offset, [fileData hitCounts], sourceLines * sizeof(int64_t));
+            }
+            *range++ = NSMakeRange(offset, sourceLines);
+            offset  += sourceLines;
+        }
+        _hitCounts           = hitCounts;
+        _ranges              = ranges;
+        _sourceIndexesByPath = [indexes copy];
+        _sourceCount         = [sources count];
+        _lineCount           = lineCount;
+    }
+    return self;
+}
+
+- (const int64_t *)hitCountsForSourcePath:(NSString *)sourcePath lineCount:(NSUInteger *)outLineCount
+{
+    NSNumber *index = sourcePath ? _sourceIndexesByPath[sourcePath] : nil;
+    if (!index)
+    {
+        *outLineCount = 0;
+        return NULL;
+    }
+    // a source w/o any lines is still found
+    static const int64_t kNoLines[1] = { 0 };
+    NSRange range                    = ((const NSRange *)[_ranges bytes])[[index unsignedIntegerValue]];
+    *outLineCount                    = range.length;
+    return range.length ? (const int64_t *)[_hitCounts bytes] + range.location : kNoLines;
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"%@ <%p>: %lu sources, %lu lines", [self class], self,
+            (unsigned long)_sourceCount, (unsigned long)_lineCount];
+}
+
+@end
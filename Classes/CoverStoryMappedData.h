@@ -0,0 +1,37 @@
+//
+//  CoverStoryMappedData.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// The pieces shared by the formats that are mapped straight off disk and used
+// in place (the coverage cache entries and the shards): everything is 8 byte
+// aligned, the columns are handed out as slices of the mapping, and a record's
+// warnings are stored as NUL terminated UTF-8 strings back to back.
+
+#import <Foundation/Foundation.h>
+
+// A range of a mapped file, so the columns can be used w/o copying them out.
+// Keeps the whole mapping alive.  The range has to already have been checked
+// against the mapping's length.
+@interface CoverStoryMappedDataSlice : NSData {
+@private
+    NSData *_backing;
+    const void *_sliceBytes;
+    NSUInteger _sliceLength;
+}
+- (id)initWithData:(NSData *)backing range:(NSRange)range;
+@end
+
+// Pads |data| out to the next 8 bytes.
+extern void mappedDataAppendPadding(NSMutableData *data);
+// |offset| rounded up to the next 8 bytes.
+static inline uint64_t mappedDataAligned(uint64_t offset)
+{
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+// |warnings| (NSStrings) in the stored form.
+extern NSData *mappedDataWarnings(NSArray *warnings);
+// And back, any that aren't UTF-8 are dropped.
+extern NSArray *mappedDataWarningsFromBytes(const void *bytes, NSUInteger length);
@@ -0,0 +1,75 @@
+//
+//  CoverStoryMappedData.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "CoverStoryMappedData.h"
+
+static const uint8_t kCSMappedDataPadding[8] = { 0 };
+
+void mappedDataAppendPadding(NSMutableData *data)
+{
+    NSUInteger remainder = [data length] % 8;
+    if (remainder)
+    {
+        [data appendBytes:kCSMappedDataPadding length:8 - remainder];
+    }
+}
+
+NSData *mappedDataWarnings(NSArray *warnings)
+{
+    NSMutableData *data = [NSMutableData data];
+    for (NSString *warning in warnings)
+    {
+        const char *utf8 = [warning UTF8String];
+        [data appendBytes:utf8 length:strlen(utf8) + 1];
+    }
+    return data;
+}
+
+NSArray *mappedDataWarningsFromBytes(const void *bytes, NSUInteger length)
+{
+    NSMutableArray *warnings = [NSMutableArray array];
+    const char *warning      = bytes;
+    const char *warningsEnd  = warning + length;
+    while (warning < warningsEnd)
+    {
+        size_t warningLength = strnlen(warning, warningsEnd - warning);
+        NSString *string     = [[NSString alloc] initWithBytes:warning
+                                                        length:warningLength
+                                                      encoding:NSUTF8StringEncoding];
+        if (string)
+        {
+            [warnings addObject:string];
+        }
+        warning += warningLength + 1;
+    }
+    return warnings;
+}
+
+@implementation CoverStoryMappedDataSlice
+
+- (id)initWithData:(NSData *)backing range:(NSRange)range
+{
+    if ((self = [super init]))
+    {
+        _backing     = backing;
+        _sliceBytes  = (const uint8_t *)[backing bytes] + range.location;
+        _sliceLength = range.length;
+    }
+    return self;
+}
+
+- (NSUInteger)length
+{
+    return _sliceLength;
+}
+
+- (const void *)bytes
+{
+    return _sliceBytes;
+}
+
+@end
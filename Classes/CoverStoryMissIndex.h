@@ -0,0 +1,43 @@
+//
+//  CoverStoryMissIndex.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// The missed (zero hit) lines of a file as sorted runs, so the scroller can
+// draw them in time proportional to its height rather than the file's length,
+// and the code view can find the next/previous missed block w/ a binary
+// search.  Built from a snapshot of the hit counts; CoverStoryCoverageFileData
+// makes a new one when its counts change (see -[CoverStoryCoverageFileData
+// missIndex]).
+
+#import <Foundation/Foundation.h>
+
+@interface CoverStoryMissIndex : NSObject {
+@private
+    NSData *_runs;  // of NSRange, sorted, non adjacent
+    NSUInteger _runCount;
+    NSUInteger _lineCount;
+    NSUInteger _missedLineCount;
+}
+
+@property (readonly, nonatomic, assign) NSUInteger runCount;
+@property (readonly, nonatomic, assign) NSUInteger lineCount;
+@property (readonly, nonatomic, assign) NSUInteger missedLineCount;
+
+- (id)initWithHitCounts:(const int64_t *)hitCounts lineCount:(NSUInteger)lineCount;
+
+- (NSRange)rangeOfRunAtIndex:(NSUInteger)index;
+
+// The first block of missed lines w/ a line after |line|, or the last block w/
+// a line before it.  {NSNotFound, 0} if there isn't one.  Pass NSNotFound as
+// |line| to start from the top (or bottom).
+- (NSRange)nextMissedRangeAfterLine:(NSUInteger)line;
+- (NSRange)previousMissedRangeBeforeLine:(NSUInteger)line;
+
+// Splits the lines into |bucketCount| equal slices and fills |outDensity| w/
+// the fraction of each that was missed.  Costs O(runs + buckets), so it's
+// cheap to redo when the view changes size.
+- (void)getMissDensity:(float *)outDensity bucketCount:(NSUInteger)bucketCount;
+
+@end
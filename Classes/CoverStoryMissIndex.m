@@ -0,0 +1,151 @@
+//
+//  CoverStoryMissIndex.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "CoverStoryMissIndex.h"
+
+@implementation CoverStoryMissIndex
+
+@synthesize runCount = _runCount;
+@synthesize lineCount = _lineCount;
+@synthesize missedLineCount = _missedLineCount;
+
+- (id)init
+{
+    return [self initWithHitCounts:NULL lineCount:0];
+}
+
+- (id)initWithHitCounts:(const int64_t *)hitCounts lineCount:(NSUInteger)lineCount
+{
+    if ((self = [super init]))
+    {
+        NSMutableData *runs = [NSMutableData data];
+        NSUInteger missed   = 0;
+        NSUInteger x        = 0;
+        while (x < lineCount)
+        {
+            if (hitCounts[x] != 0)
+            {
+                ++x;
+                continue;
+            }
+            NSUInteger start = x;
+            while ((x < lineCount) && (hitCounts[x] == 0))
+            {
+                ++x;
+            }
+            NSRange run = NSMakeRange(start, x - start);
+            [runs appendBytes:&run length:sizeof(run)];
+            missed += run.length;
+        }
+        _runs            = runs;
+        _runCount        = [runs length] / sizeof(NSRange);
+        _lineCount       = lineCount;
+        _missedLineCount = missed;
+    }
+    return self;
+}
+
+- (NSRange)rangeOfRunAtIndex:(NSUInteger)index
+{
+    NSParameterAssert(index < _runCount);
+    return ((const NSRange *)[_runs bytes])[index];
+}
+
+- (NSRange)nextMissedRangeAfterLine:(NSUInteger)line
+{
+    const NSRange *runs = [_runs bytes];
+    if (_runCount == 0)
+    {
+        return NSMakeRange(NSNotFound, 0);
+    }
+    if (line == NSNotFound)
+    {
+        return runs[0];
+    }
+    // first run that ends after |line|
+    NSUInteger low  = 0;
+    NSUInteger high = _runCount;
+    while (low < high)
+    {
+        NSUInteger middle = low + (high - low) / 2;
+        if (NSMaxRange(runs[middle]) <= line + 1)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return (low < _runCount) ? runs[low] : NSMakeRange(NSNotFound, 0);
+}
+
+- (NSRange)previousMissedRangeBeforeLine:(NSUInteger)line
+{
+    const NSRange *runs = [_runs bytes];
+    if (_runCount == 0)
+    {
+        return NSMakeRange(NSNotFound, 0);
+    }
+    if (line == NSNotFound)
+    {
+        return runs[_runCount - 1];
+    }
+    // first run that starts at or after |line|, the one before it is the answer
+    NSUInteger low  = 0;
+    NSUInteger high = _runCount;
+    while (low < high)
+    {
+        NSUInteger middle = low + (high - low) / 2;
+        if (runs[middle].location < line)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return (low > 0) ? runs[low - 1] : NSMakeRange(NSNotFound, 0);
+}
+
+- (void)getMissDensity:(float *)outDensity bucketCount:(NSUInteger)bucketCount
+{
+    if (bucketCount == 0)
+    {
+        return;
+    }
+    memset(outDensity, 0, bucketCount * sizeof(float));
+    if (_lineCount == 0)
+    {
+        return;
+    }
+    const NSRange *runs = [_runs bytes];
+    double bucketSize   = (double)_lineCount / (double)bucketCount;
+    for (NSUInteger x = 0; x < _runCount; ++x)
+    {
+        double start      = (double)runs[x].location;
+        double end        = (double)NSMaxRange(runs[x]);
+        NSUInteger bucket = (NSUInteger)(start / bucketSize);
+        while ((bucket < bucketCount) && (start < end))
+        {
+            double bucketEnd = MIN((double)(bucket + 1) * bucketSize, end);
+            if (bucketEnd > start)
+            {
+                outDensity[bucket] += (float)((bucketEnd - start) / bucketSize);
+                start = bucketEnd;
+            }
+            ++bucket;
+        }
+    }
+    for (NSUInteger x = 0; x < bucketCount; ++x)
+    {
+        outDensity[x] = MIN(outDensity[x], 1.0f);
+    }
+}
+
+@end
@@ -36,6 +36,28 @@
 
 #define kCoverStoryFilterStringTypeKey @"filterStringType" // CoverStoryFilterStringType
 
+// Report load timing/queueing (and coverage cache) numbers in the message drawer
+#define kCoverStoryShowLoadStatisticsKey @"showLoadStatistics"  // Boolean
+
+// Keep the coverage read for each gcda around between loads
+#define kCoverStoryUseCoverageCacheKey @"useCoverageCache"  // Boolean
+#define kCoverStoryCoverageCacheDirectoryKey @"coverageCacheDirectory"  // NSString, empty for the default
+
+// Reload the folders whose gcda files change while a folder is open
+#define kCoverStoryWatchForChangesKey @"watchForChanges"  // Boolean
+
+// More folders to look for gcov-<version> in (searched after the standard ones)
+#define kCoverStoryGCovSearchPathsKey @"gcovSearchPaths"  // NSArray of NSString
+
+// Trace the stages of each load, and write them out as Chrome trace JSON
+#define kCoverStoryTraceLoadsKey @"traceLoads"  // Boolean
+
+// Read gcov's output from a pipe (gcov -t) instead of the .gcov files it writes
+#define kCoverStoryStreamGCovKey @"streamGCov"  // Boolean
+
+// Answer line coverage queries for each document on a socket in this folder
+#define kCoverStoryQuerySocketFolderKey @"querySocketFolder"  // NSString, empty for off
+
 typedef NS_ENUM(NSInteger, CoverStoryFilterStringType)
 {
     kCoverStoryFilterStringTypeWildcardPattern = 0,
@@ -13,6 +13,46 @@
                                                  // and sorts
 @end
 
+// The line counts behind a coverage number, kept as a plain struct so running
+// totals can be added to and taken from w/o going through the protocol.
+typedef struct {
+    NSInteger totalLines;
+    NSInteger codeLines;         // doesn't include non-feasible
+    NSInteger hitCodeLines;
+    NSInteger nonFeasibleLines;
+} CoverStoryLineCounts;
+
+static inline CoverStoryLineCounts coverageAddLineCounts(CoverStoryLineCounts a, CoverStoryLineCounts b)
+{
+    a.totalLines       += b.totalLines;
+    a.codeLines        += b.codeLines;
+    a.hitCodeLines     += b.hitCodeLines;
+    a.nonFeasibleLines += b.nonFeasibleLines;
+    return a;
+}
+
+static inline CoverStoryLineCounts coverageSubtractLineCounts(CoverStoryLineCounts a, CoverStoryLineCounts b)
+{
+    a.totalLines       -= b.totalLines;
+    a.codeLines        -= b.codeLines;
+    a.hitCodeLines     -= b.hitCodeLines;
+    a.nonFeasibleLines -= b.nonFeasibleLines;
+    return a;
+}
+
+static inline BOOL coverageLineCountsEqual(CoverStoryLineCounts a, CoverStoryLineCounts b)
+{
+    return ((a.totalLines == b.totalLines) && (a.codeLines == b.codeLines) &&
+            (a.hitCodeLines == b.hitCodeLines) && (a.nonFeasibleLines == b.nonFeasibleLines));
+}
+
+// The NSErrors CoverStory makes itself are in this domain, w/ one of these as
+// the code.
+extern NSString *const kCoverStoryErrorDomain;
+extern const NSInteger kCoverStoryExportError;       // writing an HTML export
+extern const NSInteger kCoverStoryShardError;        // reading/writing a shard
+extern const NSInteger kCoverStoryQueryServerError;  // starting the query server
+
 // methods to get feedback while the data is processed
 @protocol CoverStoryCoverageProcessingProtocol
 - (void)coverageErrorForPath:(NSString *)path message:(NSString *)format, ...NS_FORMAT_FUNCTION(2, 3);
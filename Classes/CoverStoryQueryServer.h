@@ -0,0 +1,78 @@
+//
+//  CoverStoryQueryServer.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// Answers "what are the hit counts of these lines" over a Unix domain socket,
+// out of a CoverStoryLineIndex, so editors and review bots can ask about
+// thousands of lines in one round trip.  Each connection is served on its own
+// thread and can send any number of requests, one after another.  Setting a
+// new index swaps it in for the requests that come after; one already being
+// answered finishes w/ the index it started with.
+//
+// The protocol is binary, in native byte order (it's a local socket).  A
+// request is a CoverStoryQueryRequestHeader and then |queryCount| times a
+// CoverStoryQuery followed by |pathLength| bytes of source path (UTF-8, no
+// NUL).  The answer is a CoverStoryQueryResponseHeader and then, for each
+// query in order, a CoverStoryQueryResult followed by |lineCount| int64_t hit
+// counts (-1 for a line that isn't code, -2 for a non-feasible one).
+//
+// A query asks for |lineCount| lines starting at |firstLine| (1 based), 0
+// lines means through the end of the source.  The lines that are past either
+// end of the source are left out, the result says which ones came back.  A
+// request that doesn't make sense (bad magic, too many queries, too long a
+// path) closes the connection.  The answer is sent as it's made, so a client
+// sending a big request has to read while it writes.
+
+#import <Foundation/Foundation.h>
+#import "CoverStoryProtocols.h"
+
+@class CoverStoryLineIndex;
+
+typedef struct {
+    char magic[4];  // "CSQR"
+    uint32_t queryCount;
+} CoverStoryQueryRequestHeader;
+
+typedef struct {
+    uint32_t firstLine;
+    uint32_t lineCount;
+    uint32_t pathLength;
+} CoverStoryQuery;
+
+typedef struct {
+    char magic[4];  // "CSQA"
+    uint32_t queryCount;
+    uint64_t generation;  // bumped for each index set, so a client can tell
+} CoverStoryQueryResponseHeader;
+
+enum {
+    kCoverStoryQueryFound = 0,
+    kCoverStoryQueryUnknownSource = 1,
+    kCoverStoryQueryNoIndex = 2,  // nothing has been loaded yet
+};
+
+typedef struct {
+    uint32_t status;  // kCoverStoryQuery*
+    uint32_t firstLine;
+    uint32_t lineCount;
+    uint32_t sourceLineCount;  // how many lines the whole source has
+} CoverStoryQueryResult;
+
+@interface CoverStoryQueryServer : NSObject
+
+@property (readonly, nonatomic, copy) NSString *socketPath;
+// What's answered from, nil until something is loaded.
+@property (strong) CoverStoryLineIndex *index;
+@property (readonly) uint64_t generation;
+
+- (id)initWithSocketPath:(NSString *)socketPath;
+
+// Makes the socket (replacing a stale one left at |socketPath|, but nothing
+// else) and starts taking connections.
+- (BOOL)startWithError:(NSError **)error;
+// Closes the socket and every connection, and removes the socket file.
+- (void)stop;
+
+@end
@@ -0,0 +1,449 @@
+//
+//  CoverStoryQueryServer.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "CoverStoryQueryServer.h"
+#import "CoverStoryLineIndex.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const char kCSQueryRequestMagic[4]   = { 'C', 'S', 'Q', 'R' };
+static const char kCSQueryResponseMagic[4]  = { 'C', 'S', 'Q', 'A' };
+static const uint32_t kCSQueryMaxQueries    = 1 << 20;
+
+enum {
+    kCSQueryMaxPathLength = 4096,
+    // what's read from a connection at a time, and how much of the answer is
+    // built up before it's sent
+    kCSQueryBufferSize = 64 * 1024,
+};
+
+#if defined(MSG_NOSIGNAL)
+static const int kCSQuerySendFlags = MSG_NOSIGNAL;
+#else
+static const int kCSQuerySendFlags = 0;  // SO_NOSIGPIPE is set on the socket
+#endif
+
+// Requests are made of lots of small pieces, so they're read through this.
+typedef struct {
+    int fd;
+    size_t start;
+    size_t end;
+    uint8_t bytes[kCSQueryBufferSize];
+} CSQueryReader;
+
+static BOOL CSQueryRead(CSQueryReader *reader, void *bytes, size_t length)
+{
+    uint8_t *out = bytes;
+    while (length)
+    {
+        if (reader->start == reader->end)
+        {
+            ssize_t bytesRead = read(reader->fd, reader->bytes, sizeof(reader->bytes));
+            if ((bytesRead < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+            if (bytesRead <= 0)
+            {
+                return NO;
+            }
+            reader->start = 0;
+            reader->end   = (size_t)bytesRead;
+        }
+        size_t chunk   = MIN(length, reader->end - reader->start);
+        memcpy(out, reader->bytes + reader->start, chunk);
+        reader->start += chunk;
+        out           += chunk;
+        length        -= chunk;
+    }
+    return YES;
+}
+
+static BOOL CSQueryWrite(int fd, const void *bytes, size_t length)
+{
+    const uint8_t *cursor = bytes;
+    while (length)
+    {
+        ssize_t sent = send(fd, cursor, length, kCSQuerySendFlags);
+        if ((sent < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        if (sent <= 0)
+        {
+            return NO;
+        }
+        cursor += sent;
+        length -= (size_t)sent;
+    }
+    return YES;
+}
+
+static NSError *CSQueryServerError(NSString *format, ...) NS_FORMAT_FUNCTION(1, 2);
+static NSError *CSQueryServerError(NSString *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    NSString *description = [[NSString alloc] initWithFormat:format arguments:list];
+    va_end(list);
+    return [NSError errorWithDomain:kCoverStoryErrorDomain
+                               code:kCoverStoryQueryServerError
+                           userInfo:@{NSLocalizedDescriptionKey : description}];
+}
+
+@interface CoverStoryQueryServer () {
+@private
+    NSString *_socketPath;
+    CoverStoryLineIndex *_index;  // guarded by self
+    uint64_t _generation;         // guarded by self
+    NSMutableSet *_connections;   // NSNumber fds, guarded by self
+    BOOL _stopped;                // guarded by self
+    int _stopFd;                  // write to stop the accepting thread
+    NSThread *_thread;
+}
+- (void)acceptConnections:(NSArray *)descriptors;
+- (void)serveConnection:(NSNumber *)connection;
+- (BOOL)answerRequestFrom:(CSQueryReader *)reader response:(NSMutableData *)response;
+@end
+
+@implementation CoverStoryQueryServer
+
+@synthesize socketPath = _socketPath;
+
+- (id)init
+{
+    return [self initWithSocketPath:nil];
+}
+
+- (id)initWithSocketPath:(NSString *)socketPath
+{
+    if ((self = [super init]))
+    {
+        if (![socketPath length])
+        {
+            return nil;
+        }
+        _socketPath  = [[socketPath stringByStandardizingPath] copy];
+        _connections = [[NSMutableSet alloc] init];
+        _stopFd      = -1;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self stop];
+}
+
+- (CoverStoryLineIndex *)index
+{
+    @synchronized(self)
+    {
+        return _index;
+    }
+}
+
+- (void)setIndex:(CoverStoryLineIndex *)index
+{
+    @synchronized(self)
+    {
+        _index = index;
+        ++_generation;
+    }
+}
+
+- (uint64_t)generation
+{
+    @synchronized(self)
+    {
+        return _generation;
+    }
+}
+
+- (BOOL)startWithError:(NSError **)error
+{
+    if (_thread)
+    {
+        return YES;
+    }
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    const char *path   = [_socketPath fileSystemRepresentation];
+    size_t pathLength  = strlen(path);
+    if (pathLength >= sizeof(address.sun_path))
+    {
+        if (error)
+        {
+            *error = CSQueryServerError(@"The socket path '%@' is too long", _socketPath);
+        }
+        return NO;
+    }
+    memcpy(address.sun_path, path, pathLength + 1);
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0)
+    {
+        if (error)
+        {
+            *error = CSQueryServerError(@"Unable to make a socket (%s)", strerror(errno));
+        }
+        return NO;
+    }
+    fcntl(listenFd, F_SETFD, FD_CLOEXEC);
+    // a socket left behind by a run that didn't get to clean up is replaced,
+    // one that's still being served (or anything else) isn't
+    struct stat info;
+    if (lstat(path, &info) == 0)
+    {
+        if (!S_ISSOCK(info.st_mode) || (connect(listenFd, (struct sockaddr *)&address, sizeof(address)) == 0))
+        {
+            close(listenFd);
+            if (error)
+            {
+                *error = CSQueryServerError(@"'%@' is already in use", _socketPath);
+            }
+            return NO;
+        }
+        unlink(path);
+    }
+    int stopPipe[2] = { -1, -1 };
+    if ((bind(listenFd, (struct sockaddr *)&address, sizeof(address)) != 0) ||
+        (listen(listenFd, SOMAXCONN) != 0) ||
+        (pipe(stopPipe) != 0))
+    {
+        int listenErrno = errno;
+        close(listenFd);
+        unlink(path);
+        if (error)
+        {
+            *error = CSQueryServerError(@"Unable to listen on '%@' (%s)", _socketPath, strerror(listenErrno));
+        }
+        return NO;
+    }
+    _stopFd = stopPipe[1];
+    @synchronized(self)
+    {
+        _stopped = NO;
+    }
+    // the thread keeps us alive until -stop, it has its own copy of the fds so
+    // a restart doesn't race it closing them
+    _thread = [[NSThread alloc] initWithTarget:self
+                                      selector:@selector(acceptConnections:)
+                                        object:@[@(listenFd), @(stopPipe[0])]];
+    [_thread start];
+    return YES;
+}
+
+- (void)stop
+{
+    if (!_thread)
+    {
+        return;
+    }
+    @synchronized(self)
+    {
+        _stopped = YES;
+        // the connections' threads see the end of the stream and clean up
+        for (NSNumber *connection in _connections)
+        {
+            shutdown([connection intValue], SHUT_RDWR);
+        }
+    }
+    unlink([_socketPath fileSystemRepresentation]);
+    char stop = 0;
+    (void)write(_stopFd, &stop, 1);
+    close(_stopFd);
+    _stopFd = -1;
+    _thread = nil;
+}
+
+- (void)acceptConnections:(NSArray *)descriptors
+{
+    int listenFd = [descriptors[0] intValue];
+    int stopFd   = [descriptors[1] intValue];
+    for (;;)
+    {
+        @autoreleasepool {
+            struct pollfd fds[2] = { { listenFd, POLLIN, 0 }, { stopFd, POLLIN, 0 } };
+            int ready            = poll(fds, 2, -1);
+            if (ready < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                break;
+            }
+            if (fds[1].revents)
+            {
+                break;
+            }
+            int connectionFd = accept(listenFd, NULL, NULL);
+            if (connectionFd < 0)
+            {
+                continue;
+            }
+            fcntl(connectionFd, F_SETFD, FD_CLOEXEC);
+#if defined(SO_NOSIGPIPE)
+            int on = 1;
+            setsockopt(connectionFd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+            NSNumber *connection = @(connectionFd);
+            @synchronized(self)
+            {
+                if (_stopped)
+                {
+                    close(connectionFd);
+                    continue;
+                }
+                [_connections addObject:connection];
+            }
+            [NSThread detachNewThreadSelector:@selector(serveConnection:) toTarget:self withObject:connection];
+        }
+    }
+    close(listenFd);
+    close(stopFd);
+}
+
+- (void)serveConnection:(NSNumber *)connection
+{
+    @autoreleasepool {
+        CSQueryReader *reader   = malloc(sizeof(CSQueryReader));
+        NSMutableData *response = [NSMutableData dataWithCapacity:2 * kCSQueryBufferSize];
+        if (reader)
+        {
+            reader->fd    = [connection intValue];
+            reader->start = 0;
+            reader->end   = 0;
+            BOOL isGood   = YES;
+            while (isGood)
+            {
+                @autoreleasepool {
+                    isGood = [self answerRequestFrom:reader response:response];
+                }
+            }
+            free(reader);
+        }
+        // closed under the lock so -stop can't shut down an fd that's been
+        // reused
+        @synchronized(self)
+        {
+            [_connections removeObject:connection];
+            close([connection intValue]);
+        }
+    }
+}
+
+// Answers one request, NO when the connection is done (closed, or sent
+// something that doesn't make sense).
+- (BOOL)answerRequestFrom:(CSQueryReader *)reader response:(NSMutableData *)response
+{
+    CoverStoryQueryRequestHeader header;
+    if (!CSQueryRead(reader, &header, sizeof(header)) ||
+        (memcmp(header.magic, kCSQueryRequestMagic, sizeof(header.magic)) != 0) ||
+        (header.queryCount > kCSQueryMaxQueries))
+    {
+        return NO;
+    }
+    // the whole request is answered from the same index
+    CoverStoryLineIndex *index = nil;
+    uint64_t generation        = 0;
+    @synchronized(self)
+    {
+        index      = _index;
+        generation = _generation;
+    }
+    CoverStoryQueryResponseHeader responseHeader;
+    memcpy(responseHeader.magic, kCSQueryResponseMagic, sizeof(responseHeader.magic));
+    responseHeader.queryCount = header.queryCount;
+    responseHeader.generation = generation;
+    [response setLength:0];
+    [response appendBytes:&responseHeader length:sizeof(responseHeader)];
+
+    // lots of queries in a row are for the same source, so the last one found
+    // is kept to skip the lookup
+    char path[kCSQueryMaxPathLength];
+    char lastPath[kCSQueryMaxPathLength];
+    uint32_t lastPathLength    = UINT32_MAX;
+    const int64_t *hitCounts   = NULL;
+    NSUInteger sourceLineCount = 0;
+    for (uint32_t x = 0; x < header.queryCount; ++x)
+    {
+        CoverStoryQuery query;
+        if (!CSQueryRead(reader, &query, sizeof(query)) ||
+            (query.pathLength > kCSQueryMaxPathLength) ||
+            !CSQueryRead(reader, path, query.pathLength))
+        {
+            return NO;
+        }
+        if ((query.pathLength != lastPathLength) || (memcmp(path, lastPath, query.pathLength) != 0))
+        {
+            NSString *sourcePath = [[NSString alloc] initWithBytes:path
+                                                            length:query.pathLength
+                                                          encoding:NSUTF8StringEncoding];
+            hitCounts = [index hitCountsForSourcePath:sourcePath lineCount:&sourceLineCount];
+            if (!hitCounts && sourcePath)
+            {
+                // the index has them standardized
+                hitCounts = [index hitCountsForSourcePath:[sourcePath stringByStandardizingPath]
+                                                lineCount:&sourceLineCount];
+            }
+            memcpy(lastPath, path, query.pathLength);
+            lastPathLength = query.pathLength;
+        }
+
+        CoverStoryQueryResult result = { kCoverStoryQueryFound, query.firstLine, 0, 0 };
+        if (!index)
+        {
+            result.status = kCoverStoryQueryNoIndex;
+        }
+        else if (!hitCounts)
+        {
+            result.status = kCoverStoryQueryUnknownSource;
+        }
+        else
+        {
+            // [first, end) clipped to the source's lines
+            uint64_t first = MAX(query.firstLine, (uint32_t)1);
+            uint64_t end   = query.lineCount ? (uint64_t)query.firstLine + query.lineCount : sourceLineCount + 1;
+            end            = MIN(end, (uint64_t)sourceLineCount + 1);
+            if (first < end)
+            {
+                result.firstLine = (uint32_t)first;
+                result.lineCount = (uint32_t)(end - first);
+            }
+            result.sourceLineCount = (uint32_t)MIN(sourceLineCount, (NSUInteger)UINT32_MAX);
+        }
+        [response appendBytes:&result length:sizeof(result)];
+        if (result.lineCount)
+        {
+            [response appendBytes:hitCounts + result.firstLine - 1 length:result.lineCount * sizeof(int64_t)];
+        }
+        if ([response length] >= kCSQueryBufferSize)
+        {
+            if (!CSQueryWrite(reader->fd, [response bytes], [response length]))
+            {
+                return NO;
+            }
+            [response setLength:0];
+        }
+    }
+    return CSQueryWrite(reader->fd, [response bytes], [response length]);
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"%@ <%p>: %@", [self class], self, _socketPath];
+}
+
+@end
@@ -19,11 +19,13 @@
 
 #import <Cocoa/Cocoa.h>
 
+@class CoverStoryCoverageFileData;
+
 // Draws the special CoverStory scroller that has the hilights in it to show
 // places that don't have coverage
 @interface CoverStoryScroller : NSScroller
 
 // set the data for the scroller to work from
-- (void)setCoverageData:(NSArray *)coverageData;
+- (void)setCoverageData:(CoverStoryCoverageFileData *)coverageData;
 
 @end
@@ -18,11 +18,16 @@
 //
 
 #import "CoverStoryScroller.h"
-#import "CoverStoryCoverageLineData.h"
+#import "CoverStoryCoverageFileData.h"
+#import "CoverStoryMissIndex.h"
 #import <Carbon/Carbon.h>
 
 @interface CoverStoryScroller ()
-@property (nonatomic, strong) NSArray *coverageData;
+@property (nonatomic, strong) CoverStoryCoverageFileData *coverageData;
+// The miss density per bucket of the knob slot, and what it was made from so
+// it's only redone when the data or our size changes.
+@property (nonatomic, strong) NSMutableData *missDensity;
+@property (nonatomic, strong) CoverStoryMissIndex *missDensityIndex;
 @end
 
 @implementation CoverStoryScroller
@@ -67,40 +72,50 @@
     
     // If we have coverage data, draw the lines to denote lines we didn't hit
     // over the track. Note that this looks FAR better than Shark's impl.
+    // The lines are bucketed by pixel, so this costs the same for any size of
+    // file.
     if (_coverageData)
     {
-        NSRect slot          = [self rectForPart:NSScrollerKnobSlot];
-        NSUInteger count     = [_coverageData count];
-        CGFloat oldLineWidth = [NSBezierPath defaultLineWidth];
-        [[[NSColor redColor] colorWithAlphaComponent:0.8] set];
-        
-        // Make our lines thick enough that they "touch" when you have two lines
-        // side by side.
-        [NSBezierPath setDefaultLineWidth:NSHeight(slot) / count];
-        for (NSUInteger i = 0; i < count; ++i)
+        NSRect slot                = [self rectForPart:NSScrollerKnobSlot];
+        CoverStoryMissIndex *index = [_coverageData missIndex];
+        NSUInteger buckets         = (NSUInteger)ceil(NSHeight(slot));
+        if ([index missedLineCount] && buckets)
         {
-            CoverStoryCoverageLineData *data = _coverageData[i];
-            NSInteger hitCount               = [data hitCount];
-            if (hitCount == 0)
+            if ((index != self.missDensityIndex) || ([self.missDensity length] != buckets * sizeof(float)))
             {
-                CGFloat y = NSMinY(slot) + NSHeight(slot) * ((CGFloat)i / (CGFloat)count);
-                
-                [NSBezierPath strokeLineFromPoint:NSMakePoint(NSMinX(slot), y)
-                                          toPoint:NSMakePoint(NSMinX(slot) + NSWidth(slot), y)];
+                self.missDensity      = [NSMutableData dataWithLength:buckets * sizeof(float)];
+                self.missDensityIndex = index;
+                [index getMissDensity:[self.missDensity mutableBytes] bucketCount:buckets];
+            }
+            const float *density = [self.missDensity bytes];
+            CGFloat bucketHeight = NSHeight(slot) / buckets;
+            NSColor *red         = [NSColor redColor];
+            for (NSUInteger i = 0; i < buckets; ++i)
+            {
+                if (density[i] <= 0.0f)
+                {
+                    continue;
+                }
+                // A few missed lines in a big file still need to show up.
+                [[red colorWithAlphaComponent:0.8 * (0.4 + 0.6 * density[i])] set];
+                NSRect line = NSMakeRect(NSMinX(slot), NSMinY(slot) + bucketHeight * i,
+                                         NSWidth(slot), bucketHeight);
+                NSRectFillUsingOperation(line, NSCompositeSourceOver);
             }
         }
-        [NSBezierPath setDefaultLineWidth:oldLineWidth];
     }
     
     // call our superclass to draw the knob for us, over our coverage data.
     [self drawKnob];
 }
 
-- (void)setCoverageData:(NSArray *)coverageData
+- (void)setCoverageData:(CoverStoryCoverageFileData *)coverageData
 {
     if (coverageData != _coverageData)
     {
         _coverageData = coverageData;
+        // build the index now rather than on the first draw
+        [_coverageData missIndex];
         [self setNeedsDisplay:YES];
     }
 }
@@ -0,0 +1,40 @@
+//
+//  CoverStoryTracer.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// Spans for the stages of a load (gcov runs, parsing, merging, cleanup...),
+// w/ the thread each ran on and how long it sat in a queue first, written out
+// as Chrome trace-event JSON (chrome://tracing or Perfetto).  A tracer is only
+// made when tracing is turned on, and everything here takes a nil tracer, so
+// w/ it off a span costs a nil check and a message to nil.
+
+#import <Foundation/Foundation.h>
+
+@class CoverStoryTracer;
+
+// Timestamp to start a span (or note when work was queued), 0 w/o a tracer.
+uint64_t CoverStoryTraceNow(CoverStoryTracer *tracer);
+
+@interface CoverStoryTracer : NSObject
+
+// Drops what's been recorded, times are from here on.
+- (void)reset;
+
+// Records a span of |name| from |start| (from CoverStoryTraceNow) until now
+// on the current thread.  |queued| is when the work was queued up (0 if it
+// wasn't), |detail| the file or folder it was for (can be nil).  Safe to call
+// from any thread.
+- (void)endSpan:(NSString *)name start:(uint64_t)start queued:(uint64_t)queued detail:(NSString *)detail;
+
+- (NSUInteger)spanCount;
+
+- (NSData *)chromeTraceData;
+- (BOOL)writeChromeTraceToFile:(NSString *)path error:(NSError **)error;
+
+// The details w/ the most time in spans named any of |names| (added up per
+// detail), slowest first, as [detail, NSNumber of seconds] pairs.
+- (NSArray *)slowestDetailsForSpansNamed:(NSArray *)names limit:(NSUInteger)limit;
+
+@end
@@ -0,0 +1,223 @@
+//
+//  CoverStoryTracer.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "CoverStoryTracer.h"
+#include <pthread.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+// One span, the names and details are shared w/ the callers.
+@interface CSTraceSpan : NSObject {
+@public
+    NSString *_name;
+    NSString *_detail;
+    uint64_t _start;
+    uint64_t _end;
+    uint64_t _queued;
+    uint32_t _thread;
+}
+@end
+
+@implementation CSTraceSpan
+@end
+
+static const double kCSTraceNanosecondsPerMicrosecond = 1e3;
+static const double kCSTraceNanosecondsPerMillisecond = 1e6;
+static const double kCSTraceNanosecondsPerSecond      = 1e9;
+
+static uint64_t CSTraceNanoseconds(void)
+{
+#if defined(__APPLE__)
+    static mach_timebase_info_data_t s_timebase;
+    if (s_timebase.denom == 0)
+    {
+        mach_timebase_info(&s_timebase);
+    }
+    return mach_absolute_time() * s_timebase.numer / s_timebase.denom;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#endif
+}
+
+uint64_t CoverStoryTraceNow(CoverStoryTracer *tracer)
+{
+    return tracer ? CSTraceNanoseconds() : 0;
+}
+
+// Small numbers read better in the trace viewer than the system's thread ids.
+static uint32_t CSTraceThreadNumber(void)
+{
+    static uint32_t s_lastThread;
+    static __thread uint32_t t_thread;
+    if (t_thread == 0)
+    {
+        t_thread = __sync_add_and_fetch(&s_lastThread, 1);
+    }
+    return t_thread;
+}
+
+@interface CoverStoryTracer () {
+@private
+    pthread_mutex_t _lock;               // guards the rest
+    NSMutableArray *_spans;
+    NSMutableDictionary *_threadNames;   // NSNumber thread number -> name
+    uint64_t _origin;
+}
+@end
+
+@implementation CoverStoryTracer
+
+- (id)init
+{
+    if ((self = [super init]))
+    {
+        pthread_mutex_init(&_lock, NULL);
+        _spans       = [[NSMutableArray alloc] init];
+        _threadNames = [[NSMutableDictionary alloc] init];
+        _origin      = CSTraceNanoseconds();
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    pthread_mutex_destroy(&_lock);
+}
+
+- (void)reset
+{
+    pthread_mutex_lock(&_lock);
+    [_spans removeAllObjects];
+    [_threadNames removeAllObjects];
+    _origin = CSTraceNanoseconds();
+    pthread_mutex_unlock(&_lock);
+}
+
+- (void)endSpan:(NSString *)name start:(uint64_t)start queued:(uint64_t)queued detail:(NSString *)detail
+{
+    CSTraceSpan *span = [[CSTraceSpan alloc] init];
+    span->_end        = CSTraceNanoseconds();
+    span->_name       = name;
+    span->_detail     = detail;
+    span->_start      = start;
+    span->_queued     = queued;
+    span->_thread     = CSTraceThreadNumber();
+    NSNumber *thread  = @(span->_thread);
+    pthread_mutex_lock(&_lock);
+    // spans from before a reset aren't part of this load
+    if (start >= _origin)
+    {
+        [_spans addObject:span];
+        if (!_threadNames[thread])
+        {
+            NSThread *current    = [NSThread currentThread];
+            NSString *threadName = [current isMainThread] ? @"main" : [current name];
+            if (![threadName length])
+            {
+                threadName = [NSString stringWithFormat:@"worker %u", span->_thread];
+            }
+            _threadNames[thread] = threadName;
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+- (NSUInteger)spanCount
+{
+    pthread_mutex_lock(&_lock);
+    NSUInteger result = [_spans count];
+    pthread_mutex_unlock(&_lock);
+    return result;
+}
+
+- (NSData *)chromeTraceData
+{
+    pthread_mutex_lock(&_lock);
+    NSArray *spans            = [_spans copy];
+    NSDictionary *threadNames = [_threadNames copy];
+    uint64_t origin           = _origin;
+    pthread_mutex_unlock(&_lock);
+
+    NSNumber *pid          = @(getpid());
+    NSMutableArray *events = [NSMutableArray arrayWithCapacity:[spans count] + [threadNames count]];
+    for (NSNumber *thread in threadNames)
+    {
+        [events addObject:@{ @"name": @"thread_name", @"ph": @"M", @"pid": pid, @"tid": thread,
+                             @"args": @{ @"name": threadNames[thread] } }];
+    }
+    // microseconds, the unit the format uses
+    for (CSTraceSpan *span in spans)
+    {
+        NSMutableDictionary *args = [NSMutableDictionary dictionary];
+        if (span->_detail)
+        {
+            args[@"detail"] = span->_detail;
+        }
+        if (span->_queued && (span->_queued <= span->_start))
+        {
+            args[@"queueWaitMs"] = @((double)(span->_start - span->_queued) / kCSTraceNanosecondsPerMillisecond);
+        }
+        [events addObject:@{ @"name": span->_name,
+                             @"cat": @"load",
+                             @"ph": @"X",
+                             @"ts": @((double)(span->_start - origin) / kCSTraceNanosecondsPerMicrosecond),
+                             @"dur": @((double)(span->_end - span->_start) / kCSTraceNanosecondsPerMicrosecond),
+                             @"pid": pid,
+                             @"tid": @(span->_thread),
+                             @"args": args }];
+    }
+    return [NSJSONSerialization dataWithJSONObject:@{ @"traceEvents": events, @"displayTimeUnit": @"ms" }
+                                           options:0
+                                             error:NULL];
+}
+
+- (BOOL)writeChromeTraceToFile:(NSString *)path error:(NSError **)error
+{
+    NSData *data = [self chromeTraceData];
+    return data && [data writeToFile:path options:NSDataWritingAtomic error:error];
+}
+
+- (NSArray *)slowestDetailsForSpansNamed:(NSArray *)names limit:(NSUInteger)limit
+{
+    NSMutableDictionary *secondsByDetail = [NSMutableDictionary dictionary];
+    pthread_mutex_lock(&_lock);
+    for (CSTraceSpan *span in _spans)
+    {
+        if (span->_detail && [names containsObject:span->_name])
+        {
+            double seconds = (double)(span->_end - span->_start) / kCSTraceNanosecondsPerSecond;
+            secondsByDetail[span->_detail] = @([secondsByDetail[span->_detail] doubleValue] + seconds);
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+    NSArray *details = [secondsByDetail keysSortedByValueUsingComparator:^NSComparisonResult(id a, id b) {
+        return [b compare:a];
+    }];
+    NSMutableArray *result = [NSMutableArray array];
+    for (NSString *detail in details)
+    {
+        if ([result count] == limit)
+        {
+            break;
+        }
+        [result addObject:@[ detail, secondsByDetail[detail] ]];
+    }
+    return result;
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"%@ <%p>: %lu spans", [self class], self, (unsigned long)[self spanCount]];
+}
+
+@end
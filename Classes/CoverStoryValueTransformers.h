@@ -25,7 +25,8 @@
 @end
 
 // Transformer for changing line coverage to short summaries.
-// Used at top of file list.
+// Used at top of file list (w/ the list's CoverStoryCoverageTotals, or any
+// collection of file datas).
 @interface LineCoverageToCoverageShortSummaryTransformer : NSValueTransformer
 @end
 
@@ -8,7 +8,9 @@
 
 #import "CoverStoryValueTransformers.h"
 
+#import "CoverStoryCodeRenderingCache.h"
 #import "CoverStoryCoverageLineData.h"
+#import "CoverStoryCoverageTotals.h"
 #import "CoverStoryPreferenceKeys.h"
 #import "CoverStoryDocument.h"
 
@@ -34,43 +36,7 @@
     NSAssert([value isKindOfClass:[CoverStoryCoverageLineData class]], @"Only handle CoverStoryCoverageLineData");
     CoverStoryCoverageLineData *data = (CoverStoryCoverageLineData *)value;
     // Draw the hitcount
-    NSInteger count = [data hitCount];
-    
-    NSString *displayString  = @"";
-    NSDictionary *attributes = nil;
-    if (count != kCoverStoryNotExecutedMarker)
-    {
-        NSColor *color = nil;
-        NSMutableParagraphStyle *pStyle = [[NSParagraphStyle defaultParagraphStyle] mutableCopy];
-        [pStyle setAlignment:NSRightTextAlignment];
-        [pStyle setMinimumLineHeight:13];
-        
-        if (count == 0)
-        {
-            color = [NSColor redColor];
-        }
-        else
-        {
-            color = [NSColor colorWithDeviceWhite:0.4 alpha:1.0];
-        }
-        
-        attributes = @{NSParagraphStyleAttributeName : pStyle,
-                        NSForegroundColorAttributeName : color};
-        
-        if (count == kCoverStoryNonFeasibleMarker)
-        {
-            displayString = @"--"; // for non-feasible lines
-        }
-        else if (count < 999)
-        {
-            displayString = [NSString stringWithFormat:@"%ld", (long)count];
-        }
-        else
-        {
-            displayString = @"99+";
-        }
-    }
-    return [[NSAttributedString alloc] initWithString:displayString attributes:attributes];
+    return [[CoverStoryCodeRenderingCache sharedCache] hitCountStringForHitCount:[data hitCount]];
 }
 
 @end
@@ -100,49 +66,10 @@
     return NO;
 }
 
-- (NSColor *)defaultColorNamed:(NSString *)name
-{
-    NSColor *color = nil;
-    if (name)
-    {
-        NSUserDefaultsController *defaults = [NSUserDefaultsController sharedUserDefaultsController];
-        id values = [defaults values];
-        NSData *colorData = [values valueForKey:name];
-        if (colorData)
-        {
-            color = (NSColor *)[NSUnarchiver unarchiveObjectWithData:colorData];
-        }
-    }
-    return color;
-}
-
 - (id)transformedValue:(id)value
 {
     NSAssert([value isKindOfClass:[CoverStoryCoverageLineData class]], @"Only handle CoverStoryCoverageLineData");
-    CoverStoryCoverageLineData *data = (CoverStoryCoverageLineData *)value;
-    NSString *line = [data line];
-    NSInteger hitCount = [data hitCount];
-    NSString *colorName = nil;
-    
-    if (hitCount == 0)
-    {
-        colorName = kCoverStoryMissedLineColorKey;
-    }
-    else if (hitCount == kCoverStoryNotExecutedMarker)
-    {
-        colorName = kCoverStoryUnexecutableLineColorKey;
-    }
-    else if (hitCount == kCoverStoryNonFeasibleMarker)
-    {
-        colorName = kCoverStoryNonFeasibleLineColorKey;
-    }
-    else
-    {
-        colorName = kCoverStoryExecutedLineColorKey;
-    }
-    NSColor *textColor       = [self defaultColorNamed:colorName];
-    NSDictionary *attributes = @{NSForegroundColorAttributeName : textColor};
-    return [[NSAttributedString alloc] initWithString:line attributes:attributes];
+    return [[CoverStoryCodeRenderingCache sharedCache] sourceLineStringForLineData:(CoverStoryCoverageLineData *)value];
 }
 
 @end
@@ -261,37 +188,7 @@ const float kGoodCoverage = 75.0f;
 - (id)transformedValue:(id)value
 {
     NSAssert([value conformsToProtocol:@protocol(CoverStoryLineCoverageProtocol)], @"Only handle CoverStoryLineCoverageProtocol");
-    id<CoverStoryLineCoverageProtocol> data = (id<CoverStoryLineCoverageProtocol>)value;
-    NSInteger totalLines                    = 0;
-    NSInteger codeLines                     = 0;
-    NSInteger hitLines                      = 0;
-    NSInteger nonfeasible                   = 0;
-    NSString *coverage                      = nil;
-
-    [data coverageTotalLines:&totalLines
-                   codeLines:&codeLines
-                hitCodeLines:&hitLines
-            nonFeasibleLines:&nonfeasible
-              coverageString:&coverage
-                    coverage:NULL];
-    
-    NSString *statString = nil;
-    if (nonfeasible)
-    {
-        statString = [NSString stringWithFormat:
-                      @"Executed %@%% of %ld lines (%ld executed, %ld executable, "
-                      "%ld non-feasible, %ld total lines)", coverage,
-                      (long)codeLines, (long)hitLines, (long)codeLines,
-                      (long)nonfeasible, (long)totalLines];
-    }
-    else
-    {
-        statString = [NSString stringWithFormat:
-                      @"Executed %@%% of %ld lines (%ld executed, %ld executable, "
-                      "%ld total lines)", coverage, (long)codeLines, (long)hitLines,
-                      (long)codeLines, (long)totalLines];
-    }
-    return statString;
+    return coverageSummaryString((id<CoverStoryLineCoverageProtocol>)value);
 }
 
 @end
@@ -317,21 +214,32 @@ const float kGoodCoverage = 75.0f;
 {
     if (!value)
         return @"";
-    NSAssert1([value respondsToSelector:@selector(objectEnumerator)],
-              @"Only handle collections : %@", value);
-    NSEnumerator *arrayEnum = [value objectEnumerator];
-    NSInteger sources       = [value count];
-    NSInteger totalLines    = 0;
-    NSInteger codeLines     = 0;
-    NSInteger hitLines      = 0;
-    NSInteger nonfeasible   = 0;
-    NSString *coverage      = nil;
-    [arrayEnum coverageTotalLines:&totalLines
-                        codeLines:&codeLines
-                     hitCodeLines:&hitLines
-                 nonFeasibleLines:&nonfeasible
-                   coverageString:&coverage
-                         coverage:NULL];
+    // the file list's running totals, or a collection to add up
+    id<CoverStoryLineCoverageProtocol> data = nil;
+    NSInteger sources                       = 0;
+    if ([value isKindOfClass:[CoverStoryCoverageTotals class]])
+    {
+        data    = value;
+        sources = [value sourceCount];
+    }
+    else
+    {
+        NSAssert1([value respondsToSelector:@selector(objectEnumerator)],
+                  @"Only handle collections : %@", value);
+        data    = (id<CoverStoryLineCoverageProtocol>)[value objectEnumerator];
+        sources = [value count];
+    }
+    NSInteger totalLines  = 0;
+    NSInteger codeLines   = 0;
+    NSInteger hitLines    = 0;
+    NSInteger nonfeasible = 0;
+    NSString *coverage    = nil;
+    [data coverageTotalLines:&totalLines
+                   codeLines:&codeLines
+                hitCodeLines:&hitLines
+            nonFeasibleLines:&nonfeasible
+              coverageString:&coverage
+                    coverage:NULL];
     NSString *statString = nil;
     if (nonfeasible)
     {
@@ -372,18 +280,12 @@ const float kGoodCoverage = 75.0f;
     {
         return @"";
     }
-    NSAssert1([value respondsToSelector:@selector(objectEnumerator)], @"Only handle collections : %@", value);
-    NSEnumerator *arrayEnum = [value objectEnumerator];
-    NSInteger codeLines = 0;
-    NSString *coverage = nil;
-
-    [arrayEnum coverageTotalLines:NULL
-                        codeLines:&codeLines
-                     hitCodeLines:NULL
-                 nonFeasibleLines:NULL
-                   coverageString:&coverage
-                         coverage:NULL];
-    return [NSString stringWithFormat:@"%@%% of %ld lines", coverage, (long)codeLines];
+    if ([value isKindOfClass:[CoverStoryCoverageTotals class]])
+    {
+        return coverageShortSummaryStringForLineCounts([value lineCounts]);
+    }
+    NSAssert1([value conformsToProtocol:@protocol(NSFastEnumeration)], @"Only handle collections : %@", value);
+    return coverageShortSummaryString(value);
 }
 
 @end
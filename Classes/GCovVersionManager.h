@@ -17,25 +17,61 @@
 //  the License.
 //
 
-#import <Cocoa/Cocoa.h>
+#import <Foundation/Foundation.h>
 
 
 @interface GCovVersionManager : NSObject {
 @private
-    NSDictionary *_versionMap;
+    NSCondition *_discoveryCondition;  // guards the next four
+    NSDictionary *_versionMap;         // nil until the gcovs have been looked for
+    NSArray *_additionalSearchPaths;
+    BOOL _discovering;
+    NSUInteger _discoveryGeneration;   // bumped by -invalidate
+    NSMutableDictionary *_versionsByGCNO;  // guarded by itself
+    NSMutableDictionary *_versionsByGCov;  // guarded by itself
 }
 
 + (GCovVersionManager*)defaultManager;
 
+// Where gcov* is looked for when nothing else is said: /usr/bin, the
+// Developer directories, and the one `xcode-select -print-path` points at (or
+// $DEVELOPER_DIR).  Later folders win when they have the same version.
++ (NSArray*)defaultSearchPaths;
+
+// Searched after the default ones (so they win).  Setting them invalidates
+// what was found.
+@property (copy) NSArray *additionalSearchPaths;
+
+// Looking for the installed gcovs means listing a few folders and running
+// xcode-select, this starts that on a background thread so it's done by the
+// time the first load needs it (anything that needs it before then waits).
+// Without this it's done the first time it's needed.
+- (void)discoverInBackground;
+// Forgets the gcovs found and the versions read from gcda/gcno files, they're
+// looked for again when next needed.
+- (void)invalidate;
+
 // Installed gcovs
 - (NSString*)defaultGCovPath;
 - (NSArray*)installedVersions;
 
-// Extracting versions from gcda/gcno files.
+// Extracting versions from gcda/gcno files.  A gcda's version is remembered
+// under its gcno (until the gcno changes), so the headers are only read once
+// per build.
 - (NSString*)versionFromGCovFile:(NSString*)path;
 
+// What the gcov at |gcovPath| says it is (the first line of its --version),
+// nil if it couldn't be run.  Remembered until the binary changes, so a gcov
+// updated in place is noticed.
+- (NSString*)versionOfGCov:(NSString*)gcovPath;
+
 // Figures out the version and returns the right gcov path, if a matching
 // version number isn't found, uses the default.
 - (NSString*)gcovForGCovFile:(NSString*)path;
 
+// Splits |filenames| (in |folderPath|) up by the gcov to run them with, the
+// result maps the gcov paths to the filenames for each one (in the order
+// given).  Files w/ no gcov to use are under NSNull.
+- (NSDictionary*)filesByGCovForFiles:(NSArray*)filenames inFolder:(NSString*)folderPath;
+
 @end
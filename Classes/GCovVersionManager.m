@@ -7,56 +7,285 @@
 //
 
 #import "GCovVersionManager.h"
-#import "GTMObjectSingleton.h"
-#import "GTMNSEnumerator+Filter.h"
+#include <sys/stat.h>
+
+// What was read from a gcda/gcno (or a gcov), and what the file looked like
+// then.
+@interface GCovVersionRecord : NSObject {
+@public
+    NSString *_version;  // nil if the file didn't have a header
+    struct stat _stamp;
+}
+@end
+
+@implementation GCovVersionRecord
+@end
 
 @interface GCovVersionManager (PrivateMethods)
 + (NSMutableDictionary *)collectVersionsInFolder:(NSString *)path;
++ (NSString *)selectedDeveloperDirectory;
+- (void)discoverInThread:(id)unused;
+- (NSDictionary *)versionMap;
+- (NSDictionary *)discoverVersionsForGeneration:(NSUInteger *)generation;
+- (void)finishDiscovery:(NSDictionary *)map generation:(NSUInteger)generation;
+- (NSString *)readVersionFromGCovFile:(NSString *)path;
+- (NSString *)readVersionOfGCov:(NSString *)gcovPath;
 @end
 
 @implementation GCovVersionManager
 
-GTMOBJECT_SINGLETON_BOILERPLATE(GCovVersionManager, defaultManager);
++ (GCovVersionManager *)defaultManager
+{
+    // Plain Foundation (rather than GTMObjectSingleton) so the command line
+    // tool can build w/o the toolbox.
+    static GCovVersionManager *s_defaultManager = nil;
+    @synchronized(self)
+    {
+        if (!s_defaultManager)
+        {
+            s_defaultManager = [[self alloc] init];
+        }
+    }
+    return s_defaultManager;
+}
 
 - (id)init
 {
     if ((self = [super init]))
     {
-        // Start with what is in /usr/bin
-        NSMutableDictionary *map = [[self class] collectVersionsInFolder:@"/usr/bin"];
-        // Override it with what is in the Developer directory's /usr/bin.
-        // TODO: Should really use xcode-select -print-path as the starting point.
-        [map addEntriesFromDictionary:[[self class] collectVersionsInFolder:@"/Developer/usr/bin"]];
-        NSFileManager *fm = [NSFileManager defaultManager];
-        BOOL isDir = NO;
-        if ([fm fileExistsAtPath:@"/Applications/Xcode.app" isDirectory:&isDir] && isDir)
+        _discoveryCondition = [[NSCondition alloc] init];
+        _versionsByGCNO     = [[NSMutableDictionary alloc] init];
+        _versionsByGCov     = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
++ (NSArray *)defaultSearchPaths
+{
+    // Start with what is in /usr/bin, override it with what is in the
+    // Developer directory's /usr/bin.
+    NSMutableArray *result = [NSMutableArray arrayWithObjects:
+                              @"/usr/bin",
+                              @"/Developer/usr/bin",
+                              @"/Applications/Xcode.app/Contents/Developer/usr/bin",
+                              nil];
+    // The selected Xcode (and its toolchain) wins over all of those.
+    NSString *developerDir = [self selectedDeveloperDirectory];
+    if ([developerDir length])
+    {
+        NSArray *selected = @[ [developerDir stringByAppendingPathComponent:@"usr/bin"],
+                               [developerDir stringByAppendingPathComponent:
+                                @"Toolchains/XcodeDefault.xctoolchain/usr/bin"] ];
+        [result removeObjectsInArray:selected];
+        [result addObjectsFromArray:selected];
+    }
+    return result;
+}
+
++ (NSString *)selectedDeveloperDirectory
+{
+    NSString *result = [[NSProcessInfo processInfo] environment][@"DEVELOPER_DIR"];
+    if ([result length])
+    {
+        return [result stringByStandardizingPath];
+    }
+    NSString *xcodeSelect = @"/usr/bin/xcode-select";
+    NSFileManager *fm     = [[NSFileManager alloc] init];
+    if (![fm isExecutableFileAtPath:xcodeSelect])
+    {
+        return nil;
+    }
+    NSTask *task        = [[NSTask alloc] init];
+    NSPipe *stdOutPipe  = [NSPipe pipe];
+    [task setLaunchPath:xcodeSelect];
+    [task setArguments:@[ @"-print-path" ]];
+    [task setStandardOutput:stdOutPipe];
+    [task setStandardError:[NSFileHandle fileHandleWithNullDevice]];
+    @try {
+        [task launch];
+        NSData *stdOutData = [[stdOutPipe fileHandleForReading] readDataToEndOfFile];
+        [task waitUntilExit];
+        if ([task terminationStatus] == 0)
         {
-            [map addEntriesFromDictionary:[[self class] collectVersionsInFolder:@"/Applications/Xcode.app/Contents/Developer/usr/bin"]];
+            NSString *stdOut = [[NSString alloc] initWithData:stdOutData encoding:NSUTF8StringEncoding];
+            result = [stdOut stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
         }
+    }
+    @catch (NSException *e) {
+        NSLog(@"failed to run %@ (%@ - %@)", xcodeSelect, [e name], [e reason]);
+    }
+    return [result length] ? result : nil;
+}
+
+- (NSArray *)additionalSearchPaths
+{
+    [_discoveryCondition lock];
+    NSArray *result = _additionalSearchPaths;
+    [_discoveryCondition unlock];
+    return result;
+}
+
+- (void)setAdditionalSearchPaths:(NSArray *)searchPaths
+{
+    [_discoveryCondition lock];
+    _additionalSearchPaths = [searchPaths copy];
+    [_discoveryCondition unlock];
+    [self invalidate];
+}
+
+- (void)discoverInBackground
+{
+    [_discoveryCondition lock];
+    BOOL start = (!_versionMap && !_discovering);
+    if (start)
+    {
+        _discovering = YES;
+    }
+    [_discoveryCondition unlock];
+    if (start)
+    {
+        [NSThread detachNewThreadSelector:@selector(discoverInThread:)
+                                 toTarget:self
+                               withObject:nil];
+    }
+}
+
+- (void)discoverInThread:(id)unused
+{
+    @autoreleasepool {
+        NSUInteger generation = 0;
+        NSDictionary *map     = [self discoverVersionsForGeneration:&generation];
+        [self finishDiscovery:map generation:generation];
+    }
+}
+
+- (void)invalidate
+{
+    [_discoveryCondition lock];
+    // a search that's running now is thrown away when it finishes
+    _versionMap = nil;
+    ++_discoveryGeneration;
+    [_discoveryCondition unlock];
+    @synchronized(_versionsByGCNO)
+    {
+        [_versionsByGCNO removeAllObjects];
+    }
+    @synchronized(_versionsByGCov)
+    {
+        [_versionsByGCov removeAllObjects];
+    }
+}
+
+// Looks through the search paths, |*generation| is set to the one they were
+// read in.
+- (NSDictionary *)discoverVersionsForGeneration:(NSUInteger *)generation
+{
+    [_discoveryCondition lock];
+    NSArray *additionalSearchPaths = _additionalSearchPaths;
+    *generation                    = _discoveryGeneration;
+    [_discoveryCondition unlock];
+    NSMutableDictionary *map = [NSMutableDictionary dictionary];
+    NSArray *searchPaths     = [[[self class] defaultSearchPaths]
+                                arrayByAddingObjectsFromArray:additionalSearchPaths ?: @[]];
+    for (NSString *searchPath in searchPaths)
+    {
+        [map addEntriesFromDictionary:[[self class] collectVersionsInFolder:searchPath]];
+    }
+    return map;
+}
+
+- (void)finishDiscovery:(NSDictionary *)map generation:(NSUInteger)generation
+{
+    [_discoveryCondition lock];
+    if (generation == _discoveryGeneration)
+    {
         _versionMap = [map copy];
     }
-    return self;
+    _discovering = NO;
+    [_discoveryCondition broadcast];
+    [_discoveryCondition unlock];
 }
 
+// Waits for (or does) the search if it hasn't been done yet.
+- (NSDictionary *)versionMap
+{
+    [_discoveryCondition lock];
+    while (!_versionMap)
+    {
+        if (_discovering)
+        {
+            [_discoveryCondition wait];
+            continue;
+        }
+        _discovering = YES;
+        [_discoveryCondition unlock];
+        NSUInteger generation = 0;
+        NSDictionary *map     = [self discoverVersionsForGeneration:&generation];
+        [self finishDiscovery:map generation:generation];
+        [_discoveryCondition lock];
+    }
+    NSDictionary *result = _versionMap;
+    [_discoveryCondition unlock];
+    return result;
+}
 
 - (NSString *)defaultGCovPath
 {
-    return [_versionMap objectForKey:@""];
+    return [[self versionMap] objectForKey:@""];
 }
 
 - (NSArray *)installedVersions
 {
-    return [_versionMap allValues];
+    return [[self versionMap] allValues];
 }
 
 - (NSString *)versionFromGCovFile:(NSString *)path
+{
+    if (![path length])
+    {
+        return nil;
+    }
+    // The gcda is written by the same compiler as its gcno, so a version is
+    // good until the gcno is rebuilt (a test run rewriting the gcda doesn't
+    // change it).  W/o a gcno the file itself has to stay the same.
+    NSString *gcnoPath = [[path stringByDeletingPathExtension] stringByAppendingPathExtension:@"gcno"];
+    struct stat stamp;
+    if ((stat([gcnoPath fileSystemRepresentation], &stamp) != 0) &&
+        (stat([path fileSystemRepresentation], &stamp) != 0))
+    {
+        return nil;
+    }
+    GCovVersionRecord *record = nil;
+    @synchronized(_versionsByGCNO)
+    {
+        record = _versionsByGCNO[gcnoPath];
+    }
+    if (record &&
+        (record->_stamp.st_ino == stamp.st_ino) &&
+        (record->_stamp.st_size == stamp.st_size) &&
+        (record->_stamp.st_mtime == stamp.st_mtime) &&
+        (record->_stamp.st_ctime == stamp.st_ctime))
+    {
+        return record->_version;
+    }
+    record           = [[GCovVersionRecord alloc] init];
+    record->_version = [self readVersionFromGCovFile:path];
+    record->_stamp   = stamp;
+    @synchronized(_versionsByGCNO)
+    {
+        _versionsByGCNO[gcnoPath] = record;
+    }
+    return record->_version;
+}
+
+- (NSString *)readVersionFromGCovFile:(NSString *)path
 {
     NSString *result = nil;
     
-    uint32 GCDA_HEADER              = 'gcda';
-    uint32 GCDA_HEADER_WRONG_ENDIAN = 'adcg';
-    uint32 GCNO_HEADER              = 'gcno';
-    uint32 GCNO_HEADER_WRONG_ENDIAN = 'oncg';
+    uint32_t GCDA_HEADER              = 'gcda';
+    uint32_t GCDA_HEADER_WRONG_ENDIAN = 'adcg';
+    uint32_t GCNO_HEADER              = 'gcno';
+    uint32_t GCNO_HEADER_WRONG_ENDIAN = 'oncg';
     
     // Read in the file header and version number.
     if ([path length])
@@ -67,8 +296,8 @@ GTMOBJECT_SINGLETON_BOILERPLATE(GCovVersionManager, defaultManager);
             FILE *aFile = fopen(cPath, "r");
             if (aFile)
             {
-                uint32 buffer[2];
-                if (fread(buffer, sizeof(uint32), 2, aFile) == 2)
+                uint32_t buffer[2];
+                if (fread(buffer, sizeof(uint32_t), 2, aFile) == 2)
                 {
                     // Check the header.
                     if ((buffer[0] == GCDA_HEADER) ||
@@ -76,7 +305,7 @@ GTMOBJECT_SINGLETON_BOILERPLATE(GCovVersionManager, defaultManager);
                         (buffer[0] == GCNO_HEADER) ||
                         (buffer[0] == GCNO_HEADER_WRONG_ENDIAN))
                     {
-                        uint32 ver = buffer[1];
+                        uint32_t ver = buffer[1];
                         BOOL flip  = ((buffer[0] == GCDA_HEADER_WRONG_ENDIAN) ||
                                       (buffer[0] == GCNO_HEADER_WRONG_ENDIAN));
                         if (flip)
@@ -88,10 +317,10 @@ GTMOBJECT_SINGLETON_BOILERPLATE(GCovVersionManager, defaultManager);
                             ((ver & 0x000000ff) << 24);
                         }
                         
-                        uint32 major    = ((ver & 0xff000000) >> 24) - '0';
-                        uint32 minor10s = ((ver & 0x00ff0000) >> 16) - '0';
-                        uint32 minor1s  = ((ver & 0x0000ff00) >> 8) - '0';
-                        uint32 minor    = minor10s * 10 + minor1s;
+                        uint32_t major    = ((ver & 0xff000000) >> 24) - '0';
+                        uint32_t minor10s = ((ver & 0x00ff0000) >> 16) - '0';
+                        uint32_t minor1s  = ((ver & 0x0000ff00) >> 8) - '0';
+                        uint32_t minor    = minor10s * 10 + minor1s;
                         result = [NSString stringWithFormat:@"%u.%u", major, minor];
                     }
                 }
@@ -102,13 +331,88 @@ GTMOBJECT_SINGLETON_BOILERPLATE(GCovVersionManager, defaultManager);
     return result;
 }
 
+- (NSString *)versionOfGCov:(NSString *)gcovPath
+{
+    struct stat stamp;
+    if (![gcovPath length] || (stat([gcovPath fileSystemRepresentation], &stamp) != 0))
+    {
+        return nil;
+    }
+    GCovVersionRecord *record = nil;
+    @synchronized(_versionsByGCov)
+    {
+        record = _versionsByGCov[gcovPath];
+    }
+    if (record &&
+        (record->_stamp.st_ino == stamp.st_ino) &&
+        (record->_stamp.st_size == stamp.st_size) &&
+        (record->_stamp.st_mtime == stamp.st_mtime) &&
+        (record->_stamp.st_ctime == stamp.st_ctime))
+    {
+        return record->_version;
+    }
+    record           = [[GCovVersionRecord alloc] init];
+    record->_version = [self readVersionOfGCov:gcovPath];
+    record->_stamp   = stamp;
+    @synchronized(_versionsByGCov)
+    {
+        _versionsByGCov[gcovPath] = record;
+    }
+    return record->_version;
+}
+
+- (NSString *)readVersionOfGCov:(NSString *)gcovPath
+{
+    NSTask *task = [[NSTask alloc] init];
+    NSPipe *pipe = [NSPipe pipe];
+    [task setLaunchPath:gcovPath];
+    [task setArguments:@[ @"--version" ]];
+    [task setStandardOutput:pipe];
+    [task setStandardError:[NSFileHandle fileHandleWithNullDevice]];
+    @try {
+        [task launch];
+    }
+    @catch (NSException *e) {
+        return nil;
+    }
+    NSData *output = [[pipe fileHandleForReading] readDataToEndOfFile];
+    [task waitUntilExit];
+    if ([task terminationStatus] != 0)
+    {
+        return nil;
+    }
+    NSString *text  = [[NSString alloc] initWithData:output encoding:NSUTF8StringEncoding];
+    NSString *first = [[text componentsSeparatedByString:@"\n"] firstObject];
+    first           = [first stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+    return [first length] ? first : nil;
+}
+
 - (NSString *)gcovForGCovFile:(NSString *)path
 {
     NSString *version = [self versionFromGCovFile:path];
-    NSString *result  = [_versionMap objectForKey:version];
+    NSDictionary *map = [self versionMap];
+    NSString *result  = version ? [map objectForKey:version] : nil;
     if (!result)
     {
-        result = [self defaultGCovPath];
+        result = [map objectForKey:@""];
+    }
+    return result;
+}
+
+- (NSDictionary *)filesByGCovForFiles:(NSArray *)filenames inFolder:(NSString *)folderPath
+{
+    NSMutableDictionary *result = [NSMutableDictionary dictionary];
+    for (NSString *filename in filenames)
+    {
+        NSString *gcovPath    = [self gcovForGCovFile:[folderPath stringByAppendingPathComponent:filename]];
+        id key                = gcovPath ?: [NSNull null];
+        NSMutableArray *files = result[key];
+        if (!files)
+        {
+            files       = [NSMutableArray array];
+            result[key] = files;
+        }
+        [files addObject:filename];
     }
     return result;
 }
@@ -121,16 +425,16 @@ GTMOBJECT_SINGLETON_BOILERPLATE(GCovVersionManager, defaultManager);
     // thread safe.
     NSFileManager *fm = [[NSFileManager alloc] init];
     NSDirectoryEnumerator *enumerator = [fm enumeratorAtPath:path];
-    // ...filter to gcov* apps...
-    NSEnumerator *enumerator2 = [enumerator gtm_filteredEnumeratorByMakingEachObjectPerformSelector:@selector(hasPrefix:)
-                                                                                         withObject:@"gcov"];
-    // ...turn them all into full paths...
-    NSEnumerator *enumerator3 = [enumerator2 gtm_enumeratorByTarget:path
-                                              performOnEachSelector:@selector(stringByAppendingPathComponent:)];
-
-    // ...walk over them validating they are good to use.
-    for (NSString *gcovPath in enumerator3)
+    for (NSString *relativePath in enumerator)
     {
+        // ...filter to gcov* apps...
+        if (![relativePath hasPrefix:@"gcov"])
+        {
+            continue;
+        }
+        // ...turn them into full paths and validate they are good to use.
+        NSString *gcovPath = [path stringByAppendingPathComponent:relativePath];
+        
         // Must be executable.
         if (![fm isExecutableFileAtPath:gcovPath])
         {
@@ -0,0 +1,1010 @@
+//
+//  coverstory-bench.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// Benchmarks for the coverage pipeline.  Generates a corpus of .gcov files
+// (and, when there's a compiler, a real tree of .gcda/.gcno files), then times
+// each stage on its own the way the app drives it: finding the files, running
+// gcov, parsing, merging into a set, filtering, adding up the totals, and the
+// HTML export.  Each stage is run --repeat times, the results can be written
+// as JSON, and --compare checks them against a stored run and exits non-zero
+// if a stage got slower than the tolerance.  Only needs Foundation, like
+// coverstory-cli.
+
+#import <Foundation/Foundation.h>
+#import "CoverStoryCoverageSet.h"
+#import "CoverStoryCoverageFileData.h"
+#import "CoverStoryFilePredicate.h"
+#import "CoverStoryHTMLExporter.h"
+#import "GCovVersionManager.h"
+#import "CodeCoverage.h"
+#include <errno.h>
+#include <float.h>
+#include <getopt.h>
+#include <stdio.h>
+
+#ifndef COVERSTORY_RESOURCE_DIR
+#define COVERSTORY_RESOURCE_DIR "../Resources"
+#endif
+
+enum {
+    kCSBenchExitSuccess    = 0,
+    kCSBenchExitFailure    = 1,  // bad arguments, or the corpus couldn't be made
+    kCSBenchExitRegression = 3,  // a stage is slower than the baseline allows
+};
+
+// Results files w/ another format version aren't compared against.
+static const NSInteger kCSBenchFormatVersion = 1;
+// Differences smaller than this are noise, whatever the percentage.
+static const NSTimeInterval kCSBenchNoiseFloor = 0.002;
+// The set gets file datas in batches this big (about what the delivery queue
+// hands the document).
+static const NSUInteger kCSBenchMergeBatch = 64;
+
+// What to generate.
+typedef struct {
+    NSUInteger files;         // units (one .c each)
+    NSUInteger lines;         // per unit
+    NSUInteger folders;       // the units are spread over
+    NSUInteger headers;       // shared headers, each w/ a .gcov in every unit that includes it
+    NSUInteger includes;      // headers each unit includes
+    NSUInteger headerLines;
+    double unexecutable;      // fraction of the lines that aren't code
+    double missed;            // fraction of the code lines that weren't hit
+    NSUInteger maxHits;       // hit lines get 1...maxHits, skewed low
+    double nonFeasible;       // fraction of the lines w/ a COV_NF_LINE marker
+    NSUInteger gcdaUnits;     // units in the compiled tree, 0 for none
+    uint64_t seed;
+} CSBenchConfig;
+
+// Deterministic (and the same everywhere) so a corpus can be made again.
+static uint64_t CSBenchRandom(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double CSBenchRandomFraction(uint64_t *state)
+{
+    return (double)(CSBenchRandom(state) >> 11) / (double)(1ULL << 53);
+}
+
+// Most hit lines run a few times, a few run a lot.
+static uint64_t CSBenchHitCount(uint64_t *state, NSUInteger maxHits)
+{
+    double fraction = CSBenchRandomFraction(state);
+    return 1 + (uint64_t)((double)(MAX(maxHits, (NSUInteger)1) - 1) * fraction * fraction * fraction);
+}
+
+static NSString *CSBenchSourceLine(NSUInteger x, uint64_t variant)
+{
+    switch (variant % 6)
+    {
+        case 0:
+            return [NSString stringWithFormat:@"    result = Function%lu(argument, %lu);",
+                    (unsigned long)(x % 997), (unsigned long)x];
+        case 1:
+            return [NSString stringWithFormat:@"    if (count > %lu && (flags & kFlag%lu)) {",
+                    (unsigned long)x, (unsigned long)(x % 31)];
+        case 2:
+            return @"        return \"<escaped> & 'quoted'\";";
+        case 3:
+            return [NSString stringWithFormat:@"\tfor (i = 0; i < %lu; ++i)  // loop", (unsigned long)(x % 64)];
+        case 4:
+            return @"    }";
+        default:
+            return [NSString stringWithFormat:@"    total += values[%lu];", (unsigned long)(x % 128)];
+    }
+}
+
+// Writes one .gcov file, |random| picks the hits (and, for a unit, the text).
+static BOOL CSBenchWriteGCovFile(NSString *path,
+                                 NSString *sourcePath,
+                                 NSUInteger lineCount,
+                                 uint64_t textSeed,
+                                 uint64_t *random,
+                                 const CSBenchConfig *config)
+{
+    FILE *file = fopen([path fileSystemRepresentation], "w");
+    if (!file)
+    {
+        return NO;
+    }
+    fprintf(file, "        -:    0:Source:%s\n", [sourcePath UTF8String]);
+    fprintf(file, "        -:    0:Graph:%s.gcno\n", [[sourcePath lastPathComponent] UTF8String]);
+    fprintf(file, "        -:    0:Data:%s.gcda\n", [[sourcePath lastPathComponent] UTF8String]);
+    fprintf(file, "        -:    0:Runs:1\n");
+    fprintf(file, "        -:    0:Programs:1\n");
+    // the text only depends on |textSeed|, so a header reads the same in
+    // every unit (and merges)
+    uint64_t text = textSeed | 1;
+    for (NSUInteger x = 0; x < lineCount; ++x)
+    {
+        @autoreleasepool {
+            uint64_t variant  = CSBenchRandom(&text);
+            BOOL nonFeasible  = (CSBenchRandomFraction(&text) < config->nonFeasible);
+            BOOL unexecutable = (CSBenchRandomFraction(&text) < config->unexecutable);
+            NSString *line    = CSBenchSourceLine(x, variant);
+            if (nonFeasible)
+            {
+                line = [line stringByAppendingString:@"  // COV_NF_LINE"];
+            }
+            const char *source = [line UTF8String];
+            if (unexecutable)
+            {
+                fprintf(file, "        -:%5lu:%s\n", (unsigned long)x + 1, source);
+            }
+            else if (CSBenchRandomFraction(random) < config->missed)
+            {
+                fprintf(file, "    #####:%5lu:%s\n", (unsigned long)x + 1, source);
+            }
+            else
+            {
+                fprintf(file, "%9llu:%5lu:%s\n", (unsigned long long)CSBenchHitCount(random, config->maxHits),
+                        (unsigned long)x + 1, source);
+            }
+        }
+    }
+    BOOL result = (ferror(file) == 0);
+    return (fclose(file) == 0) && result;
+}
+
+// <corpus>/gcov/dirNN/unitNNNNN.c.gcov, and the includes named the way gcov
+// -l names them, unitNNNNN.c.gcda##headerNN.h.gcov.
+static BOOL CSBenchMakeGCovCorpus(NSString *dir, const CSBenchConfig *config)
+{
+    NSFileManager *fm  = [[NSFileManager alloc] init];
+    uint64_t random    = config->seed | 1;
+    NSUInteger folders = MAX(config->folders, (NSUInteger)1);
+    for (NSUInteger x = 0; x < config->files; ++x)
+    {
+        @autoreleasepool {
+            NSString *folder = [dir stringByAppendingPathComponent:
+                                [NSString stringWithFormat:@"dir%02lu", (unsigned long)(x % folders)]];
+            if ((x < folders) &&
+                ![fm createDirectoryAtPath:folder withIntermediateDirectories:YES attributes:nil error:NULL])
+            {
+                return NO;
+            }
+            NSString *unit = [NSString stringWithFormat:@"unit%05lu.c", (unsigned long)x];
+            if (!CSBenchWriteGCovFile([folder stringByAppendingPathComponent:[unit stringByAppendingString:@".gcov"]],
+                                      [@"/bench/src" stringByAppendingPathComponent:unit],
+                                      config->lines, CSBenchRandom(&random), &random, config))
+            {
+                return NO;
+            }
+            for (NSUInteger y = 0; (y < config->includes) && (y < config->headers); ++y)
+            {
+                NSUInteger headerIndex = (x + y) % config->headers;
+                NSString *header       = [NSString stringWithFormat:@"header%02lu.h", (unsigned long)headerIndex];
+                NSString *name         = [NSString stringWithFormat:@"%@.gcda##%@.gcov", unit, header];
+                if (!CSBenchWriteGCovFile([folder stringByAppendingPathComponent:name],
+                                          [@"/bench/include" stringByAppendingPathComponent:header],
+                                          config->headerLines, config->seed + headerIndex + 1, &random, config))
+                {
+                    return NO;
+                }
+            }
+        }
+    }
+    return YES;
+}
+
+// Runs |launchPath| in |dir|, NO if it couldn't be run or failed.
+static BOOL CSBenchRun(NSString *launchPath, NSArray *arguments, NSString *dir)
+{
+    NSTask *task = [[NSTask alloc] init];
+    [task setLaunchPath:launchPath];
+    [task setArguments:arguments];
+    [task setCurrentDirectoryPath:dir];
+    [task setStandardOutput:[NSFileHandle fileHandleWithNullDevice]];
+    [task setStandardError:[NSFileHandle fileHandleWithNullDevice]];
+    @try {
+        [task launch];
+        [task waitUntilExit];
+    }
+    @catch (NSException *e) {
+        return NO;
+    }
+    return [task terminationStatus] == 0;
+}
+
+static NSString *CSBenchFindExecutable(NSString *name)
+{
+    if ([name isAbsolutePath])
+    {
+        return [[NSFileManager defaultManager] isExecutableFileAtPath:name] ? name : nil;
+    }
+    NSString *searchPath = [[NSProcessInfo processInfo] environment][@"PATH"];
+    for (NSString *folder in [searchPath componentsSeparatedByString:@":"])
+    {
+        NSString *path = [folder stringByAppendingPathComponent:name];
+        if ([folder length] && [[NSFileManager defaultManager] isExecutableFileAtPath:path])
+        {
+            return path;
+        }
+    }
+    return nil;
+}
+
+// Compiles |config->gcdaUnits| small units w/ --coverage into <dir> and runs
+// the program once, so there's a .gcda/.gcno pair for each.  Returns the gcda
+// names, nil if there's no compiler (or it didn't work).
+static NSArray *CSBenchMakeGCDATree(NSString *dir, NSString *compiler, const CSBenchConfig *config)
+{
+    NSString *cc = CSBenchFindExecutable(compiler);
+    if (!cc || (config->gcdaUnits == 0))
+    {
+        return nil;
+    }
+    NSFileManager *fm = [[NSFileManager alloc] init];
+    if (![fm createDirectoryAtPath:dir withIntermediateDirectories:YES attributes:nil error:NULL])
+    {
+        return nil;
+    }
+    NSMutableString *mainSource = [NSMutableString stringWithString:@"int main(void) {\n  long total = 0;\n"];
+    NSMutableArray *objects     = [NSMutableArray array];
+    NSMutableArray *gcdaNames   = [NSMutableArray array];
+    NSUInteger branches         = MAX(config->lines / 8, (NSUInteger)1);
+    for (NSUInteger x = 0; x < config->gcdaUnits; ++x)
+    {
+        NSString *unit          = [NSString stringWithFormat:@"unit%05lu", (unsigned long)x];
+        NSMutableString *source = [NSMutableString stringWithFormat:@"long %@(long value) {\n  long total = 0;\n", unit];
+        for (NSUInteger y = 0; y < branches; ++y)
+        {
+            // about half the branches are taken
+            [source appendFormat:@"  if ((value + %lu) %% 2 == 0) {\n    total += %lu;\n  } else {\n    total -= value;\n  }\n",
+                                 (unsigned long)(y * 7 + x), (unsigned long)y];
+        }
+        [source appendString:@"  return total;\n}\n"];
+        NSString *sourceName = [unit stringByAppendingPathExtension:@"c"];
+        if (![source writeToFile:[dir stringByAppendingPathComponent:sourceName]
+                      atomically:NO
+                        encoding:NSUTF8StringEncoding
+                           error:NULL] ||
+            !CSBenchRun(cc, @[ @"--coverage", @"-O0", @"-c", sourceName ], dir))
+        {
+            return nil;
+        }
+        [mainSource insertString:[NSString stringWithFormat:@"long %@(long);\n", unit] atIndex:0];
+        [mainSource appendFormat:@"  total += %@(%lu);\n", unit, (unsigned long)x];
+        [objects addObject:[unit stringByAppendingPathExtension:@"o"]];
+        [gcdaNames addObject:[unit stringByAppendingPathExtension:@"gcda"]];
+    }
+    [mainSource appendString:@"  return total == 42;\n}\n"];
+    if (![mainSource writeToFile:[dir stringByAppendingPathComponent:@"main.c"]
+                      atomically:NO
+                        encoding:NSUTF8StringEncoding
+                           error:NULL])
+    {
+        return nil;
+    }
+    NSArray *linkArguments = [@[ @"--coverage", @"-O0", @"-o", @"bench", @"main.c" ] arrayByAddingObjectsFromArray:objects];
+    if (!CSBenchRun(cc, linkArguments, dir))
+    {
+        return nil;
+    }
+    // the exit status is whatever the totals came to
+    CSBenchRun([dir stringByAppendingPathComponent:@"bench"], @[], dir);
+    for (NSString *name in gcdaNames)
+    {
+        if (![fm fileExistsAtPath:[dir stringByAppendingPathComponent:name]])
+        {
+            return nil;
+        }
+    }
+    return gcdaNames;
+}
+
+// Counts what goes wrong (a merge that fails is a bug in the generator).
+@interface CSBenchReceiver : NSObject<CoverStoryCoverageProcessingProtocol> {
+@public
+    NSUInteger _errorCount;
+    NSUInteger _warningCount;
+}
+@end
+
+@implementation CSBenchReceiver
+
+- (void)coverageErrorForPath:(NSString *)path message:(NSString *)format, ...
+{
+    @synchronized(self)
+    {
+        if (_errorCount++ == 0)
+        {
+            va_list list;
+            va_start(list, format);
+            NSString *message = [[NSString alloc] initWithFormat:format arguments:list];
+            va_end(list);
+            fprintf(stderr, "%s: error: %s\n", [path UTF8String], [message UTF8String]);
+        }
+    }
+}
+
+- (void)coverageWarningForPath:(NSString *)path message:(NSString *)format, ...
+{
+    @synchronized(self)
+    {
+        ++_warningCount;
+    }
+}
+
+@end
+
+// The times for one stage across the repeats.
+@interface CSBenchStage : NSObject {
+@public
+    NSString *_name;
+    NSMutableArray *_seconds;
+    NSUInteger _items;       // files the stage handled (per repeat)
+    NSUInteger _lines;       // source lines, where that means something
+}
+@end
+
+@implementation CSBenchStage
+
+- (NSTimeInterval)median
+{
+    NSArray *sorted  = [_seconds sortedArrayUsingSelector:@selector(compare:)];
+    NSUInteger count = [sorted count];
+    if (count == 0)
+    {
+        return 0;
+    }
+    if (count % 2)
+    {
+        return [sorted[count / 2] doubleValue];
+    }
+    return ([sorted[count / 2 - 1] doubleValue] + [sorted[count / 2] doubleValue]) / 2;
+}
+
+- (NSDictionary *)dictionary
+{
+    NSTimeInterval median       = [self median];
+    NSMutableDictionary *result = [NSMutableDictionary dictionary];
+    result[@"seconds"]          = _seconds;
+    result[@"min"]              = [_seconds valueForKeyPath:@"@min.self"] ?: @0;
+    result[@"median"]           = @(median);
+    result[@"items"]            = @(_items);
+    result[@"itemsPerSecond"]   = @(median > 0 ? _items / median : 0);
+    if (_lines)
+    {
+        result[@"lines"]          = @(_lines);
+        result[@"linesPerSecond"] = @(median > 0 ? _lines / median : 0);
+    }
+    return result;
+}
+
+@end
+
+// Runs the stages over a corpus, --repeat times.
+@interface CSBenchRunner : NSObject {
+@public
+    NSString *_gcovCorpus;
+    NSString *_gcdaTree;       // nil if there isn't one
+    NSArray *_gcdaNames;
+    NSString *_scratchDir;
+    NSString *_resourceDir;
+    NSUInteger _jobs;
+    NSString *_filter;
+    NSMutableDictionary *_stages;  // name -> CSBenchStage
+    NSMutableArray *_stageOrder;
+    CSBenchReceiver *_receiver;
+}
+- (void)runOnce;
+- (NSArray *)stages;  // of CSBenchStage, in the order they ran
+@end
+
+@implementation CSBenchRunner
+
+- (id)init
+{
+    if ((self = [super init]))
+    {
+        _stages     = [[NSMutableDictionary alloc] init];
+        _stageOrder = [[NSMutableArray alloc] init];
+        _receiver   = [[CSBenchReceiver alloc] init];
+    }
+    return self;
+}
+
+- (void)record:(NSString *)name seconds:(NSTimeInterval)seconds items:(NSUInteger)items lines:(NSUInteger)lines
+{
+    CSBenchStage *stage = _stages[name];
+    if (!stage)
+    {
+        stage           = [[CSBenchStage alloc] init];
+        stage->_name    = name;
+        stage->_seconds = [NSMutableArray array];
+        _stages[name]   = stage;
+        [_stageOrder addObject:name];
+    }
+    [stage->_seconds addObject:@(seconds)];
+    stage->_items = items;
+    stage->_lines = lines;
+}
+
+// Same walk processCoverageForFolder: does: everything under the folder w/
+// the extension, sorted, and batched up by the folder they're in.
+static NSDictionary *CSBenchDiscover(NSString *path, NSString *extension, NSUInteger *outCount)
+{
+    NSFileManager *fm            = [[NSFileManager alloc] init];
+    NSMutableArray *allFilePaths = [NSMutableArray array];
+    for (NSString *relativePath in [fm enumeratorAtPath:path])
+    {
+        if ([relativePath hasSuffix:extension])
+        {
+            [allFilePaths addObject:[path stringByAppendingPathComponent:relativePath]];
+        }
+    }
+    [allFilePaths sortUsingSelector:@selector(compare:)];
+    NSMutableDictionary *filesByFolder = [NSMutableDictionary dictionary];
+    for (NSString *filePath in allFilePaths)
+    {
+        NSString *folder      = [filePath stringByDeletingLastPathComponent];
+        NSMutableArray *files = filesByFolder[folder];
+        if (!files)
+        {
+            files                 = [NSMutableArray array];
+            filesByFolder[folder] = files;
+        }
+        [files addObject:[filePath lastPathComponent]];
+    }
+    *outCount = [allFilePaths count];
+    return filesByFolder;
+}
+
+// gcov -l over the tree, into |outDir|.  Returns the .gcov files it wrote.
+- (NSArray *)runGCovInto:(NSString *)outDir
+{
+    NSFileManager *fm = [[NSFileManager alloc] init];
+    [fm removeItemAtPath:outDir error:NULL];
+    [fm createDirectoryAtPath:outDir withIntermediateDirectories:YES attributes:nil error:NULL];
+    NSDictionary *filesByGCov = [[GCovVersionManager defaultManager] filesByGCovForFiles:_gcdaNames
+                                                                                inFolder:_gcdaTree];
+    for (id gcovPath in filesByGCov)
+    {
+        if (gcovPath == [NSNull null])
+        {
+            continue;
+        }
+        NSMutableArray *arguments = [NSMutableArray arrayWithObjects:@"-l", @"-o", _gcdaTree, nil];
+        for (NSString *name in filesByGCov[gcovPath])
+        {
+            [arguments addObject:[_gcdaTree stringByAppendingPathComponent:name]];
+        }
+        CSBenchRun(gcovPath, arguments, outDir);
+    }
+    NSMutableArray *result = [NSMutableArray array];
+    for (NSString *name in [fm contentsOfDirectoryAtPath:outDir error:NULL])
+    {
+        if ([name hasSuffix:@".gcov"])
+        {
+            [result addObject:[outDir stringByAppendingPathComponent:name]];
+        }
+    }
+    return result;
+}
+
+// Set up the way coverstory-cli sets it up.
+- (CoverStoryHTMLExporter *)newExporter
+{
+    NSString *stringsPath = [_resourceDir stringByAppendingPathComponent:@"HTMLExport.strings"];
+    NSDictionary *strings = [NSDictionary dictionaryWithContentsOfFile:stringsPath];
+    CoverStoryHTMLExporter *exporter =
+        [[CoverStoryHTMLExporter alloc] initWithPageTemplate:strings[@"HTMLExportTemplate"]
+                                               indexTemplate:strings[@"HTMLIndexTemplate"]];
+    NSString *css = [NSString stringWithContentsOfFile:[_resourceDir stringByAppendingPathComponent:@"coverstory.css"]
+                                              encoding:NSUTF8StringEncoding
+                                                 error:NULL];
+    if (css)
+    {
+        [exporter setStylesheet:[CoverStoryHTMLExporter stylesheetFromTemplate:css lineColors:nil]];
+    }
+    [exporter setJavaScript:[NSData dataWithContentsOfFile:[_resourceDir stringByAppendingPathComponent:@"coverstory.js"]]];
+    [exporter setMaxConcurrentPages:_jobs];
+    return exporter;
+}
+
+- (void)runOnce
+{
+    NSDate *start = nil;
+
+    // finding the files
+    NSUInteger gcovCount = 0;
+    NSUInteger gcdaCount = 0;
+    start                = [NSDate date];
+    NSDictionary *gcovFilesByFolder = CSBenchDiscover(_gcovCorpus, @".gcov", &gcovCount);
+    if (_gcdaTree)
+    {
+        CSBenchDiscover(_gcdaTree, @".gcda", &gcdaCount);
+    }
+    [self record:@"discovery" seconds:-[start timeIntervalSinceNow] items:gcovCount + gcdaCount lines:0];
+
+    NSMutableArray *gcovPaths = [NSMutableArray arrayWithCapacity:gcovCount];
+    for (NSString *folder in [[gcovFilesByFolder allKeys] sortedArrayUsingSelector:@selector(compare:)])
+    {
+        for (NSString *name in gcovFilesByFolder[folder])
+        {
+            [gcovPaths addObject:[folder stringByAppendingPathComponent:name]];
+        }
+    }
+
+    // running gcov (what it writes gets parsed w/ the rest)
+    if (_gcdaTree)
+    {
+        start           = [NSDate date];
+        NSArray *output = [self runGCovInto:[_scratchDir stringByAppendingPathComponent:@"gcov-out"]];
+        [self record:@"gcov" seconds:-[start timeIntervalSinceNow] items:[_gcdaNames count] lines:0];
+        [gcovPaths addObjectsFromArray:output];
+    }
+
+    // parsing
+    NSMutableArray *fileDatas = [NSMutableArray arrayWithCapacity:[gcovPaths count]];
+    NSUInteger lines          = 0;
+    start                     = [NSDate date];
+    for (NSString *path in gcovPaths)
+    {
+        @autoreleasepool {
+            CoverStoryCoverageFileData *fileData =
+                [CoverStoryCoverageFileData newCoverageFileDataFromPath:path
+                                                               document:nil
+                                                        messageReceiver:_receiver];
+            if (fileData)
+            {
+                [fileDatas addObject:fileData];
+                lines += [fileData lineCount];
+            }
+        }
+    }
+    [self record:@"parse" seconds:-[start timeIntervalSinceNow] items:[fileDatas count] lines:lines];
+
+    // merging (the headers are the same source over and over)
+    CoverStoryCoverageSet *dataSet = [[CoverStoryCoverageSet alloc] init];
+    NSUInteger fileDataCount       = [fileDatas count];
+    start                          = [NSDate date];
+    for (NSUInteger x = 0; x < fileDataCount; x += kCSBenchMergeBatch)
+    {
+        NSRange range = NSMakeRange(x, MIN(kCSBenchMergeBatch, fileDataCount - x));
+        [dataSet addFileDatas:[fileDatas subarrayWithRange:range] messageReceiver:_receiver];
+    }
+    [self record:@"merge" seconds:-[start timeIntervalSinceNow] items:fileDataCount lines:lines];
+    NSArray *merged = [dataSet valueForKey:@"fileDatas"];
+
+    // filtering
+    CoverStoryFilePredicate *predicate = [[CoverStoryFilePredicate alloc] initWithHideSDKSources:YES
+                                                                             hideUnittestSources:YES
+                                                                                    filterString:_filter];
+    start             = [NSDate date];
+    NSArray *filtered = [predicate filteredArrayFromArray:merged];
+    [self record:@"filter" seconds:-[start timeIntervalSinceNow] items:[merged count] lines:0];
+
+    // the totals, and the coverage column for each source
+    NSInteger totalLines = 0;
+    start                = [NSDate date];
+    [dataSet coverageTotalLines:&totalLines
+                      codeLines:NULL
+                   hitCodeLines:NULL
+               nonFeasibleLines:NULL
+                 coverageString:NULL
+                       coverage:NULL];
+    for (CoverStoryCoverageFileData *fileData in filtered)
+    {
+        [fileData coverage];
+    }
+    [self record:@"aggregate" seconds:-[start timeIntervalSinceNow] items:[merged count] lines:(NSUInteger)totalLines];
+
+    // the export
+    CoverStoryHTMLExporter *exporter = [self newExporter];
+    NSString *htmlDir                = [_scratchDir stringByAppendingPathComponent:@"html"];
+    [[NSFileManager defaultManager] removeItemAtPath:htmlDir error:NULL];
+    NSError *error = nil;
+    start          = [NSDate date];
+    if (![exporter writeFileDatas:filtered toDirectory:htmlDir error:&error])
+    {
+        fprintf(stderr, "%s: error: export failed: %s\n", [htmlDir fileSystemRepresentation],
+                [[error localizedDescription] UTF8String]);
+    }
+    [self record:@"export" seconds:-[start timeIntervalSinceNow] items:[filtered count] lines:0];
+}
+
+- (NSArray *)stages
+{
+    NSMutableArray *result = [NSMutableArray array];
+    for (NSString *name in _stageOrder)
+    {
+        [result addObject:_stages[name]];
+    }
+    return result;
+}
+
+@end
+
+static NSDictionary *CSBenchConfigDictionary(const CSBenchConfig *config, NSUInteger repeat, NSUInteger jobs,
+                                             NSString *filter)
+{
+    return @{
+        @"files": @(config->files),
+        @"lines": @(config->lines),
+        @"folders": @(config->folders),
+        @"headers": @(config->headers),
+        @"includes": @(config->includes),
+        @"headerLines": @(config->headerLines),
+        @"unexecutable": @(config->unexecutable),
+        @"missed": @(config->missed),
+        @"maxHits": @(config->maxHits),
+        @"nonFeasible": @(config->nonFeasible),
+        @"gcdaUnits": @(config->gcdaUnits),
+        @"seed": @(config->seed),
+        @"repeat": @(repeat),
+        @"jobs": @(jobs),
+        @"filter": filter ?: @"",
+    };
+}
+
+// Prints each stage's median against the baseline's, returns YES if any got
+// slower by more than |tolerance| (a fraction).
+static BOOL CSBenchCompare(NSDictionary *results, NSDictionary *baseline, double tolerance)
+{
+    if ([baseline[@"formatVersion"] integerValue] != kCSBenchFormatVersion)
+    {
+        fprintf(stderr, "coverstory-bench: warning: the baseline is in another format, not comparing\n");
+        return NO;
+    }
+    if (![baseline[@"config"] isEqual:results[@"config"]])
+    {
+        fprintf(stderr, "coverstory-bench: warning: the baseline was run w/ other settings\n");
+    }
+    BOOL regressed         = NO;
+    NSDictionary *current  = results[@"stages"];
+    NSDictionary *previous = baseline[@"stages"];
+    printf("\n%-10s  %10s  %10s  %8s\n", "stage", "baseline", "now", "change");
+    for (NSString *name in results[@"stageOrder"])
+    {
+        NSNumber *before = previous[name][@"median"];
+        double after     = [current[name][@"median"] doubleValue];
+        if (!before)
+        {
+            printf("%-10s  %10s  %9.4fs  %8s\n", [name UTF8String], "-", after, "new");
+            continue;
+        }
+        double change = ([before doubleValue] > 0) ? (after / [before doubleValue] - 1) : 0;
+        BOOL slower   = (change > tolerance) && (after - [before doubleValue] > kCSBenchNoiseFloor);
+        printf("%-10s  %9.4fs  %9.4fs  %+7.1f%%%s\n", [name UTF8String], [before doubleValue], after,
+               change * 100, slower ? "  REGRESSION" : "");
+        regressed |= slower;
+    }
+    return regressed;
+}
+
+// A count has to be all digits (strtoul would take "-1" and wrap it).
+static BOOL CSBenchParseCount(const char *arg, NSUInteger *outCount)
+{
+    char *end           = NULL;
+    errno               = 0;
+    unsigned long count = strtoul(arg, &end, 10);
+    if ((end == arg) || *end || (*arg == '-') || (errno == ERANGE))
+    {
+        return NO;
+    }
+    *outCount = (NSUInteger)count;
+    return YES;
+}
+
+// Percentages are taken as 0 through |maxPercent| and handed back as a
+// fraction.
+static BOOL CSBenchParsePercent(const char *arg, double maxPercent, double *outFraction)
+{
+    char *end      = NULL;
+    double percent = strtod(arg, &end);
+    if ((end == arg) || *end || !((percent >= 0) && (percent <= maxPercent)))
+    {
+        return NO;
+    }
+    *outFraction = percent / 100;
+    return YES;
+}
+
+static void PrintUsage(FILE *file)
+{
+    fputs("usage: coverstory-bench [options]\n"
+          "\n"
+          "Makes a corpus and times each stage of loading it.\n"
+          "\n"
+          "  -n, --files N         units to generate (default: 500)\n"
+          "  -l, --lines N         lines per unit (default: 2000)\n"
+          "      --folders N       folders to spread them over (default: 16)\n"
+          "      --headers N       shared headers (default: 8)\n"
+          "      --includes N      headers each unit includes (default: 2)\n"
+          "      --header-lines N  lines per header (default: 300)\n"
+          "      --unexecutable P  percent of lines that aren't code (default: 30)\n"
+          "      --missed P        percent of code lines not hit (default: 20)\n"
+          "      --max-hits N      most times a line is hit (default: 1000)\n"
+          "      --nf P            percent of lines marked COV_NF_LINE (default: 1)\n"
+          "      --gcda N          also compile N units w/ --coverage and time gcov\n"
+          "                        on them (default: 50, 0 for none)\n"
+          "      --cc PATH         compiler for --gcda (default: cc)\n"
+          "      --seed N          for the generator (default: 1)\n"
+          "  -r, --repeat N        times to run each stage (default: 5)\n"
+          "  -j, --jobs N          workers for the export (default: one per core)\n"
+          "  -f, --filter STRING   filter string for the filter stage\n"
+          "  -o, --output FILE     write the results as JSON to FILE\n"
+          "  -c, --compare FILE    compare w/ the results in FILE, exit with 3 if\n"
+          "                        a stage is slower than --tolerance\n"
+          "      --tolerance P     percent slower that's still ok (default: 10)\n"
+          "      --resources DIR   where HTMLExport.strings, coverstory.css and\n"
+          "                        coverstory.js are (default: " COVERSTORY_RESOURCE_DIR ")\n"
+          "      --keep DIR        make the corpus in DIR and leave it there\n"
+          "  -h, --help            print this message\n",
+          file);
+}
+
+int main(int argc, char *argv[])
+{
+    @autoreleasepool {
+        CSBenchConfig config = {
+            .files        = 500,
+            .lines        = 2000,
+            .folders      = 16,
+            .headers      = 8,
+            .includes     = 2,
+            .headerLines  = 300,
+            .unexecutable = 0.30,
+            .missed       = 0.20,
+            .maxHits      = 1000,
+            .nonFeasible  = 0.01,
+            .gcdaUnits    = 50,
+            .seed         = 1,
+        };
+        NSUInteger repeat     = 5;
+        NSUInteger jobs       = 0;
+        NSString *filter      = nil;
+        NSString *outputPath  = nil;
+        NSString *comparePath = nil;
+        double tolerance      = 0.10;
+        NSString *resourceDir = @COVERSTORY_RESOURCE_DIR;
+        NSString *keepDir     = nil;
+        NSString *compiler    = @"cc";
+
+        enum {
+            kOptFolders = 256, kOptHeaders, kOptIncludes, kOptHeaderLines, kOptUnexecutable, kOptMissed,
+            kOptMaxHits, kOptNonFeasible, kOptGCDA, kOptCC, kOptSeed, kOptTolerance, kOptResources, kOptKeep
+        };
+        static const struct option longOptions[] = {
+            { "files",        required_argument, NULL, 'n' },
+            { "lines",        required_argument, NULL, 'l' },
+            { "folders",      required_argument, NULL, kOptFolders },
+            { "headers",      required_argument, NULL, kOptHeaders },
+            { "includes",     required_argument, NULL, kOptIncludes },
+            { "header-lines", required_argument, NULL, kOptHeaderLines },
+            { "unexecutable", required_argument, NULL, kOptUnexecutable },
+            { "missed",       required_argument, NULL, kOptMissed },
+            { "max-hits",     required_argument, NULL, kOptMaxHits },
+            { "nf",           required_argument, NULL, kOptNonFeasible },
+            { "gcda",         required_argument, NULL, kOptGCDA },
+            { "cc",           required_argument, NULL, kOptCC },
+            { "seed",         required_argument, NULL, kOptSeed },
+            { "repeat",       required_argument, NULL, 'r' },
+            { "jobs",         required_argument, NULL, 'j' },
+            { "filter",       required_argument, NULL, 'f' },
+            { "output",       required_argument, NULL, 'o' },
+            { "compare",      required_argument, NULL, 'c' },
+            { "tolerance",    required_argument, NULL, kOptTolerance },
+            { "resources",    required_argument, NULL, kOptResources },
+            { "keep",         required_argument, NULL, kOptKeep },
+            { "help",         no_argument,       NULL, 'h' },
+            { NULL, 0, NULL, 0 },
+        };
+        int option;
+        while ((option = getopt_long(argc, argv, "n:l:r:j:f:o:c:h", longOptions, NULL)) != -1)
+        {
+            BOOL valid = YES;
+            switch (option)
+            {
+                case 'n':
+                    valid = CSBenchParseCount(optarg, &config.files);
+                    break;
+                case 'l':
+                    valid = CSBenchParseCount(optarg, &config.lines);
+                    break;
+                case kOptFolders:
+                    valid = CSBenchParseCount(optarg, &config.folders);
+                    break;
+                case kOptHeaders:
+                    valid = CSBenchParseCount(optarg, &config.headers);
+                    break;
+                case kOptIncludes:
+                    valid = CSBenchParseCount(optarg, &config.includes);
+                    break;
+                case kOptHeaderLines:
+                    valid = CSBenchParseCount(optarg, &config.headerLines);
+                    break;
+                case kOptUnexecutable:
+                    valid = CSBenchParsePercent(optarg, 100, &config.unexecutable);
+                    break;
+                case kOptMissed:
+                    valid = CSBenchParsePercent(optarg, 100, &config.missed);
+                    break;
+                case kOptMaxHits:
+                    valid = CSBenchParseCount(optarg, &config.maxHits);
+                    break;
+                case kOptNonFeasible:
+                    valid = CSBenchParsePercent(optarg, 100, &config.nonFeasible);
+                    break;
+                case kOptGCDA:
+                    valid = CSBenchParseCount(optarg, &config.gcdaUnits);
+                    break;
+                case kOptCC:
+                    compiler = @(optarg);
+                    break;
+                case kOptSeed:
+                {
+                    NSUInteger seed = 0;
+                    valid           = CSBenchParseCount(optarg, &seed);
+                    config.seed     = seed;
+                    break;
+                }
+                case 'r':
+                    valid  = CSBenchParseCount(optarg, &repeat);
+                    repeat = MAX(repeat, (NSUInteger)1);
+                    break;
+                case 'j':
+                    valid = CSBenchParseCount(optarg, &jobs);
+                    break;
+                case 'f':
+                    filter = @(optarg);
+                    break;
+                case 'o':
+                    outputPath = @(optarg);
+                    break;
+                case 'c':
+                    comparePath = @(optarg);
+                    break;
+                case kOptTolerance:
+                    valid = CSBenchParsePercent(optarg, DBL_MAX, &tolerance);
+                    break;
+                case kOptResources:
+                    resourceDir = @(optarg);
+                    break;
+                case kOptKeep:
+                    keepDir = [@(optarg) stringByStandardizingPath];
+                    break;
+                case 'h':
+                    PrintUsage(stdout);
+                    return kCSBenchExitSuccess;
+                default:
+                    PrintUsage(stderr);
+                    return kCSBenchExitFailure;
+            }
+            if (!valid)
+            {
+                fprintf(stderr, "coverstory-bench: error: bad value '%s'\n", optarg);
+                PrintUsage(stderr);
+                return kCSBenchExitFailure;
+            }
+        }
+        if ((optind < argc) || (config.files == 0) || (config.lines == 0))
+        {
+            PrintUsage(stderr);
+            return kCSBenchExitFailure;
+        }
+        if (jobs == 0)
+        {
+            jobs = [[NSProcessInfo processInfo] activeProcessorCount];
+        }
+        NSDictionary *baseline = nil;
+        if (comparePath)
+        {
+            NSData *data = [NSData dataWithContentsOfFile:comparePath];
+            baseline     = data ? [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL] : nil;
+            if (![baseline isKindOfClass:[NSDictionary class]])
+            {
+                fprintf(stderr, "%s: error: not a results file\n", [comparePath fileSystemRepresentation]);
+                return kCSBenchExitFailure;
+            }
+        }
+
+        // the filter stage reads the patterns from the defaults
+        [CoverStoryFilePredicate registerDefaults];
+        [[GCovVersionManager defaultManager] discoverInBackground];
+
+        NSFileManager *fm = [NSFileManager defaultManager];
+        NSString *workDir = keepDir ?: [NSTemporaryDirectory() stringByAppendingPathComponent:
+                                        [NSString stringWithFormat:@"coverstory-bench-%@",
+                                         [[NSProcessInfo processInfo] globallyUniqueString]]];
+        CSBenchRunner *runner  = [[CSBenchRunner alloc] init];
+        runner->_gcovCorpus    = [workDir stringByAppendingPathComponent:@"gcov"];
+        runner->_scratchDir    = [workDir stringByAppendingPathComponent:@"scratch"];
+        runner->_resourceDir   = resourceDir;
+        runner->_jobs          = jobs;
+        runner->_filter        = filter;
+        [fm removeItemAtPath:runner->_gcovCorpus error:NULL];
+        [fm removeItemAtPath:runner->_scratchDir error:NULL];
+        if (!CSBenchMakeGCovCorpus(runner->_gcovCorpus, &config))
+        {
+            fprintf(stderr, "%s: error: couldn't write the corpus\n", [workDir fileSystemRepresentation]);
+            return kCSBenchExitFailure;
+        }
+        if (config.gcdaUnits)
+        {
+            NSString *gcdaTree = [workDir stringByAppendingPathComponent:@"gcda"];
+            [fm removeItemAtPath:gcdaTree error:NULL];
+            runner->_gcdaNames = CSBenchMakeGCDATree(gcdaTree, compiler, &config);
+            if (runner->_gcdaNames)
+            {
+                runner->_gcdaTree = gcdaTree;
+            }
+            else
+            {
+                fprintf(stderr, "coverstory-bench: warning: couldn't build w/ %s, not timing gcov\n",
+                        [compiler UTF8String]);
+                config.gcdaUnits = 0;
+            }
+        }
+
+        for (NSUInteger x = 0; x < repeat; ++x)
+        {
+            @autoreleasepool {
+                [runner runOnce];
+            }
+        }
+        if (runner->_receiver->_errorCount)
+        {
+            fprintf(stderr, "coverstory-bench: warning: %lu errors while loading\n",
+                    (unsigned long)runner->_receiver->_errorCount);
+        }
+
+        NSMutableDictionary *stages = [NSMutableDictionary dictionary];
+        NSMutableArray *stageOrder  = [NSMutableArray array];
+        printf("%-10s  %10s  %10s  %8s  %14s\n", "stage", "median", "min", "items", "items/s");
+        for (CSBenchStage *stage in [runner stages])
+        {
+            NSDictionary *stageResults = [stage dictionary];
+            stages[stage->_name]       = stageResults;
+            [stageOrder addObject:stage->_name];
+            printf("%-10s  %9.4fs  %9.4fs  %8lu  %14.0f\n", [stage->_name UTF8String],
+                   [stageResults[@"median"] doubleValue], [stageResults[@"min"] doubleValue],
+                   (unsigned long)stage->_items, [stageResults[@"itemsPerSecond"] doubleValue]);
+        }
+        NSDictionary *results = @{
+            @"formatVersion": @(kCSBenchFormatVersion),
+            @"tool": @"coverstory-bench",
+            @"date": [[NSDate date] description],
+            @"host": @{
+                @"processors": @([[NSProcessInfo processInfo] activeProcessorCount]),
+                @"os": [[NSProcessInfo processInfo] operatingSystemVersionString],
+            },
+            @"config": CSBenchConfigDictionary(&config, repeat, jobs, filter),
+            @"stageOrder": stageOrder,
+            @"stages": stages,
+        };
+
+        if (!keepDir)
+        {
+            [fm removeItemAtPath:workDir error:NULL];
+        }
+        if (outputPath)
+        {
+            NSError *error = nil;
+            NSData *json   = [NSJSONSerialization dataWithJSONObject:results
+                                                             options:NSJSONWritingPrettyPrinted
+                                                               error:&error];
+            if (!json || ![json writeToFile:outputPath atomically:YES])
+            {
+                fprintf(stderr, "%s: error: couldn't write the results\n", [outputPath fileSystemRepresentation]);
+                return kCSBenchExitFailure;
+            }
+        }
+        if (baseline && CSBenchCompare(results, baseline, tolerance))
+        {
+            return kCSBenchExitRegression;
+        }
+    }
+    return kCSBenchExitSuccess;
+}
@@ -0,0 +1,1114 @@
+//
+//  coverstory-cli.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// Headless front end to the coverage model classes.  Reads build folders,
+// .gcda files, .gcov files, or coverage shards, merges them the same way the
+// app does, prints a summary, optionally writes the HTML export and/or a shard
+// of everything read, and exits non-zero if the total coverage is under a
+// threshold.  With --watch it keeps running instead, and reloads (and reports
+// again) just the folders whose .gcda files change.  With --trace it writes
+// where the time went in the load as Chrome trace JSON.  With --stream-gcov
+// gcov's output is parsed from a pipe instead of a scratch folder.  With
+// --diff it also compares against a base run (ie - the last good build's
+// shard), and exits non-zero if any lines are newly missed.  Only needs
+// Foundation (see the GNUmakefile), so it also builds on Linux w/ GNUstep.
+
+#import <Foundation/Foundation.h>
+#import "CoverStoryCoverageSet.h"
+#import "CoverStoryCoverageFileData.h"
+#import "CoverStoryCoverageShard.h"
+#import "CoverStoryCoverageDiff.h"
+#import "CoverStoryCoverageImporter.h"
+#import "CoverStoryGCovDataReader.h"
+#import "CoverStoryGCovStream.h"
+#import "CoverStoryFilePredicate.h"
+#import "CoverStoryFolderWatcher.h"
+#import "CoverStoryHTMLExporter.h"
+#import "CoverStoryLineIndex.h"
+#import "CoverStoryQueryServer.h"
+#import "CoverStoryPreferenceKeys.h"
+#import "CoverStoryTracer.h"
+#import "GCovVersionManager.h"
+#import "CodeCoverage.h"
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#ifndef COVERSTORY_RESOURCE_DIR
+#define COVERSTORY_RESOURCE_DIR "../Resources"
+#endif
+
+enum {
+    kCSExitSuccess        = 0,
+    kCSExitFailure        = 1,  // bad arguments, or no coverage data read
+    kCSExitBelowThreshold = 2,
+    kCSExitNewlyMissed    = 3,  // w/ --diff
+};
+
+// gcov has a startup cost, so a folder is only split into runs this big.
+static const NSUInteger kCSFilesPerRun = 32;
+// How long .gcda files have to be left alone before a watched folder reloads.
+static const NSTimeInterval kCSWatchLatency = 0.5;
+// How many of the slowest files/folders --trace reports.
+static const NSUInteger kCSTraceSummaryLimit = 5;
+
+// What read file datas are kept under when the set keeps them by folder (the
+// watcher reports real paths).
+static NSString *CSOriginForFolder(NSString *folderPath)
+{
+    return [[folderPath stringByResolvingSymlinksInPath] stringByStandardizingPath];
+}
+
+// Collects the coverage for everything it's given on a queue of |jobs|
+// workers, and reports anything that goes wrong to stderr.
+@interface CSCoverageLoader : NSObject<CoverStoryCoverageProcessingProtocol> {
+@private
+    NSOperationQueue *_queue;
+    NSString *_gcovPath;
+    CoverStoryCoverageSet *_dataSet;
+    NSMutableArray *_shardPaths;  // merged together once everything else is in
+    NSUInteger _errorCount;
+    NSUInteger _warningCount;
+    CoverStoryTracer *_tracer;
+    BOOL _streamsGCov;
+}
+@property (readonly, nonatomic, strong) CoverStoryCoverageSet *dataSet;
+// Set before adding paths to trace the load (nil by default).
+@property (nonatomic, strong) CoverStoryTracer *tracer;
+// Parse gcov -t's output as it comes instead of having gcov write .gcov
+// files (falls back to the files for a gcov w/o -t).
+@property (nonatomic, assign) BOOL streamsGCov;
+@property (readonly) NSUInteger errorCount;
+@property (readonly) NSUInteger warningCount;
+- (id)initWithJobs:(NSUInteger)jobs gcovPath:(NSString *)gcovPath;
+// A folder (searched for .gcda files), a .gcda file, a .gcov file, a
+// .csshard file, or an lcov tracefile or llvm-cov export to import.
+- (BOOL)addPath:(NSString *)path;
+- (void)waitUntilFinished;
+// Reads the .gcda files in each of |folders| again and swaps them in for
+// what those folders had (the data set has to keep origins).
+- (void)reloadFolders:(NSSet *)folders;
+@end
+
+@interface CSCoverageLoader ()
+- (void)queueFiles:(NSArray *)filenames inFolder:(NSString *)folderPath;
+- (NSArray *)runsForFiles:(NSArray *)filenames inFolder:(NSString *)folderPath;
+- (void)processFiles:(NSArray *)filenames inFolder:(NSString *)folderPath;
+- (NSArray *)readFiles:(NSArray *)filenames inFolder:(NSString *)folderPath;
+- (NSArray *)runGCovForFiles:(NSArray *)filenames inFolder:(NSString *)folderPath;
+- (NSArray *)runGCov:(NSString *)gcovPath forFiles:(NSArray *)filenames inFolder:(NSString *)folderPath;
+- (NSArray *)streamGCov:(NSString *)gcovPath
+               forFiles:(NSArray *)filenames
+               inFolder:(NSString *)folderPath
+                tempDir:(NSString *)tempDir;
+- (void)reportGCovErrors:(NSData *)stdErrData gcovPath:(NSString *)gcovPath;
+- (void)addFileDatas:(NSArray *)fileDatas;
+- (void)addFileDatas:(NSArray *)fileDatas fromOrigin:(NSString *)origin;
+- (void)report:(NSString *)kind path:(NSString *)path format:(NSString *)format arguments:(va_list)args NS_FORMAT_FUNCTION(3, 0);
+@end
+
+@implementation CSCoverageLoader
+
+@synthesize dataSet = _dataSet;
+@synthesize tracer = _tracer;
+@synthesize streamsGCov = _streamsGCov;
+
+- (id)init
+{
+    return [self initWithJobs:0 gcovPath:nil];
+}
+
+- (id)initWithJobs:(NSUInteger)jobs gcovPath:(NSString *)gcovPath
+{
+    if ((self = [super init]))
+    {
+        if (jobs == 0)
+        {
+            jobs = [[NSProcessInfo processInfo] activeProcessorCount];
+        }
+        _queue = [[NSOperationQueue alloc] init];
+        [_queue setMaxConcurrentOperationCount:MAX(jobs, (NSUInteger)1)];
+        _gcovPath   = [gcovPath copy];
+        _dataSet    = [[CoverStoryCoverageSet alloc] init];
+        _shardPaths = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (BOOL)addPath:(NSString *)path
+{
+    path = [path stringByStandardizingPath];
+    NSFileManager *fm = [[NSFileManager alloc] init];
+    BOOL isDir        = NO;
+    if (![fm fileExistsAtPath:path isDirectory:&isDir])
+    {
+        [self coverageErrorForPath:path message:@"no such file or directory"];
+        return NO;
+    }
+    if (!isDir)
+    {
+        NSString *extension = [path pathExtension];
+        if ([extension isEqualToString:@"gcov"])
+        {
+            CoverStoryTracer *tracer = _tracer;
+            uint64_t queued          = CoverStoryTraceNow(tracer);
+            [_queue addOperationWithBlock:^{
+                @autoreleasepool {
+                    uint64_t start = CoverStoryTraceNow(tracer);
+                    CoverStoryCoverageFileData *fileData =
+                        [CoverStoryCoverageFileData newCoverageFileDataFromPath:path
+                                                                       document:nil
+                                                                messageReceiver:self];
+                    [tracer endSpan:@"parse" start:start queued:queued detail:path];
+                    if (fileData)
+                    {
+                        [self addFileDatas:@[fileData]];
+                    }
+                }
+            }];
+            return YES;
+        }
+        if ([extension isEqualToString:@"gcda"])
+        {
+            [self queueFiles:@[[path lastPathComponent]] inFolder:[path stringByDeletingLastPathComponent]];
+            return YES;
+        }
+        if ([extension isEqualToString:@"csshard"])
+        {
+            [_shardPaths addObject:path];
+            return YES;
+        }
+        if ([CoverStoryCoverageImporter formatOfFileAtPath:path] != kCoverStoryImportFormatNone)
+        {
+            CoverStoryTracer *tracer = _tracer;
+            NSUInteger jobs          = (NSUInteger)[_queue maxConcurrentOperationCount];
+            [_queue addOperationWithBlock:^{
+                @autoreleasepool {
+                    uint64_t start = CoverStoryTraceNow(tracer);
+                    CoverStoryCoverageImporter *importer =
+                        [[CoverStoryCoverageImporter alloc] initWithMaxConcurrency:jobs maxRecordsInFlight:0];
+                    [importer importFileAtPath:path
+                                      document:nil
+                               messageReceiver:self
+                                       handler:^(CoverStoryCoverageFileData *fileData) {
+                                           [self addFileDatas:@[fileData]];
+                                       }];
+                    [tracer endSpan:@"import" start:start queued:0 detail:path];
+                }
+            }];
+            return YES;
+        }
+        [self coverageErrorForPath:path message:@"not a folder, .gcda, .gcov, .csshard, lcov or llvm-cov export file"];
+        return NO;
+    }
+
+    // Batch the gcda files up by the folder they're in (gcov is run per folder).
+    NSMutableDictionary *filesByFolder = [NSMutableDictionary dictionary];
+    for (NSString *relativePath in [fm enumeratorAtPath:path])
+    {
+        if (![relativePath hasSuffix:@".gcda"])
+        {
+            continue;
+        }
+        NSString *fullPath       = [path stringByAppendingPathComponent:relativePath];
+        NSString *folder         = [fullPath stringByDeletingLastPathComponent];
+        NSMutableArray *filenames = filesByFolder[folder];
+        if (!filenames)
+        {
+            filenames              = [NSMutableArray array];
+            filesByFolder[folder] = filenames;
+        }
+        [filenames addObject:[fullPath lastPathComponent]];
+    }
+    if ([filesByFolder count] == 0)
+    {
+        [self coverageWarningForPath:path message:@"found no gcda files to process"];
+    }
+    for (NSString *folder in filesByFolder)
+    {
+        [self queueFiles:filesByFolder[folder] inFolder:folder];
+    }
+    return YES;
+}
+
+- (void)queueFiles:(NSArray *)filenames inFolder:(NSString *)folderPath
+{
+    CoverStoryTracer *tracer = _tracer;
+    for (NSArray *runFiles in [self runsForFiles:filenames inFolder:folderPath])
+    {
+        uint64_t queued = CoverStoryTraceNow(tracer);
+        [_queue addOperationWithBlock:^{
+            @autoreleasepool {
+                uint64_t start = CoverStoryTraceNow(tracer);
+                [self processFiles:runFiles inFolder:folderPath];
+                [tracer endSpan:@"batch" start:start queued:queued detail:folderPath];
+            }
+        }];
+    }
+}
+
+// Splits |filenames| up by the gcov that goes w/ them (so the runs for
+// different compilers go side by side on the queue), and those into runs.
+- (NSArray *)runsForFiles:(NSArray *)filenames inFolder:(NSString *)folderPath
+{
+    NSArray *groups = @[ filenames ];
+    if (!_gcovPath)
+    {
+        NSDictionary *filesByGCov = [[GCovVersionManager defaultManager] filesByGCovForFiles:filenames
+                                                                                    inFolder:folderPath];
+        groups = [filesByGCov allValues];
+    }
+    NSMutableArray *runs = [NSMutableArray array];
+    for (NSArray *group in groups)
+    {
+        NSArray *sorted      = [group sortedArrayUsingSelector:@selector(compare:)];
+        NSUInteger fileCount = [sorted count];
+        for (NSUInteger start = 0; start < fileCount; start += kCSFilesPerRun)
+        {
+            [runs addObject:[sorted subarrayWithRange:NSMakeRange(start, MIN(kCSFilesPerRun, fileCount - start))]];
+        }
+    }
+    return runs;
+}
+
+- (void)processFiles:(NSArray *)filenames inFolder:(NSString *)folderPath
+{
+    NSString *origin = [_dataSet keepsOrigins] ? CSOriginForFolder(folderPath) : nil;
+    [self addFileDatas:[self readFiles:filenames inFolder:folderPath] fromOrigin:origin];
+}
+
+- (NSArray *)readFiles:(NSArray *)filenames inFolder:(NSString *)folderPath
+{
+    // Read what we can directly, only what's left needs gcov.
+    NSMutableArray *fileDatas     = [NSMutableArray array];
+    NSMutableArray *gcovFilenames = [NSMutableArray array];
+    for (NSString *filename in filenames)
+    {
+        NSString *fullPath = [folderPath stringByAppendingPathComponent:filename];
+        uint64_t start     = CoverStoryTraceNow(_tracer);
+        NSArray *read      = [CoverStoryGCovDataReader coverageFileDatasForGCDAPath:fullPath
+                                                                           document:nil
+                                                                    messageReceiver:self];
+        [_tracer endSpan:@"read" start:start queued:0 detail:fullPath];
+        if (read)
+        {
+            [fileDatas addObjectsFromArray:read];
+        }
+        else
+        {
+            [gcovFilenames addObject:filename];
+        }
+    }
+    if ([gcovFilenames count])
+    {
+        [fileDatas addObjectsFromArray:[self runGCovForFiles:gcovFilenames inFolder:folderPath]];
+    }
+    return fileDatas;
+}
+
+- (NSArray *)runGCovForFiles:(NSArray *)filenames inFolder:(NSString *)folderPath
+{
+    if (_gcovPath)
+    {
+        return [self runGCov:_gcovPath forFiles:filenames inFolder:folderPath];
+    }
+    // The runs were already split up by gcov, but a file could have been
+    // rebuilt by another compiler since.
+    NSDictionary *filesByGCov = [[GCovVersionManager defaultManager] filesByGCovForFiles:filenames
+                                                                                inFolder:folderPath];
+    NSMutableArray *fileDatas = [NSMutableArray array];
+    for (id gcovPath in filesByGCov)
+    {
+        NSArray *gcovFiles = filesByGCov[gcovPath];
+        if (gcovPath == [NSNull null])
+        {
+            [self coverageErrorForPath:folderPath message:@"couldn't find gcov to process %lu files",
+                                       (unsigned long)[gcovFiles count]];
+            continue;
+        }
+        [fileDatas addObjectsFromArray:[self runGCov:gcovPath forFiles:gcovFiles inFolder:folderPath]];
+    }
+    return fileDatas;
+}
+
+- (NSArray *)runGCov:(NSString *)gcovPath forFiles:(NSArray *)filenames inFolder:(NSString *)folderPath
+{
+    NSFileManager *fm = [[NSFileManager alloc] init];
+    NSString *tempDir = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                         [NSString stringWithFormat:@"coverstory-cli-%@",
+                          [[NSProcessInfo processInfo] globallyUniqueString]]];
+    if (![fm createDirectoryAtPath:tempDir withIntermediateDirectories:YES attributes:nil error:NULL])
+    {
+        [self coverageErrorForPath:tempDir message:@"failed to make a scratch directory"];
+        return @[];
+    }
+    if (_streamsGCov)
+    {
+        NSArray *fileDatas = [self streamGCov:gcovPath forFiles:filenames inFolder:folderPath tempDir:tempDir];
+        if (fileDatas)
+        {
+            [fm removeItemAtPath:tempDir error:NULL];
+            return fileDatas;
+        }
+    }
+
+    NSMutableArray *arguments = [NSMutableArray arrayWithObjects:@"-l", @"-o", folderPath, nil];
+    for (NSString *filename in filenames)
+    {
+        [arguments addObject:[folderPath stringByAppendingPathComponent:filename]];
+    }
+    // gcov writes its output to the current directory.
+    NSTask *task        = [[NSTask alloc] init];
+    NSPipe *stdErrPipe  = [NSPipe pipe];
+    [task setLaunchPath:gcovPath];
+    [task setArguments:arguments];
+    [task setCurrentDirectoryPath:tempDir];
+    [task setStandardOutput:[NSFileHandle fileHandleWithNullDevice]];
+    [task setStandardError:stdErrPipe];
+    NSMutableArray *fileDatas = [NSMutableArray array];
+    @try {
+        uint64_t start = CoverStoryTraceNow(_tracer);
+        [task launch];
+        NSData *stdErrData = [[stdErrPipe fileHandleForReading] readDataToEndOfFile];
+        [task waitUntilExit];
+        [_tracer endSpan:@"gcov" start:start queued:0 detail:folderPath];
+        [self reportGCovErrors:stdErrData gcovPath:gcovPath];
+
+        // since we batch process, we might have gotten some data even w/ an error
+        for (NSString *name in [fm contentsOfDirectoryAtPath:tempDir error:NULL])
+        {
+            if (![name hasSuffix:@".gcov"])
+            {
+                continue;
+            }
+            @autoreleasepool {
+                NSString *fullPath = [tempDir stringByAppendingPathComponent:name];
+                uint64_t start     = CoverStoryTraceNow(_tracer);
+                CoverStoryCoverageFileData *fileData =
+                    [CoverStoryCoverageFileData newCoverageFileDataFromPath:fullPath
+                                                                   document:nil
+                                                            messageReceiver:self];
+                [_tracer endSpan:@"parse" start:start queued:0 detail:fullPath];
+                if (fileData)
+                {
+                    [fileDatas addObject:fileData];
+                }
+            }
+        }
+    }
+    @catch (NSException *e) {
+        [self coverageErrorForPath:gcovPath message:@"failed to run gcov (%@ - %@)", [e name], [e reason]];
+    }
+    @finally {
+        uint64_t start = CoverStoryTraceNow(_tracer);
+        [fm removeItemAtPath:tempDir error:NULL];
+        [_tracer endSpan:@"cleanup" start:start queued:0 detail:tempDir];
+    }
+    return fileDatas;
+}
+
+// The runs are small enough to go on gcov's command line, and the workers are
+// already busy w/ the other runs, so each source is parsed right when it comes
+// out (gcov waits on the pipe meanwhile).  nil if gcov rejected -t (it's too
+// old to know it).  -t means nothing gets written, it's still run from
+// |tempDir| so the sources resolve the same as w/ the usual way.
+- (NSArray *)streamGCov:(NSString *)gcovPath
+               forFiles:(NSArray *)filenames
+               inFolder:(NSString *)folderPath
+                tempDir:(NSString *)tempDir
+{
+    NSMutableArray *arguments = [NSMutableArray arrayWithObjects:@"-t", @"-o", folderPath, nil];
+    for (NSString *filename in filenames)
+    {
+        [arguments addObject:[folderPath stringByAppendingPathComponent:filename]];
+    }
+    NSTask *task = [[NSTask alloc] init];
+    [task setLaunchPath:gcovPath];
+    [task setArguments:arguments];
+    [task setCurrentDirectoryPath:tempDir];
+    NSMutableArray *fileDatas = [NSMutableArray array];
+    CoverStoryTracer *tracer  = _tracer;
+    CoverStoryGCovStream *stream
+        = [[CoverStoryGCovStream alloc] initWithMaxPendingChunks:1
+                                                         handler:^(CoverStoryGCovStream *chunkStream, NSData *chunk) {
+            @autoreleasepool {
+                NSString *dataName = [[CoverStoryGCovStream dataPathForChunk:chunk] lastPathComponent];
+                NSString *path     = dataName ? [folderPath stringByAppendingPathComponent:dataName] : folderPath;
+                uint64_t start     = CoverStoryTraceNow(tracer);
+                CoverStoryCoverageFileData *fileData =
+                    [CoverStoryCoverageFileData newCoverageFileDataFromGCovData:chunk
+                                                                           path:path
+                                                                       document:nil
+                                                                messageReceiver:self];
+                [tracer endSpan:@"parse" start:start queued:0 detail:path];
+                if (fileData)
+                {
+                    [fileDatas addObject:fileData];
+                }
+                [chunkStream finishedChunk];
+            }
+        }];
+    NSData *stdErrData = nil;
+    BOOL exitedOK      = NO;
+    @try {
+        uint64_t start = CoverStoryTraceNow(_tracer);
+        exitedOK       = [stream runTask:task standardError:&stdErrData];
+        [_tracer endSpan:@"gcov" start:start queued:0 detail:folderPath];
+    }
+    @catch (NSException *e) {
+        [self coverageErrorForPath:gcovPath message:@"failed to run gcov (%@ - %@)", [e name], [e reason]];
+        return fileDatas;
+    }
+    if (!exitedOK && ([stream chunkCount] == 0) && [CoverStoryGCovStream standardErrorRejectsStreaming:stdErrData])
+    {
+        return nil;
+    }
+    [self reportGCovErrors:stdErrData gcovPath:gcovPath];
+    return fileDatas;
+}
+
+- (void)reportGCovErrors:(NSData *)stdErrData gcovPath:(NSString *)gcovPath
+{
+    NSString *stdErr = [[NSString alloc] initWithData:stdErrData encoding:NSUTF8StringEncoding];
+    for (NSString *line in [stdErr componentsSeparatedByString:@"\n"])
+    {
+        if ([line length] && ![line hasSuffix:@"'404*', prefer '402*'"])
+        {
+            [self coverageErrorForPath:gcovPath message:@"%@", line];
+        }
+    }
+}
+
+- (void)addFileDatas:(NSArray *)fileDatas
+{
+    [self addFileDatas:fileDatas fromOrigin:nil];
+}
+
+- (void)addFileDatas:(NSArray *)fileDatas fromOrigin:(NSString *)origin
+{
+    if ([fileDatas count] == 0)
+    {
+        return;
+    }
+    // The set isn't thread safe.
+    @synchronized(_dataSet)
+    {
+        uint64_t start = CoverStoryTraceNow(_tracer);
+        [_dataSet addFileDatas:fileDatas fromOrigin:origin messageReceiver:self];
+        [_tracer endSpan:@"merge" start:start queued:0 detail:origin];
+    }
+}
+
+- (void)reloadFolders:(NSSet *)folders
+{
+    NSFileManager *fm                      = [[NSFileManager alloc] init];
+    NSMutableDictionary *fileDatasByOrigin = [NSMutableDictionary dictionaryWithCapacity:[folders count]];
+    for (NSString *folder in folders)
+    {
+        // a folder w/ no .gcda files left just drops what it had
+        NSMutableArray *folderFileDatas = [NSMutableArray array];
+        NSMutableArray *filenames       = [NSMutableArray array];
+        fileDatasByOrigin[CSOriginForFolder(folder)] = folderFileDatas;
+        for (NSString *name in [fm contentsOfDirectoryAtPath:folder error:NULL])
+        {
+            if ([name hasSuffix:@".gcda"])
+            {
+                [filenames addObject:name];
+            }
+        }
+        for (NSArray *runFiles in [self runsForFiles:filenames inFolder:folder])
+        {
+            [_queue addOperationWithBlock:^{
+                @autoreleasepool {
+                    NSArray *read = [self readFiles:runFiles inFolder:folder];
+                    @synchronized(folderFileDatas)
+                    {
+                        [folderFileDatas addObjectsFromArray:read];
+                    }
+                }
+            }];
+        }
+    }
+    [_queue waitUntilAllOperationsAreFinished];
+    @synchronized(_dataSet)
+    {
+        [_dataSet replaceFileDatasByOrigin:fileDatasByOrigin messageReceiver:self];
+    }
+}
+
+- (void)waitUntilFinished
+{
+    [_queue waitUntilAllOperationsAreFinished];
+    if ([_shardPaths count])
+    {
+        NSArray *fileDatas = [CoverStoryCoverageShard fileDatasByMergingShardsAtPaths:_shardPaths
+                                                                       maxConcurrency:[_queue maxConcurrentOperationCount]
+                                                                             document:nil
+                                                                      messageReceiver:self];
+        [_shardPaths removeAllObjects];
+        [self addFileDatas:fileDatas];
+    }
+}
+
+- (NSUInteger)errorCount
+{
+    @synchronized(self)
+    {
+        return _errorCount;
+    }
+}
+
+- (NSUInteger)warningCount
+{
+    @synchronized(self)
+    {
+        return _warningCount;
+    }
+}
+
+- (void)report:(NSString *)kind path:(NSString *)path format:(NSString *)format arguments:(va_list)args
+{
+    NSString *message = [[NSString alloc] initWithFormat:format arguments:args];
+    NSString *line    = [NSString stringWithFormat:@"%@: %@: %@\n", path ?: @"coverstory-cli", kind, message];
+    @synchronized(self)
+    {
+        fputs([line UTF8String], stderr);
+    }
+}
+
+- (void)coverageErrorForPath:(NSString *)path message:(NSString *)format, ...
+{
+    @synchronized(self)
+    {
+        ++_errorCount;
+    }
+    va_list list;
+    va_start(list, format);
+    [self report:@"error" path:path format:format arguments:list];
+    va_end(list);
+}
+
+- (void)coverageWarningForPath:(NSString *)path message:(NSString *)format, ...
+{
+    @synchronized(self)
+    {
+        ++_warningCount;
+    }
+    va_list list;
+    va_start(list, format);
+    [self report:@"warning" path:path format:format arguments:list];
+    va_end(list);
+}
+
+@end
+
+static void PrintUsage(FILE *file)
+{
+    fputs("usage: coverstory-cli [options] <build folder | .gcda | .gcov | .csshard | .info | .json>...\n"
+          "\n"
+          "  -j, --jobs N          number of workers (default: one per core)\n"
+          "  -t, --threshold PCT   exit with 2 if the total coverage is under PCT\n"
+          "  -o, --html DIR        write the HTML export into DIR\n"
+          "  -s, --shard FILE      write everything read (unfiltered) as a shard\n"
+          "                        to FILE, to merge w/ others later\n"
+          "  -r, --resources DIR   where HTMLExport.strings, coverstory.css and\n"
+          "                        coverstory.js are (default: " COVERSTORY_RESOURCE_DIR ")\n"
+          "      --gcov PATH       gcov to use instead of picking one per file\n"
+          "      --gcov-dir DIR    look for gcov-<version> in DIR too (can be\n"
+          "                        given more than once)\n"
+          "      --hide-sdk        leave out system/SDK sources\n"
+          "      --hide-unittests  leave out unittest sources\n"
+          "  -f, --filter STRING   only include sources matching STRING\n"
+          "      --regex           STRING is a regular expression, not a wildcard\n"
+          "  -w, --watch           keep running, and report again whenever the\n"
+          "                        .gcda files in the build folders change\n"
+          "      --trace FILE      write where the time went in the load to FILE\n"
+          "                        (Chrome trace JSON, see chrome://tracing)\n"
+          "      --stream-gcov     parse gcov's output from a pipe (gcov -t) instead\n"
+          "                        of having it write .gcov files\n"
+          "      --diff BASE       compare against BASE (anything that can be read,\n"
+          "                        usually a shard of an earlier run; can be given\n"
+          "                        more than once), exit with 3 if any lines are\n"
+          "                        newly missed\n"
+          "      --diff-report FILE\n"
+          "                        write what changed against BASE to FILE as JSON\n"
+          "      --serve SOCKET    keep running, and answer line coverage queries on\n"
+          "                        the Unix domain socket SOCKET (with -w, from the\n"
+          "                        latest reload)\n"
+          "  -q, --quiet           only print the total\n"
+          "  -h, --help            print this message\n",
+          file);
+}
+
+static BOOL WriteHTMLExport(NSArray *fileDatas, NSString *directory, NSString *resourceDir, NSUInteger jobs)
+{
+    NSString *stringsPath = [resourceDir stringByAppendingPathComponent:@"HTMLExport.strings"];
+    NSDictionary *strings = [NSDictionary dictionaryWithContentsOfFile:stringsPath];
+    CoverStoryHTMLExporter *exporter =
+        [[CoverStoryHTMLExporter alloc] initWithPageTemplate:strings[@"HTMLExportTemplate"]
+                                               indexTemplate:strings[@"HTMLIndexTemplate"]];
+    if (!exporter)
+    {
+        fprintf(stderr, "%s: error: couldn't read the export templates\n", [stringsPath fileSystemRepresentation]);
+        return NO;
+    }
+    NSString *css = [NSString stringWithContentsOfFile:[resourceDir stringByAppendingPathComponent:@"coverstory.css"]
+                                              encoding:NSUTF8StringEncoding
+                                                 error:NULL];
+    if (css)
+    {
+        [exporter setStylesheet:[CoverStoryHTMLExporter stylesheetFromTemplate:css lineColors:nil]];
+    }
+    [exporter setJavaScript:[NSData dataWithContentsOfFile:[resourceDir stringByAppendingPathComponent:@"coverstory.js"]]];
+    [exporter setMaxConcurrentPages:jobs];
+
+    NSError *error = nil;
+    if (![exporter writeFileDatas:fileDatas toDirectory:directory error:&error])
+    {
+        fprintf(stderr, "%s: error: export failed: %s\n", [directory fileSystemRepresentation],
+                [[error localizedDescription] UTF8String]);
+        return NO;
+    }
+    return YES;
+}
+
+// Writes |tracer|'s spans to |path|, and unless |quiet| lists where the most
+// time went on stderr.
+static BOOL WriteTrace(CoverStoryTracer *tracer, NSString *path, BOOL quiet)
+{
+    NSError *error = nil;
+    if (![tracer writeChromeTraceToFile:path error:&error])
+    {
+        fprintf(stderr, "%s: error: writing the trace failed: %s\n", [path fileSystemRepresentation],
+                [[error localizedDescription] UTF8String]);
+        return NO;
+    }
+    if (quiet)
+    {
+        return YES;
+    }
+    NSArray *summaries = @[ @[ @"slowest files", @[ @"read", @"parse" ] ],
+                            @[ @"slowest folders", @[ @"batch" ] ] ];
+    for (NSArray *summary in summaries)
+    {
+        for (NSArray *pair in [tracer slowestDetailsForSpansNamed:summary[1] limit:kCSTraceSummaryLimit])
+        {
+            fprintf(stderr, "coverstory-cli: %s: %8.1fms  %s\n", [summary[0] UTF8String],
+                    [pair[1] doubleValue] * 1000.0, [pair[0] UTF8String]);
+        }
+    }
+    return YES;
+}
+
+// Prints the summary of what |loader| has that passes |predicate| (and
+// writes the export), returns what the tool should exit with.
+static int ReportCoverage(CSCoverageLoader *loader,
+                          CoverStoryFilePredicate *predicate,
+                          BOOL quiet,
+                          NSString *htmlDir,
+                          NSString *resourceDir,
+                          NSUInteger jobs,
+                          float threshold)
+{
+    NSArray *fileDatas = nil;
+    @synchronized([loader dataSet])
+    {
+        fileDatas = [predicate filteredArrayFromArray:[[loader dataSet] valueForKey:@"fileDatas"]];
+    }
+    NSSortDescriptor *byPath = [NSSortDescriptor sortDescriptorWithKey:@"sourcePath" ascending:YES];
+    fileDatas = [fileDatas sortedArrayUsingDescriptors:@[byPath]];
+    if ([fileDatas count] == 0)
+    {
+        fputs("coverstory-cli: error: no coverage data read\n", stderr);
+        return kCSExitFailure;
+    }
+
+    if (!quiet)
+    {
+        for (CoverStoryCoverageFileData *fileData in fileDatas)
+        {
+            NSString *coverage = nil;
+            NSInteger code     = 0;
+            NSInteger hit      = 0;
+            [fileData coverageTotalLines:NULL
+                               codeLines:&code
+                            hitCodeLines:&hit
+                        nonFeasibleLines:NULL
+                          coverageString:&coverage
+                                coverage:NULL];
+            printf("%6s%%  %6ld/%-6ld  %s\n", [coverage UTF8String], (long)hit, (long)code,
+                   [[fileData sourcePath] UTF8String]);
+        }
+    }
+    float coverage = 0.0f;
+    [[fileDatas objectEnumerator] coverageTotalLines:NULL
+                                           codeLines:NULL
+                                        hitCodeLines:NULL
+                                    nonFeasibleLines:NULL
+                                      coverageString:NULL
+                                            coverage:&coverage];
+    NSString *summary = coverageSummaryString((id<CoverStoryLineCoverageProtocol>)[fileDatas objectEnumerator]);
+    printf("%s in %lu sources.\n", [summary UTF8String], (unsigned long)[fileDatas count]);
+
+    if (htmlDir && !WriteHTMLExport(fileDatas, htmlDir, resourceDir, jobs))
+    {
+        return kCSExitFailure;
+    }
+    if ((threshold >= 0.0f) && (coverage < threshold))
+    {
+        fprintf(stderr, "coverstory-cli: coverage %.1f%% is under the %.1f%% threshold\n", coverage, threshold);
+        return kCSExitBelowThreshold;
+    }
+    return kCSExitSuccess;
+}
+
+// Prints how what |loader| has compares to |baseFileDatas| (both filtered by
+// |predicate|), and writes the report.  Returns what the tool should exit
+// with.
+static int ReportDiff(NSArray *baseFileDatas,
+                      CSCoverageLoader *loader,
+                      CoverStoryFilePredicate *predicate,
+                      BOOL quiet,
+                      NSString *reportPath,
+                      NSUInteger jobs)
+{
+    NSArray *fileDatas = nil;
+    @synchronized([loader dataSet])
+    {
+        fileDatas = [predicate filteredArrayFromArray:[[loader dataSet] valueForKey:@"fileDatas"]];
+    }
+    CoverStoryCoverageDiff *diff =
+        [[CoverStoryCoverageDiff alloc] initWithBaseFileDatas:[predicate filteredArrayFromArray:baseFileDatas]
+                                             currentFileDatas:fileDatas
+                                               maxConcurrency:jobs];
+    if (!quiet)
+    {
+        NSSortDescriptor *byPath = [NSSortDescriptor sortDescriptorWithKey:@"sourcePath" ascending:YES];
+        for (CoverStoryFileCoverageDiff *fileDiff in [[diff fileDiffs] sortedArrayUsingDescriptors:@[byPath]])
+        {
+            // the lines are what's useful, the list of them is in the report
+            NSUInteger missed  = [[fileDiff nowMissedLines] count];
+            NSUInteger covered = [[fileDiff nowCoveredLines] count];
+            if (!missed && !covered)
+            {
+                continue;
+            }
+            printf("%+6ld  %+6ld  %s\n", -(long)missed, (long)covered, [[fileDiff sourcePath] UTF8String]);
+        }
+    }
+    printf("Against the base: %s.\n", [[diff summaryString] UTF8String]);
+
+    NSError *error = nil;
+    if (reportPath && ![diff writeReportToFile:reportPath error:&error])
+    {
+        fprintf(stderr, "%s: error: writing the diff report failed: %s\n", [reportPath fileSystemRepresentation],
+                [[error localizedDescription] UTF8String]);
+        return kCSExitFailure;
+    }
+    if ([diff nowMissedCount])
+    {
+        fprintf(stderr, "coverstory-cli: %lu lines are newly missed\n", (unsigned long)[diff nowMissedCount]);
+        return kCSExitNewlyMissed;
+    }
+    return kCSExitSuccess;
+}
+
+int main(int argc, char *argv[])
+{
+    @autoreleasepool {
+        NSUInteger jobs          = 0;
+        float threshold          = -1.0f;
+        NSString *htmlDir        = nil;
+        NSString *shardPath      = nil;
+        NSString *resourceDir    = @COVERSTORY_RESOURCE_DIR;
+        NSString *gcovPath       = nil;
+        NSMutableArray *gcovDirs = [NSMutableArray array];
+        BOOL hideSDK             = NO;
+        BOOL hideUnittests       = NO;
+        NSString *filter         = nil;
+        BOOL useRegex            = NO;
+        BOOL quiet               = NO;
+        BOOL watch               = NO;
+        NSString *tracePath      = nil;
+        BOOL streamGCov          = NO;
+        NSMutableArray *diffBase = [NSMutableArray array];
+        NSString *diffReportPath = nil;
+        NSString *servePath      = nil;
+
+        enum { kOptGCov = 256, kOptGCovDir, kOptHideSDK, kOptHideUnittests, kOptRegex, kOptTrace, kOptStreamGCov,
+               kOptDiff, kOptDiffReport, kOptServe };
+        static const struct option longOptions[] = {
+            { "jobs",           required_argument, NULL, 'j' },
+            { "threshold",      required_argument, NULL, 't' },
+            { "html",           required_argument, NULL, 'o' },
+            { "shard",          required_argument, NULL, 's' },
+            { "resources",      required_argument, NULL, 'r' },
+            { "gcov",           required_argument, NULL, kOptGCov },
+            { "gcov-dir",       required_argument, NULL, kOptGCovDir },
+            { "hide-sdk",       no_argument,       NULL, kOptHideSDK },
+            { "hide-unittests", no_argument,       NULL, kOptHideUnittests },
+            { "filter",         required_argument, NULL, 'f' },
+            { "regex",          no_argument,       NULL, kOptRegex },
+            { "watch",          no_argument,       NULL, 'w' },
+            { "trace",          required_argument, NULL, kOptTrace },
+            { "stream-gcov",    no_argument,       NULL, kOptStreamGCov },
+            { "diff",           required_argument, NULL, kOptDiff },
+            { "diff-report",    required_argument, NULL, kOptDiffReport },
+            { "serve",          required_argument, NULL, kOptServe },
+            { "quiet",          no_argument,       NULL, 'q' },
+            { "help",           no_argument,       NULL, 'h' },
+            { NULL, 0, NULL, 0 },
+        };
+        int option;
+        while ((option = getopt_long(argc, argv, "j:t:o:s:r:f:wqh", longOptions, NULL)) != -1)
+        {
+            switch (option)
+            {
+                case 'j':
+                {
+                    char *end = NULL;
+                    jobs      = (NSUInteger)strtoul(optarg, &end, 10);
+                    if ((end == optarg) || *end || (*optarg == '-'))
+                    {
+                        fprintf(stderr, "coverstory-cli: error: --jobs needs a count, not '%s'\n", optarg);
+                        return kCSExitFailure;
+                    }
+                    break;
+                }
+                case 't':
+                {
+                    char *end = NULL;
+                    threshold = strtof(optarg, &end);
+                    if ((end == optarg) || *end)
+                    {
+                        fprintf(stderr, "coverstory-cli: error: --threshold needs a percentage, not '%s'\n", optarg);
+                        return kCSExitFailure;
+                    }
+                    break;
+                }
+                case 'o':
+                    htmlDir = @(optarg);
+                    break;
+                case 's':
+                    shardPath = @(optarg);
+                    break;
+                case 'r':
+                    resourceDir = @(optarg);
+                    break;
+                case kOptGCov:
+                    gcovPath = @(optarg);
+                    break;
+                case kOptGCovDir:
+                    [gcovDirs addObject:[@(optarg) stringByStandardizingPath]];
+                    break;
+                case kOptHideSDK:
+                    hideSDK = YES;
+                    break;
+                case kOptHideUnittests:
+                    hideUnittests = YES;
+                    break;
+                case 'f':
+                    filter = @(optarg);
+                    break;
+                case kOptRegex:
+                    useRegex = YES;
+                    break;
+                case 'w':
+                    watch = YES;
+                    break;
+                case kOptTrace:
+                    tracePath = @(optarg);
+                    break;
+                case kOptStreamGCov:
+                    streamGCov = YES;
+                    break;
+                case kOptDiff:
+                    [diffBase addObject:@(optarg)];
+                    break;
+                case kOptDiffReport:
+                    diffReportPath = @(optarg);
+                    break;
+                case kOptServe:
+                    servePath = @(optarg);
+                    break;
+                case 'q':
+                    quiet = YES;
+                    break;
+                case 'h':
+                    PrintUsage(stdout);
+                    return kCSExitSuccess;
+                default:
+                    PrintUsage(stderr);
+                    return kCSExitFailure;
+            }
+        }
+        if (optind >= argc)
+        {
+            PrintUsage(stderr);
+            return kCSExitFailure;
+        }
+        if (diffReportPath && ![diffBase count])
+        {
+            fputs("coverstory-cli: error: --diff-report needs --diff\n", stderr);
+            return kCSExitFailure;
+        }
+
+        // The predicate reads its patterns and the filter type from the
+        // defaults, keep ours out of anything persistent.
+        [CoverStoryFilePredicate registerDefaults];
+        NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+        CoverStoryFilterStringType filterType =
+            useRegex ? kCoverStoryFilterStringTypeRegularExpression : kCoverStoryFilterStringTypeWildcardPattern;
+        [defaults setVolatileDomain:@{ kCoverStoryFilterStringTypeKey: @(filterType) } forName:NSArgumentDomain];
+
+        if ([gcovDirs count])
+        {
+            [[GCovVersionManager defaultManager] setAdditionalSearchPaths:gcovDirs];
+        }
+        // looked for while the folders are being listed
+        [[GCovVersionManager defaultManager] discoverInBackground];
+        CSCoverageLoader *loader = [[CSCoverageLoader alloc] initWithJobs:jobs gcovPath:gcovPath];
+        BOOL argumentsGood       = YES;
+        // to reload a folder later, what it read has to be kept apart
+        [[loader dataSet] setKeepsOrigins:watch];
+        [loader setStreamsGCov:streamGCov];
+        if (tracePath)
+        {
+            [loader setTracer:[[CoverStoryTracer alloc] init]];
+        }
+        for (int x = optind; x < argc; ++x)
+        {
+            argumentsGood &= [loader addPath:@(argv[x])];
+        }
+        [loader waitUntilFinished];
+        if (tracePath && !WriteTrace([loader tracer], tracePath, quiet))
+        {
+            return kCSExitFailure;
+        }
+        // only the first load is traced
+        [loader setTracer:nil];
+        if (!argumentsGood)
+        {
+            return kCSExitFailure;
+        }
+
+        if (shardPath)
+        {
+            NSError *error = nil;
+            if (![CoverStoryCoverageShard writeFileDatas:[[loader dataSet] valueForKey:@"fileDatas"]
+                                                  toFile:shardPath
+                                                   error:&error])
+            {
+                fprintf(stderr, "%s: error: writing the shard failed: %s\n", [shardPath fileSystemRepresentation],
+                        [[error localizedDescription] UTF8String]);
+                return kCSExitFailure;
+            }
+        }
+
+        CoverStoryFilePredicate *predicate =
+            [[CoverStoryFilePredicate alloc] initWithHideSDKSources:hideSDK
+                                                hideUnittestSources:hideUnittests
+                                                       filterString:filter];
+        // the base is read once, and compared against every report
+        NSArray *baseFileDatas = nil;
+        if ([diffBase count])
+        {
+            CSCoverageLoader *baseLoader = [[CSCoverageLoader alloc] initWithJobs:jobs gcovPath:gcovPath];
+            [baseLoader setStreamsGCov:streamGCov];
+            BOOL baseGood = YES;
+            for (NSString *path in diffBase)
+            {
+                baseGood &= [baseLoader addPath:path];
+            }
+            [baseLoader waitUntilFinished];
+            if (!baseGood)
+            {
+                return kCSExitFailure;
+            }
+            baseFileDatas = [[baseLoader dataSet] valueForKey:@"fileDatas"];
+        }
+
+        int result = ReportCoverage(loader, predicate, quiet, htmlDir, resourceDir, jobs, threshold);
+        if (baseFileDatas)
+        {
+            int diffResult = ReportDiff(baseFileDatas, loader, predicate, quiet, diffReportPath, jobs);
+            if (result == kCSExitSuccess)
+            {
+                result = diffResult;
+            }
+        }
+        // answers queries about what was read, and after each reload
+        CoverStoryQueryServer *server = nil;
+        if (servePath)
+        {
+            server         = [[CoverStoryQueryServer alloc] initWithSocketPath:servePath];
+            NSError *error = nil;
+            if (![server startWithError:&error])
+            {
+                fprintf(stderr, "coverstory-cli: error: %s\n", [[error localizedDescription] UTF8String]);
+                return kCSExitFailure;
+            }
+            [server setIndex:[[CoverStoryLineIndex alloc] initWithFileDatas:[[loader dataSet] valueForKey:@"fileDatas"]]];
+            if (!quiet)
+            {
+                printf("Serving coverage queries on %s\n", [[server socketPath] fileSystemRepresentation]);
+            }
+        }
+        if (!watch && !server)
+        {
+            return result;
+        }
+
+        // Each watched folder reports from its own thread, take turns.
+        NSMutableArray *watchers = [NSMutableArray array];
+        for (int x = optind; watch && (x < argc); ++x)
+        {
+            NSString *path = [@(argv[x]) stringByStandardizingPath];
+            BOOL isDir     = NO;
+            if (![[NSFileManager defaultManager] fileExistsAtPath:path isDirectory:&isDir] || !isDir)
+            {
+                continue;
+            }
+            CoverStoryFolderWatcher *watcher =
+                [[CoverStoryFolderWatcher alloc] initWithPath:path
+                                                      latency:kCSWatchLatency
+                                                      handler:^(NSSet *changedFolders) {
+                    @synchronized(loader)
+                    {
+                        [loader reloadFolders:changedFolders];
+                        [server setIndex:[[CoverStoryLineIndex alloc]
+                                          initWithFileDatas:[[loader dataSet] valueForKey:@"fileDatas"]]];
+                        printf("\n");
+                        ReportCoverage(loader, predicate, quiet, htmlDir, resourceDir, jobs, threshold);
+                        if (baseFileDatas)
+                        {
+                            ReportDiff(baseFileDatas, loader, predicate, quiet, diffReportPath, jobs);
+                        }
+                        fflush(stdout);
+                    }
+                }];
+            if (![watcher start])
+            {
+                fprintf(stderr, "%s: error: couldn't watch for changes\n", [path fileSystemRepresentation]);
+                return kCSExitFailure;
+            }
+            [watchers addObject:watcher];
+        }
+        if (watch && ([watchers count] == 0))
+        {
+            fputs("coverstory-cli: error: --watch needs a build folder to watch\n", stderr);
+            return kCSExitFailure;
+        }
+        fflush(stdout);
+        // until interrupted
+        for (;;)
+        {
+            pause();
+        }
+    }
+    return kCSExitSuccess;
+}
@@ -0,0 +1,15 @@
+//
+//  CoverStoryBenchmarking.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// The benchmarks are slow, so they only run when CS_RUN_BENCHMARKS is set in
+// the environment.  Each one starts w/ |if (!ShouldRunBenchmarks()) return;|.
+
+#import <Foundation/Foundation.h>
+
+static inline BOOL ShouldRunBenchmarks(void)
+{
+    return getenv("CS_RUN_BENCHMARKS") != NULL;
+}
@@ -0,0 +1,131 @@
+//
+//  CoverStoryCoverageCacheTest.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "GTMSenTestCase.h"
+#import "CoverStoryCoverageCache.h"
+#import "CoverStoryCoverageFileData.h"
+#import "CoverStoryGCovDataReader.h"
+
+@interface CoverStoryCoverageCacheTest : SenTestCase {
+@private
+    NSString *_scratchDir;
+    NSString *_gcdaPath;
+    CoverStoryCoverageCache *_cache;
+}
+@end
+
+@implementation CoverStoryCoverageCacheTest
+
+- (void)setUp
+{
+    NSFileManager *fm    = [NSFileManager defaultManager];
+    NSBundle *testBundle = [NSBundle bundleForClass:[self class]];
+    NSString *gcda       = [testBundle pathForResource:@"test_i386_4_0" ofType:@"gcda"];
+    NSString *gcno       = [testBundle pathForResource:@"test_i386_4_0" ofType:@"gcno"];
+    STAssertNotNil(gcda, nil);
+    STAssertNotNil(gcno, nil);
+
+    _scratchDir = [NSTemporaryDirectory() stringByAppendingPathComponent:@"CoverStoryCoverageCacheTest"];
+    [fm removeItemAtPath:_scratchDir error:NULL];
+    NSString *unitDir = [_scratchDir stringByAppendingPathComponent:@"unit"];
+    STAssertTrue([fm createDirectoryAtPath:unitDir withIntermediateDirectories:YES attributes:nil error:NULL], nil);
+    _gcdaPath = [unitDir stringByAppendingPathComponent:@"test.gcda"];
+    STAssertTrue([fm copyItemAtPath:gcda toPath:_gcdaPath error:NULL], nil);
+    STAssertTrue([fm copyItemAtPath:gcno toPath:[unitDir stringByAppendingPathComponent:@"test.gcno"] error:NULL], nil);
+
+    _cache = [[CoverStoryCoverageCache alloc] initWithDirectory:[_scratchDir stringByAppendingPathComponent:@"cache"]];
+    STAssertNotNil(_cache, nil);
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_scratchDir error:NULL];
+}
+
+- (void)testRoundTrip
+{
+    STAssertNil([[CoverStoryCoverageCache alloc] initWithDirectory:nil], nil);
+    STAssertNil([_cache keyForGCDAPath:@"/does/not/exist.gcda" gcovVersion:@"gcov 4.0.1"], nil);
+
+    CoverStoryCoverageCacheKey *key = [_cache keyForGCDAPath:_gcdaPath gcovVersion:@"gcov 4.0.1"];
+    STAssertNotNil(key, nil);
+    STAssertNil([_cache fileDatasForKey:key document:nil], nil);
+    STAssertEquals([_cache missCount], (NSUInteger)1, nil);
+
+    NSArray *fileDatas = [CoverStoryGCovDataReader coverageFileDatasForGCDAPath:_gcdaPath
+                                                                       document:nil
+                                                                messageReceiver:nil];
+    STAssertGreaterThan([fileDatas count], (NSUInteger)0, nil);
+    STAssertTrue([_cache storeFileDatas:fileDatas forKey:key], nil);
+    STAssertEquals([_cache storeCount], (NSUInteger)1, nil);
+
+    // A fresh key for the same files finds it.
+    key = [_cache keyForGCDAPath:_gcdaPath gcovVersion:@"gcov 4.0.1"];
+    NSArray *cached = [_cache fileDatasForKey:key document:nil];
+    STAssertEquals([cached count], [fileDatas count], nil);
+    STAssertEquals([_cache hitCount], (NSUInteger)1, nil);
+    STAssertEqualsWithAccuracy([_cache hitRate], 0.5f, 0.001f, nil);
+    for (NSUInteger x = 0; x < [cached count]; ++x)
+    {
+        CoverStoryCoverageFileData *original = fileDatas[x];
+        CoverStoryCoverageFileData *copy     = cached[x];
+        STAssertEqualObjects([copy sourcePath], [original sourcePath], nil);
+        STAssertEquals([copy lineCount], [original lineCount], nil);
+        for (NSUInteger y = 0; y < [copy lineCount]; ++y)
+        {
+            STAssertEquals([copy hitCountForLineAtIndex:y], [original hitCountForLineAtIndex:y], @"line %lu", (unsigned long)y);
+            STAssertEqualObjects([copy lineAtIndex:y], [original lineAtIndex:y], @"line %lu", (unsigned long)y);
+        }
+        STAssertEqualObjects([copy queuedWarnings], [original queuedWarnings], nil);
+        // the copy is independent of what was mapped in
+        if ([copy lineCount])
+        {
+            [copy addHits:1 toLineAtIndex:0];
+        }
+    }
+    cached = [_cache fileDatasForKey:key document:nil];
+    STAssertEquals([cached[0] hitCountForLineAtIndex:0], [fileDatas[0] hitCountForLineAtIndex:0], nil);
+
+    // Any change to the key misses.
+    STAssertNil([_cache fileDatasForKey:[_cache keyForGCDAPath:_gcdaPath gcovVersion:@"gcov 4.2.1"]
+                               document:nil], nil);
+    NSDictionary *attributes = @{ NSFileModificationDate : [NSDate dateWithTimeIntervalSinceNow:-3600] };
+    STAssertTrue([[NSFileManager defaultManager] setAttributes:attributes ofItemAtPath:_gcdaPath error:NULL], nil);
+    STAssertNil([_cache fileDatasForKey:[_cache keyForGCDAPath:_gcdaPath gcovVersion:@"gcov 4.0.1"]
+                               document:nil], nil);
+
+    NSString *description = [_cache statisticsDescription];
+    STAssertNotNil(description, nil);
+    [_cache resetStatistics];
+    STAssertEquals([_cache hitCount], (NSUInteger)0, nil);
+    STAssertEquals([_cache missCount], (NSUInteger)0, nil);
+    STAssertEqualsWithAccuracy([_cache hitRate], 0.0f, 0.001f, nil);
+
+    STAssertTrue([_cache removeAllEntries], nil);
+    STAssertNil([_cache fileDatasForKey:key document:nil], nil);
+}
+
+- (void)testCorruptEntry
+{
+    CoverStoryCoverageCacheKey *key = [_cache keyForGCDAPath:_gcdaPath gcovVersion:nil];
+    STAssertNotNil(key, nil);
+    NSArray *fileDatas = [CoverStoryGCovDataReader coverageFileDatasForGCDAPath:_gcdaPath
+                                                                       document:nil
+                                                                messageReceiver:nil];
+    STAssertTrue([_cache storeFileDatas:fileDatas forKey:key], nil);
+
+    // Chop the end off the entry, it should just be a miss.
+    NSString *cacheDir = [_cache directory];
+    NSArray *entries   = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:cacheDir error:NULL];
+    STAssertEquals([entries count], (NSUInteger)1, nil);
+    NSString *entryPath = [cacheDir stringByAppendingPathComponent:entries[0]];
+    NSData *entry       = [NSData dataWithContentsOfFile:entryPath];
+    STAssertTrue([[entry subdataWithRange:NSMakeRange(0, [entry length] - 12)] writeToFile:entryPath atomically:YES], nil);
+    STAssertNil([_cache fileDatasForKey:key document:nil], nil);
+}
+
+@end
@@ -237,8 +237,307 @@
     // (ifdefs)
 }
 
+- (void)test6FileDataQueuedWarnings
+{
+    NSBundle *testBundle = [NSBundle bundleForClass:[self class]];
+    STAssertNotNil(testBundle, nil);
+    
+    // Foo2 has one executed line marked as non feasible
+    NSString *path = [testBundle pathForResource:@"Foo2" ofType:@"gcov"];
+    STAssertNotNil(path, nil);
+    CoverStoryCoverageFileData *data =
+    [CoverStoryCoverageFileData newCoverageFileDataFromPath:path
+                                                   document:nil
+                                            messageReceiver:nil];
+    STAssertNotNil(data, nil);
+    NSArray *warnings = [data queuedWarnings];
+    STAssertEquals([warnings count], (NSUInteger)1, nil);
+    STAssertEqualObjects([warnings objectAtIndex:0],
+                         @"Line 5 is marked as a Non Feasible line, but was executed.",
+                         nil);
+    
+    struct TestDataRecord {
+        NSUInteger index;
+        NSInteger hitCount;
+        char line[40];
+    } testData[] = {
+        { 0, kCoverStoryNotExecutedMarker, "//  Fake gcov data for testing with" },
+        { 1, 0, "unreached line 1" },
+        { 4, kCoverStoryNonFeasibleMarker, "reached line 1 //COV_NF_LINE" },
+        { 6, kCoverStoryNotExecutedMarker, "  //COV_NF_START" },
+        { 7, kCoverStoryNonFeasibleMarker, "unreached line 3" },
+        { 9, kCoverStoryNotExecutedMarker, "  // COV_NF_END" },
+        { 10, 9, "reached line 3" },
+        { 14, kCoverStoryNonFeasibleMarker, "code  // COV_NF_END" },
+    };
+    NSArray *lines = [data lines];
+    for (size_t x = 0; x < sizeof(testData) / sizeof(struct TestDataRecord); ++x)
+    {
+        CoverStoryCoverageLineData *line = [lines objectAtIndex:testData[x].index];
+        STAssertEquals([line hitCount], testData[x].hitCount, @"index %zu", x);
+        STAssertTrue([[line line] hasPrefix:@(testData[x].line)], @"index %zu", x);
+    }
+}
+
+- (void)test7FileDataColumns
+{
+    NSBundle *testBundle = [NSBundle bundleForClass:[self class]];
+    STAssertNotNil(testBundle, nil);
+    
+    NSString *path = [testBundle pathForResource:@"Foo1a" ofType:@"gcov"];
+    STAssertNotNil(path, nil);
+    CoverStoryCoverageFileData *data =
+    [CoverStoryCoverageFileData newCoverageFileDataFromPath:path
+                                                   document:nil
+                                            messageReceiver:nil];
+    STAssertNotNil(data, nil);
+    CoverStoryCoverageFileData *data2 =
+    [CoverStoryCoverageFileData newCoverageFileDataFromPath:path
+                                                   document:nil
+                                            messageReceiver:nil];
+    STAssertNotNil(data2, nil);
+    
+    // the line objects are just views on the columns
+    NSArray *lines           = [data lines];
+    const int64_t *hitCounts = [data hitCounts];
+    STAssertEquals([lines count], [data lineCount], nil);
+    NSMutableArray *before   = [NSMutableArray array];
+    for (NSUInteger x = 0; x < [data lineCount]; ++x)
+    {
+        CoverStoryCoverageLineData *line = [lines objectAtIndex:x];
+        STAssertEquals([line lineIndex], x, @"index %lu", (unsigned long)x);
+        STAssertEquals([line hitCount], (NSInteger)hitCounts[x], @"index %lu", (unsigned long)x);
+        STAssertEqualObjects([line line], [data lineAtIndex:x], @"index %lu", (unsigned long)x);
+        STAssertEqualObjects(line, [lines objectAtIndex:x], @"index %lu", (unsigned long)x);
+        [before addObject:@(hitCounts[x])];
+    }
+    
+    // adding a copy of itself doubles the real hits and leaves the rest alone
+    STAssertTrue([data addFileData:data2 messageReceiver:nil], nil);
+    hitCounts = [data hitCounts];
+    for (NSUInteger x = 0; x < [data lineCount]; ++x)
+    {
+        int64_t hits = [[before objectAtIndex:x] longLongValue];
+        STAssertEquals(hitCounts[x], hits > 0 ? hits * 2 : hits, @"index %lu", (unsigned long)x);
+    }
+    STAssertEquals([[data coverage] floatValue], [[data2 coverage] floatValue], nil);
+}
+
 #pragma mark CoverStoryCoverageSet
 
-// TODO: write these tests
+- (void)observeValueForKeyPath:(NSString *)keyPath
+                      ofObject:(id)object
+                        change:(NSDictionary *)change
+                       context:(void *)context
+{
+    // context is the change counter for the test
+    NSMutableArray *changes = (__bridge NSMutableArray *)context;
+    [changes addObject:change];
+}
+
+- (void)test8SetAddFileDatas
+{
+    NSBundle *testBundle = [NSBundle bundleForClass:[self class]];
+    STAssertNotNil(testBundle, nil);
+    
+    NSMutableArray *fileDatas = [NSMutableArray array];
+    for (NSString *name in @[ @"Foo1a", @"Foo2", @"Foo1b", @"Foo3" ])
+    {
+        NSString *path = [testBundle pathForResource:name ofType:@"gcov"];
+        STAssertNotNil(path, @"%@", name);
+        CoverStoryCoverageFileData *data =
+        [CoverStoryCoverageFileData newCoverageFileDataFromPath:path
+                                                       document:nil
+                                                messageReceiver:nil];
+        STAssertNotNil(data, @"%@", name);
+        [fileDatas addObject:data];
+    }
+    
+    CoverStoryCoverageSet *set = [[CoverStoryCoverageSet alloc] init];
+    NSMutableArray *changes    = [NSMutableArray array];
+    [set addObserver:self
+          forKeyPath:@"fileDatas"
+             options:NSKeyValueObservingOptionNew
+             context:(__bridge void *)changes];
+    
+    // Foo1a and Foo1b are both Foo.m, so they merge; one change for the batch
+    STAssertTrue([set addFileDatas:fileDatas messageReceiver:nil], nil);
+    STAssertEquals([changes count], (NSUInteger)1, nil);
+    NSArray *inSet = [set valueForKey:@"fileDatas"];
+    STAssertEquals([inSet count], (NSUInteger)3, nil);
+    STAssertEqualObjects([[inSet objectAtIndex:0] sourcePath], @"Foo.m", nil);
+    STAssertEqualObjects([[inSet objectAtIndex:1] sourcePath], @"Bar.m", nil);
+    STAssertEqualObjects([[inSet objectAtIndex:2] sourcePath], @"mcctest.c", nil);
+    NSIndexSet *indexes = [[changes objectAtIndex:0] objectForKey:NSKeyValueChangeIndexesKey];
+    STAssertEqualObjects(indexes, [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, 3)], nil);
+    
+    // merging into what's there doesn't post a change, new ones go at the end
+    NSString *path = [testBundle pathForResource:@"Foo1a" ofType:@"gcov"];
+    STAssertTrue([set addFileData:[CoverStoryCoverageFileData newCoverageFileDataFromPath:path
+                                                                                 document:nil
+                                                                          messageReceiver:nil]
+                  messageReceiver:nil], nil);
+    STAssertEquals([changes count], (NSUInteger)1, nil);
+    path = [testBundle pathForResource:@"NoEndingNewline" ofType:@"gcov"];
+    STAssertTrue([set addFileData:[CoverStoryCoverageFileData newCoverageFileDataFromPath:path
+                                                                                 document:nil
+                                                                          messageReceiver:nil]
+                  messageReceiver:nil], nil);
+    STAssertEquals([changes count], (NSUInteger)2, nil);
+    STAssertEqualObjects([[[set valueForKey:@"fileDatas"] lastObject] sourcePath], @"Baz.m", nil);
+    
+    // after clearing, the same paths are new again
+    [set removeAllData];
+    STAssertEquals([[set valueForKey:@"fileDatas"] count], (NSUInteger)0, nil);
+    STAssertTrue([set addFileData:[fileDatas objectAtIndex:1] messageReceiver:nil], nil);
+    STAssertEquals([[set valueForKey:@"fileDatas"] count], (NSUInteger)1, nil);
+    
+    [set removeObserver:self forKeyPath:@"fileDatas"];
+}
+
+- (CoverStoryCoverageFileData *)fileDataNamed:(NSString *)name
+{
+    NSString *path = [[NSBundle bundleForClass:[self class]] pathForResource:name ofType:@"gcov"];
+    STAssertNotNil(path, @"%@", name);
+    return [CoverStoryCoverageFileData newCoverageFileDataFromPath:path document:nil messageReceiver:nil];
+}
+
+- (void)test9SetReplaceByOrigin
+{
+    CoverStoryCoverageSet *set = [[CoverStoryCoverageSet alloc] init];
+    [set setKeepsOrigins:YES];
+    NSMutableArray *changes = [NSMutableArray array];
+    [set addObserver:self
+          forKeyPath:@"fileDatas"
+             options:NSKeyValueObservingOptionNew
+             context:(__bridge void *)changes];
+
+    // Foo.m comes from both folders, so it gets a copy to merge into and the
+    // first folder's stays as it was read
+    CoverStoryCoverageFileData *foo1a = [self fileDataNamed:@"Foo1a"];
+    STAssertTrue([set addFileDatas:@[ foo1a, [self fileDataNamed:@"Foo2"] ] fromOrigin:@"/a" messageReceiver:nil], nil);
+    STAssertTrue([set addFileDatas:@[ [self fileDataNamed:@"Foo1b"], [self fileDataNamed:@"Foo3"] ]
+                        fromOrigin:@"/b"
+                   messageReceiver:nil], nil);
+    NSArray *inSet = [set valueForKey:@"fileDatas"];
+    STAssertEquals([inSet count], (NSUInteger)3, nil);
+    CoverStoryCoverageFileData *foo = [inSet objectAtIndex:0];
+    CoverStoryCoverageFileData *bar = [inSet objectAtIndex:1];
+    STAssertTrue(foo != foo1a, nil);
+    CoverStoryCoverageFileData *merged = [self fileDataNamed:@"Foo1a"];
+    STAssertTrue([merged addFileData:[self fileDataNamed:@"Foo1b"] messageReceiver:nil], nil);
+    STAssertEquals(memcmp([foo hitCounts], [merged hitCounts], [foo lineCount] * sizeof(int64_t)), 0, nil);
+    CoverStoryCoverageFileData *fresh = [self fileDataNamed:@"Foo1a"];
+    STAssertEquals(memcmp([foo1a hitCounts], [fresh hitCounts], [foo1a lineCount] * sizeof(int64_t)), 0, nil);
+
+    // the same thing read again changes nothing
+    [changes removeAllObjects];
+    NSUInteger generation = [set contentGeneration];
+    NSDictionary *again   = @{ @"/b" : @[ [self fileDataNamed:@"Foo1b"], [self fileDataNamed:@"Foo3"] ] };
+    STAssertTrue([set replaceFileDatasByOrigin:again messageReceiver:nil], nil);
+    STAssertEquals([changes count], (NSUInteger)0, nil);
+    STAssertEquals([set contentGeneration], generation, nil);
+    STAssertTrue([[set valueForKey:@"fileDatas"] objectAtIndex:0] == foo, nil);
+
+    // dropping a folder puts Foo.m back to just what /a had and removes what
+    // only /b had
+    STAssertTrue([set replaceFileDatasByOrigin:@{ @"/b" : @[] } messageReceiver:nil], nil);
+    inSet = [set valueForKey:@"fileDatas"];
+    STAssertEquals([inSet count], (NSUInteger)2, nil);
+    STAssertTrue([inSet objectAtIndex:0] == foo1a, nil);
+    STAssertTrue([inSet objectAtIndex:1] == bar, nil);
+    STAssertEquals([changes count], (NSUInteger)2, nil);
+    STAssertEquals([set contentGeneration], generation + 2, nil);
+    STAssertEquals([[[changes objectAtIndex:0] objectForKey:NSKeyValueChangeKindKey] integerValue],
+                   (NSInteger)NSKeyValueChangeReplacement, nil);
+    STAssertEquals([[[changes objectAtIndex:1] objectForKey:NSKeyValueChangeKindKey] integerValue],
+                   (NSInteger)NSKeyValueChangeRemoval, nil);
+
+    // a folder coming back appends what's new to it
+    [changes removeAllObjects];
+    STAssertTrue([set replaceFileDatasByOrigin:@{ @"/c" : @[ [self fileDataNamed:@"NoEndingNewline"] ] }
+                               messageReceiver:nil], nil);
+    STAssertEquals([changes count], (NSUInteger)1, nil);
+    STAssertEqualObjects([[[set valueForKey:@"fileDatas"] lastObject] sourcePath], @"Baz.m", nil);
+
+    [set removeObserver:self forKeyPath:@"fileDatas"];
+}
+
+// The set's running totals have to come out the same as adding them all up.
+- (void)assertTotalsOfSet:(CoverStoryCoverageSet *)set
+{
+    NSInteger totals[4] = { 0, 0, 0, 0 };
+    NSInteger summed[4] = { 0, 0, 0, 0 };
+    [set coverageTotalLines:&totals[0]
+                  codeLines:&totals[1]
+               hitCodeLines:&totals[2]
+           nonFeasibleLines:&totals[3]
+             coverageString:NULL
+                   coverage:NULL];
+    [[[set valueForKey:@"fileDatas"] objectEnumerator] coverageTotalLines:&summed[0]
+                                                                codeLines:&summed[1]
+                                                             hitCodeLines:&summed[2]
+                                                         nonFeasibleLines:&summed[3]
+                                                           coverageString:NULL
+                                                                 coverage:NULL];
+    for (int x = 0; x < 4; ++x)
+    {
+        STAssertEquals(totals[x], summed[x], @"count %d", x);
+    }
+}
+
+- (void)test10SetRunningTotals
+{
+    // the sort key follows the hit counts
+    CoverStoryCoverageFileData *foo1a = [self fileDataNamed:@"Foo1a"];
+    float coverage                    = 0.0f;
+    [foo1a coverageTotalLines:NULL
+                    codeLines:NULL
+                 hitCodeLines:NULL
+             nonFeasibleLines:NULL
+               coverageString:NULL
+                     coverage:&coverage];
+    STAssertEquals([foo1a coverageSortKey], coverage, nil);
+    STAssertEquals([[foo1a coverage] floatValue], coverage, nil);
+    CoverStoryLineCounts before = [foo1a lineCounts];
+    STAssertEquals(before.totalLines, (NSInteger)[foo1a lineCount], nil);
+
+    CoverStoryCoverageSet *set = [[CoverStoryCoverageSet alloc] init];
+    NSMutableArray *handled    = [NSMutableArray array];
+    [set setCountsChangedHandler:^(CoverStoryCoverageFileData *fileData, CoverStoryLineCounts countsBefore) {
+        [handled addObject:fileData];
+    }];
+    STAssertTrue([set addFileDatas:@[ foo1a, [self fileDataNamed:@"Foo2"] ] messageReceiver:nil], nil);
+    [self assertTotalsOfSet:set];
+    STAssertEquals([handled count], (NSUInteger)0, nil);
+
+    // merging into what's there re-counts it and tells the handler
+    STAssertTrue([set addFileDatas:@[ [self fileDataNamed:@"Foo1b"], [self fileDataNamed:@"Foo3"] ]
+                   messageReceiver:nil], nil);
+    [self assertTotalsOfSet:set];
+    STAssertEquals([handled count], (NSUInteger)1, nil);
+    STAssertTrue([handled lastObject] == foo1a, nil);
+    STAssertFalse(coverageLineCountsEqual(before, [foo1a lineCounts]), nil);
+    [set removeAllData];
+    [self assertTotalsOfSet:set];
+
+    // and when keeping origins, through copies, swaps and removals
+    set = [[CoverStoryCoverageSet alloc] init];
+    [set setKeepsOrigins:YES];
+    STAssertTrue([set addFileDatas:@[ [self fileDataNamed:@"Foo1a"], [self fileDataNamed:@"Foo2"] ]
+                        fromOrigin:@"/a"
+                   messageReceiver:nil], nil);
+    STAssertTrue([set addFileDatas:@[ [self fileDataNamed:@"Foo1b"], [self fileDataNamed:@"Foo3"] ]
+                        fromOrigin:@"/b"
+                   messageReceiver:nil], nil);
+    [self assertTotalsOfSet:set];
+    STAssertTrue([set addFileDatas:@[ [self fileDataNamed:@"Foo1a"] ] fromOrigin:@"/a" messageReceiver:nil], nil);
+    [self assertTotalsOfSet:set];
+    STAssertTrue([set replaceFileDatasByOrigin:@{ @"/b" : @[] } messageReceiver:nil], nil);
+    [self assertTotalsOfSet:set];
+    STAssertTrue([set replaceFileDatasByOrigin:@{ @"/c" : @[ [self fileDataNamed:@"NoEndingNewline"] ] }
+                               messageReceiver:nil], nil);
+    [self assertTotalsOfSet:set];
+}
 
 @end
@@ -0,0 +1,186 @@
+//
+//  CoverStoryCoverageDiffTest.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "GTMSenTestCase.h"
+#import "CoverStoryCoverageDiff.h"
+#import "CoverStoryCoverageFileData+Testing.h"
+
+@interface CoverStoryCoverageDiffTest : SenTestCase
+@end
+
+@implementation CoverStoryCoverageDiffTest
+
+- (void)testUnchanged
+{
+    NSArray *lines                       = @[ @"int a;", @"a = 1;", @"// b", @"return a;" ];
+    const int64_t hits[]                 = { 1, 0, -1, 3 };
+    CoverStoryCoverageFileData *base     = [CoverStoryCoverageFileData fileDataWithPath:@"/a.c" lines:lines hits:hits];
+    CoverStoryCoverageFileData *current  = [CoverStoryCoverageFileData fileDataWithPath:@"/a.c" lines:lines hits:hits];
+    CoverStoryCoverageDiff *diff = [[CoverStoryCoverageDiff alloc] initWithBaseFileDatas:@[base]
+                                                                        currentFileDatas:@[current]
+                                                                          maxConcurrency:0];
+    STAssertEquals([[diff fileDiffs] count], (NSUInteger)0, nil);
+    STAssertEquals([diff nowMissedCount], (NSUInteger)0, nil);
+    STAssertEquals([diff baseSourceCount], (NSUInteger)1, nil);
+    STAssertEquals([diff currentSourceCount], (NSUInteger)1, nil);
+    STAssertTrue(coverageLineCountsEqual([diff baseLineCounts], [diff currentLineCounts]), nil);
+    STAssertNil([diff fileDiffForSourcePath:@"/a.c"], nil);
+}
+
+- (void)testSameText
+{
+    // more than a block of counts, w/ a change on either side of it
+    NSMutableArray *lines = [NSMutableArray array];
+    for (int x = 0; x < 12; ++x)
+    {
+        [lines addObject:[NSString stringWithFormat:@"line %d;", x]];
+    }
+    const int64_t baseHits[]    = { 1, 0, -1, 3, 2, 0, 1, 1, 1, 1, 0, 4 };
+    const int64_t currentHits[] = { 0, 1, -1, 5, 2, 0, 1, 1, 1, 1, 0, -1 };
+    CoverStoryCoverageFileData *base    = [CoverStoryCoverageFileData fileDataWithPath:@"/a.c" lines:lines hits:baseHits];
+    CoverStoryCoverageFileData *current = [CoverStoryCoverageFileData fileDataWithPath:@"/a.c" lines:lines hits:currentHits];
+    CoverStoryCoverageDiff *diff = [[CoverStoryCoverageDiff alloc] initWithBaseFileDatas:@[base]
+                                                                        currentFileDatas:@[current]
+                                                                          maxConcurrency:1];
+    STAssertEquals([[diff fileDiffs] count], (NSUInteger)1, nil);
+    CoverStoryFileCoverageDiff *fileDiff = [diff fileDiffForSourcePath:@"/a.c"];
+    STAssertNotNil(fileDiff, nil);
+    STAssertEquals([fileDiff kind], kCoverStoryFileDiffChanged, nil);
+    STAssertFalse([fileDiff realigned], nil);
+    STAssertEqualObjects([fileDiff nowMissedLines], [NSIndexSet indexSetWithIndex:0], nil);
+    STAssertEqualObjects([fileDiff nowCoveredLines], [NSIndexSet indexSetWithIndex:1], nil);
+    STAssertEqualObjects([fileDiff countChangedLines], [NSIndexSet indexSetWithIndex:3], nil);
+    STAssertEquals([diff nowMissedCount], (NSUInteger)1, nil);
+    STAssertEquals([diff nowCoveredCount], (NSUInteger)1, nil);
+    STAssertEquals([diff countChangedCount], (NSUInteger)1, nil);
+}
+
+- (void)testRealigned
+{
+    NSArray *baseLines          = @[ @"a();", @"b();", @"c();", @"d();" ];
+    const int64_t baseHits[]    = { 1, 1, 0, 1 };
+    NSArray *currentLines       = @[ @"a();", @"x();", @"b();", @"c();", @"d();" ];
+    const int64_t currentHits[] = { 1, 0, 1, 1, 1 };
+    CoverStoryCoverageFileData *base    = [CoverStoryCoverageFileData fileDataWithPath:@"/a.c" lines:baseLines hits:baseHits];
+    CoverStoryCoverageFileData *current = [CoverStoryCoverageFileData fileDataWithPath:@"/a.c" lines:currentLines hits:currentHits];
+    CoverStoryCoverageDiff *diff = [[CoverStoryCoverageDiff alloc] initWithBaseFileDatas:@[base]
+                                                                        currentFileDatas:@[current]
+                                                                          maxConcurrency:0];
+    CoverStoryFileCoverageDiff *fileDiff = [diff fileDiffForSourcePath:@"/a.c"];
+    STAssertNotNil(fileDiff, nil);
+    STAssertTrue([fileDiff realigned], nil);
+    // the new line is missed, and c() moved down one and got covered
+    STAssertEqualObjects([fileDiff nowMissedLines], [NSIndexSet indexSetWithIndex:1], nil);
+    STAssertEqualObjects([fileDiff nowCoveredLines], [NSIndexSet indexSetWithIndex:3], nil);
+    STAssertEquals([[fileDiff countChangedLines] count], (NSUInteger)0, nil);
+
+    // an edit that doesn't change the coverage isn't listed
+    const int64_t sameHits[] = { 1, -1, 1, 0, 1 };
+    NSArray *commented       = @[ @"a();", @"// x", @"b();", @"c();", @"d();" ];
+    base    = [CoverStoryCoverageFileData fileDataWithPath:@"/a.c" lines:baseLines hits:baseHits];
+    current = [CoverStoryCoverageFileData fileDataWithPath:@"/a.c" lines:commented hits:sameHits];
+    diff    = [[CoverStoryCoverageDiff alloc] initWithBaseFileDatas:@[base]
+                                                currentFileDatas:@[current]
+                                                  maxConcurrency:0];
+    STAssertEquals([[diff fileDiffs] count], (NSUInteger)0, nil);
+}
+
+- (void)testTooManyEdits
+{
+    // reversing the file is far more edits than Myers is allowed, so the lines
+    // are matched up by the ones that are unique
+    static const NSUInteger kLineCount = 3000;
+    NSMutableArray *baseLines    = [NSMutableArray array];
+    NSMutableArray *currentLines = [NSMutableArray array];
+    NSMutableData *baseHits      = [NSMutableData dataWithLength:kLineCount * sizeof(int64_t)];
+    NSMutableData *currentHits   = [NSMutableData dataWithLength:kLineCount * sizeof(int64_t)];
+    int64_t *was                 = [baseHits mutableBytes];
+    int64_t *now                 = [currentHits mutableBytes];
+    for (NSUInteger x = 0; x < kLineCount; ++x)
+    {
+        [baseLines addObject:[NSString stringWithFormat:@"f%lu();", (unsigned long)x]];
+        [currentLines addObject:[NSString stringWithFormat:@"f%lu();", (unsigned long)(kLineCount - 1 - x)]];
+        was[x] = (int64_t)x + 1;
+        now[x] = (int64_t)(kLineCount - x);
+    }
+    // f10() isn't hit anymore
+    now[kLineCount - 1 - 10] = 0;
+    CoverStoryCoverageFileData *base    = [CoverStoryCoverageFileData fileDataWithPath:@"/a.c" lines:baseLines hits:was];
+    CoverStoryCoverageFileData *current = [CoverStoryCoverageFileData fileDataWithPath:@"/a.c" lines:currentLines hits:now];
+    CoverStoryCoverageDiff *diff = [[CoverStoryCoverageDiff alloc] initWithBaseFileDatas:@[base]
+                                                                        currentFileDatas:@[current]
+                                                                          maxConcurrency:0];
+    CoverStoryFileCoverageDiff *fileDiff = [diff fileDiffForSourcePath:@"/a.c"];
+    STAssertNotNil(fileDiff, nil);
+    STAssertTrue([fileDiff realigned], nil);
+    STAssertEqualObjects([fileDiff nowMissedLines], [NSIndexSet indexSetWithIndex:kLineCount - 1 - 10], nil);
+    STAssertEquals([[fileDiff nowCoveredLines] count], (NSUInteger)0, nil);
+    STAssertEquals([[fileDiff countChangedLines] count], (NSUInteger)0, nil);
+}
+
+- (void)testAddedAndRemoved
+{
+    NSArray *lines       = @[ @"a();", @"b();", @"c();" ];
+    const int64_t hits[] = { 1, 0, 0 };
+    NSMutableArray *base    = [NSMutableArray array];
+    NSMutableArray *current = [NSMutableArray array];
+    // enough sources that they're split up between workers
+    for (int x = 0; x < 200; ++x)
+    {
+        NSString *path = [NSString stringWithFormat:@"/src/%d.c", x];
+        [base addObject:[CoverStoryCoverageFileData fileDataWithPath:path lines:lines hits:hits]];
+        [current addObject:[CoverStoryCoverageFileData fileDataWithPath:path lines:lines hits:hits]];
+    }
+    [base addObject:[CoverStoryCoverageFileData fileDataWithPath:@"/gone.c" lines:lines hits:hits]];
+    [current addObject:[CoverStoryCoverageFileData fileDataWithPath:@"/new.c" lines:lines hits:hits]];
+    CoverStoryCoverageDiff *diff = [[CoverStoryCoverageDiff alloc] initWithBaseFileDatas:base
+                                                                        currentFileDatas:current
+                                                                          maxConcurrency:4];
+    STAssertEquals([[diff fileDiffs] count], (NSUInteger)2, nil);
+    STAssertEquals([diff addedSourceCount], (NSUInteger)1, nil);
+    STAssertEquals([diff removedSourceCount], (NSUInteger)1, nil);
+    CoverStoryFileCoverageDiff *added = [diff fileDiffForSourcePath:@"/new.c"];
+    STAssertEquals([added kind], kCoverStoryFileDiffAdded, nil);
+    STAssertEqualObjects([added nowMissedLines], [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(1, 2)], nil);
+    CoverStoryFileCoverageDiff *removed = [diff fileDiffForSourcePath:@"/gone.c"];
+    STAssertEquals([removed kind], kCoverStoryFileDiffRemoved, nil);
+    STAssertEquals([[removed nowMissedLines] count], (NSUInteger)0, nil);
+    STAssertEquals([removed currentLineCounts].totalLines, (NSInteger)0, nil);
+    STAssertEquals([diff nowMissedCount], (NSUInteger)2, nil);
+    STAssertEquals([diff baseSourceCount], (NSUInteger)201, nil);
+    STAssertEquals([diff currentSourceCount], (NSUInteger)201, nil);
+}
+
+- (void)testReport
+{
+    NSArray *lines              = @[ @"a();", @"b();", @"c();" ];
+    const int64_t baseHits[]    = { 1, 1, 0 };
+    const int64_t currentHits[] = { 1, 0, 1 };
+    CoverStoryCoverageFileData *base    = [CoverStoryCoverageFileData fileDataWithPath:@"/a.c" lines:lines hits:baseHits];
+    CoverStoryCoverageFileData *current = [CoverStoryCoverageFileData fileDataWithPath:@"/a.c" lines:lines hits:currentHits];
+    CoverStoryCoverageDiff *diff = [[CoverStoryCoverageDiff alloc] initWithBaseFileDatas:@[base]
+                                                                        currentFileDatas:@[current]
+                                                                          maxConcurrency:0];
+    NSData *json = [diff reportJSONData];
+    STAssertNotNil(json, nil);
+    NSDictionary *report = [NSJSONSerialization JSONObjectWithData:json options:0 error:NULL];
+    STAssertEqualObjects(report[@"newlyMissedLines"], @1, nil);
+    STAssertEqualObjects(report[@"newlyCoveredLines"], @1, nil);
+    STAssertEqualObjects(report[@"base"][@"sources"], @1, nil);
+    STAssertEqualObjects(report[@"current"][@"hitCodeLines"], @2, nil);
+    NSArray *sources = report[@"sources"];
+    STAssertEquals([sources count], (NSUInteger)1, nil);
+    NSDictionary *source = [sources lastObject];
+    STAssertEqualObjects(source[@"sourcePath"], @"/a.c", nil);
+    STAssertEqualObjects(source[@"status"], @"changed", nil);
+    // 1 based
+    STAssertEqualObjects(source[@"newlyMissed"], @[ @2 ], nil);
+    STAssertEqualObjects(source[@"newlyCovered"], @[ @3 ], nil);
+    STAssertEqualObjects([diff summaryString], @"1 newly missed, 1 newly covered lines (66.7% -> 66.7%)", nil);
+}
+
+@end
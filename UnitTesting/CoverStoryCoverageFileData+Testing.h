@@ -0,0 +1,19 @@
+//
+//  CoverStoryCoverageFileData+Testing.h
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// Builds file datas for the tests w/o going through gcov.
+
+#import "CoverStoryCoverageFileData.h"
+
+@interface CoverStoryCoverageFileData (Testing)
+
+// A source w/ |lines| (no newlines) and |hits| (one per line, markers and
+// all, used as is).
++ (CoverStoryCoverageFileData *)fileDataWithPath:(NSString *)path lines:(NSArray *)lines hits:(const int64_t *)hits;
+// Same, w/ |count| made up lines ("line0();", "line1();"...).
++ (CoverStoryCoverageFileData *)fileDataWithPath:(NSString *)path hits:(const int64_t *)hits count:(NSUInteger)count;
+
+@end
@@ -0,0 +1,42 @@
+//
+//  CoverStoryCoverageFileData+Testing.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "CoverStoryCoverageFileData+Testing.h"
+
+@implementation CoverStoryCoverageFileData (Testing)
+
++ (CoverStoryCoverageFileData *)fileDataWithPath:(NSString *)path lines:(NSArray *)lines hits:(const int64_t *)hits
+{
+    NSMutableData *text   = [NSMutableData data];
+    NSMutableData *ranges = [NSMutableData data];
+    for (NSString *line in lines)
+    {
+        NSData *bytes             = [line dataUsingEncoding:NSUTF8StringEncoding];
+        CoverStoryLineRange range = { (uint32_t)[text length], (uint32_t)[bytes length] };
+        [text appendData:bytes];
+        [ranges appendBytes:&range length:sizeof(range)];
+    }
+    NSData *hitCounts = [NSData dataWithBytes:hits length:[lines count] * sizeof(int64_t)];
+    return [[CoverStoryCoverageFileData alloc] initWithSourcePath:path
+                                                             text:text
+                                                       lineRanges:ranges
+                                                        hitCounts:hitCounts
+                                          applyNonFeasibleMarkers:NO
+                                                         document:nil];
+}
+
++ (CoverStoryCoverageFileData *)fileDataWithPath:(NSString *)path hits:(const int64_t *)hits count:(NSUInteger)count
+{
+    NSMutableArray *lines = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger x = 0; x < count; ++x)
+    {
+        [lines addObject:[NSString stringWithFormat:@"line%lu();", (unsigned long)x]];
+    }
+    return [self fileDataWithPath:path lines:lines hits:hits];
+}
+
+@end
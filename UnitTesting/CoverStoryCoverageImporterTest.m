@@ -0,0 +1,254 @@
+//
+//  CoverStoryCoverageImporterTest.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "GTMSenTestCase.h"
+#import "CoverStoryCoverageImporter.h"
+#import "CoverStoryCoverageFileData.h"
+
+// Counts what the import reports.
+@interface CSImporterTestReceiver : NSObject<CoverStoryCoverageProcessingProtocol> {
+@public
+    NSUInteger _errorCount;
+    NSUInteger _warningCount;
+}
+@end
+
+@implementation CSImporterTestReceiver
+
+- (void)coverageErrorForPath:(NSString *)path message:(NSString *)format, ...
+{
+    @synchronized(self)
+    {
+        ++_errorCount;
+    }
+}
+
+- (void)coverageWarningForPath:(NSString *)path message:(NSString *)format, ...
+{
+    @synchronized(self)
+    {
+        ++_warningCount;
+    }
+}
+
+@end
+
+@interface CoverStoryCoverageImporterTest : SenTestCase {
+@private
+    NSString *_tempDir;
+}
+@end
+
+@implementation CoverStoryCoverageImporterTest
+
+- (void)setUp
+{
+    _tempDir = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                [NSString stringWithFormat:@"CoverStoryCoverageImporterTest-%@",
+                 [[NSProcessInfo processInfo] globallyUniqueString]]];
+    [[NSFileManager defaultManager] createDirectoryAtPath:_tempDir
+                              withIntermediateDirectories:YES
+                                               attributes:nil
+                                                    error:NULL];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_tempDir error:NULL];
+}
+
+- (NSString *)writeFileNamed:(NSString *)name contents:(NSString *)contents
+{
+    NSString *path = [_tempDir stringByAppendingPathComponent:name];
+    STAssertTrue([contents writeToFile:path atomically:YES encoding:NSUTF8StringEncoding error:NULL], nil);
+    return path;
+}
+
+// The file datas from importing |path|, in record order.
+- (NSArray *)importPath:(NSString *)path
+        maxConcurrency:(NSUInteger)maxConcurrency
+    maxRecordsInFlight:(NSUInteger)maxRecordsInFlight
+              receiver:(CSImporterTestReceiver *)receiver
+{
+    CoverStoryCoverageImporter *importer =
+        [[CoverStoryCoverageImporter alloc] initWithMaxConcurrency:maxConcurrency
+                                                maxRecordsInFlight:maxRecordsInFlight];
+    NSMutableArray *fileDatas = [NSMutableArray array];
+    STAssertTrue([importer importFileAtPath:path
+                                   document:nil
+                            messageReceiver:receiver
+                                    handler:^(CoverStoryCoverageFileData *fileData) {
+                                        @synchronized(fileDatas)
+                                        {
+                                            [fileDatas addObject:fileData];
+                                        }
+                                    }], nil);
+    return fileDatas;
+}
+
+- (void)assertFileData:(CoverStoryCoverageFileData *)fileData
+                  hits:(const int64_t *)hits
+                 count:(NSUInteger)count
+{
+    STAssertEquals([fileData lineCount], count, @"%@", [fileData sourcePath]);
+    for (NSUInteger x = 0; x < MIN(count, [fileData lineCount]); ++x)
+    {
+        STAssertEquals([fileData hitCountForLineAtIndex:x], (NSInteger)hits[x], @"line %lu", (unsigned long)x + 1);
+    }
+}
+
+- (void)testFormatOfFile
+{
+    NSString *info  = [self writeFileNamed:@"a.info" contents:@"TN:\nSF:a.c\nend_of_record\n"];
+    NSString *bare  = [self writeFileNamed:@"coverage" contents:@"SF:a.c\nend_of_record\n"];
+    NSString *json  = [self writeFileNamed:@"a.json" contents:@" {\n  \"data\": []}"];
+    NSString *other = [self writeFileNamed:@"b.json" contents:@"{\"name\": \"CoverStory\"}"];
+    NSString *text  = [self writeFileNamed:@"a.txt" contents:@"hello"];
+    STAssertEquals([CoverStoryCoverageImporter formatOfFileAtPath:info], kCoverStoryImportFormatLCov, nil);
+    STAssertEquals([CoverStoryCoverageImporter formatOfFileAtPath:bare], kCoverStoryImportFormatLCov, nil);
+    STAssertEquals([CoverStoryCoverageImporter formatOfFileAtPath:json], kCoverStoryImportFormatLLVMCov, nil);
+    STAssertEquals([CoverStoryCoverageImporter formatOfFileAtPath:other], kCoverStoryImportFormatNone, nil);
+    STAssertEquals([CoverStoryCoverageImporter formatOfFileAtPath:text], kCoverStoryImportFormatNone, nil);
+    STAssertEquals([CoverStoryCoverageImporter formatOfFileAtPath:@"/does/not/exist.info"],
+                   kCoverStoryImportFormatNone, nil);
+}
+
+- (void)testLCov
+{
+    NSString *source = [self writeFileNamed:@"a.c"
+                                   contents:@"int main() {\n  if (x)\n    abort(); // COV_NF_LINE\n  return 0;\n}\n"];
+    NSString *info   = [self writeFileNamed:@"a.info"
+                                   contents:@"TN:unit\n"
+                                             "SF:a.c\n"
+                                             "FN:1,main\n"
+                                             "FNDA:3,main\n"
+                                             "DA:1,3\n"
+                                             "DA:2,3,d41d8cd98f00b204e9800998ecf8427e\n"
+                                             "DA:3,0\n"
+                                             "DA:4,1\r\n"
+                                             "DA:4,2\n"
+                                             "DA:5,-1\n"
+                                             "DA:7,1\n"
+                                             "BRDA:2,0,0,3\n"
+                                             "LF:6\n"
+                                             "LH:5\n"
+                                             "end_of_record\n"];
+    CSImporterTestReceiver *receiver = [[CSImporterTestReceiver alloc] init];
+    NSArray *fileDatas               = [self importPath:info maxConcurrency:0 maxRecordsInFlight:0 receiver:receiver];
+    STAssertEquals(receiver->_errorCount, (NSUInteger)0, nil);
+    STAssertEquals([fileDatas count], (NSUInteger)1, nil);
+    CoverStoryCoverageFileData *fileData = fileDatas[0];
+    // relative to the tracefile
+    STAssertEqualObjects([fileData sourcePath], [source stringByStandardizingPath], nil);
+    // the lines past the end of the source are filled in
+    int64_t hits[] = { 3, 3, kCoverStoryNonFeasibleMarker, 3, kCoverStoryNotExecutedMarker,
+                       kCoverStoryNotExecutedMarker, 1 };
+    [self assertFileData:fileData hits:hits count:sizeof(hits) / sizeof(hits[0])];
+    STAssertEqualObjects([fileData lineAtIndex:0], @"int main() {", nil);
+    STAssertEqualObjects([fileData lineAtIndex:6], @"/*EOF*/", nil);
+}
+
+- (void)testLCovRecordsMerge
+{
+    [self writeFileNamed:@"b.c" contents:@"a();\nb();\n"];
+    NSString *info = [self writeFileNamed:@"b.info"
+                                 contents:@"TN:first\nSF:b.c\nDA:1,1\nDA:2,0\nend_of_record\n"
+                                           "TN:second\nSF:b.c\nDA:1,2\nDA:2,5\nend_of_record\n"
+                                           "TN:bad\nSF:b.c\nDA:one,2\nend_of_record\n"
+                                           "TN:none\nSF:b.c\nend_of_record\n"
+                                           "SF:missing.c\nDA:1,1\n"];
+    CSImporterTestReceiver *receiver = [[CSImporterTestReceiver alloc] init];
+    NSArray *fileDatas               = [self importPath:info maxConcurrency:2 maxRecordsInFlight:1 receiver:receiver];
+    // the bad line, and the missing source
+    STAssertEquals(receiver->_errorCount, (NSUInteger)2, nil);
+    STAssertEquals([fileDatas count], (NSUInteger)3, nil);
+    NSMutableArray *sources = [NSMutableArray array];
+    for (CoverStoryCoverageFileData *fileData in fileDatas)
+    {
+        if ([[fileData sourcePath] hasSuffix:@"b.c"])
+        {
+            [sources addObject:fileData];
+        }
+    }
+    STAssertEquals([sources count], (NSUInteger)2, nil);
+    CoverStoryCoverageFileData *merged = sources[0];
+    STAssertTrue([merged addFileData:sources[1] messageReceiver:receiver], nil);
+    int64_t hits[] = { 3, 5 };
+    [self assertFileData:merged hits:hits count:2];
+}
+
+- (void)testLCovAcrossReads
+{
+    // bigger than what's read at a time, so records span the reads
+    NSString *source             = [self writeFileNamed:@"c.c" contents:@"a();\nb();\nc();\n"];
+    NSMutableString *lcov        = [NSMutableString string];
+    const NSUInteger recordCount = 40000;
+    for (NSUInteger x = 0; x < recordCount; ++x)
+    {
+        [lcov appendFormat:@"TN:test_%lu\nSF:%@\nDA:1,1\nDA:3,%lu\nend_of_record\n",
+         (unsigned long)x, source, (unsigned long)x];
+    }
+    NSString *info = [self writeFileNamed:@"c.info" contents:lcov];
+    CoverStoryCoverageImporter *importer = [[CoverStoryCoverageImporter alloc] initWithMaxConcurrency:0
+                                                                                    maxRecordsInFlight:0];
+    CSImporterTestReceiver *receiver     = [[CSImporterTestReceiver alloc] init];
+    __block int64_t total                = 0;
+    STAssertTrue([importer importFileAtPath:info
+                                   document:nil
+                            messageReceiver:receiver
+                                    handler:^(CoverStoryCoverageFileData *fileData) {
+                                        @synchronized(receiver)
+                                        {
+                                            total += [fileData hitCountForLineAtIndex:2];
+                                        }
+                                    }], nil);
+    STAssertEquals(receiver->_errorCount, (NSUInteger)0, nil);
+    STAssertEquals([importer recordCount], recordCount, nil);
+    STAssertEquals(total, (int64_t)(recordCount * (recordCount - 1) / 2), nil);
+}
+
+- (void)testLLVMCov
+{
+    NSString *source = [self writeFileNamed:@"d.c"
+                                   contents:@"int main() {\n  return 0;\n}\n\n#if 0\n#endif\nvoid unused() {\n}\n"];
+    NSString *export =
+        [NSString stringWithFormat:
+         @"{\"data\":[{\"files\":[{\"filename\":\"%@\","
+          "\"segments\":[[1,12,5,true,true,false],[3,2,0,false,false,false],"
+          "[5,1,0,false,true,false],[6,7,0,false,false,false],"
+          "[7,15,0,true,true,false],[8,2,0,false,false,false]],"
+          "\"branches\":[],\"summary\":{\"lines\":{\"count\":5,\"covered\":3}}},"
+          "{\"filename\":\"missing.c\",\"segments\":[[1,1,1,true,true]]},"
+          "{\"filename\":\"bad.c\",\"segments\":[[1,1]]}],"
+          "\"functions\":[{\"name\":\"main\",\"count\":5,\"filenames\":[\"%@\"],\"regions\":[[1,12,3,2,5,0,0,0]]}],"
+          "\"totals\":{\"lines\":{\"count\":5}}}],"
+          "\"type\":\"llvm.coverage.json.export\",\"version\":\"2.0.1\"}",
+         source, source];
+    NSString *json = [self writeFileNamed:@"d.json" contents:export];
+    CSImporterTestReceiver *receiver = [[CSImporterTestReceiver alloc] init];
+    NSArray *fileDatas               = [self importPath:json maxConcurrency:1 maxRecordsInFlight:0 receiver:receiver];
+    // the missing source, and the bad segment
+    STAssertEquals(receiver->_errorCount, (NSUInteger)2, nil);
+    STAssertEquals([fileDatas count], (NSUInteger)2, nil);
+    CoverStoryCoverageFileData *fileData = fileDatas[0];
+    STAssertEqualObjects([fileData sourcePath], [source stringByStandardizingPath], nil);
+    int64_t hits[] = { 5, 5, 5, kCoverStoryNotExecutedMarker, kCoverStoryNotExecutedMarker,
+                       kCoverStoryNotExecutedMarker, 0, 0 };
+    [self assertFileData:fileData hits:hits count:sizeof(hits) / sizeof(hits[0])];
+    // a missing source still comes through, w/ the lines filled in
+    STAssertEqualObjects([fileDatas[1] sourcePath], [[_tempDir stringByAppendingPathComponent:@"missing.c"] stringByStandardizingPath], nil);
+    STAssertEquals([fileDatas[1] hitCountForLineAtIndex:0], (NSInteger)1, nil);
+
+    // cut off in the middle
+    NSString *cut = [self writeFileNamed:@"cut.json" contents:[export substringToIndex:60]];
+    receiver      = [[CSImporterTestReceiver alloc] init];
+    STAssertEquals([[self importPath:cut maxConcurrency:1 maxRecordsInFlight:0 receiver:receiver] count],
+                   (NSUInteger)0, nil);
+    STAssertEquals(receiver->_errorCount, (NSUInteger)1, nil);
+}
+
+@end
@@ -0,0 +1,142 @@
+//
+//  CoverStoryCoverageMemoryBenchmark.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// Measures how much heap the line data for a large (synthetic) source file
+// takes.  These are slow, so they only run when CS_RUN_BENCHMARKS is set in
+// the environment.
+
+#import <malloc/malloc.h>
+#import "GTMSenTestCase.h"
+#import "CoverStoryBenchmarking.h"
+#import "CoverStoryCoverageFileData.h"
+#import "CoverStoryCoverageLineData.h"
+
+static const NSUInteger kBenchmarkLineCount = 5000000;
+
+@interface CoverStoryCoverageMemoryBenchmark : SenTestCase
+@end
+
+@implementation CoverStoryCoverageMemoryBenchmark
+
+static size_t HeapInUse(void)
+{
+    malloc_statistics_t stats;
+    malloc_zone_statistics(NULL, &stats);
+    return stats.size_in_use;
+}
+
+// Same mix of lines the gcov files for a normal project have: some not
+// executable, some missed, most hit.
+static NSInteger SyntheticHitCount(NSUInteger x)
+{
+    switch (x % 5) {
+        case 0:
+            return kCoverStoryNotExecutedMarker;
+        case 1:
+            return 0;
+        default:
+            return (NSInteger)(x % 97) + 1;
+    }
+}
+
+static NSString *SyntheticLine(NSUInteger x)
+{
+    return [NSString stringWithFormat:@"    result = Function%lu(argument, %lu);  // some comment",
+            (unsigned long)(x % 1000), (unsigned long)x];
+}
+
+// Writes out a .gcov file w/ |lineCount| lines of source.
+static NSString *WriteSyntheticGCovFile(NSUInteger lineCount)
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"CoverStoryBenchmark.m.gcov"];
+    FILE *file     = fopen([path fileSystemRepresentation], "w");
+    if (!file)
+    {
+        return nil;
+    }
+    fprintf(file, "        -:    0:Source:CoverStoryBenchmark.m\n");
+    fprintf(file, "        -:    0:Graph:CoverStoryBenchmark.gcno\n");
+    fprintf(file, "        -:    0:Data:CoverStoryBenchmark.gcda\n");
+    fprintf(file, "        -:    0:Runs:1\n");
+    fprintf(file, "        -:    0:Programs:1\n");
+    for (NSUInteger x = 0; x < lineCount; ++x)
+    {
+        @autoreleasepool
+        {
+            NSInteger hitCount = SyntheticHitCount(x);
+            const char *line   = [SyntheticLine(x) UTF8String];
+            if (hitCount == kCoverStoryNotExecutedMarker)
+            {
+                fprintf(file, "        -:%5lu:%s\n", (unsigned long)x + 1, line);
+            }
+            else if (hitCount == 0)
+            {
+                fprintf(file, "    #####:%5lu:%s\n", (unsigned long)x + 1, line);
+            }
+            else
+            {
+                fprintf(file, "%9ld:%5lu:%s\n", (long)hitCount, (unsigned long)x + 1, line);
+            }
+        }
+    }
+    fclose(file);
+    return path;
+}
+
+- (void)testLineStorageMemory
+{
+    if (!ShouldRunBenchmarks())
+    {
+        return;
+    }
+
+    // Before: one object (and one string) per line, the way the file data
+    // used to hold them.
+    double objectBytesPerLine = 0;
+    @autoreleasepool
+    {
+        size_t start           = HeapInUse();
+        NSMutableArray *lines  = [NSMutableArray arrayWithCapacity:kBenchmarkLineCount];
+        for (NSUInteger x = 0; x < kBenchmarkLineCount; ++x)
+        {
+            @autoreleasepool
+            {
+                CoverStoryCoverageLineData *data =
+                    [CoverStoryCoverageLineData newCoverageLineDataWithLine:SyntheticLine(x)
+                                                                   hitCount:SyntheticHitCount(x)
+                                                               coverageFile:nil];
+                [lines addObject:data];
+            }
+        }
+        objectBytesPerLine = (double)(HeapInUse() - start) / kBenchmarkLineCount;
+        STAssertEquals([lines count], kBenchmarkLineCount, nil);
+    }
+
+    // After: the columns the file data keeps now.
+    NSString *path = WriteSyntheticGCovFile(kBenchmarkLineCount);
+    STAssertNotNil(path, nil);
+    double columnBytesPerLine = 0;
+    NSTimeInterval loadTime   = 0;
+    @autoreleasepool
+    {
+        size_t start        = HeapInUse();
+        NSDate *startDate   = [NSDate date];
+        CoverStoryCoverageFileData *data =
+            [CoverStoryCoverageFileData newCoverageFileDataFromPath:path
+                                                           document:nil
+                                                    messageReceiver:nil];
+        loadTime           = -[startDate timeIntervalSinceNow];
+        columnBytesPerLine = (double)(HeapInUse() - start) / kBenchmarkLineCount;
+        STAssertEquals([data lineCount], kBenchmarkLineCount, nil);
+    }
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+
+    NSLog(@"%lu lines: line objects %.1f bytes/line, columns %.1f bytes/line (loaded in %.2fs)",
+          (unsigned long)kBenchmarkLineCount, objectBytesPerLine, columnBytesPerLine, loadTime);
+    STAssertLessThan(columnBytesPerLine, objectBytesPerLine, nil);
+}
+
+@end
@@ -0,0 +1,171 @@
+//
+//  CoverStoryCoverageShardTest.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "GTMSenTestCase.h"
+#import "CoverStoryCoverageShard.h"
+#import "CoverStoryCoverageFileData+Testing.h"
+#import "CodeCoverage.h"
+
+// Counts what the merge reports.
+@interface CSShardTestReceiver : NSObject<CoverStoryCoverageProcessingProtocol> {
+@public
+    NSUInteger _errorCount;
+    NSUInteger _warningCount;
+}
+@end
+
+@implementation CSShardTestReceiver
+
+- (void)coverageErrorForPath:(NSString *)path message:(NSString *)format, ...
+{
+    ++_errorCount;
+}
+
+- (void)coverageWarningForPath:(NSString *)path message:(NSString *)format, ...
+{
+    ++_warningCount;
+}
+
+@end
+
+@interface CoverStoryCoverageShardTest : SenTestCase {
+@private
+    NSString *_tempDir;
+}
+@end
+
+@implementation CoverStoryCoverageShardTest
+
+- (void)setUp
+{
+    _tempDir = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                [NSString stringWithFormat:@"CoverStoryCoverageShardTest-%@",
+                 [[NSProcessInfo processInfo] globallyUniqueString]]];
+    [[NSFileManager defaultManager] createDirectoryAtPath:_tempDir
+                              withIntermediateDirectories:YES
+                                               attributes:nil
+                                                    error:NULL];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_tempDir error:NULL];
+}
+
+- (NSString *)writeShardNamed:(NSString *)name fileDatas:(NSArray *)fileDatas
+{
+    NSString *path = [_tempDir stringByAppendingPathComponent:name];
+    NSError *error = nil;
+    STAssertTrue([CoverStoryCoverageShard writeFileDatas:fileDatas toFile:path error:&error], @"%@", error);
+    return path;
+}
+
+- (void)testRoundTrip
+{
+    int64_t hits[] = { kCoverStoryNotExecutedMarker, 0, 3, kCoverStoryNonFeasibleMarker };
+    NSArray *lines = @[ @"int main() {", @"  if (x)", @"    return é;", @"  abort(); // COV_NF_LINE" ];
+    NSArray *fileDatas = @[ [CoverStoryCoverageFileData fileDataWithPath:@"/src/a.c" lines:lines hits:hits],
+                            [CoverStoryCoverageFileData fileDataWithPath:@"/src/b.c" lines:@[ @"" ] hits:hits] ];
+    NSString *path = [self writeShardNamed:@"round.csshard" fileDatas:fileDatas];
+
+    NSError *error                 = nil;
+    CoverStoryCoverageShard *shard = [[CoverStoryCoverageShard alloc] initWithContentsOfFile:path error:&error];
+    STAssertNotNil(shard, @"%@", error);
+    STAssertEquals([shard sourceCount], (NSUInteger)2, nil);
+    NSArray *read = [shard fileDatasWithDocument:nil];
+    STAssertEquals([read count], (NSUInteger)2, nil);
+    CoverStoryCoverageFileData *fileData = read[0];
+    STAssertEqualObjects([fileData sourcePath], @"/src/a.c", nil);
+    STAssertEquals([fileData lineCount], [lines count], nil);
+    for (NSUInteger x = 0; x < [lines count]; ++x)
+    {
+        STAssertEqualObjects([fileData lineAtIndex:x], lines[x], nil);
+        STAssertEquals([fileData hitCountForLineAtIndex:x], (NSInteger)hits[x], nil);
+    }
+    STAssertEqualObjects([read[1] sourcePath], @"/src/b.c", nil);
+
+    // not a shard
+    NSString *junkPath = [_tempDir stringByAppendingPathComponent:@"junk.csshard"];
+    [[@"not a shard" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:junkPath atomically:YES];
+    STAssertNil([[CoverStoryCoverageShard alloc] initWithContentsOfFile:junkPath error:&error], nil);
+    STAssertEquals([error code], kCoverStoryShardError, nil);
+}
+
+- (void)testMergeMatchesAddingInOrder
+{
+    // Every combination of not executed, non-feasible, missed and hit across
+    // three shards, the merge has to agree w/ folding them in one at a time.
+    const int64_t values[] = { kCoverStoryNotExecutedMarker, kCoverStoryNonFeasibleMarker, 0, 2 };
+    const NSUInteger valueCount = sizeof(values) / sizeof(values[0]);
+    const NSUInteger lineCount  = valueCount * valueCount * valueCount;
+    NSMutableArray *lines = [NSMutableArray array];
+    int64_t shardHits[3][lineCount];
+    int64_t expected[lineCount];
+    for (NSUInteger x = 0; x < lineCount; ++x)
+    {
+        [lines addObject:[NSString stringWithFormat:@"line %lu;", (unsigned long)x]];
+        shardHits[0][x] = values[x % valueCount];
+        shardHits[1][x] = values[(x / valueCount) % valueCount];
+        shardHits[2][x] = values[x / (valueCount * valueCount)];
+        expected[x]     = coverageMergeHitCounts(coverageMergeHitCounts(shardHits[0][x], shardHits[1][x]),
+                                                 shardHits[2][x]);
+    }
+    NSMutableArray *paths = [NSMutableArray array];
+    for (NSUInteger x = 0; x < 3; ++x)
+    {
+        CoverStoryCoverageFileData *fileData = [CoverStoryCoverageFileData fileDataWithPath:@"/src/merge.c" lines:lines hits:shardHits[x]];
+        [paths addObject:[self writeShardNamed:[NSString stringWithFormat:@"%lu.csshard", (unsigned long)x]
+                                     fileDatas:@[ fileData ]]];
+    }
+
+    CSShardTestReceiver *receiver = [[CSShardTestReceiver alloc] init];
+    NSArray *merged = [CoverStoryCoverageShard fileDatasByMergingShardsAtPaths:paths
+                                                                maxConcurrency:2
+                                                                      document:nil
+                                                               messageReceiver:receiver];
+    STAssertEquals(receiver->_errorCount, (NSUInteger)0, nil);
+    STAssertEquals([merged count], (NSUInteger)1, nil);
+    CoverStoryCoverageFileData *fileData = merged[0];
+    for (NSUInteger x = 0; x < lineCount; ++x)
+    {
+        STAssertEquals([fileData hitCountForLineAtIndex:x], (NSInteger)expected[x],
+                       @"line %lu: %lld, %lld, %lld", (unsigned long)x,
+                       shardHits[0][x], shardHits[1][x], shardHits[2][x]);
+    }
+}
+
+- (void)testMismatchedSourceIsLeftOut
+{
+    int64_t first[]  = { 1, 0 };
+    int64_t second[] = { 4, 4 };
+    int64_t third[]  = { 2, 5 };
+    NSArray *lines   = @[ @"a();", @"b();" ];
+    NSArray *paths   = @[
+        [self writeShardNamed:@"1.csshard"
+                    fileDatas:@[ [CoverStoryCoverageFileData fileDataWithPath:@"/src/m.c" lines:lines hits:first] ]],
+        [self writeShardNamed:@"2.csshard"
+                    fileDatas:@[ [CoverStoryCoverageFileData fileDataWithPath:@"/src/m.c" lines:@[ @"a();", @"c();" ] hits:second] ]],
+        [self writeShardNamed:@"3.csshard"
+                    fileDatas:@[ [CoverStoryCoverageFileData fileDataWithPath:@"/src/m.c" lines:lines hits:third] ]],
+        [_tempDir stringByAppendingPathComponent:@"missing.csshard"],
+    ];
+
+    CSShardTestReceiver *receiver = [[CSShardTestReceiver alloc] init];
+    NSArray *merged = [CoverStoryCoverageShard fileDatasByMergingShardsAtPaths:paths
+                                                                maxConcurrency:0
+                                                                      document:nil
+                                                               messageReceiver:receiver];
+    // one for the missing shard, one for the source that didn't match
+    STAssertEquals(receiver->_errorCount, (NSUInteger)2, nil);
+    STAssertEquals([merged count], (NSUInteger)1, nil);
+    CoverStoryCoverageFileData *fileData = merged[0];
+    STAssertEqualObjects([fileData lineAtIndex:1], @"b();", nil);
+    STAssertEquals([fileData hitCountForLineAtIndex:0], (NSInteger)3, nil);
+    STAssertEquals([fileData hitCountForLineAtIndex:1], (NSInteger)5, nil);
+}
+
+@end
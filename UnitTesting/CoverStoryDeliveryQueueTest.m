@@ -0,0 +1,87 @@
+//
+//  CoverStoryDeliveryQueueTest.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "GTMSenTestCase.h"
+#import "CoverStoryDeliveryQueue.h"
+
+@interface CoverStoryDeliveryQueueTest : SenTestCase
+@end
+
+@implementation CoverStoryDeliveryQueueTest
+
+- (void)testBatching
+{
+    NSMutableArray *delivered = [NSMutableArray array];
+    NSMutableArray *batches   = [NSMutableArray array];
+    CoverStoryDeliveryQueue *queue = [[CoverStoryDeliveryQueue alloc] initWithHandler:^(NSArray *batch) {
+        [batches addObject:@([batch count])];
+        [delivered addObjectsFromArray:batch];
+    }];
+    STAssertNotNil(queue, nil);
+    [queue setMaxBatchSize:10];
+    
+    for (NSUInteger x = 0; x < 25; ++x)
+    {
+        [queue push:@(x)];
+    }
+    STAssertEquals([queue depth], (NSUInteger)25, nil);
+    [queue drain];
+    STAssertEquals([queue depth], (NSUInteger)0, nil);
+    STAssertEqualObjects(batches, (@[ @10, @10, @5 ]), nil);
+    for (NSUInteger x = 0; x < 25; ++x)
+    {
+        STAssertEqualObjects([delivered objectAtIndex:x], @(x), nil);
+    }
+    STAssertEquals([queue deliveredCount], (NSUInteger)25, nil);
+    STAssertEquals([queue batchCount], (NSUInteger)3, nil);
+    STAssertEquals([queue maxDepth], (NSUInteger)25, nil);
+    STAssertGreaterThanOrEqual([queue maxLatency], [queue averageLatency], nil);
+    STAssertNotNil([queue statisticsDescription], nil);
+    
+    [queue resetStatistics];
+    STAssertEquals([queue deliveredCount], (NSUInteger)0, nil);
+    STAssertEquals([queue maxDepth], (NSUInteger)0, nil);
+}
+
+- (void)testManyProducers
+{
+    const NSUInteger kProducers   = 8;
+    const NSUInteger kPerProducer = 5000;
+    NSMutableArray *delivered     = [NSMutableArray array];
+    CoverStoryDeliveryQueue *queue = [[CoverStoryDeliveryQueue alloc] initWithHandler:^(NSArray *batch) {
+        [delivered addObjectsFromArray:batch];
+    }];
+    
+    dispatch_group_t group = dispatch_group_create();
+    for (NSUInteger producer = 0; producer < kProducers; ++producer)
+    {
+        dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            for (NSUInteger x = 0; x < kPerProducer; ++x)
+            {
+                [queue push:@[ @(producer), @(x) ]];
+            }
+        });
+    }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    [queue drain];
+    
+    // everything showed up once, and each producer's items are in order
+    STAssertEquals([delivered count], kProducers * kPerProducer, nil);
+    NSMutableArray *next = [NSMutableArray array];
+    for (NSUInteger producer = 0; producer < kProducers; ++producer)
+    {
+        [next addObject:@0];
+    }
+    for (NSArray *item in delivered)
+    {
+        NSUInteger producer = [[item objectAtIndex:0] unsignedIntegerValue];
+        STAssertEqualObjects([item objectAtIndex:1], [next objectAtIndex:producer], nil);
+        [next replaceObjectAtIndex:producer withObject:@([[item objectAtIndex:1] unsignedIntegerValue] + 1)];
+    }
+}
+
+@end
@@ -0,0 +1,142 @@
+//
+//  CoverStoryFilePredicateTest.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "GTMSenTestCase.h"
+#import "CoverStoryFilePredicate.h"
+#import "CoverStoryPreferenceKeys.h"
+
+@interface CoverStoryFilePredicateTest : SenTestCase
+@end
+
+@implementation CoverStoryFilePredicateTest
+
+- (void)setUp
+{
+    [CoverStoryFilePredicate registerDefaults];
+    [[NSUserDefaults standardUserDefaults] removeObjectForKey:kCoverStoryFilterStringTypeKey];
+}
+
+- (void)tearDown
+{
+    [[NSUserDefaults standardUserDefaults] removeObjectForKey:kCoverStoryFilterStringTypeKey];
+}
+
+- (NSArray *)files
+{
+    return @[
+        @{ @"sourcePath" : @"/Users/me/Project/Foo.m" },
+        @{ @"sourcePath" : @"/Users/me/Project/FooTest.m" },
+        @{ @"sourcePath" : @"/Users/me/Project/Bar.mm" },
+        @{ @"sourcePath" : @"/usr/include/stdio.h" },
+        @{ @"sourcePath" : @"/Developer/SDKs/iPhoneOS.sdk/UIKit.h" },
+    ];
+}
+
+- (NSArray *)pathsFiltering:(NSArray *)files with:(CoverStoryFilePredicate *)predicate
+{
+    NSArray *filtered = [predicate filteredArrayFromArray:files];
+    // has to agree w/ the one at a time answer
+    STAssertEqualObjects(filtered, [files filteredArrayUsingPredicate:predicate], nil);
+    return [filtered valueForKey:@"sourcePath"];
+}
+
+- (void)testHiding
+{
+    NSArray *files = [self files];
+    CoverStoryFilePredicate *predicate = [[CoverStoryFilePredicate alloc] init];
+    STAssertEquals([[self pathsFiltering:files with:predicate] count], (NSUInteger)5, nil);
+
+    predicate = [[CoverStoryFilePredicate alloc] initWithHideSDKSources:YES
+                                                    hideUnittestSources:NO
+                                                           filterString:nil];
+    STAssertEqualObjects([self pathsFiltering:files with:predicate],
+                         (@[ @"/Users/me/Project/Foo.m", @"/Users/me/Project/FooTest.m",
+                             @"/Users/me/Project/Bar.mm" ]), nil);
+
+    predicate = [[CoverStoryFilePredicate alloc] initWithHideSDKSources:YES
+                                                    hideUnittestSources:YES
+                                                           filterString:nil];
+    STAssertEqualObjects([self pathsFiltering:files with:predicate],
+                         (@[ @"/Users/me/Project/Foo.m", @"/Users/me/Project/Bar.mm" ]), nil);
+}
+
+- (void)testWildcard
+{
+    NSArray *files = [self files];
+    CoverStoryFilePredicate *predicate = [[CoverStoryFilePredicate alloc] initWithHideSDKSources:NO
+                                                                             hideUnittestSources:NO
+                                                                                    filterString:@"foo"];
+    STAssertEqualObjects([self pathsFiltering:files with:predicate],
+                         (@[ @"/Users/me/Project/Foo.m", @"/Users/me/Project/FooTest.m" ]), nil);
+    predicate = [[CoverStoryFilePredicate alloc] initWithHideSDKSources:NO
+                                                    hideUnittestSources:NO
+                                                           filterString:@"*.m?"];
+    STAssertEqualObjects([self pathsFiltering:files with:predicate], @[ @"/Users/me/Project/Bar.mm" ], nil);
+}
+
+- (void)testRegularExpression
+{
+    [[NSUserDefaults standardUserDefaults] setInteger:kCoverStoryFilterStringTypeRegularExpression
+                                               forKey:kCoverStoryFilterStringTypeKey];
+    NSArray *files = [self files];
+    CoverStoryFilePredicate *predicate = [[CoverStoryFilePredicate alloc] initWithHideSDKSources:NO
+                                                                             hideUnittestSources:NO
+                                                                                    filterString:@"(foo|bar)\\.m+$"];
+    STAssertEqualObjects([self pathsFiltering:files with:predicate],
+                         (@[ @"/Users/me/Project/Foo.m", @"/Users/me/Project/Bar.mm" ]), nil);
+
+    // one that doesn't parse shows everything
+    predicate = [[CoverStoryFilePredicate alloc] initWithHideSDKSources:NO
+                                                    hideUnittestSources:NO
+                                                           filterString:@"(foo"];
+    STAssertEquals([[self pathsFiltering:files with:predicate] count], (NSUInteger)5, nil);
+}
+
+- (void)testLargeArray
+{
+    // Enough files to be split up, and filtered twice w/ a generation (the
+    // second is the first reused).
+    NSMutableArray *files = [NSMutableArray array];
+    for (NSUInteger x = 0; x < 10000; ++x)
+    {
+        NSString *path = [NSString stringWithFormat:@"/src/dir%lu/file%lu.m", (unsigned long)(x % 10), (unsigned long)x];
+        [files addObject:@{ @"sourcePath" : path }];
+    }
+    NSUInteger expected[] = { 10000, 10000, 1000, 1000, 112 };
+    NSString *typed[]     = { @"", @"d", @"dir3", @"dir3/", @"dir3/file3" };
+    for (NSUInteger x = 0; x < sizeof(typed) / sizeof(typed[0]); ++x)
+    {
+        CoverStoryFilePredicate *predicate = [[CoverStoryFilePredicate alloc] initWithHideSDKSources:NO
+                                                                                 hideUnittestSources:NO
+                                                                                        filterString:typed[x]];
+        NSArray *first = [self pathsFiltering:files with:predicate];
+        STAssertEquals([first count], expected[x], @"%@", typed[x]);
+        NSArray *again = [predicate filteredArrayFromArray:files contentGeneration:1];
+        STAssertEqualObjects([again valueForKey:@"sourcePath"], first, @"%@", typed[x]);
+        STAssertTrue([predicate filteredArrayFromArray:files contentGeneration:1] == again, @"%@", typed[x]);
+    }
+}
+
+- (void)testContentGeneration
+{
+    NSMutableArray *files = [[self files] mutableCopy];
+    CoverStoryFilePredicate *predicate = [[CoverStoryFilePredicate alloc] initWithHideSDKSources:YES
+                                                                             hideUnittestSources:NO
+                                                                                    filterString:nil];
+    NSArray *filtered = [predicate filteredArrayFromArray:files contentGeneration:1];
+    STAssertEquals([filtered count], (NSUInteger)3, nil);
+    STAssertTrue([predicate filteredArrayFromArray:files contentGeneration:1] == filtered, nil);
+
+    // one in the middle swapped in place, the same count, first and last
+    NSDictionary *replacement = @{ @"sourcePath" : @"/Users/me/Project/Baz.m" };
+    files[1]                  = replacement;
+    filtered                  = [predicate filteredArrayFromArray:files contentGeneration:2];
+    STAssertTrue([filtered indexOfObjectIdenticalTo:replacement] != NSNotFound, @"%@", filtered);
+    STAssertEqualObjects(filtered, [files filteredArrayUsingPredicate:predicate], nil);
+}
+
+@end
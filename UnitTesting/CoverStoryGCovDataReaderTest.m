@@ -0,0 +1,95 @@
+//
+//  CoverStoryGCovDataReaderTest.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "GTMSenTestCase.h"
+#import "CoverStoryGCovDataReader.h"
+#import "CoverStoryCoverageFileData.h"
+
+@interface CoverStoryGCovDataReaderTest : SenTestCase
+@end
+
+@implementation CoverStoryGCovDataReaderTest
+
+- (void)testCanRead
+{
+    NSBundle *testBundle = [NSBundle bundleForClass:[self class]];
+    STAssertNotNil(testBundle, nil);
+
+    STAssertTrue([CoverStoryGCovDataReader canReadGCovFile:[testBundle pathForResource:@"test_ppc_4_0.gcno" ofType:nil]], nil);
+    STAssertTrue([CoverStoryGCovDataReader canReadGCovFile:[testBundle pathForResource:@"test_x86_64_4_2.gcda" ofType:nil]], nil);
+    STAssertFalse([CoverStoryGCovDataReader canReadGCovFile:[testBundle pathForResource:@"Foo1a" ofType:@"gcov"]], nil);
+    STAssertFalse([CoverStoryGCovDataReader canReadGCovFile:@"/etc/passwd"], nil);
+    STAssertFalse([CoverStoryGCovDataReader canReadGCovFile:@"/does/not/exist"], nil);
+
+    STAssertNil([CoverStoryGCovDataReader coverageFileDatasForGCDAPath:@"/does/not/exist.gcda"
+                                                              document:nil
+                                                       messageReceiver:nil], nil);
+}
+
+- (void)testLineCounts
+{
+    // See GCovVersionManagerTest for the little app these came from.  The
+    // source isn't around, so the lines all come back as /*EOF*/ just like gcov.
+    NSBundle *testBundle = [NSBundle bundleForClass:[self class]];
+    STAssertNotNil(testBundle, nil);
+
+    const char *names[] = {
+        "test_i386_4_0",
+        "test_i386_4_2",
+        "test_ppc_4_0",
+        "test_ppc_4_2",
+        "test_x86_64_4_0",
+        "test_x86_64_4_2",
+    };
+    const int64_t expected[] = {
+        kCoverStoryNotExecutedMarker,
+        kCoverStoryNotExecutedMarker,
+        kCoverStoryNotExecutedMarker,
+        1,
+        kCoverStoryNotExecutedMarker,
+        11,
+        10,
+        1,
+    };
+    for (size_t x = 0; x < sizeof(names) / sizeof(names[0]); ++x)
+    {
+        NSString *path = [testBundle pathForResource:@(names[x]) ofType:@"gcda"];
+        STAssertNotNil(path, @"index %zu", x);
+        NSArray *fileDatas = [CoverStoryGCovDataReader coverageFileDatasForGCDAPath:path
+                                                                           document:nil
+                                                                    messageReceiver:nil];
+        STAssertNotNil(fileDatas, @"index %zu", x);
+        CoverStoryCoverageFileData *data = nil;
+        for (CoverStoryCoverageFileData *fileData in fileDatas)
+        {
+            if ([[fileData sourcePath] isEqual:@"test.c"])
+            {
+                data = fileData;
+            }
+        }
+        STAssertNotNil(data, @"index %zu", x);
+        STAssertEquals([data lineCount], (NSUInteger)(sizeof(expected) / sizeof(expected[0])), @"index %zu", x);
+        const int64_t *hitCounts = [data hitCounts];
+        for (size_t y = 0; y < [data lineCount]; ++y)
+        {
+            STAssertEquals(hitCounts[y], expected[y], @"index %zu line %zu", x, y + 1);
+            STAssertEqualObjects([data lineAtIndex:y], @"/*EOF*/", @"index %zu line %zu", x, y + 1);
+        }
+        NSInteger codeLines    = 0;
+        NSInteger hitCodeLines = 0;
+        [data coverageTotalLines:NULL
+                       codeLines:&codeLines
+                    hitCodeLines:&hitCodeLines
+                nonFeasibleLines:NULL
+                  coverageString:NULL
+                        coverage:NULL];
+        STAssertEquals(codeLines, (NSInteger)4, @"index %zu", x);
+        STAssertEquals(hitCodeLines, (NSInteger)4, @"index %zu", x);
+    }
+}
+
+@end
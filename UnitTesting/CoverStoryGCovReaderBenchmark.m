@@ -0,0 +1,181 @@
+//
+//  CoverStoryGCovReaderBenchmark.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// Compares reading coverage w/ CoverStoryGCovDataReader against running gcov
+// and parsing the .gcov files it writes.  These are slow, so they only run
+// when CS_RUN_BENCHMARKS is set in the environment.
+
+#import "GTMSenTestCase.h"
+#import "CoverStoryBenchmarking.h"
+#import "CoverStoryGCovDataReader.h"
+#import "CoverStoryCoverageFileData.h"
+#import "GCovVersionManager.h"
+
+static const NSUInteger kFixtureIterations = 200;
+static const NSUInteger kCorpusUnits       = 2000;
+
+@interface CoverStoryGCovReaderBenchmark : SenTestCase
+@end
+
+@implementation CoverStoryGCovReaderBenchmark
+
+// Makes a scratch dir w/ |count| copies of the fixture gcda/gcno pair and
+// returns the gcda names.
+static NSArray *MakeCorpus(NSString *dir, NSString *gcdaFixture, NSUInteger count)
+{
+    NSFileManager *fm   = [NSFileManager defaultManager];
+    NSString *gcnoFixture = [[gcdaFixture stringByDeletingPathExtension] stringByAppendingPathExtension:@"gcno"];
+    [fm removeItemAtPath:dir error:NULL];
+    if (![fm createDirectoryAtPath:dir withIntermediateDirectories:YES attributes:nil error:NULL])
+    {
+        return nil;
+    }
+    NSMutableArray *names = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger x = 0; x < count; ++x)
+    {
+        NSString *base = [NSString stringWithFormat:@"unit%04lu", (unsigned long)x];
+        NSString *gcda = [base stringByAppendingPathExtension:@"gcda"];
+        NSString *gcno = [base stringByAppendingPathExtension:@"gcno"];
+        if (![fm copyItemAtPath:gcdaFixture toPath:[dir stringByAppendingPathComponent:gcda] error:NULL] ||
+            ![fm copyItemAtPath:gcnoFixture toPath:[dir stringByAppendingPathComponent:gcno] error:NULL])
+        {
+            return nil;
+        }
+        [names addObject:gcda];
+    }
+    return names;
+}
+
+static NSTimeInterval TimeNativeReader(NSString *dir, NSArray *names, NSUInteger *outFileDatas)
+{
+    NSUInteger fileDatas = 0;
+    NSDate *start        = [NSDate date];
+    for (NSString *name in names)
+    {
+        @autoreleasepool
+        {
+            NSArray *datas =
+                [CoverStoryGCovDataReader coverageFileDatasForGCDAPath:[dir stringByAppendingPathComponent:name]
+                                                              document:nil
+                                                       messageReceiver:nil];
+            fileDatas += [datas count];
+        }
+    }
+    *outFileDatas = fileDatas;
+    return -[start timeIntervalSinceNow];
+}
+
+// Runs gcov the way the document does (one run, output in a scratch dir) and
+// parses what it wrote.  Returns a negative time if gcov couldn't be run.
+static NSTimeInterval TimeGCov(NSString *gcovPath, NSString *dir, NSArray *names, NSUInteger *outFileDatas)
+{
+    NSString *outDir  = [dir stringByAppendingPathComponent:@"gcov-out"];
+    NSFileManager *fm = [NSFileManager defaultManager];
+    [fm removeItemAtPath:outDir error:NULL];
+    [fm createDirectoryAtPath:outDir withIntermediateDirectories:YES attributes:nil error:NULL];
+
+    NSDate *start  = [NSDate date];
+    NSTask *task   = [[NSTask alloc] init];
+    [task setLaunchPath:gcovPath];
+    [task setCurrentDirectoryPath:outDir];
+    NSMutableArray *args = [NSMutableArray arrayWithObjects:@"-l", @"-o", dir, nil];
+    for (NSString *name in names)
+    {
+        [args addObject:[dir stringByAppendingPathComponent:name]];
+    }
+    [task setArguments:args];
+    [task setStandardOutput:[NSFileHandle fileHandleWithNullDevice]];
+    [task setStandardError:[NSFileHandle fileHandleWithNullDevice]];
+    @try {
+        [task launch];
+    }
+    @catch (NSException *e) {
+        return -1;
+    }
+    [task waitUntilExit];
+
+    NSUInteger fileDatas = 0;
+    for (NSString *name in [fm contentsOfDirectoryAtPath:outDir error:NULL])
+    {
+        if (![name hasSuffix:@".gcov"])
+        {
+            continue;
+        }
+        @autoreleasepool
+        {
+            CoverStoryCoverageFileData *data =
+                [CoverStoryCoverageFileData newCoverageFileDataFromPath:[outDir stringByAppendingPathComponent:name]
+                                                               document:nil
+                                                        messageReceiver:nil];
+            if (data)
+            {
+                ++fileDatas;
+            }
+        }
+    }
+    *outFileDatas = fileDatas;
+    return fileDatas ? -[start timeIntervalSinceNow] : -1;
+}
+
+- (void)runComparisonForUnits:(NSUInteger)units iterations:(NSUInteger)iterations label:(NSString *)label
+{
+    NSBundle *testBundle = [NSBundle bundleForClass:[self class]];
+    NSString *fixture    = [testBundle pathForResource:@"test_i386_4_0" ofType:@"gcda"];
+    STAssertNotNil(fixture, nil);
+    NSString *dir = [NSTemporaryDirectory() stringByAppendingPathComponent:@"CoverStoryGCovReaderBenchmark"];
+    NSArray *names = MakeCorpus(dir, fixture, units);
+    STAssertNotNil(names, nil);
+
+    NSTimeInterval nativeTime = 0;
+    NSTimeInterval gcovTime   = 0;
+    NSUInteger nativeDatas    = 0;
+    NSUInteger gcovDatas      = 0;
+    NSString *gcovPath        = [[GCovVersionManager defaultManager] gcovForGCovFile:fixture];
+    for (NSUInteger x = 0; x < iterations; ++x)
+    {
+        nativeTime += TimeNativeReader(dir, names, &nativeDatas);
+        if (gcovPath && (gcovTime >= 0))
+        {
+            NSTimeInterval runTime = TimeGCov(gcovPath, dir, names, &gcovDatas);
+            gcovTime = (runTime < 0) ? -1 : gcovTime + runTime;
+        }
+    }
+    if (gcovPath && (gcovTime >= 0))
+    {
+        NSLog(@"%@: %lu gcda x %lu: native reader %.3fs (%lu files), gcov %.3fs (%lu files), %.1fx",
+              label, (unsigned long)units, (unsigned long)iterations,
+              nativeTime, (unsigned long)nativeDatas, gcovTime, (unsigned long)gcovDatas,
+              gcovTime / MAX(nativeTime, 1e-9));
+    }
+    else
+    {
+        NSLog(@"%@: %lu gcda x %lu: native reader %.3fs (%lu files), gcov (%@) couldn't handle the data",
+              label, (unsigned long)units, (unsigned long)iterations,
+              nativeTime, (unsigned long)nativeDatas, gcovPath);
+    }
+    STAssertEquals(nativeDatas, units, nil);
+    [[NSFileManager defaultManager] removeItemAtPath:dir error:NULL];
+}
+
+- (void)testFixture
+{
+    if (!ShouldRunBenchmarks())
+    {
+        return;
+    }
+    [self runComparisonForUnits:1 iterations:kFixtureIterations label:@"test_i386_4_0"];
+}
+
+- (void)testGeneratedCorpus
+{
+    if (!ShouldRunBenchmarks())
+    {
+        return;
+    }
+    [self runComparisonForUnits:kCorpusUnits iterations:1 label:@"corpus"];
+}
+
+@end
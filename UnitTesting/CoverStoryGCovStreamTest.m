@@ -0,0 +1,150 @@
+//
+//  CoverStoryGCovStreamTest.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "GTMSenTestCase.h"
+#import "CoverStoryGCovStream.h"
+#import "CoverStoryCoverageFileData.h"
+#include <unistd.h>
+
+@interface CoverStoryGCovStreamTest : SenTestCase
+@end
+
+@implementation CoverStoryGCovStreamTest
+
+- (NSData *)contentsOfTestFile:(NSString *)name
+{
+    NSBundle *testBundle = [NSBundle bundleForClass:[self class]];
+    NSString *path       = [testBundle pathForResource:name ofType:@"gcov"];
+    STAssertNotNil(path, name);
+    return [NSData dataWithContentsOfFile:path];
+}
+
+- (void)testSplitting
+{
+    // what gcov -t puts out, w/ the summaries some gcovs mix in, and the last
+    // file w/o a newline at the end
+    NSArray *names        = @[ @"Foo1a", @"Foo2", @"Foo3", @"NoEndingNewline" ];
+    NSData *summary       = [@"File 'Foo.m'\nLines executed:75.00% of 8\n\n" dataUsingEncoding:NSUTF8StringEncoding];
+    NSMutableData *output = [NSMutableData dataWithData:summary];
+    for (NSString *name in names)
+    {
+        [output appendData:[self contentsOfTestFile:name]];
+        if (![name isEqualToString:[names lastObject]])
+        {
+            [output appendData:summary];
+        }
+    }
+
+    NSMutableArray *chunks       = [NSMutableArray array];
+    CoverStoryGCovStream *stream =
+        [[CoverStoryGCovStream alloc] initWithMaxPendingChunks:1
+                                                       handler:^(CoverStoryGCovStream *chunkStream, NSData *chunk) {
+            [chunks addObject:chunk];
+            [chunkStream finishedChunk];
+        }];
+    // in pieces that don't line up w/ the lines
+    const char *bytes = [output bytes];
+    NSUInteger length = [output length];
+    for (NSUInteger x = 0; x < length; x += 7)
+    {
+        [stream appendBytes:bytes + x length:MIN((NSUInteger)7, length - x)];
+    }
+    [stream finish];
+
+    STAssertEquals([chunks count], [names count], nil);
+    STAssertEquals([stream chunkCount], [names count], nil);
+    for (NSUInteger x = 0; x < MIN([chunks count], [names count]); ++x)
+    {
+        NSString *name = names[x];
+        STAssertEqualObjects(chunks[x], [self contentsOfTestFile:name], name);
+
+        NSBundle *testBundle = [NSBundle bundleForClass:[self class]];
+        NSString *path       = [testBundle pathForResource:name ofType:@"gcov"];
+        CoverStoryCoverageFileData *fromFile =
+            [CoverStoryCoverageFileData newCoverageFileDataFromPath:path document:nil messageReceiver:nil];
+        CoverStoryCoverageFileData *fromChunk =
+            [CoverStoryCoverageFileData newCoverageFileDataFromGCovData:chunks[x]
+                                                                   path:name
+                                                               document:nil
+                                                        messageReceiver:nil];
+        STAssertNotNil(fromChunk, name);
+        STAssertEqualObjects([fromChunk sourcePath], [fromFile sourcePath], name);
+        STAssertEquals([fromChunk lineCount], [fromFile lineCount], name);
+        STAssertTrue(coverageLineCountsEqual([fromChunk lineCounts], [fromFile lineCounts]), name);
+    }
+
+    // nothing but summaries is nothing
+    [stream appendBytes:[summary bytes] length:[summary length]];
+    [stream finish];
+    STAssertEquals([chunks count], [names count], nil);
+}
+
+- (void)testDataPath
+{
+    STAssertEqualObjects([CoverStoryGCovStream dataPathForChunk:[self contentsOfTestFile:@"Foo1a"]],
+                         @"Foo.gcda", nil);
+    NSData *noHeader = [@"        1:    1:int x;\n" dataUsingEncoding:NSUTF8StringEncoding];
+    STAssertNil([CoverStoryGCovStream dataPathForChunk:noHeader], nil);
+    STAssertNil([CoverStoryGCovStream dataPathForChunk:[NSData data]], nil);
+}
+
+- (void)testRejectsStreaming
+{
+    NSArray *rejections = @[ @"gcov: invalid option -- 't'\nUsage: gcov [OPTION]... SOURCE|OBJ...\n",
+                             @"gcov: unrecognized option '-t'\n",
+                             @"gcov: Unknown command line argument '-t'.  Try: 'gcov --help'\n" ];
+    for (NSString *rejection in rejections)
+    {
+        NSData *stdErr = [rejection dataUsingEncoding:NSUTF8StringEncoding];
+        STAssertTrue([CoverStoryGCovStream standardErrorRejectsStreaming:stdErr], rejection);
+    }
+    NSData *failure = [@"Foo.gcno:cannot open notes file\n" dataUsingEncoding:NSUTF8StringEncoding];
+    STAssertFalse([CoverStoryGCovStream standardErrorRejectsStreaming:failure], nil);
+    STAssertFalse([CoverStoryGCovStream standardErrorRejectsStreaming:[NSData data]], nil);
+}
+
+- (void)testBackpressure
+{
+    static const NSUInteger kMaxPending = 2;
+    static const NSUInteger kFileCount  = 20;
+    NSData *file            = [self contentsOfTestFile:@"Foo1a"];
+    NSOperationQueue *queue = [[NSOperationQueue alloc] init];
+    [queue setMaxConcurrentOperationCount:4];
+    __block NSUInteger outstanding    = 0;
+    __block NSUInteger maxOutstanding = 0;
+    __block NSUInteger parsed         = 0;
+    NSObject *lock                    = [[NSObject alloc] init];
+    CoverStoryGCovStream *stream =
+        [[CoverStoryGCovStream alloc] initWithMaxPendingChunks:kMaxPending
+                                                       handler:^(CoverStoryGCovStream *chunkStream, NSData *chunk) {
+            @synchronized(lock)
+            {
+                ++outstanding;
+                maxOutstanding = MAX(maxOutstanding, outstanding);
+            }
+            [queue addOperationWithBlock:^{
+                // a slow parser
+                usleep(1000);
+                @synchronized(lock)
+                {
+                    --outstanding;
+                    ++parsed;
+                }
+                [chunkStream finishedChunk];
+            }];
+        }];
+    for (NSUInteger x = 0; x < kFileCount; ++x)
+    {
+        [stream appendBytes:[file bytes] length:[file length]];
+    }
+    [stream finish];
+    [queue waitUntilAllOperationsAreFinished];
+    STAssertEquals(parsed, kFileCount, nil);
+    STAssertTrue(maxOutstanding <= kMaxPending, @"%lu out at once", (unsigned long)maxOutstanding);
+}
+
+@end
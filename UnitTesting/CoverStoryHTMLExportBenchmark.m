@@ -0,0 +1,166 @@
+//
+//  CoverStoryHTMLExportBenchmark.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+// Times rendering the source table for a big generated file, against the
+// string based rendering the exporter used to do, and a full export of a
+// batch of them.  These are slow, so they only run when CS_RUN_BENCHMARKS is
+// set in the environment.
+
+#import "GTMSenTestCase.h"
+#import "CoverStoryBenchmarking.h"
+#import "CoverStoryHTMLExporter.h"
+#import "CoverStoryCoverageFileData.h"
+#import "CodeCoverage.h"
+
+static const NSUInteger kSourceLines      = 200000;
+static const NSUInteger kRenderIterations = 5;
+static const NSUInteger kExportFiles      = 64;
+
+@interface CoverStoryHTMLExportBenchmark : SenTestCase
+@end
+
+@implementation CoverStoryHTMLExportBenchmark
+
+// Something that looks like source: indenting w/ tabs and spaces, and a fair
+// number of the characters that need escaping.
+static CoverStoryCoverageFileData *MakeSourceFile(NSString *path, NSUInteger lineCount)
+{
+    NSArray *samples = @[
+        @"#include <stdio.h>",
+        @"",
+        @"static int Compare(const void *a, const void *b)",
+        @"{",
+        @"\tif (*(const int *)a < *(const int *)b && a != b)",
+        @"\t\treturn -1;",
+        @"    printf(\"%s -> '%d'\\n\", name, value);",
+        @"        // costs 5 \u20ac \u2013 or so  (two  spaces)",
+        @"  return x > y ? x : y;",
+        @"}",
+    ];
+    NSMutableData *text      = [NSMutableData data];
+    NSMutableData *ranges    = [NSMutableData data];
+    NSMutableData *hitCounts = [NSMutableData data];
+    for (NSUInteger x = 0; x < lineCount; ++x)
+    {
+        NSData *bytes             = [samples[x % [samples count]] dataUsingEncoding:NSUTF8StringEncoding];
+        CoverStoryLineRange range = { (uint32_t)[text length], (uint32_t)[bytes length] };
+        int64_t hits              = (x % 7 == 0) ? kCoverStoryNotExecutedMarker : (int64_t)(x % 5);
+        [text appendData:bytes];
+        [ranges appendBytes:&range length:sizeof(range)];
+        [hitCounts appendBytes:&hits length:sizeof(hits)];
+    }
+    return [[CoverStoryCoverageFileData alloc] initWithSourcePath:path
+                                                             text:text
+                                                       lineRanges:ranges
+                                                        hitCounts:hitCounts
+                                          applyNonFeasibleMarkers:NO
+                                                         document:nil];
+}
+
+// The per line NSString rendering htmlSourceTableData: used to do (w/ just the
+// escapes the generated file needs).
+static NSString *LegacySourceTable(CoverStoryCoverageFileData *fileData)
+{
+    unichar nbsp                = 0xA0;
+    NSString *tabReplacement    = [NSString stringWithFormat:@"%C ", nbsp];
+    NSMutableString *sourceHtml = [NSMutableString string];
+    NSArray *escapes            = @[ @[ @"&", @"&amp;" ], @[ @"<", @"&lt;" ], @[ @">", @"&gt;" ],
+                                     @[ @"\"", @"&quot;" ], @[ @"'", @"&apos;" ],
+                                     @[ @"\u20ac", @"&euro;" ], @[ @"\u2013", @"&ndash;" ] ];
+    for (NSUInteger x = 0; x < [fileData lineCount]; ++x)
+    {
+        NSString *lineSource = [fileData lineAtIndex:x];
+        lineSource = [lineSource stringByReplacingOccurrencesOfString:@"\t" withString:tabReplacement];
+        lineSource = [lineSource stringByReplacingOccurrencesOfString:@"  " withString:tabReplacement];
+        for (NSArray *escape in escapes)
+        {
+            lineSource = [lineSource stringByReplacingOccurrencesOfString:escape[0] withString:escape[1]];
+        }
+        NSInteger hitCount       = [fileData hitCountForLineAtIndex:x];
+        NSString *hitCountString = @"";
+        NSString *hitStyle       = @"sourcelineskipped";
+        if (hitCount != kCoverStoryNotExecutedMarker)
+        {
+            hitStyle       = (hitCount == 0) ? @"sourcelinemissed" : @"sourcelinehit";
+            hitCountString = [NSString stringWithFormat:@"%ld", (long)hitCount];
+        }
+        [sourceHtml appendFormat:@"<tr class='sourceline'>\n"
+                                 @"<td class='sourcelinehitcount'>%@</td>\n"
+                                 @"<td class='%@'>%@</td>\n"
+                                 @"</tr>\n", hitCountString, hitStyle, lineSource];
+    }
+    return sourceHtml;
+}
+
+- (void)testRenderSourceTable
+{
+    if (!ShouldRunBenchmarks())
+    {
+        return;
+    }
+    CoverStoryCoverageFileData *fileData = MakeSourceFile(@"/bench/big.c", kSourceLines);
+    CoverStoryHTMLExporter *exporter     = [[CoverStoryHTMLExporter alloc] initWithPageTemplate:@""
+                                                                                  indexTemplate:@""];
+    NSString *rendered = nil;
+    NSDate *start      = [NSDate date];
+    for (NSUInteger x = 0; x < kRenderIterations; ++x)
+    {
+        @autoreleasepool {
+            rendered = [exporter htmlSourceTableData:fileData];
+        }
+    }
+    NSTimeInterval renderTime = -[start timeIntervalSinceNow];
+
+    NSString *legacy = nil;
+    start            = [NSDate date];
+    for (NSUInteger x = 0; x < kRenderIterations; ++x)
+    {
+        @autoreleasepool {
+            legacy = LegacySourceTable(fileData);
+        }
+    }
+    NSTimeInterval legacyTime = -[start timeIntervalSinceNow];
+
+    NSLog(@"source table: %lu lines x %lu: renderer %.3fs (%.0f lines/s), string based %.3fs, %.1fx",
+          (unsigned long)kSourceLines, (unsigned long)kRenderIterations,
+          renderTime, (kSourceLines * kRenderIterations) / MAX(renderTime, 1e-9),
+          legacyTime, legacyTime / MAX(renderTime, 1e-9));
+    STAssertEqualObjects(rendered, legacy, nil);
+}
+
+- (void)testExport
+{
+    if (!ShouldRunBenchmarks())
+    {
+        return;
+    }
+    NSMutableArray *fileDatas = [NSMutableArray array];
+    for (NSUInteger x = 0; x < kExportFiles; ++x)
+    {
+        NSString *path = [NSString stringWithFormat:@"/bench/file%lu.c", (unsigned long)x];
+        [fileDatas addObject:MakeSourceFile(path, kSourceLines / 10)];
+    }
+    CoverStoryHTMLExporter *exporter =
+        [[CoverStoryHTMLExporter alloc] initWithPageTemplate:@"__TITLE__ __SOURCE_NAME__ __SOURCE_PATH__ "
+                                                             @"__SOURCE_DATE__ __FILE_SUMMARY__ "
+                                                             @"__SOURCE_SUMMARY__ __SOURCE_DATA__"
+                                               indexTemplate:@"__REDIRECT_URL__"];
+    NSString *dir = [NSTemporaryDirectory() stringByAppendingPathComponent:@"CoverStoryHTMLExportBenchmark"];
+    for (NSUInteger jobs = 1; jobs <= [[NSProcessInfo processInfo] activeProcessorCount]; jobs *= 2)
+    {
+        [[NSFileManager defaultManager] removeItemAtPath:dir error:NULL];
+        [exporter setMaxConcurrentPages:jobs];
+        NSError *error = nil;
+        NSDate *start  = [NSDate date];
+        STAssertTrue([exporter writeFileDatas:fileDatas toDirectory:dir error:&error], @"%@", error);
+        NSLog(@"export: %lu files x %lu lines w/ %lu workers: %.3fs",
+              (unsigned long)kExportFiles, (unsigned long)(kSourceLines / 10), (unsigned long)jobs,
+              -[start timeIntervalSinceNow]);
+    }
+    [[NSFileManager defaultManager] removeItemAtPath:dir error:NULL];
+}
+
+@end
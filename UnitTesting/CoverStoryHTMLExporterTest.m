@@ -0,0 +1,155 @@
+//
+//  CoverStoryHTMLExporterTest.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "GTMSenTestCase.h"
+#import "CoverStoryHTMLExporter.h"
+#import "CoverStoryCoverageFileData+Testing.h"
+#import "CoverStoryPreferenceKeys.h"
+#import "CodeCoverage.h"
+
+@interface CoverStoryHTMLExporterTest : SenTestCase
+@end
+
+@implementation CoverStoryHTMLExporterTest
+
+- (void)testStylesheet
+{
+    NSString *css = @"a { color: $$SOURCE_LINE_MISSED_COLOR$$; }\n"
+                    @"b { color: $$SOURCE_LINE_HIT_COLOR$$; }\n";
+    NSString *result = [CoverStoryHTMLExporter stylesheetFromTemplate:css lineColors:nil];
+    STAssertEqualObjects(result, @"a { color: #FF0000; }\nb { color: #000000; }\n", nil);
+    result = [CoverStoryHTMLExporter stylesheetFromTemplate:css
+                                                 lineColors:@{ kCoverStoryExecutedLineColorKey : @"#00FF00" }];
+    STAssertEqualObjects(result, @"a { color: #FF0000; }\nb { color: #00FF00; }\n", nil);
+}
+
+- (void)testSourceLineSpacing
+{
+    // Tabs and pairs of spaces become nbsp+space, pairing up left to right.
+    int64_t hits[] = { 1, 1, 1 };
+    NSArray *lines = @[ @"a\t b", @"   c", @"\u20ac\u2013\u00e9" ];
+    CoverStoryCoverageFileData *fileData = [CoverStoryCoverageFileData fileDataWithPath:@"/src/spacing.c" lines:lines hits:hits];
+    CoverStoryHTMLExporter *exporter     = [[CoverStoryHTMLExporter alloc] initWithPageTemplate:@"" indexTemplate:@""];
+    NSString *source = [exporter htmlSourceTableData:fileData];
+    STAssertTrue([source rangeOfString:@"'>a\u00a0\u00a0 b</td>"].length > 0, source);
+    STAssertTrue([source rangeOfString:@"'>\u00a0  c</td>"].length > 0, source);
+    STAssertTrue([source rangeOfString:@"'>&euro;&ndash;\u00e9</td>"].length > 0, source);
+}
+
+- (void)testExport
+{
+    int64_t hits[] = { kCoverStoryNotExecutedMarker, 0, 3 };
+    NSArray *lines = @[ @"#include <stdio.h>", @"if (a < b && c > d)", @"  return \"x\";" ];
+    CoverStoryCoverageFileData *fileData = [CoverStoryCoverageFileData fileDataWithPath:@"/src/a&b.c" lines:lines hits:hits];
+    STAssertNotNil(fileData, nil);
+
+    STAssertNil([[CoverStoryHTMLExporter alloc] initWithPageTemplate:nil indexTemplate:@""], nil);
+    CoverStoryHTMLExporter *exporter =
+        [[CoverStoryHTMLExporter alloc] initWithPageTemplate:@"__TITLE__|__SOURCE_NAME__|__SOURCE_PATH__|"
+                                                             @"__SOURCE_DATE__|__FILE_SUMMARY__|__FILE_DATA__|"
+                                                             @"__SOURCE_SUMMARY__|__SOURCE_DATA__"
+                                               indexTemplate:@"go to __REDIRECT_URL__"];
+    STAssertNotNil(exporter, nil);
+
+    NSString *source = [exporter htmlSourceTableData:fileData];
+    STAssertTrue([source rangeOfString:@"&lt;stdio.h&gt;"].length > 0, source);
+    STAssertTrue([source rangeOfString:@"a &lt; b &amp;&amp; c &gt; d"].length > 0, source);
+    STAssertTrue([source rangeOfString:@"&quot;x&quot;"].length > 0, source);
+    STAssertTrue([source rangeOfString:@"sourcelinemissed"].length > 0, source);
+    STAssertTrue([source rangeOfString:@"<td class='sourcelinehitcount'>3</td>"].length > 0, source);
+
+    NSString *directory = [NSTemporaryDirectory() stringByAppendingPathComponent:@"CoverStoryHTMLExporterTest"];
+    NSFileManager *fm   = [NSFileManager defaultManager];
+    [fm removeItemAtPath:directory error:NULL];
+    NSError *error = nil;
+    STAssertTrue([exporter writeFileDatas:@[fileData] toDirectory:directory error:&error], @"%@", error);
+    NSSet *names = [NSSet setWithArray:[fm contentsOfDirectoryAtPath:directory error:NULL]];
+    STAssertEqualObjects(names, ([NSSet setWithObjects:@"a&b.c.html", @"index.html", @"coverstory-files.js", nil]), nil);
+    NSString *page = [NSString stringWithContentsOfFile:[directory stringByAppendingPathComponent:@"a&b.c.html"]
+                                               encoding:NSUTF8StringEncoding
+                                                  error:NULL];
+    STAssertTrue([page hasPrefix:@"a&amp;b.c|a&amp;b.c|/src/a&amp;b.c|"], page);
+    // The file list isn't in the page any more.
+    STAssertTrue([page rangeOfString:@"filelessthan"].length == 0, page);
+    STAssertTrue([page rangeOfString:@"&lt;stdio.h&gt;"].length > 0, page);
+    NSString *index = [NSString stringWithContentsOfFile:[directory stringByAppendingPathComponent:@"index.html"]
+                                                encoding:NSUTF8StringEncoding
+                                                   error:NULL];
+    STAssertEqualObjects(index, @"go to ./a&b.c.html", nil);
+    NSString *script = [[NSString alloc] initWithData:[exporter fileListScriptForFileDatas:@[fileData]]
+                                             encoding:NSUTF8StringEncoding];
+    STAssertTrue([script rangeOfString:@"[\"a&b.c.html\",\"a&amp;b.c\",\"filelessthan55percent\",\"50.00\"]"].length > 0, script);
+
+    // A template missing a token is an error.
+    exporter = [[CoverStoryHTMLExporter alloc] initWithPageTemplate:@"__TITLE__" indexTemplate:@""];
+    error    = nil;
+    STAssertFalse([exporter writeFileDatas:@[fileData] toDirectory:directory error:&error], nil);
+    STAssertEqualObjects([error domain], kCoverStoryErrorDomain, nil);
+    STAssertEquals([error code], kCoverStoryExportError, nil);
+    [fm removeItemAtPath:directory error:NULL];
+}
+
+- (void)testSameNamedSources
+{
+    int64_t hits[] = { 1 };
+    // Each source's one line is its path, so a page can be checked against it.
+    NSMutableArray *fileDatas = [NSMutableArray array];
+    for (NSString *path in @[ @"/src/one/main.m", @"/src/two/main.m", @"/src/two/Main.m", @"/src/other.m" ])
+    {
+        [fileDatas addObject:[CoverStoryCoverageFileData fileDataWithPath:path lines:@[ path ] hits:hits]];
+    }
+    CoverStoryHTMLExporter *exporter =
+        [[CoverStoryHTMLExporter alloc] initWithPageTemplate:@"__TITLE__|__SOURCE_NAME__|__SOURCE_PATH__|"
+                                                             @"__SOURCE_DATE__|__FILE_SUMMARY__|__FILE_DATA__|"
+                                                             @"__SOURCE_SUMMARY__|__SOURCE_DATA__"
+                                               indexTemplate:@"__REDIRECT_URL__"];
+    [exporter setMaxConcurrentPages:4];
+    NSString *directory = [NSTemporaryDirectory() stringByAppendingPathComponent:@"CoverStoryHTMLExporterTest"];
+    NSFileManager *fm   = [NSFileManager defaultManager];
+    [fm removeItemAtPath:directory error:NULL];
+    NSError *error = nil;
+    STAssertTrue([exporter writeFileDatas:fileDatas toDirectory:directory error:&error], @"%@", error);
+
+    // Every source gets its own page, the one w/ a name of its own keeps it.
+    NSArray *pages = [[fm contentsOfDirectoryAtPath:directory error:NULL]
+                      filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"self ENDSWITH '.html'"]];
+    STAssertEquals([pages count], (NSUInteger)5, @"%@", pages);
+    STAssertTrue([pages containsObject:@"other.m.html"], @"%@", pages);
+    STAssertFalse([pages containsObject:@"main.m.html"], @"%@", pages);
+    NSString *script = [[NSString alloc] initWithData:[exporter fileListScriptForFileDatas:fileDatas]
+                                             encoding:NSUTF8StringEncoding];
+    NSString *index  = [NSString stringWithContentsOfFile:[directory stringByAppendingPathComponent:@"index.html"]
+                                                encoding:NSUTF8StringEncoding
+                                                   error:NULL];
+    NSMutableSet *seen = [NSMutableSet set];
+    for (NSString *page in pages)
+    {
+        if ([page isEqualToString:@"index.html"])
+        {
+            continue;
+        }
+        STAssertFalse([seen containsObject:[page lowercaseString]], page);
+        [seen addObject:[page lowercaseString]];
+        STAssertTrue([script rangeOfString:[NSString stringWithFormat:@"[\"%@\"", page]].length > 0, script);
+        NSString *contents = [NSString stringWithContentsOfFile:[directory stringByAppendingPathComponent:page]
+                                                       encoding:NSUTF8StringEncoding
+                                                          error:NULL];
+        NSString *sourcePath = [contents componentsSeparatedByString:@"|"][2];
+        NSString *line       = [NSString stringWithFormat:@"'>%@</td>", sourcePath];
+        STAssertTrue([contents rangeOfString:line].length > 0, contents);
+    }
+    STAssertEquals([seen count], (NSUInteger)4, nil);
+    STAssertTrue([index hasPrefix:@"./main.m-"], index);
+    STAssertTrue([pages containsObject:[index substringFromIndex:2]], index);
+
+    // The names don't change from one export to the next.
+    STAssertEqualObjects(script, [[NSString alloc] initWithData:[exporter fileListScriptForFileDatas:fileDatas]
+                                                        encoding:NSUTF8StringEncoding], nil);
+    [fm removeItemAtPath:directory error:NULL];
+}
+
+@end
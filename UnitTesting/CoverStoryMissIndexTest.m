@@ -0,0 +1,73 @@
+//
+//  CoverStoryMissIndexTest.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "GTMSenTestCase.h"
+#import "CoverStoryMissIndex.h"
+#import "CodeCoverage.h"
+
+@interface CoverStoryMissIndexTest : SenTestCase
+@end
+
+@implementation CoverStoryMissIndexTest
+
+- (void)testRuns
+{
+    const int64_t hits[] = {
+        0, 0, 1, kCoverStoryNotExecutedMarker, 0, 3, kCoverStoryNonFeasibleMarker, 0, 0, 0
+    };
+    NSUInteger lineCount = sizeof(hits) / sizeof(hits[0]);
+    CoverStoryMissIndex *index = [[CoverStoryMissIndex alloc] initWithHitCounts:hits lineCount:lineCount];
+    STAssertEquals([index runCount], (NSUInteger)3, nil);
+    STAssertEquals([index missedLineCount], (NSUInteger)6, nil);
+    STAssertEquals([index rangeOfRunAtIndex:0], NSMakeRange(0, 2), nil);
+    STAssertEquals([index rangeOfRunAtIndex:1], NSMakeRange(4, 1), nil);
+    STAssertEquals([index rangeOfRunAtIndex:2], NSMakeRange(7, 3), nil);
+
+    STAssertEquals([index nextMissedRangeAfterLine:NSNotFound], NSMakeRange(0, 2), nil);
+    STAssertEquals([index nextMissedRangeAfterLine:0], NSMakeRange(0, 2), nil);
+    STAssertEquals([index nextMissedRangeAfterLine:1], NSMakeRange(4, 1), nil);
+    STAssertEquals([index nextMissedRangeAfterLine:4], NSMakeRange(7, 3), nil);
+    STAssertEquals([index nextMissedRangeAfterLine:9].location, (NSUInteger)NSNotFound, nil);
+
+    STAssertEquals([index previousMissedRangeBeforeLine:NSNotFound], NSMakeRange(7, 3), nil);
+    STAssertEquals([index previousMissedRangeBeforeLine:9], NSMakeRange(7, 3), nil);
+    STAssertEquals([index previousMissedRangeBeforeLine:7], NSMakeRange(4, 1), nil);
+    STAssertEquals([index previousMissedRangeBeforeLine:4], NSMakeRange(0, 2), nil);
+    STAssertEquals([index previousMissedRangeBeforeLine:0].location, (NSUInteger)NSNotFound, nil);
+
+    CoverStoryMissIndex *empty = [[CoverStoryMissIndex alloc] init];
+    STAssertEquals([empty runCount], (NSUInteger)0, nil);
+    STAssertEquals([empty nextMissedRangeAfterLine:NSNotFound].location, (NSUInteger)NSNotFound, nil);
+    STAssertEquals([empty previousMissedRangeBeforeLine:NSNotFound].location, (NSUInteger)NSNotFound, nil);
+}
+
+- (void)testDensity
+{
+    const int64_t hits[] = { 0, 0, 1, 1, 0, 1, 1, 1 };
+    CoverStoryMissIndex *index = [[CoverStoryMissIndex alloc] initWithHitCounts:hits lineCount:8];
+    float density[4];
+    [index getMissDensity:density bucketCount:4];
+    STAssertEqualsWithAccuracy(density[0], 1.0f, 0.001f, nil);
+    STAssertEqualsWithAccuracy(density[1], 0.0f, 0.001f, nil);
+    STAssertEqualsWithAccuracy(density[2], 0.5f, 0.001f, nil);
+    STAssertEqualsWithAccuracy(density[3], 0.0f, 0.001f, nil);
+
+    // more buckets than lines
+    float fine[16];
+    [index getMissDensity:fine bucketCount:16];
+    STAssertEqualsWithAccuracy(fine[0], 1.0f, 0.001f, nil);
+    STAssertEqualsWithAccuracy(fine[5], 0.0f, 0.001f, nil);
+    STAssertEqualsWithAccuracy(fine[9], 1.0f, 0.001f, nil);
+
+    // fewer buckets than lines, the total is conserved
+    float coarse[3];
+    [index getMissDensity:coarse bucketCount:3];
+    float total = (coarse[0] + coarse[1] + coarse[2]) * (8.0f / 3.0f);
+    STAssertEqualsWithAccuracy(total, 3.0f, 0.001f, nil);
+}
+
+@end
@@ -0,0 +1,200 @@
+//
+//  CoverStoryQueryServerTest.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "GTMSenTestCase.h"
+#import "CoverStoryQueryServer.h"
+#import "CoverStoryLineIndex.h"
+#import "CoverStoryCoverageFileData+Testing.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+@interface CoverStoryQueryServerTest : SenTestCase {
+@private
+    NSString *_tempDir;
+}
+@end
+
+@implementation CoverStoryQueryServerTest
+
+- (void)setUp
+{
+    // short, socket paths are limited to about a hundred bytes
+    _tempDir = [@"/tmp" stringByAppendingPathComponent:
+                [NSString stringWithFormat:@"csq-%d", getpid()]];
+    [[NSFileManager defaultManager] createDirectoryAtPath:_tempDir
+                              withIntermediateDirectories:YES
+                                               attributes:nil
+                                                    error:NULL];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_tempDir error:NULL];
+}
+
+- (int)connectTo:(NSString *)socketPath
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, [socketPath fileSystemRepresentation], sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    STAssertTrue(fd >= 0, nil);
+    STAssertEquals(connect(fd, (struct sockaddr *)&address, sizeof(address)), 0, nil);
+    return fd;
+}
+
+- (BOOL)readFrom:(int)fd bytes:(void *)bytes length:(size_t)length
+{
+    uint8_t *cursor = bytes;
+    while (length)
+    {
+        ssize_t bytesRead = read(fd, cursor, length);
+        if (bytesRead <= 0)
+        {
+            return NO;
+        }
+        cursor += bytesRead;
+        length -= (size_t)bytesRead;
+    }
+    return YES;
+}
+
+// Sends |queries| (each [path, first line, line count]) and returns the
+// results as [status, first line, source line count, NSData of counts].
+- (NSArray *)ask:(int)fd queries:(NSArray *)queries generation:(uint64_t *)outGeneration
+{
+    NSMutableData *request              = [NSMutableData data];
+    CoverStoryQueryRequestHeader header = { { 'C', 'S', 'Q', 'R' }, (uint32_t)[queries count] };
+    [request appendBytes:&header length:sizeof(header)];
+    for (NSArray *query in queries)
+    {
+        NSData *path          = [query[0] dataUsingEncoding:NSUTF8StringEncoding];
+        CoverStoryQuery entry = { [query[1] unsignedIntValue], [query[2] unsignedIntValue],
+                                  (uint32_t)[path length] };
+        [request appendBytes:&entry length:sizeof(entry)];
+        [request appendData:path];
+    }
+    // the answer starts coming before a big request is all sent, so it's sent
+    // while the answer's read
+    NSOperationQueue *queue = [[NSOperationQueue alloc] init];
+    __block ssize_t written = 0;
+    [queue addOperationWithBlock:^{
+        written = write(fd, [request bytes], [request length]);
+    }];
+
+    CoverStoryQueryResponseHeader responseHeader;
+    STAssertTrue([self readFrom:fd bytes:&responseHeader length:sizeof(responseHeader)], nil);
+    STAssertEquals(memcmp(responseHeader.magic, "CSQA", 4), 0, nil);
+    STAssertEquals(responseHeader.queryCount, (uint32_t)[queries count], nil);
+    *outGeneration          = responseHeader.generation;
+    NSMutableArray *results = [NSMutableArray array];
+    for (NSUInteger x = 0; x < [queries count]; ++x)
+    {
+        CoverStoryQueryResult result;
+        STAssertTrue([self readFrom:fd bytes:&result length:sizeof(result)], nil);
+        NSMutableData *counts = [NSMutableData dataWithLength:result.lineCount * sizeof(int64_t)];
+        STAssertTrue([self readFrom:fd bytes:[counts mutableBytes] length:[counts length]], nil);
+        [results addObject:@[ @(result.status), @(result.firstLine), @(result.sourceLineCount), counts ]];
+    }
+    [queue waitUntilAllOperationsAreFinished];
+    STAssertEquals(written, (ssize_t)[request length], nil);
+    return results;
+}
+
+- (void)testIndex
+{
+    int64_t hits[] = { kCoverStoryNotExecutedMarker, 0, 4, kCoverStoryNonFeasibleMarker };
+    NSArray *fileDatas = @[ [CoverStoryCoverageFileData fileDataWithPath:@"/src/a.c" hits:hits count:4],
+                            [CoverStoryCoverageFileData fileDataWithPath:@"/src/b.c" hits:hits + 2 count:2],
+                            [CoverStoryCoverageFileData fileDataWithPath:@"/src/a.c" hits:hits count:1] ];
+    CoverStoryLineIndex *index = [[CoverStoryLineIndex alloc] initWithFileDatas:fileDatas];
+    STAssertEquals([index sourceCount], (NSUInteger)2, nil);
+    STAssertEquals([index lineCount], (NSUInteger)6, nil);
+
+    NSUInteger lineCount  = 0;
+    const int64_t *counts = [index hitCountsForSourcePath:@"/src/a.c" lineCount:&lineCount];
+    STAssertEquals(lineCount, (NSUInteger)4, nil);
+    STAssertEquals(memcmp(counts, hits, sizeof(hits)), 0, nil);
+    counts = [index hitCountsForSourcePath:@"/src/b.c" lineCount:&lineCount];
+    STAssertEquals(lineCount, (NSUInteger)2, nil);
+    STAssertEquals(counts[1], (int64_t)kCoverStoryNonFeasibleMarker, nil);
+    STAssertTrue([index hitCountsForSourcePath:@"/src/c.c" lineCount:&lineCount] == NULL, nil);
+
+    // it's a snapshot
+    [fileDatas[1] addHits:10 toLineAtIndex:0];
+    counts = [index hitCountsForSourcePath:@"/src/b.c" lineCount:&lineCount];
+    STAssertEquals(counts[0], (int64_t)4, nil);
+}
+
+- (void)testServer
+{
+    NSString *socketPath          = [_tempDir stringByAppendingPathComponent:@"q.sock"];
+    CoverStoryQueryServer *server = [[CoverStoryQueryServer alloc] initWithSocketPath:socketPath];
+    NSError *error                = nil;
+    STAssertTrue([server startWithError:&error], @"%@", error);
+    // only one at a time
+    CoverStoryQueryServer *other = [[CoverStoryQueryServer alloc] initWithSocketPath:socketPath];
+    STAssertFalse([other startWithError:&error], nil);
+    STAssertEquals([error code], kCoverStoryQueryServerError, nil);
+
+    int fd              = [self connectTo:socketPath];
+    uint64_t generation = 0;
+    NSArray *results    = [self ask:fd queries:@[ @[ @"/src/a.c", @1, @0 ] ] generation:&generation];
+    STAssertEquals([results[0][0] unsignedIntValue], (unsigned)kCoverStoryQueryNoIndex, nil);
+    STAssertEquals(generation, (uint64_t)0, nil);
+
+    int64_t hits[1000];
+    for (NSUInteger x = 0; x < 1000; ++x)
+    {
+        hits[x] = (x % 3) ? (int64_t)x : kCoverStoryNotExecutedMarker;
+    }
+    [server setIndex:[[CoverStoryLineIndex alloc] initWithFileDatas:@[
+        [CoverStoryCoverageFileData fileDataWithPath:@"/src/a.c" hits:hits count:1000] ]]];
+    results = [self ask:fd
+                queries:@[ @[ @"/src/a.c", @1, @0 ],       // all of it
+                           @[ @"/src/a.c", @998, @10 ],    // past the end
+                           @[ @"/src/a.c", @0, @3 ],       // before the start
+                           @[ @"/src/./a.c", @5, @1 ],     // not standardized
+                           @[ @"/src/b.c", @1, @1 ],
+                           @[ @"/src/a.c", @1001, @1 ] ]
+             generation:&generation];
+    STAssertEquals(generation, (uint64_t)1, nil);
+    STAssertEquals([results[0][0] unsignedIntValue], (unsigned)kCoverStoryQueryFound, nil);
+    STAssertEquals([results[0][2] unsignedIntValue], 1000U, nil);
+    STAssertEqualObjects(results[0][3], [NSData dataWithBytes:hits length:sizeof(hits)], nil);
+    STAssertEquals([results[1][1] unsignedIntValue], 998U, nil);
+    STAssertEqualObjects(results[1][3], [NSData dataWithBytes:hits + 997 length:3 * sizeof(int64_t)], nil);
+    STAssertEquals([results[2][1] unsignedIntValue], 1U, nil);
+    STAssertEqualObjects(results[2][3], [NSData dataWithBytes:hits length:2 * sizeof(int64_t)], nil);
+    STAssertEqualObjects(results[3][3], [NSData dataWithBytes:hits + 4 length:sizeof(int64_t)], nil);
+    STAssertEquals([results[4][0] unsignedIntValue], (unsigned)kCoverStoryQueryUnknownSource, nil);
+    STAssertEquals([results[5][0] unsignedIntValue], (unsigned)kCoverStoryQueryFound, nil);
+    STAssertEquals([results[5][3] length], (NSUInteger)0, nil);
+
+    // a bigger answer than is sent at a time
+    NSMutableArray *queries = [NSMutableArray array];
+    for (NSUInteger x = 0; x < 5000; ++x)
+    {
+        [queries addObject:@[ @"/src/a.c", @(x % 1000 + 1), @2 ]];
+    }
+    results = [self ask:fd queries:queries generation:&generation];
+    STAssertEquals([results count], (NSUInteger)5000, nil);
+    STAssertEqualObjects([results lastObject][3], [NSData dataWithBytes:hits + 999 length:sizeof(int64_t)], nil);
+
+    // nonsense closes the connection
+    STAssertEquals(write(fd, "JUNKJUNK", 8), (ssize_t)8, nil);
+    char byte;
+    STAssertEquals(read(fd, &byte, 1), (ssize_t)0, nil);
+    close(fd);
+
+    [server stop];
+    STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:socketPath], nil);
+}
+
+@end
@@ -0,0 +1,81 @@
+//
+//  CoverStoryTracerTest.m
+//  CoverStory
+//
+//  Copyright 2013 Google Inc. All rights reserved.
+//
+
+#import "GTMSenTestCase.h"
+#import "CoverStoryTracer.h"
+#include <unistd.h>
+
+@interface CoverStoryTracerTest : SenTestCase
+@end
+
+@implementation CoverStoryTracerTest
+
+- (void)testNilTracer
+{
+    CoverStoryTracer *tracer = nil;
+    STAssertEquals(CoverStoryTraceNow(tracer), (uint64_t)0, nil);
+    [tracer endSpan:@"parse" start:0 queued:0 detail:@"a.gcov"];
+    STAssertEquals([tracer spanCount], (NSUInteger)0, nil);
+}
+
+- (void)testChromeTrace
+{
+    CoverStoryTracer *tracer = [[CoverStoryTracer alloc] init];
+    uint64_t queued          = CoverStoryTraceNow(tracer);
+    uint64_t start           = CoverStoryTraceNow(tracer);
+    STAssertTrue(start >= queued, nil);
+    [tracer endSpan:@"batch" start:start queued:queued detail:@"/build/Foo"];
+    [tracer endSpan:@"merge" start:CoverStoryTraceNow(tracer) queued:0 detail:nil];
+    STAssertEquals([tracer spanCount], (NSUInteger)2, nil);
+
+    NSDictionary *trace = [NSJSONSerialization JSONObjectWithData:[tracer chromeTraceData] options:0 error:NULL];
+    STAssertNotNil(trace, nil);
+    NSArray *events     = trace[@"traceEvents"];
+    NSPredicate *spans  = [NSPredicate predicateWithFormat:@"ph == 'X'"];
+    NSArray *spanEvents = [events filteredArrayUsingPredicate:spans];
+    STAssertEquals([spanEvents count], (NSUInteger)2, nil);
+    NSDictionary *batch = spanEvents[0];
+    STAssertEqualObjects(batch[@"name"], @"batch", nil);
+    STAssertEqualObjects(batch[@"args"][@"detail"], @"/build/Foo", nil);
+    STAssertNotNil(batch[@"args"][@"queueWaitMs"], nil);
+    STAssertTrue([batch[@"dur"] doubleValue] >= 0.0, nil);
+    STAssertNil(spanEvents[1][@"args"][@"queueWaitMs"], nil);
+    // the thread got named
+    NSPredicate *names  = [NSPredicate predicateWithFormat:@"ph == 'M'"];
+    NSArray *nameEvents = [events filteredArrayUsingPredicate:names];
+    STAssertEquals([nameEvents count], (NSUInteger)1, nil);
+
+    // a reset drops what was there, and spans started before it
+    [tracer reset];
+    STAssertEquals([tracer spanCount], (NSUInteger)0, nil);
+    [tracer endSpan:@"parse" start:start queued:0 detail:@"a.gcov"];
+    STAssertEquals([tracer spanCount], (NSUInteger)0, nil);
+}
+
+- (void)testSlowest
+{
+    CoverStoryTracer *tracer = [[CoverStoryTracer alloc] init];
+    uint64_t start           = CoverStoryTraceNow(tracer);
+    usleep(2000);
+    [tracer endSpan:@"parse" start:start queued:0 detail:@"slow.gcov"];
+    uint64_t fastStart = CoverStoryTraceNow(tracer);
+    [tracer endSpan:@"parse" start:fastStart queued:0 detail:@"fast.gcov"];
+    [tracer endSpan:@"read" start:fastStart queued:0 detail:@"fast.gcov"];
+    [tracer endSpan:@"batch" start:start queued:0 detail:@"/build"];
+
+    NSArray *slowest = [tracer slowestDetailsForSpansNamed:@[ @"parse", @"read" ] limit:5];
+    STAssertEquals([slowest count], (NSUInteger)2, nil);
+    STAssertEqualObjects(slowest[0][0], @"slow.gcov", nil);
+    STAssertTrue([slowest[0][1] doubleValue] >= 0.002, nil);
+    STAssertEqualObjects(slowest[1][0], @"fast.gcov", nil);
+
+    slowest = [tracer slowestDetailsForSpansNamed:@[ @"parse" ] limit:1];
+    STAssertEquals([slowest count], (NSUInteger)1, nil);
+    STAssertEqualObjects(slowest[0][0], @"slow.gcov", nil);
+}
+
+@end
@@ -93,4 +93,103 @@
     STAssertNil([mgr versionFromGCovFile:nil], nil);
 }
 
+- (void)testSearchPathsAndPartitioning
+{
+    NSFileManager *fm    = [NSFileManager defaultManager];
+    NSBundle *testBundle = [NSBundle bundleForClass:[self class]];
+    NSString *tempDir    = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                            [NSString stringWithFormat:@"GCovVersionManagerTest-%@",
+                             [[NSProcessInfo processInfo] globallyUniqueString]]];
+    NSString *binDir     = [tempDir stringByAppendingPathComponent:@"bin"];
+    NSString *dataDir    = [tempDir stringByAppendingPathComponent:@"data"];
+    STAssertTrue([fm createDirectoryAtPath:binDir withIntermediateDirectories:YES attributes:nil error:NULL], nil);
+    STAssertTrue([fm createDirectoryAtPath:dataDir withIntermediateDirectories:YES attributes:nil error:NULL], nil);
+
+    // stand-in gcovs, only have to be executable
+    NSDictionary *executable = @{ NSFilePosixPermissions: @0755 };
+    for (NSString *name in @[ @"gcov-4.0", @"gcov-4.2" ])
+    {
+        STAssertTrue([fm createFileAtPath:[binDir stringByAppendingPathComponent:name]
+                                 contents:[@"#!/bin/sh\n" dataUsingEncoding:NSUTF8StringEncoding]
+                               attributes:executable], nil);
+    }
+    NSDictionary *copies = @{
+        @"a.gcda": @"test_i386_4_0.gcda",
+        @"a.gcno": @"test_i386_4_0.gcno",
+        @"b.gcda": @"test_i386_4_2.gcda",
+        @"b.gcno": @"test_i386_4_2.gcno",
+        @"c.gcda": @"test_x86_64_4_0.gcda",
+    };
+    for (NSString *name in copies)
+    {
+        STAssertTrue([fm copyItemAtPath:[testBundle pathForResource:copies[name] ofType:nil]
+                                 toPath:[dataDir stringByAppendingPathComponent:name]
+                                  error:NULL], @"%@", name);
+    }
+
+    GCovVersionManager *mgr = [[GCovVersionManager alloc] init];
+    [mgr setAdditionalSearchPaths:@[ binDir ]];
+    [mgr discoverInBackground];
+    NSString *gcov40 = [binDir stringByAppendingPathComponent:@"gcov-4.0"];
+    NSString *gcov42 = [binDir stringByAppendingPathComponent:@"gcov-4.2"];
+    STAssertTrue([[mgr installedVersions] containsObject:gcov40], nil);
+
+    NSDictionary *filesByGCov = [mgr filesByGCovForFiles:@[ @"a.gcda", @"b.gcda", @"c.gcda" ] inFolder:dataDir];
+    STAssertEquals([filesByGCov count], (NSUInteger)2, @"%@", filesByGCov);
+    STAssertEqualObjects(filesByGCov[gcov40], (@[ @"a.gcda", @"c.gcda" ]), nil);
+    STAssertEqualObjects(filesByGCov[gcov42], (@[ @"b.gcda" ]), nil);
+
+    // A test run rewriting the gcda doesn't get its header read again...
+    NSString *aGCDA = [dataDir stringByAppendingPathComponent:@"a.gcda"];
+    NSString *aGCNO = [dataDir stringByAppendingPathComponent:@"a.gcno"];
+    STAssertTrue([fm removeItemAtPath:aGCDA error:NULL], nil);
+    STAssertTrue([fm createFileAtPath:aGCDA contents:[NSData data] attributes:nil], nil);
+    STAssertEqualObjects([mgr versionFromGCovFile:aGCDA], @"4.0", nil);
+    // ...but rebuilding w/ another compiler does.
+    STAssertTrue([fm removeItemAtPath:aGCDA error:NULL], nil);
+    STAssertTrue([fm removeItemAtPath:aGCNO error:NULL], nil);
+    STAssertTrue([fm copyItemAtPath:[testBundle pathForResource:@"test_i386_4_2.gcda" ofType:nil]
+                             toPath:aGCDA
+                              error:NULL], nil);
+    STAssertTrue([fm copyItemAtPath:[testBundle pathForResource:@"test_i386_4_2.gcno" ofType:nil]
+                             toPath:aGCNO
+                              error:NULL], nil);
+    // (the copy keeps the fixture's date)
+    STAssertTrue([fm setAttributes:@{ NSFileModificationDate: [NSDate dateWithTimeIntervalSinceNow:60] }
+                      ofItemAtPath:aGCNO
+                             error:NULL], nil);
+    STAssertEqualObjects([mgr versionFromGCovFile:aGCDA], @"4.2", nil);
+    STAssertEqualObjects([mgr gcovForGCovFile:aGCDA], gcov42, nil);
+
+    // changing the search paths looks again
+    [mgr setAdditionalSearchPaths:nil];
+    STAssertFalse([[mgr installedVersions] containsObject:gcov40], nil);
+
+    [fm removeItemAtPath:tempDir error:NULL];
+}
+
+- (void)testVersionOfGCov
+{
+    NSFileManager *fm        = [NSFileManager defaultManager];
+    NSString *gcov           = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                                [NSString stringWithFormat:@"gcov-%@",
+                                 [[NSProcessInfo processInfo] globallyUniqueString]]];
+    NSDictionary *executable = @{ NSFilePosixPermissions: @0755 };
+    GCovVersionManager *mgr  = [[GCovVersionManager alloc] init];
+    STAssertNil([mgr versionOfGCov:gcov], nil);
+
+    STAssertTrue([fm createFileAtPath:gcov
+                             contents:[@"#!/bin/sh\necho 'gcov 4.0'\necho more\n" dataUsingEncoding:NSUTF8StringEncoding]
+                           attributes:executable], nil);
+    STAssertEqualObjects([mgr versionOfGCov:gcov], @"gcov 4.0", nil);
+    // updated in place
+    STAssertTrue([fm removeItemAtPath:gcov error:NULL], nil);
+    STAssertTrue([fm createFileAtPath:gcov
+                             contents:[@"#!/bin/sh\necho 'gcov 4.2.1'\n" dataUsingEncoding:NSUTF8StringEncoding]
+                           attributes:executable], nil);
+    STAssertEqualObjects([mgr versionOfGCov:gcov], @"gcov 4.2.1", nil);
+
+    [fm removeItemAtPath:gcov error:NULL];
+}
+
 @end